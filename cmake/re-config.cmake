@@ -19,6 +19,7 @@ endif()
 option(USE_OPENSSL "Enable OpenSSL" ${OPENSSL_FOUND})
 option(USE_UNIXSOCK "Enable Unix Domain Sockets" ON)
 option(USE_TRACE "Enable Tracing helpers" OFF)
+option(USE_MEM_CACHE "Enable per-thread memory caches" OFF)
 
 if(NOT CMAKE_BUILD_TYPE AND NOT CMAKE_CONFIGURATION_TYPES)
     message(STATUS "Setting build type to 'Debug' as none was specified.")
@@ -85,6 +86,15 @@ if(${CMAKE_SYSTEM_NAME} MATCHES "Linux")
   if(HAVE_ACCEPT4)
     list(APPEND RE_DEFINITIONS HAVE_ACCEPT4)
   endif()
+  check_function_exists(recvmmsg HAVE_RECVMMSG)
+  check_function_exists(sendmmsg HAVE_SENDMMSG)
+  if(HAVE_RECVMMSG AND HAVE_SENDMMSG)
+    list(APPEND RE_DEFINITIONS HAVE_MMSG)
+  endif()
+  check_function_exists(pthread_setaffinity_np HAVE_PTHREAD_SETAFFINITY)
+  if(HAVE_PTHREAD_SETAFFINITY)
+    list(APPEND RE_DEFINITIONS HAVE_PTHREAD_SETAFFINITY)
+  endif()
 endif()
 
 if(CMAKE_USE_PTHREADS_INIT)
@@ -101,6 +111,18 @@ if(UNIX)
   if(HAVE_KQUEUE)
     list(APPEND RE_DEFINITIONS HAVE_KQUEUE)
   endif()
+  check_symbol_exists(clock_nanosleep "time.h" HAVE_CLOCK_NANOSLEEP)
+  if(HAVE_CLOCK_NANOSLEEP)
+    list(APPEND RE_DEFINITIONS HAVE_CLOCK_NANOSLEEP)
+  endif()
+endif()
+
+if(${CMAKE_SYSTEM_NAME} MATCHES "Linux")
+  check_symbol_exists(IORING_POLL_ADD_MULTI "linux/io_uring.h"
+    HAVE_IO_URING)
+  if(HAVE_IO_URING)
+    list(APPEND RE_DEFINITIONS HAVE_IO_URING)
+  endif()
 endif()
 
 check_include_file(sys/prctl.h HAVE_PRCTL)
@@ -195,6 +217,12 @@ if(USE_TRACE)
   )
 endif()
 
+if(USE_MEM_CACHE)
+  list(APPEND RE_DEFINITIONS
+    RE_MEM_CACHE
+  )
+endif()
+
 if(${CMAKE_SYSTEM_NAME} MATCHES "Darwin")
   list(APPEND RE_DEFINITIONS DARWIN)
   include_directories(/opt/local/include)
@@ -47,6 +47,7 @@ extern "C" {
 #include "re_rtp.h"
 #include "re_rtpext.h"
 #include "re_sdp.h"
+#include "re_shard.h"
 #include "re_uri.h"
 #include "re_sip.h"
 #include "re_sipevent.h"
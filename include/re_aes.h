@@ -15,6 +15,14 @@ enum aes_mode {
 	AES_MODE_GCM,  /**< AES Galois Counter Mode (GCM) */
 };
 
+/** AES-CTR segment with its own initial counter block */
+struct aes_seg {
+	const uint8_t *iv;  /**< Initial counter block (16 bytes) */
+	uint8_t *out;       /**< Output buffer, may be equal to in */
+	const uint8_t *in;  /**< Input buffer                      */
+	size_t len;         /**< Number of bytes                   */
+};
+
 struct aes;
 
 int  aes_alloc(struct aes **stp, enum aes_mode mode,
@@ -25,3 +33,4 @@ int  aes_encr(struct aes *aes, uint8_t *out, const uint8_t *in, size_t len);
 int  aes_decr(struct aes *aes, uint8_t *out, const uint8_t *in, size_t len);
 int  aes_get_authtag(struct aes *aes, uint8_t *tag, size_t taglen);
 int  aes_authenticate(struct aes *aes, const uint8_t *tag, size_t taglen);
+int  aes_ctr_batch(struct aes *aes, const struct aes_seg *segv, size_t segc);
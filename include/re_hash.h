@@ -8,8 +8,18 @@
 struct hash;
 struct pl;
 
+/**
+ * Defines the key handler of a growable hashmap table
+ *
+ * @param le List element
+ *
+ * @return Hash key the element was appended with
+ */
+typedef uint32_t (hash_key_h)(struct le *le);
+
 
 int  hash_alloc(struct hash **hp, uint32_t bsize);
+int  hash_grow_set(struct hash *h, hash_key_h *keyh);
 void hash_append(struct hash *h, uint32_t key, struct le *le, void *data);
 void hash_unlink(struct le *le);
 struct le *hash_lookup(const struct hash *h, uint32_t key, list_apply_h *ah,
@@ -33,3 +43,9 @@ uint32_t hash_joaat_pl(const struct pl *pl);
 uint32_t hash_joaat_pl_ci(const struct pl *pl);
 uint32_t hash_fast(const char *k, size_t len);
 uint32_t hash_fast_str(const char *str);
+uint32_t hash_wyhash(const uint8_t *key, size_t len);
+uint32_t hash_wyhash_ci(const char *str, size_t len);
+uint32_t hash_wyhash_str(const char *str);
+uint32_t hash_wyhash_str_ci(const char *str);
+uint32_t hash_wyhash_pl(const struct pl *pl);
+uint32_t hash_wyhash_pl_ci(const struct pl *pl);
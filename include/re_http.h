@@ -111,6 +111,7 @@ struct http_conf {
 typedef bool(http_hdr_h)(const struct http_hdr *hdr, void *arg);
 
 int  http_msg_decode(struct http_msg **msgp, struct mbuf *mb, bool req);
+void http_msg_arena_set(bool enable);
 
 
 const struct http_hdr *http_msg_hdr(const struct http_msg *msg,
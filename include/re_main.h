@@ -16,7 +16,8 @@ enum {
 #ifndef FD_WRITE
 	FD_WRITE  = 1<<1,
 #endif
-	FD_EXCEPT = 1<<2
+	FD_EXCEPT = 1<<2,
+	FD_EDGE   = 1<<3  /**< Handler drains, edge-triggered capable */
 };
 
 
@@ -40,6 +41,8 @@ int   fd_listen(struct re_fhs **fhsp, re_sock_t fd, int flags, fd_h *fh,
 	void *arg);
 struct re_fhs *fd_close(struct re_fhs *fhs);
 int   fd_setsize(int maxfds);
+void  fd_pending(struct re_fhs *fhs);
+unsigned fd_budget(const struct re_fhs *fhs);
 
 int   libre_init(void);
 void  libre_close(void);
@@ -49,6 +52,9 @@ int   re_main(re_signal_h *signalh);
 void  re_cancel(void);
 int   re_debug(struct re_printf *pf, void *unused);
 int   re_nfds(void);
+int   re_maxevents_set(int maxevents);
+int   re_edge_set(bool enable);
+int   re_budget_set(unsigned budget);
 
 int  re_alloc(struct re **rep);
 int  re_thread_attach(struct re *re);
@@ -81,6 +87,7 @@ enum poll_method {
 	METHOD_SELECT,
 	METHOD_EPOLL,
 	METHOD_KQUEUE,
+	METHOD_IO_URING,
 	/* sep */
 	METHOD_MAX
 };
@@ -233,3 +233,67 @@ static inline size_t mbuf_end(const struct mbuf *mb)
 {
 	return mb ? mb->end : 0;
 }
+
+
+/* Mbuf chain */
+
+/** Maximum number of segments in an mbuf chain */
+#define MBUF_CHAIN_MAX 8
+
+/** Defines a segment of an mbuf chain */
+struct mbuf_seg {
+	struct mbuf *mb;  /**< Referenced memory buffer */
+	size_t pos;       /**< Start of segment         */
+	size_t end;       /**< End of segment           */
+};
+
+/**
+ * Defines a chain of memory buffers for scatter-gather I/O.
+ *
+ * Protocol layers prepend headers and append payload as separate
+ * segments without copying, and the chain is sent with one vectored
+ * write (udp_sendv, tcp_sendv).
+ */
+struct mbuf_chain {
+	struct mbuf_seg segv[MBUF_CHAIN_MAX]; /**< Segments          */
+	unsigned segc;                         /**< Number of segments */
+	size_t len;                            /**< Total length       */
+};
+
+void mbuf_chain_init(struct mbuf_chain *mc);
+void mbuf_chain_reset(struct mbuf_chain *mc);
+int  mbuf_chain_append(struct mbuf_chain *mc, struct mbuf *mb);
+int  mbuf_chain_prepend(struct mbuf_chain *mc, struct mbuf *mb);
+int  mbuf_chain_flatten(const struct mbuf_chain *mc, struct mbuf *mb);
+
+
+/**
+ * Get the total length of an mbuf chain
+ *
+ * @param mc Mbuf chain
+ *
+ * @return Number of bytes in all segments
+ */
+static inline size_t mbuf_chain_len(const struct mbuf_chain *mc)
+{
+	return mc ? mc->len : 0;
+}
+
+
+/* Mbuf pool */
+
+/** Mbuf pool statistics */
+struct mbuf_pool_stat {
+	size_t size;         /**< Number of buffers in the pool     */
+	size_t inuse;        /**< Buffers currently borrowed        */
+	size_t inuse_peak;   /**< High-water mark of borrowed buffers */
+	uint64_t borrows;    /**< Total number of mbuf_pool_get()   */
+	uint64_t misses;     /**< Heap allocations, pool exhausted  */
+};
+
+struct mbuf_pool;
+
+int  mbuf_pool_alloc(struct mbuf_pool **mpp, size_t n, size_t bufsz);
+struct mbuf *mbuf_pool_get(struct mbuf_pool *mp, bool *pooled);
+size_t mbuf_pool_bufsz(const struct mbuf_pool *mp);
+int  mbuf_pool_get_stat(struct mbuf_pool *mp, struct mbuf_pool_stat *stat);
@@ -17,6 +17,9 @@ typedef void (mem_destroy_h)(void *data);
 struct memstat {
 	size_t bytes_cur;    /**< Current bytes allocated      */
 	size_t blocks_cur;   /**< Current blocks allocated     */
+	size_t bytes_peak;   /**< Peak bytes allocated         */
+	size_t blocks_peak;  /**< Peak blocks allocated        */
+	uint64_t allocs;     /**< Total number of allocations  */
 };
 
 void    *mem_alloc(size_t size, mem_destroy_h *dh);
@@ -34,6 +37,15 @@ void     mem_threshold_set(ssize_t n);
 struct re_printf;
 int      mem_status(struct re_printf *pf, void *unused);
 int      mem_get_stat(struct memstat *mstat);
+int      mem_cache_set(size_t maxsize);
+void     mem_cache_flush(void);
+
+
+/* Mem Arena */
+struct mem_arena;
+int  mem_arena_alloc(struct mem_arena **arenap, size_t size);
+void mem_arena_enter(struct mem_arena *arena);
+void mem_arena_leave(void);
 
 
 /* Secure memory functions */
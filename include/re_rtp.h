@@ -237,6 +237,7 @@ struct rtcp_stats {
 struct sa;
 struct re_printf;
 struct rtp_sock;
+struct rtp_mux;
 
 /**
  * Defines the callback handler for received RTP packets
@@ -286,6 +287,17 @@ uint16_t rtp_sess_seq(const struct rtp_sock *rs);
 const struct sa *rtp_local(const struct rtp_sock *rs);
 int rtp_clear(struct rtp_sock *rs);
 
+/* Shared RTP/RTCP socket api */
+int   rtp_mux_alloc(struct rtp_mux **muxp, const struct sa *laddr);
+int   rtp_mux_listen(struct rtp_sock **rsp, struct rtp_mux *mux,
+		     bool enable_rtcp, rtp_recv_h *recvh, rtcp_recv_h *rtcph,
+		     void *arg);
+int   rtp_mux_peer_set(struct rtp_sock *rs, const struct sa *peer);
+int   rtp_mux_ssrc_set(struct rtp_sock *rs, uint32_t ssrc);
+const struct sa *rtp_mux_local(const struct rtp_mux *mux);
+void *rtp_mux_sock(const struct rtp_mux *mux);
+int   rtp_mux_debug(struct re_printf *pf, const struct rtp_mux *mux);
+
 /* RTCP session api */
 void  rtcp_start(struct rtp_sock *rs, const char *cname,
 		 const struct sa *peer);
@@ -0,0 +1,48 @@
+/**
+ * @file re_shard.h  Sharded reactors
+ *
+ * A shard is a thread with its own re main loop. Listeners opened with
+ * SO_REUSEPORT on the same address in every shard (udp_listen_reuseport,
+ * tcp_listen) let the kernel spread incoming flows across all shards.
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+struct shard;
+struct shards;
+
+/** Reuseport steering program */
+enum shard_steer {
+	SHARD_STEER_KERNEL = 0,  /**< Kernel default (flow hash)         */
+	SHARD_STEER_HASH,        /**< skb rx-hash modulo number of shards */
+	SHARD_STEER_CPU,         /**< Receiving CPU modulo number of shards */
+};
+
+/**
+ * Defines the shard init handler, called in the shard thread before the
+ * main loop is started. Returning an error aborts shards_alloc().
+ *
+ * @param sh  Shard
+ * @param arg Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+typedef int (shard_init_h)(struct shard *sh, void *arg);
+
+/**
+ * Defines the shard close handler, called in the shard thread after the
+ * main loop has stopped. All objects owned by the shard must be
+ * dereferenced here.
+ *
+ * @param sh  Shard
+ * @param arg Handler argument
+ */
+typedef void (shard_close_h)(struct shard *sh, void *arg);
+
+int  shards_alloc(struct shards **shsp, unsigned n, shard_init_h *inith,
+		  shard_close_h *closeh, void *arg);
+unsigned shards_count(const struct shards *shs);
+struct shard *shards_get(const struct shards *shs, unsigned idx);
+unsigned shard_index(const struct shard *sh);
+int  shard_async(struct shard *sh, re_async_h *cb, void *arg);
+int  shard_steer_attach(re_sock_t fd, enum shard_steer steer, unsigned n);
@@ -134,6 +134,10 @@ enum sip_hdrid {
 	SIP_HDR_NONE = -1
 };
 
+enum {
+	SIP_HDR_SLOTS = 104,  /**< Header table slots (IDs above + 1) */
+};
+
 
 enum rel100_mode {
 	REL100_DISABLED = 0,
@@ -194,12 +198,21 @@ struct sip_rack {
 /** SIP Header */
 struct sip_hdr {
 	struct le le;          /**< Linked-list element    */
-	struct le he;          /**< Hash-table element     */
+	struct le he;          /**< Header-table element   */
 	struct pl name;        /**< SIP Header name        */
 	struct pl val;         /**< SIP Header value       */
 	enum sip_hdrid id;     /**< SIP Header id (unique) */
 };
 
+/**
+ * SIP Header table slot. Slot 0 holds extension headers, the other slots
+ * one well-known header ID each. Indices are 1-based into sip_msg.hdrv.
+ */
+struct sip_hdrslot {
+	uint16_t head;         /**< First header, 0 if none */
+	uint16_t tail;         /**< Last header, 0 if none  */
+};
+
 /** SIP Message */
 struct sip_msg {
 	struct sa src;         /**< Source network address               */
@@ -222,12 +235,15 @@ struct sip_msg {
 	struct pl maxfwd;      /**< Cached Max-Forwards header           */
 	struct pl expires;     /**< Cached Expires header                */
 	struct pl clen;        /**< Cached Content-Length header         */
-	struct hash *hdrht;    /**< Hash-table with all SIP headers      */
+	struct sip_hdr *hdrv;  /**< Vector with all SIP headers          */
+	uint32_t hdrc;         /**< Number of headers in hdrv            */
+	struct sip_hdrslot hdrt[SIP_HDR_SLOTS]; /**< Headers by ID       */
 	struct mbuf *mb;       /**< Buffer containing the SIP message    */
 	void *sock;            /**< Transport socket                     */
 	uint64_t tag;          /**< Opaque tag                           */
 	enum sip_transp tp;    /**< SIP Transport                        */
 	bool req;              /**< True if Request, False if Response  */
+	uint16_t lazy;         /**< Values not parsed yet (lazy decode)  */
 };
 
 /** SIP Loop-state */
@@ -414,6 +430,15 @@ bool sip_dialog_cmp_half(const struct sip_dialog *dlg,
 
 /* msg */
 int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb);
+int sip_msg_decode_lazy(struct sip_msg **msgp, struct mbuf *mb);
+void sip_msg_arena_set(bool enable);
+const struct uri *sip_msg_uri(const struct sip_msg *msg);
+const struct sip_via *sip_msg_via(const struct sip_msg *msg);
+const struct sip_taddr *sip_msg_to(const struct sip_msg *msg);
+const struct sip_taddr *sip_msg_from(const struct sip_msg *msg);
+const struct sip_cseq *sip_msg_cseq(const struct sip_msg *msg);
+const struct sip_rack *sip_msg_rack(const struct sip_msg *msg);
+const struct msg_ctype *sip_msg_ctype(const struct sip_msg *msg);
 const struct sip_hdr *sip_msg_hdr(const struct sip_msg *msg,
 				  enum sip_hdrid id);
 const struct sip_hdr *sip_msg_hdr_apply(const struct sip_msg *msg,
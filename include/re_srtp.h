@@ -16,6 +16,8 @@ enum srtp_suite {
 
 enum srtp_flags {
 	SRTP_UNENCRYPTED_SRTCP = 1<<1,
+	SRTP_REPLAY_WINDOW_1K  = 1<<2,  /**< 1024 packets RTP replay window */
+	SRTP_REPLAY_WINDOW_4K  = 1<<3,  /**< 4096 packets RTP replay window */
 };
 
 struct srtp;
@@ -24,6 +26,10 @@ int srtp_alloc(struct srtp **srtpp, enum srtp_suite suite,
 	       const uint8_t *key, size_t key_bytes, int flags);
 int srtp_encrypt(struct srtp *srtp, struct mbuf *mb);
 int srtp_decrypt(struct srtp *srtp, struct mbuf *mb);
+int srtp_encrypt_batch(struct srtp *srtp, struct mbuf **mbv, int *errv,
+		       size_t n);
+int srtp_decrypt_batch(struct srtp *srtp, struct mbuf **mbv, int *errv,
+		       size_t n);
 int srtcp_encrypt(struct srtp *srtp, struct mbuf *mb);
 int srtcp_decrypt(struct srtp *srtp, struct mbuf *mb);
 
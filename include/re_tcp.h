@@ -6,6 +6,8 @@
 struct sa;
 struct tcp_sock;
 struct tcp_conn;
+struct mbuf_chain;
+struct mbuf_pool;
 
 
 /**
@@ -46,6 +48,14 @@ typedef void (tcp_recv_h)(struct mbuf *mb, void *arg);
  */
 typedef void (tcp_close_h)(int err, void *arg);
 
+/** TCP send queue statistics */
+struct tcp_txq_stat {
+	size_t entries;      /**< Number of queued buffers            */
+	size_t bytes;        /**< Number of queued bytes              */
+	size_t bytes_peak;   /**< High-water mark of queued bytes     */
+	size_t zc_pending;   /**< Zero-copy sends awaiting completion */
+};
+
 
 /* TCP Socket */
 int  tcp_sock_alloc(struct tcp_sock **tsp, const struct sa *local,
@@ -70,14 +80,18 @@ int  tcp_conn_alloc(struct tcp_conn **tcp, const struct sa *peer,
 int  tcp_conn_bind(struct tcp_conn *tc, const struct sa *local);
 int  tcp_conn_connect(struct tcp_conn *tc, const struct sa *peer);
 int  tcp_send(struct tcp_conn *tc, struct mbuf *mb);
+int  tcp_sendv(struct tcp_conn *tc, const struct mbuf_chain *mc);
+int  tcp_send_zc(struct tcp_conn *tc, struct mbuf *mb);
 int  tcp_set_send(struct tcp_conn *tc, tcp_send_h *sendh);
 void tcp_set_handlers(struct tcp_conn *tc, tcp_estab_h *eh, tcp_recv_h *rh,
 		      tcp_close_h *ch, void *arg);
 void tcp_conn_rxsz_set(struct tcp_conn *tc, size_t rxsz);
+void tcp_conn_rxpool_set(struct tcp_conn *tc, struct mbuf_pool *mp);
 void tcp_conn_txqsz_set(struct tcp_conn *tc, size_t txqsz);
 int  tcp_conn_local_get(const struct tcp_conn *tc, struct sa *local);
 int  tcp_conn_peer_get(const struct tcp_conn *tc, struct sa *peer);
 size_t tcp_conn_txqsz(const struct tcp_conn *tc);
+int  tcp_conn_txq_stat(const struct tcp_conn *tc, struct tcp_txq_stat *stat);
 
 
 /* High-level API */
@@ -7,6 +7,8 @@
 
 struct sa;
 struct udp_sock;
+struct mbuf_chain;
+struct mbuf_pool;
 
 typedef int (udp_send_h)(const struct sa *dst,
 			 struct mbuf *mb, void *arg);
@@ -24,6 +26,8 @@ typedef void (udp_error_h)(int err, void *arg);
 
 int  udp_listen(struct udp_sock **usp, const struct sa *local,
 		udp_recv_h *rh, void *arg);
+int  udp_listen_reuseport(struct udp_sock **usp, const struct sa *local,
+			  udp_recv_h *rh, void *arg);
 int  udp_alloc_sockless(struct udp_sock **usp,
 			udp_send_h *sendh, udp_recv_h *recvh, void *arg);
 int  udp_alloc_fd(struct udp_sock **usp, re_sock_t fd,
@@ -31,12 +35,21 @@ int  udp_alloc_fd(struct udp_sock **usp, re_sock_t fd,
 int  udp_connect(struct udp_sock *us, const struct sa *peer);
 int  udp_open(struct udp_sock **usp, int af);
 int  udp_send(struct udp_sock *us, const struct sa *dst, struct mbuf *mb);
+int  udp_sendv(struct udp_sock *us, const struct sa *dst,
+	       const struct mbuf_chain *mc);
+int  udp_send_batch(struct udp_sock *us, const struct sa *dstv,
+		    struct mbuf * const *mbv, size_t n);
+int  udp_send_gso(struct udp_sock *us, const struct sa *dst,
+		  struct mbuf *mb, size_t segsz);
 int  udp_local_get(const struct udp_sock *us, struct sa *local);
 int  udp_setsockopt(struct udp_sock *us, int level, int optname,
 		    const void *optval, uint32_t optlen);
 int  udp_sockbuf_set(struct udp_sock *us, int size);
 void udp_rxsz_set(struct udp_sock *us, size_t rxsz);
 void udp_rxbuf_presz_set(struct udp_sock *us, size_t rx_presz);
+int  udp_rxbatch_set(struct udp_sock *us, unsigned n);
+int  udp_gro_set(struct udp_sock *us, bool enable);
+int  udp_rxpool_set(struct udp_sock *us, struct mbuf_pool *mp);
 void udp_handler_set(struct udp_sock *us, udp_recv_h *rh, void *arg);
 void udp_error_handler_set(struct udp_sock *us, udp_error_h *eh);
 int  udp_thread_attach(struct udp_sock *us);
@@ -18,11 +18,24 @@ typedef void (aumix_frame_h)(const int16_t *sampv, size_t sampc, void *arg);
 typedef void (aumix_record_h)(struct auframe *af);
 typedef void (aumix_read_h)(struct auframe *af, void *arg);
 
+/**
+ * Audio mixer speaker handler
+ *
+ * @param src    Audio mixer source
+ * @param active True if the source is now an active speaker
+ * @param arg    Handler argument
+ */
+typedef void (aumix_speaker_h)(struct aumix_source *src, bool active,
+			       void *arg);
+
 int aumix_alloc(struct aumix **mixp, uint32_t srate,
 		uint8_t ch, uint32_t ptime);
 void aumix_recordh(struct aumix *mix, aumix_record_h *recordh);
 void aumix_record_sumh(struct aumix *mix, aumix_record_h *recordh);
 int aumix_playfile(struct aumix *mix, const char *filepath);
+int aumix_thread_sched(struct aumix *mix, int prio, int cpu);
+int aumix_speakers(struct aumix *mix, uint32_t n, aumix_speaker_h *speakerh,
+		   void *arg);
 uint32_t aumix_source_count(const struct aumix *mix);
 int aumix_source_alloc(struct aumix_source **srcp, struct aumix *mix,
 		       aumix_frame_h *fh, void *arg);
@@ -34,3 +47,8 @@ int  aumix_source_put(struct aumix_source *src, const int16_t *sampv,
 void aumix_source_readh(struct aumix_source *src, aumix_read_h *readh);
 void aumix_source_flush(struct aumix_source *src);
 int aumix_debug(struct re_printf *pf, const struct aumix *mix);
+
+/* Mixing kernels */
+void aumix_acc(int32_t *accv, const int16_t *sampv, size_t sampc);
+void aumix_sub_sat(int16_t *dstv, const int32_t *accv,
+		   const int16_t *sampv, size_t sampc);
@@ -6,10 +6,18 @@
 
 #define _BSD_SOURCE 1
 #define _DEFAULT_SOURCE 1
+#define _GNU_SOURCE 1
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
 #include <string.h>
+#include <time.h>
+#ifdef WIN32
+#include <windows.h>
+#elif defined (HAVE_PTHREAD)
+#include <pthread.h>
+#include <sched.h>
+#endif
 #include <re.h>
 #include <rem_au.h>
 #include <rem_aulevel.h>
@@ -19,6 +27,36 @@
 #include <rem_aumix.h>
 
 
+enum {
+	HIST_SIZE = 8,         /**< Number of histogram buckets       */
+	RESYNC_FRAMES = 4,     /**< Frames behind before clock resync */
+	SPK_HYST_DB = 6,       /**< Bonus of current speakers in [dB] */
+	SPK_RELEASE_DB = 1,    /**< Level decay per frame in [dB]     */
+};
+
+/** Histogram bucket limits in [us], the last bucket has no limit */
+static const uint32_t hist_usec[HIST_SIZE - 1] = {
+	100, 250, 500, 1000, 2000, 5000, 10000
+};
+
+/** Mixer thread scheduling */
+struct mix_sched {
+	int prio;              /**< Real-time priority, 0 for normal  */
+	int cpu;               /**< CPU to pin to, -1 for any         */
+	int err;               /**< Result of the last change         */
+	bool pending;          /**< Change waiting for mixer thread   */
+};
+
+/** Mixer clock statistics */
+struct mix_stats {
+	uint64_t ticks;              /**< Mixed frames                */
+	uint64_t missed;             /**< Frames done after deadline  */
+	uint64_t resync;             /**< Clock resynchronizations    */
+	uint64_t late_max;           /**< Latest wakeup in [us]       */
+	uint32_t latev[HIST_SIZE];   /**< Late wakeups                */
+	uint32_t missv[HIST_SIZE];   /**< Missed frame deadlines      */
+};
+
 /** Defines an Audio mixer */
 struct aumix {
 	mtx_t *mutex;
@@ -33,6 +71,18 @@ struct aumix {
 	aumix_record_h *recordh;
 	aumix_record_h *record_sumh;
 	struct auframe rec_sum;
+	struct mix_sched sched;
+	struct mix_stats stats;
+	cnd_t sched_cond;
+	uint8_t *silence;
+	uint8_t *frame;
+	int16_t *mix_frame;
+	int16_t *sum_frame;
+	int32_t *acc;
+	struct aumix_source **spkv;
+	uint32_t spkn;
+	aumix_speaker_h *speakerh;
+	void *speaker_arg;
 	bool run;
 };
 
@@ -46,7 +96,11 @@ struct aumix_source {
 	aumix_frame_h *fh;
 	aumix_read_h *readh;
 	void *arg;
+	double level;
+	double score;
 	bool muted;
+	bool speaker;
+	bool sel;
 };
 
 
@@ -78,6 +132,12 @@ static void destructor(void *arg)
 
 	mem_deref(mix->af);
 	mem_deref(mix->mutex);
+	mem_deref(mix->silence);
+	mem_deref(mix->frame);
+	mem_deref(mix->mix_frame);
+	mem_deref(mix->sum_frame);
+	mem_deref(mix->acc);
+	mem_deref(mix->spkv);
 }
 
 
@@ -97,66 +157,274 @@ static void source_destructor(void *arg)
 }
 
 
-static int aumix_thread(void *arg)
+/* Monotonic clock of the mixer thread in [us] */
+static uint64_t mix_clock(void)
 {
-	uint8_t *silence, *frame, *base_frame;
-	struct aumix *mix = arg;
-	int16_t *mix_frame;
-	uint64_t ts = 0;
+#ifdef HAVE_CLOCK_NANOSLEEP
+	struct timespec ts;
 
-	silence   = mem_zalloc(mix->frame_size*2, NULL);
-	frame     = mem_alloc(mix->frame_size*2, NULL);
-	mix_frame = mem_alloc(mix->frame_size*2, NULL);
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
 
-	if (!silence || !frame || !mix_frame)
-		goto out;
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+	return tmr_jiffies_usec();
+#endif
+}
+
+
+/* Sleep until an absolute deadline of mix_clock() */
+static void mix_sleep_until(uint64_t deadline)
+{
+#ifdef HAVE_CLOCK_NANOSLEEP
+	struct timespec ts;
+
+	ts.tv_sec  = (time_t)(deadline / 1000000);
+	ts.tv_nsec = (long)(deadline % 1000000) * 1000;
+
+	while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					&ts, NULL))
+		;
+#else
+	uint64_t now = mix_clock();
+
+	if (deadline > now)
+		sys_usleep((unsigned)(deadline - now));
+#endif
+}
+
+
+static void hist_add(uint32_t *histv, uint64_t usec)
+{
+	size_t i;
+
+	for (i = 0; i < RE_ARRAY_SIZE(hist_usec); i++) {
+		if (usec < hist_usec[i])
+			break;
+	}
+
+	++histv[i];
+}
+
+
+static int hist_print(struct re_printf *pf, const uint32_t *histv)
+{
+	int err = 0;
+
+	for (size_t i = 0; i < RE_ARRAY_SIZE(hist_usec); i++)
+		err |= re_hprintf(pf, " <%uus:%u", hist_usec[i], histv[i]);
+
+	err |= re_hprintf(pf, " >=%uus:%u\n",
+			  hist_usec[RE_ARRAY_SIZE(hist_usec) - 1],
+			  histv[HIST_SIZE - 1]);
+
+	return err;
+}
+
+
+/* Applies the scheduling of the calling thread */
+static int sched_apply(int prio, int cpu)
+{
+#ifdef WIN32
+	if (!SetThreadPriority(GetCurrentThread(),
+			       prio ? THREAD_PRIORITY_TIME_CRITICAL :
+			       THREAD_PRIORITY_NORMAL))
+		return EPERM;
+
+	if (cpu >= 0 && !SetThreadAffinityMask(GetCurrentThread(),
+						(DWORD_PTR)1 << cpu))
+		return EINVAL;
+
+	return 0;
+#elif defined (HAVE_PTHREAD)
+	struct sched_param param;
+	int err;
+
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = prio;
+
+	err = pthread_setschedparam(pthread_self(),
+				    prio ? SCHED_FIFO : SCHED_OTHER, &param);
+	if (err)
+		return err;
+
+	if (cpu >= 0) {
+#ifdef HAVE_PTHREAD_SETAFFINITY
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+
+		err = pthread_setaffinity_np(pthread_self(), sizeof(set),
+					     &set);
+#else
+		err = ENOSYS;
+#endif
+	}
+
+	return err;
+#else
+	(void)prio;
+	(void)cpu;
+
+	return ENOSYS;
+#endif
+}
+
+
+/* Smoothed level, fast attack and slow release */
+static void speaker_level(struct aumix_source *src)
+{
+	double level = auframe_level(&src->af);
+
+	src->level = max(level, src->level - SPK_RELEASE_DB);
+	src->level = max(src->level, AULEVEL_MIN);
+}
+
+
+static void speaker_clear(struct aumix *mix, struct aumix_source *src)
+{
+	if (!src->speaker)
+		return;
+
+	src->speaker = false;
+
+	if (mix->speakerh)
+		mix->speakerh(src, false, mix->speaker_arg);
+}
+
+
+/* Picks the spkn loudest sources and adds them to the mix */
+static void speaker_select(struct aumix *mix)
+{
+	struct aumix_source **topv = mix->spkv;
+	uint32_t k = 0;
+	struct le *le;
+
+	for (le = mix->srcl.head; le; le = le->next) {
+
+		struct aumix_source *src = le->data;
+		uint32_t i;
+
+		src->sel = false;
+
+		if (src->muted)
+			continue;
+
+		/* hysteresis, a new speaker must be clearly louder */
+		src->score = src->level + (src->speaker ? SPK_HYST_DB : 0);
+
+		if (k < mix->spkn)
+			i = k++;
+		else if (src->score > topv[k - 1]->score)
+			i = k - 1;
+		else
+			continue;
+
+		while (i > 0 && topv[i - 1]->score < src->score) {
+			topv[i] = topv[i - 1];
+			--i;
+		}
+
+		topv[i] = src;
+	}
+
+	for (uint32_t i = 0; i < k; i++) {
+		topv[i]->sel = true;
+		aumix_acc(mix->acc, topv[i]->frame, mix->frame_size);
+	}
+
+	for (le = mix->srcl.head; le; le = le->next) {
+
+		struct aumix_source *src = le->data;
+
+		if (src->sel == src->speaker)
+			continue;
+
+		src->speaker = src->sel;
+
+		if (mix->speakerh)
+			mix->speakerh(src, src->speaker, mix->speaker_arg);
+	}
+}
+
+
+static int aumix_thread(void *arg)
+{
+	uint8_t *base_frame;
+	struct aumix *mix = arg;
+	uint64_t deadline = 0;
+	uint64_t ptime = mix->ptime * 1000;
 
 	mtx_lock(mix->mutex);
 
 	while (mix->run) {
 
 		struct le *le;
-		uint64_t now;
+		uint64_t now, late;
+		bool sum;
+
+		if (mix->sched.pending) {
+			mix->sched.err = sched_apply(mix->sched.prio,
+						     mix->sched.cpu);
+			mix->sched.pending = false;
+			cnd_broadcast(&mix->sched_cond);
+		}
 
 		if (!mix->srcl.head) {
 			mix->af = mem_deref(mix->af);
 			cnd_wait(&mix->cond, mix->mutex);
-			ts = 0;
+			deadline = 0;
+			continue;
 		}
-		else {
+
+		/* the first frame is mixed right away */
+		if (deadline) {
 			mtx_unlock(mix->mutex);
-			sys_usleep(4000);
+			mix_sleep_until(deadline);
 			mtx_lock(mix->mutex);
-		}
 
-		now = tmr_jiffies();
-		if (!ts)
-			ts = now;
+			if (!mix->run || !mix->srcl.head)
+				continue;
 
-		if (ts > now)
-			continue;
+			now  = mix_clock();
+			late = now > deadline ? now - deadline : 0;
+
+			hist_add(mix->stats.latev, late);
+			mix->stats.late_max = max(mix->stats.late_max, late);
+		}
+		else {
+			deadline = mix_clock();
+		}
 
 		if (mix->af) {
 
 			size_t n = mix->frame_size*2;
 
-			if (aufile_read(mix->af, frame, &n) || n == 0) {
+			if (aufile_read(mix->af, mix->frame, &n) || n == 0) {
 				mix->af = mem_deref(mix->af);
-				base_frame = silence;
+				base_frame = mix->silence;
 			}
 			else if (n < mix->frame_size*2) {
-				memset(frame + n, 0, mix->frame_size*2 - n);
+				memset(mix->frame + n, 0,
+				       mix->frame_size*2 - n);
 				mix->af = mem_deref(mix->af);
-				base_frame = frame;
+				base_frame = mix->frame;
 			}
 			else {
-				base_frame = frame;
+				base_frame = mix->frame;
 			}
 		}
 		else {
-			base_frame = silence;
+			base_frame = mix->silence;
 		}
 
+		/* one 32-bit sum of all sources per tick */
+		memset(mix->acc, 0, mix->frame_size*sizeof(*mix->acc));
+
+		if (base_frame != mix->silence)
+			aumix_acc(mix->acc, (int16_t *)base_frame,
+				  mix->frame_size);
+
 		for (le = mix->srcl.head; le; le = le->next) {
 
 			struct aumix_source *src = le->data;
@@ -164,6 +432,8 @@ static int aumix_thread(void *arg)
 			if (src->muted)
 				continue;
 
+			src->af.level = AULEVEL_UNDEF;
+
 			if (src->readh)
 				src->readh(&src->af, src->arg);
 			else
@@ -171,86 +441,76 @@ static int aumix_thread(void *arg)
 
 			if (mix->recordh)
 				mix->recordh(&src->af);
-		}
-
-		for (le = mix->srcl.head; le; le = le->next) {
 
-			struct aumix_source *src = le->data;
-			struct le *cle;
-
-			memcpy(mix_frame, base_frame, mix->frame_size * 2);
-
-			LIST_FOREACH(&mix->srcl, cle)
-			{
+			if (mix->spkn)
+				speaker_level(src);
+			else
+				aumix_acc(mix->acc, src->frame,
+					  mix->frame_size);
+		}
 
-				struct aumix_source *csrc = cle->data;
-				int32_t sample;
+		if (mix->spkn)
+			speaker_select(mix);
 
-				/* skip self */
-				if (csrc == src)
-					continue;
+		/* mix-minus, each source hears everyone but itself.
+		   Sources that are not in the mix share the full sum. */
+		sum = false;
 
-				if (csrc->muted)
-					continue;
+		for (le = mix->srcl.head; le; le = le->next) {
 
-				for (size_t i = 0; i < mix->frame_size; i++) {
-					sample = mix_frame[i] + csrc->frame[i];
+			struct aumix_source *src = le->data;
 
-					/* hard clipping */
-					if (sample >= 32767)
-						sample = 32767;
-					if (sample <= -32767)
-						sample = -32767;
+			if (src->muted || (mix->spkn && !src->speaker)) {
 
-					mix_frame[i] = (int16_t)sample;
+				if (!sum) {
+					aumix_sub_sat(mix->sum_frame,
+						      mix->acc, NULL,
+						      mix->frame_size);
+					sum = true;
 				}
+
+				src->fh(mix->sum_frame, mix->frame_size,
+					src->arg);
+				continue;
 			}
 
-			src->fh(mix_frame, mix->frame_size, src->arg);
+			aumix_sub_sat(mix->mix_frame, mix->acc, src->frame,
+				      mix->frame_size);
+
+			src->fh(mix->mix_frame, mix->frame_size, src->arg);
 		}
 
 		if (mix->record_sumh) {
-			struct le *cle;
-
-			memcpy(mix_frame, base_frame, mix->frame_size * 2);
-
-			LIST_FOREACH(&mix->srcl, cle)
-			{
-				struct aumix_source *csrc = cle->data;
-				int32_t sample;
-
-				if (csrc->muted)
-					continue;
 
-				for (size_t i = 0; i < mix->frame_size; i++) {
-					sample = mix_frame[i] + csrc->frame[i];
+			if (!sum)
+				aumix_sub_sat(mix->sum_frame, mix->acc, NULL,
+					      mix->frame_size);
 
-					/* hard clipping */
-					if (sample >= 32767)
-						sample = 32767;
-					if (sample <= -32767)
-						sample = -32767;
+			mix->rec_sum.timestamp = tmr_jiffies();
+			mix->rec_sum.sampv     = mix->sum_frame;
 
-					mix_frame[i] = (int16_t)sample;
-				}
-			}
+			mix->record_sumh(&mix->rec_sum);
+		}
 
-			mix->rec_sum.timestamp = now;
-			mix->rec_sum.sampv     = mix_frame;
+		/* a frame is due before the next one starts */
+		now = mix_clock();
+		++mix->stats.ticks;
+		deadline += ptime;
 
-			mix->record_sumh(&mix->rec_sum);
+		if (now > deadline) {
+			++mix->stats.missed;
+			hist_add(mix->stats.missv, now - deadline);
 		}
 
-		ts += mix->ptime;
+		/* too far behind to catch up, restart the clock */
+		if (now > deadline + RESYNC_FRAMES * ptime) {
+			++mix->stats.resync;
+			deadline = now;
+		}
 	}
 
 	mtx_unlock(mix->mutex);
 
- out:
-	mem_deref(mix_frame);
-	mem_deref(silence);
-	mem_deref(frame);
-
 	return 0;
 }
 
@@ -288,6 +548,19 @@ int aumix_alloc(struct aumix **mixp, uint32_t srate,
 	mix->rec_sum.srate = srate;
 	mix->rec_sum.sampc = mix->frame_size;
 
+	mix->sched.cpu = -1;
+
+	mix->silence   = mem_zalloc(mix->frame_size*2, NULL);
+	mix->frame     = mem_alloc(mix->frame_size*2, NULL);
+	mix->mix_frame = mem_alloc(mix->frame_size*2, NULL);
+	mix->sum_frame = mem_alloc(mix->frame_size*2, NULL);
+	mix->acc       = mem_alloc(mix->frame_size*sizeof(*mix->acc), NULL);
+	if (!mix->silence || !mix->frame || !mix->mix_frame ||
+	    !mix->sum_frame || !mix->acc) {
+		err = ENOMEM;
+		goto out;
+	}
+
 	err = mutex_alloc(&mix->mutex);
 	if (err) {
 		goto out;
@@ -299,6 +572,12 @@ int aumix_alloc(struct aumix **mixp, uint32_t srate,
 		goto out;
 	}
 
+	err = cnd_init(&mix->sched_cond) != thrd_success;
+	if (err) {
+		err = ENOMEM;
+		goto out;
+	}
+
 	mix->run = true;
 
 	err = thread_create_name(&mix->thread, "aumix", aumix_thread, mix);
@@ -317,6 +596,96 @@ int aumix_alloc(struct aumix **mixp, uint32_t srate,
 }
 
 
+/**
+ * Set the scheduling of the mixer thread
+ *
+ * Real-time priority usually needs extra privileges, e.g. CAP_SYS_NICE
+ * or an RLIMIT_RTPRIO limit on Linux.
+ *
+ * @param mix  Audio mixer
+ * @param prio Real-time (SCHED_FIFO) priority, 0 for normal scheduling
+ * @param cpu  CPU to pin the mixer thread to, -1 for no pinning
+ *
+ * @return 0 for success, otherwise error code
+ */
+int aumix_thread_sched(struct aumix *mix, int prio, int cpu)
+{
+	int err;
+
+	if (!mix || prio < 0 || cpu < -1)
+		return EINVAL;
+
+	mtx_lock(mix->mutex);
+
+	mix->sched.prio    = prio;
+	mix->sched.cpu     = cpu;
+	mix->sched.pending = true;
+	cnd_signal(&mix->cond);
+
+	while (mix->sched.pending)
+		cnd_wait(&mix->sched_cond, mix->mutex);
+
+	err = mix->sched.err;
+
+	mtx_unlock(mix->mutex);
+
+	return err;
+}
+
+
+/**
+ * Mix only the loudest sources (active speakers)
+ *
+ * Each frame the level of every unmuted source is measured, and only
+ * the n loudest sources are added to the mix. A current speaker keeps
+ * its place until another source is clearly louder. All other sources
+ * receive the same mix of the speakers.
+ *
+ * @param mix      Audio mixer
+ * @param n        Number of speakers, 0 to mix all sources
+ * @param speakerh Optional handler for speaker changes
+ * @param arg      Handler argument
+ *
+ * @return 0 for success, otherwise error code
+ *
+ * @note The handler is called from the mixer thread, or from the calling
+ *       thread when the mode is disabled or a source is disabled
+ */
+int aumix_speakers(struct aumix *mix, uint32_t n, aumix_speaker_h *speakerh,
+		   void *arg)
+{
+	struct aumix_source **spkv = NULL;
+	struct le *le;
+
+	if (!mix)
+		return EINVAL;
+
+	if (n) {
+		spkv = mem_zalloc(n * sizeof(*spkv), NULL);
+		if (!spkv)
+			return ENOMEM;
+	}
+
+	mtx_lock(mix->mutex);
+
+	/* the current speakers are told with the previous handler */
+	if (!n) {
+		LIST_FOREACH(&mix->srcl, le)
+			speaker_clear(mix, le->data);
+	}
+
+	mem_deref(mix->spkv);
+	mix->spkv        = spkv;
+	mix->spkn        = n;
+	mix->speakerh    = speakerh;
+	mix->speaker_arg = arg;
+
+	mtx_unlock(mix->mutex);
+
+	return 0;
+}
+
+
 /**
  * Add multitrack record handler (each source can be identified by auframe->id)
  *
@@ -435,6 +804,7 @@ int aumix_source_alloc(struct aumix_source **srcp, struct aumix *mix,
 	src->fh  = fh ? fh : dummy_frame_handler;
 	src->arg = arg;
 	src->muted = false;
+	src->level = AULEVEL_MIN;
 
 	sz = mix->frame_size*2;
 
@@ -522,6 +892,7 @@ void aumix_source_enable(struct aumix_source *src, bool enable)
 	}
 	else {
 		list_unlink(&src->le);
+		speaker_clear(mix, src);
 	}
 
 	mtx_unlock(mix->mutex);
@@ -582,13 +953,23 @@ int aumix_debug(struct re_printf *pf, const struct aumix *mix)
 	LIST_FOREACH(&mix->srcl, le)
 	{
 		struct aumix_source *src = le->data;
-		re_hprintf(pf, "\tsource: %p muted=%d ", src, src->muted);
+		re_hprintf(pf, "\tsource: %p muted=%d speaker=%d level=%.1f ",
+			   src, src->muted, src->speaker, src->level);
 		err = aubuf_debug(pf, src->aubuf);
 		if (err)
 			goto out;
 		re_hprintf(pf, "\n");
 	}
 
+	err  = re_hprintf(pf, "\tclock: ptime=%ums ticks=%llu missed=%llu"
+			  " resync=%llu late_max=%lluus\n",
+			  mix->ptime, mix->stats.ticks, mix->stats.missed,
+			  mix->stats.resync, mix->stats.late_max);
+	err |= re_hprintf(pf, "\twakeup late:  ");
+	err |= hist_print(pf, mix->stats.latev);
+	err |= re_hprintf(pf, "\tdeadline miss:");
+	err |= hist_print(pf, mix->stats.missv);
+
 out:
 	mtx_unlock(mix->mutex);
 	return err;
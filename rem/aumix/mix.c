@@ -0,0 +1,177 @@
+/**
+ * @file aumix/mix.c  Audio mixer kernels
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+#if defined (__AVX2__)
+#include <immintrin.h>
+#elif defined (__SSE2__)
+#include <emmintrin.h>
+#elif defined (__ARM_NEON) || defined (HAVE_NEON)
+#include <arm_neon.h>
+#endif
+#include <re.h>
+#include <rem.h>
+
+
+/**
+ * Add PCM samples to a 32-bit accumulator
+ *
+ * @param accv  Accumulator
+ * @param sampv PCM samples
+ * @param sampc Number of samples
+ */
+void aumix_acc(int32_t *accv, const int16_t *sampv, size_t sampc)
+{
+	size_t i = 0;
+
+	if (!accv || !sampv)
+		return;
+
+#if defined (__AVX2__)
+	for (; i + 16 <= sampc; i += 16) {
+		__m256i s0, s1, a0, a1;
+
+		s0 = _mm256_cvtepi16_epi32(
+			_mm_loadu_si128((const __m128i *)&sampv[i]));
+		s1 = _mm256_cvtepi16_epi32(
+			_mm_loadu_si128((const __m128i *)&sampv[i + 8]));
+		a0 = _mm256_loadu_si256((const __m256i *)&accv[i]);
+		a1 = _mm256_loadu_si256((const __m256i *)&accv[i + 8]);
+
+		_mm256_storeu_si256((__m256i *)&accv[i],
+				    _mm256_add_epi32(a0, s0));
+		_mm256_storeu_si256((__m256i *)&accv[i + 8],
+				    _mm256_add_epi32(a1, s1));
+	}
+#elif defined (__SSE2__)
+	for (; i + 8 <= sampc; i += 8) {
+		__m128i s, lo, hi, a0, a1;
+
+		s  = _mm_loadu_si128((const __m128i *)&sampv[i]);
+		lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+		hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+		a0 = _mm_loadu_si128((const __m128i *)&accv[i]);
+		a1 = _mm_loadu_si128((const __m128i *)&accv[i + 4]);
+
+		_mm_storeu_si128((__m128i *)&accv[i], _mm_add_epi32(a0, lo));
+		_mm_storeu_si128((__m128i *)&accv[i + 4],
+				 _mm_add_epi32(a1, hi));
+	}
+#elif defined (__ARM_NEON) || defined (HAVE_NEON)
+	for (; i + 8 <= sampc; i += 8) {
+		int16x8_t s = vld1q_s16(&sampv[i]);
+
+		vst1q_s32(&accv[i], vaddw_s16(vld1q_s32(&accv[i]),
+					       vget_low_s16(s)));
+		vst1q_s32(&accv[i + 4], vaddw_s16(vld1q_s32(&accv[i + 4]),
+						   vget_high_s16(s)));
+	}
+#endif
+
+	for (; i < sampc; i++)
+		accv[i] += sampv[i];
+}
+
+
+/**
+ * Subtract PCM samples from a 32-bit accumulator and saturate the
+ * result to 16-bit. This gives the mix-minus of one source.
+ *
+ * @param dstv  Destination PCM samples
+ * @param accv  Accumulator
+ * @param sampv PCM samples to subtract, NULL for none
+ * @param sampc Number of samples
+ */
+void aumix_sub_sat(int16_t *dstv, const int32_t *accv,
+		   const int16_t *sampv, size_t sampc)
+{
+	size_t i = 0;
+
+	if (!dstv || !accv)
+		return;
+
+	if (!sampv) {
+#if defined (__AVX2__)
+		for (; i + 16 <= sampc; i += 16) {
+			__m256i a0, a1, r;
+
+			a0 = _mm256_loadu_si256((const __m256i *)&accv[i]);
+			a1 = _mm256_loadu_si256((const __m256i *)&accv[i+8]);
+			r  = _mm256_permute4x64_epi64(
+				_mm256_packs_epi32(a0, a1), 0xd8);
+
+			_mm256_storeu_si256((__m256i *)&dstv[i], r);
+		}
+#elif defined (__SSE2__)
+		for (; i + 8 <= sampc; i += 8) {
+			__m128i a0, a1;
+
+			a0 = _mm_loadu_si128((const __m128i *)&accv[i]);
+			a1 = _mm_loadu_si128((const __m128i *)&accv[i + 4]);
+
+			_mm_storeu_si128((__m128i *)&dstv[i],
+					 _mm_packs_epi32(a0, a1));
+		}
+#elif defined (__ARM_NEON) || defined (HAVE_NEON)
+		for (; i + 8 <= sampc; i += 8) {
+			int16x4_t lo = vqmovn_s32(vld1q_s32(&accv[i]));
+			int16x4_t hi = vqmovn_s32(vld1q_s32(&accv[i + 4]));
+
+			vst1q_s16(&dstv[i], vcombine_s16(lo, hi));
+		}
+#endif
+		for (; i < sampc; i++)
+			dstv[i] = saturate_s16(accv[i]);
+
+		return;
+	}
+
+#if defined (__AVX2__)
+	for (; i + 16 <= sampc; i += 16) {
+		__m256i s0, s1, a0, a1, r;
+
+		s0 = _mm256_cvtepi16_epi32(
+			_mm_loadu_si128((const __m128i *)&sampv[i]));
+		s1 = _mm256_cvtepi16_epi32(
+			_mm_loadu_si128((const __m128i *)&sampv[i + 8]));
+		a0 = _mm256_loadu_si256((const __m256i *)&accv[i]);
+		a1 = _mm256_loadu_si256((const __m256i *)&accv[i + 8]);
+
+		r = _mm256_packs_epi32(_mm256_sub_epi32(a0, s0),
+				       _mm256_sub_epi32(a1, s1));
+
+		_mm256_storeu_si256((__m256i *)&dstv[i],
+				    _mm256_permute4x64_epi64(r, 0xd8));
+	}
+#elif defined (__SSE2__)
+	for (; i + 8 <= sampc; i += 8) {
+		__m128i s, lo, hi, a0, a1;
+
+		s  = _mm_loadu_si128((const __m128i *)&sampv[i]);
+		lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+		hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+		a0 = _mm_loadu_si128((const __m128i *)&accv[i]);
+		a1 = _mm_loadu_si128((const __m128i *)&accv[i + 4]);
+
+		_mm_storeu_si128((__m128i *)&dstv[i],
+				 _mm_packs_epi32(_mm_sub_epi32(a0, lo),
+						 _mm_sub_epi32(a1, hi)));
+	}
+#elif defined (__ARM_NEON) || defined (HAVE_NEON)
+	for (; i + 8 <= sampc; i += 8) {
+		int16x8_t s = vld1q_s16(&sampv[i]);
+		int32x4_t lo, hi;
+
+		lo = vsubw_s16(vld1q_s32(&accv[i]), vget_low_s16(s));
+		hi = vsubw_s16(vld1q_s32(&accv[i + 4]), vget_high_s16(s));
+
+		vst1q_s16(&dstv[i], vcombine_s16(vqmovn_s32(lo),
+						 vqmovn_s32(hi)));
+	}
+#endif
+
+	for (; i < sampc; i++)
+		dstv[i] = saturate_sub16(accv[i], sampv[i]);
+}
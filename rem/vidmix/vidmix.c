@@ -22,31 +22,140 @@
 #define VIDEO_TIMEBASE 1000000U
 
 
+enum {
+	POOL_SIZE = 2,            /**< Worker threads besides the scheduler */
+	COMP_TIMEOUT = 1000000,   /**< Lifetime of unused composite in [us] */
+};
+
+
+/*
+ * One scheduler thread drives all running sources and sleeps until the
+ * next one is due. Every tick the sources that are due are grouped by
+ * their mosaic layout, each distinct layout is composed once, and the
+ * composite is then handed to all sources of that group. Composing and
+ * the frame handlers run in parallel on the scheduler and a small worker
+ * pool, without rwlock. The tiles of a compose are taken under rwlock
+ * and reference the received frames, which vidmix_source_put() replaces
+ * instead of overwriting them.
+ *
+ * A composite is persistent. It remembers the tiles it was drawn with
+ * and the frame generation of each tile, and only tiles with a new frame
+ * are drawn again. A change of the tile geometry redraws the whole frame.
+ */
+
+enum tile_mode {
+	TILE_NONE,      /**< Not visible     */
+	TILE_FULL,      /**< Whole frame     */
+	TILE_CENTER,    /**< Cropped to rect */
+	TILE_ASPECT,    /**< Fitted to rect  */
+};
+
+/** One participant in a composite */
+struct vidmix_tile {
+	const struct vidmix_source *src;
+	struct vidframe *frame;    /**< Frame to draw, ref'd until drawn */
+	enum tile_mode mode;
+	struct vidrect rect;
+	struct vidsz sz;           /**< Size of the drawn frame        */
+	uint64_t gen;              /**< Generation of the drawn frame  */
+};
+
+/** Mosaic layout, sources with equal layouts share one composite */
+struct vidmix_layout {
+	struct vidsz size;
+	enum vidfmt fmt;
+	const struct vidmix_source *self;  /**< Hidden own source or NULL */
+	const void *focus;
+	bool focus_full;
+	bool content_hide;
+};
+
+/** Composed mosaic of one layout */
+struct vidmix_comp {
+	struct le le;              /**< Member of vidmix compl         */
+	struct le le_job;          /**< Member of the worker job list  */
+	struct vidmix_layout lay;
+	struct vidframe *frame;
+	struct vidmix_tile *tilev; /**< Tiles drawn in frame           */
+	struct vidmix_tile *newv;  /**< Tiles of the next compose      */
+	unsigned tilec;
+	unsigned newc;
+	unsigned tilesz;           /**< Allocated size of tile arrays  */
+	bool valid;                /**< Frame matches tilev            */
+	bool full;                 /**< Last compose was a redraw      */
+	unsigned drawn;            /**< Tiles drawn in last compose    */
+	unsigned clean;            /**< Tiles skipped in last compose  */
+	uint64_t tick;             /**< Last tick it was composed in   */
+	uint64_t used;             /**< Last time it was used in [us]  */
+};
+
+struct vidmix;
+
+typedef void (pool_work_h)(struct vidmix *mix);
+
 struct vidmix {
 	mtx_t rwlock;
 	struct list srcl;
+	struct list runl;          /**< Running sources                */
+	struct list compl;         /**< Composites, scheduler only     */
+	struct list curl;          /**< Sources in frame handlers      */
+	cnd_t cond;
+	thrd_t thread;
+	bool run;
 	bool initialized;
 	uint32_t next_pidx;
+	uint64_t gen;              /**< Last frame generation          */
 	enum vidfmt fmt;
+
+	/* worker pool, each worker takes part in every phase */
+	mtx_t pool_mtx;
+	cnd_t job_cond;
+	cnd_t done_cond;
+	thrd_t workerv[POOL_SIZE];
+	unsigned workerc;
+	struct list jobl;          /**< Composites to draw             */
+	pool_work_h *work;         /**< Work of the current phase      */
+	uint64_t phase;
+	unsigned pending;          /**< Workers busy with the phase    */
+	bool pool_run;
+
+	struct {
+		uint64_t ticks;      /**< Ticks with due sources        */
+		uint64_t composed;   /**< Composites composed           */
+		uint64_t delivered;  /**< Mixed frames delivered        */
+		uint64_t redraws;    /**< Composites drawn from scratch */
+		uint64_t drawn;      /**< Tiles drawn                   */
+		uint64_t clean;      /**< Unchanged tiles skipped       */
+	} stats;
 };
 
 struct vidmix_source {
 	struct le le;
+	struct le rle;             /**< Member of vidmix runl          */
 	uint32_t pidx;
-	thrd_t thread;
-	mtx_t *mutex;
-	struct vidframe *frame_tx;
 	struct vidframe *frame_rx;
+	struct vidframe *frame_put; /**< Spare frame for the next put  */
 	struct vidmix *mix;
+	struct vidmix_comp *comp;  /**< Composite of the current tick  */
 	vidmix_frame_h *fh;
 	void *arg;
 	void *focus;
+	struct vidsz size;
+	uint64_t gen;              /**< Generation of frame_rx, unique */
+	uint64_t ts;
 	bool content_hide;
 	bool focus_full;
 	unsigned fint;
 	bool selfview;
 	bool content;
-	bool run;
+	bool due;
+};
+
+/** Source whose frame handler is running */
+struct vidmix_cur {
+	struct le le;
+	const struct vidmix_source *src;
+	thrd_t thrd;
 };
 
 
@@ -60,12 +169,56 @@ static inline void clear_frame(struct vidframe *vf)
 }
 
 
+static void sched_stop(struct vidmix *mix)
+{
+	mtx_lock(&mix->rwlock);
+	bool run = mix->run;
+	mix->run = false;
+	cnd_broadcast(&mix->cond);
+	mtx_unlock(&mix->rwlock);
+
+	if (run)
+		thrd_join(mix->thread, NULL);
+
+	mtx_lock(&mix->pool_mtx);
+	mix->pool_run = false;
+	cnd_broadcast(&mix->job_cond);
+	mtx_unlock(&mix->pool_mtx);
+
+	for (unsigned i = 0; i < mix->workerc; i++)
+		thrd_join(mix->workerv[i], NULL);
+
+	mix->workerc = 0;
+}
+
+
 static void destructor(void *arg)
 {
 	struct vidmix *mix = arg;
 
-	if (mix->initialized)
-		mtx_destroy(&mix->rwlock);
+	if (!mix->initialized)
+		return;
+
+	sched_stop(mix);
+
+	list_flush(&mix->compl);
+
+	mtx_destroy(&mix->rwlock);
+	mtx_destroy(&mix->pool_mtx);
+	cnd_destroy(&mix->cond);
+	cnd_destroy(&mix->job_cond);
+	cnd_destroy(&mix->done_cond);
+}
+
+
+static void comp_destructor(void *arg)
+{
+	struct vidmix_comp *comp = arg;
+
+	list_unlink(&comp->le);
+	mem_deref(comp->frame);
+	mem_deref(comp->tilev);
+	mem_deref(comp->newv);
 }
 
 
@@ -81,23 +234,18 @@ static void source_destructor(void *arg)
 		mtx_unlock(&src->mix->rwlock);
 	}
 
-	mem_deref(src->frame_tx);
 	mem_deref(src->frame_rx);
+	mem_deref(src->frame_put);
 	mem_deref(src->mix);
-	mem_deref(src->mutex);
 }
 
 
-static inline void source_mix(struct vidframe *mframe,
-			      const struct vidframe *frame_src,
-			      unsigned n, unsigned rows, unsigned idx,
-			      bool focus, bool focus_this, bool focus_full)
+static inline enum tile_mode tile_calc(struct vidrect *rect,
+				       const struct vidsz *msz,
+				       unsigned n, unsigned rows, unsigned idx,
+				       bool focus, bool focus_this,
+				       bool focus_full)
 {
-	struct vidrect rect;
-
-	if (!frame_src)
-		return;
-
 	if (focus) {
 
 		const unsigned nmin = focus_full ? 12 : 6;
@@ -105,49 +253,76 @@ static inline void source_mix(struct vidframe *mframe,
 		n = max((n+1), nmin)/2;
 
 		if (focus_this) {
-			rect.w = mframe->size.w * (n-1) / n;
-			rect.h = mframe->size.h * (n-1) / n;
-			rect.x = 0;
-			rect.y = 0;
+			rect->w = msz->w * (n-1) / n;
+			rect->h = msz->h * (n-1) / n;
+			rect->x = 0;
+			rect->y = 0;
 		}
 		else {
-			rect.w = mframe->size.w / n;
-			rect.h = mframe->size.h / n;
+			rect->w = msz->w / n;
+			rect->h = msz->h / n;
 
 			if (idx < n) {
-				rect.x = mframe->size.w - rect.w;
-				rect.y = rect.h * idx;
+				rect->x = msz->w - rect->w;
+				rect->y = rect->h * idx;
 			}
 			else if (idx < (n*2 - 1)) {
-				rect.x = rect.w * (n*2 - 2 - idx);
-				rect.y = mframe->size.h - rect.h;
+				rect->x = rect->w * (n*2 - 2 - idx);
+				rect->y = msz->h - rect->h;
 			}
 			else {
-				return;
+				return TILE_NONE;
 			}
 		}
 	}
 	else if (rows == 1) {
 
-		source_mix_full(mframe, frame_src);
-		return;
+		return TILE_FULL;
 	}
 	else if (n <= 3) {
-		rect.w = mframe->size.w / n;
-		rect.h = mframe->size.h;
-		rect.x = (rect.w) * (idx % n);
-		rect.y = 0;
-		vidconv_center(mframe, frame_src, &rect);
-		return;
+		rect->w = msz->w / n;
+		rect->h = msz->h;
+		rect->x = (rect->w) * (idx % n);
+		rect->y = 0;
+		return TILE_CENTER;
 	}
 	else {
-		rect.w = mframe->size.w / rows;
-		rect.h = mframe->size.h / rows;
-		rect.x = rect.w * (idx % rows);
-		rect.y = rect.h * (idx / rows);
+		rect->w = msz->w / rows;
+		rect->h = msz->h / rows;
+		rect->x = rect->w * (idx % rows);
+		rect->y = rect->h * (idx / rows);
 	}
 
-	vidconv_aspect(mframe, frame_src, &rect);
+	return TILE_ASPECT;
+}
+
+
+static inline void tile_draw(struct vidframe *mframe,
+			     const struct vidmix_tile *tile)
+{
+	const struct vidframe *frame_src = tile->frame;
+	struct vidrect rect = tile->rect;
+
+	if (!frame_src)
+		return;
+
+	switch (tile->mode) {
+
+	case TILE_FULL:
+		source_mix_full(mframe, frame_src);
+		break;
+
+	case TILE_CENTER:
+		vidconv_center(mframe, frame_src, &rect);
+		break;
+
+	case TILE_ASPECT:
+		vidconv_aspect(mframe, frame_src, &rect);
+		break;
+
+	default:
+		break;
+	}
 }
 
 
@@ -184,131 +359,583 @@ static inline unsigned calc_rows(unsigned n)
 }
 
 
-static int vidmix_thread(void *arg)
+static void tile_set(struct vidmix_tile *tile,
+		     const struct vidmix_source *src, enum tile_mode mode)
 {
-	struct vidmix_source *src = arg;
-	struct vidmix *mix = src->mix;
-	uint64_t ts = tmr_jiffies_usec();
+	tile->src   = src;
+	tile->frame = mem_ref(src->frame_rx);
+	tile->mode  = mode;
+	tile->gen   = src->gen;
 
-	mtx_lock(src->mutex);
+	if (src->frame_rx)
+		tile->sz = src->frame_rx->size;
+	else
+		tile->sz.w = tile->sz.h = 0;
+}
 
-	while (src->run) {
 
-		unsigned n, rows, idx;
-		struct le *le;
-		uint64_t now;
+static bool tile_geom_equal(const struct vidmix_tile *a,
+			    const struct vidmix_tile *b)
+{
+	if (a->src != b->src || a->mode != b->mode ||
+	    !vidsz_cmp(&a->sz, &b->sz))
+		return false;
 
-		mtx_unlock(src->mutex);
-		sys_usleep(4000);
-		mtx_lock(src->mutex);
+	if (a->mode == TILE_NONE || a->mode == TILE_FULL)
+		return true;
 
-		now = tmr_jiffies_usec();
+	return a->rect.x == b->rect.x && a->rect.y == b->rect.y &&
+		a->rect.w == b->rect.w && a->rect.h == b->rect.h;
+}
 
-		if (ts > now)
+
+static int tiles_alloc(struct vidmix_comp *comp, unsigned n)
+{
+	struct vidmix_tile *tilev, *newv;
+
+	if (n <= comp->tilesz)
+		return 0;
+
+	tilev = mem_reallocarray(comp->tilev, n, sizeof(*tilev), NULL);
+	if (!tilev)
+		return ENOMEM;
+
+	comp->tilev = tilev;
+
+	newv = mem_reallocarray(comp->newv, n, sizeof(*newv), NULL);
+	if (!newv)
+		return ENOMEM;
+
+	comp->newv   = newv;
+	comp->tilesz = n;
+
+	return 0;
+}
+
+
+/* Take the tiles of the next compose of a layout, rwlock is held */
+static int comp_plan(const struct vidmix *mix, struct vidmix_comp *comp)
+{
+	const struct vidmix_layout *lay = &comp->lay;
+	struct vidmix_tile *tilev;
+	unsigned n, rows, idx, tilec = 0;
+	struct le *le;
+	int err;
+
+	for (le=mix->srcl.head, n=0; le; le=le->next) {
+
+		const struct vidmix_source *lsrc = le->data;
+
+		if (lsrc == lay->self)
 			continue;
 
-		if (!src->frame_tx) {
-			ts += src->fint;
+		if (lsrc->content && lay->content_hide)
 			continue;
+
+		++n;
+	}
+
+	err = tiles_alloc(comp, n);
+	if (err)
+		return err;
+
+	tilev = comp->newv;
+	rows = calc_rows(n);
+
+	/* the full focus is the background of all other tiles */
+	for (le=mix->srcl.head; le; le=le->next) {
+
+		const struct vidmix_source *lsrc = le->data;
+
+		if (lsrc == lay->focus && lay->focus_full &&
+		    lsrc != lay->self &&
+		    !(lsrc->content && lay->content_hide)) {
+
+			tile_set(&tilev[tilec++], lsrc, TILE_FULL);
+			break;
 		}
+	}
 
-		mtx_lock(&mix->rwlock);
+	for (le=mix->srcl.head, idx=0; le; le=le->next) {
 
-		clear_frame(src->frame_tx);
+		const struct vidmix_source *lsrc = le->data;
+		struct vidmix_tile *tile;
 
-		for (le=mix->srcl.head, n=0; le; le=le->next) {
+		if (lsrc == lay->self)
+			continue;
 
-			const struct vidmix_source *lsrc = le->data;
+		if (lsrc->content && lay->content_hide)
+			continue;
 
-			if (lsrc == src && !src->selfview)
-				continue;
+		if (lsrc == lay->focus && lay->focus_full)
+			continue;
 
-			if (lsrc->content && src->content_hide)
-				continue;
+		tile = &tilev[tilec++];
+
+		tile_set(tile, lsrc, tile_calc(&tile->rect, &lay->size,
+					       n, rows, idx,
+					       lay->focus != NULL,
+					       lay->focus == lsrc,
+					       lay->focus_full));
+
+		if (lay->focus != lsrc)
+			++idx;
+	}
+
+	comp->newc = tilec;
+
+	return 0;
+}
+
+
+/* Draw the taken tiles of a composite, without rwlock */
+static void compose(struct vidmix_comp *comp)
+{
+	struct vidframe *frame = comp->frame;
+	struct vidmix_tile *tilev = comp->newv;
+	const unsigned tilec = comp->newc;
+	bool redraw;
+
+	comp->drawn = comp->clean = 0;
+
+	redraw = !comp->valid || tilec != comp->tilec;
+
+	for (unsigned i = 0; i < tilec && !redraw; i++) {
+
+		if (!tile_geom_equal(&tilev[i], &comp->tilev[i]))
+			redraw = true;
+
+		/* other tiles are drawn on top of a changed background */
+		if (i == 0 && tilev[0].mode == TILE_FULL && tilec > 1 &&
+		    tilev[0].gen != comp->tilev[0].gen)
+			redraw = true;
+	}
+
+	if (redraw)
+		clear_frame(frame);
 
-			if (lsrc == src->focus && src->focus_full)
-				source_mix_full(src->frame_tx, lsrc->frame_rx);
+	for (unsigned i = 0; i < tilec; i++) {
+
+		if (tilev[i].mode == TILE_NONE)
+			continue;
 
-			++n;
+		if (!redraw && tilev[i].gen == comp->tilev[i].gen) {
+			++comp->clean;
+			continue;
 		}
 
-		rows = calc_rows(n);
+		tile_draw(frame, &tilev[i]);
+		++comp->drawn;
+	}
 
-		for (le=mix->srcl.head, idx=0; le; le=le->next) {
+	for (unsigned i = 0; i < tilec; i++)
+		tilev[i].frame = mem_deref(tilev[i].frame);
 
-			const struct vidmix_source *lsrc = le->data;
+	comp->newv  = comp->tilev;
+	comp->tilev = tilev;
+	comp->tilec = tilec;
+	comp->valid = true;
+	comp->full  = redraw;
+}
 
-			if (lsrc == src && !src->selfview)
-				continue;
 
-			if (lsrc->content && src->content_hide)
-				continue;
+static bool layout_equal(const struct vidmix_layout *a,
+			 const struct vidmix_layout *b)
+{
+	return vidsz_cmp(&a->size, &b->size) &&
+		a->fmt          == b->fmt &&
+		a->self         == b->self &&
+		a->focus        == b->focus &&
+		a->focus_full   == b->focus_full &&
+		a->content_hide == b->content_hide;
+}
 
-			if (lsrc == src->focus && src->focus_full)
-				continue;
 
-			source_mix(src->frame_tx, lsrc->frame_rx, n, rows, idx,
-				   src->focus != NULL, src->focus == lsrc,
-				   src->focus_full);
+static void layout_get(struct vidmix_layout *lay,
+		       const struct vidmix_source *src)
+{
+	lay->size = src->size;
+	lay->fmt  = src->mix->fmt;
+	lay->self = (src->le.list && !src->selfview) ? src : NULL;
+	lay->focus        = src->focus;
+	lay->focus_full   = src->focus_full;
+	lay->content_hide = src->content_hide;
+}
+
+
+static struct vidmix_comp *comp_get(struct vidmix *mix,
+				    const struct vidmix_layout *lay)
+{
+	struct vidmix_comp *comp;
+	struct le *le;
+
+	LIST_FOREACH(&mix->compl, le) {
+
+		comp = le->data;
+
+		if (layout_equal(&comp->lay, lay))
+			return comp;
+	}
+
+	comp = mem_zalloc(sizeof(*comp), comp_destructor);
+	if (!comp)
+		return NULL;
+
+	comp->lay  = *lay;
+	comp->tick = mix->stats.ticks - 1;
+
+	if (vidframe_alloc(&comp->frame, lay->fmt, &lay->size))
+		return mem_deref(comp);
+
+	list_append(&mix->compl, &comp->le, comp);
 
-			if (src->focus != lsrc)
-				++idx;
+	return comp;
+}
+
+
+static int worker_thread(void *arg)
+{
+	struct vidmix *mix = arg;
+	uint64_t phase = 0;
+
+	mtx_lock(&mix->pool_mtx);
+
+	while (mix->pool_run) {
+
+		pool_work_h *work = mix->work;
+
+		if (phase == mix->phase) {
+			cnd_wait(&mix->job_cond, &mix->pool_mtx);
+			continue;
 		}
 
-		mtx_unlock(&mix->rwlock);
+		phase = mix->phase;
 
-		src->fh(ts, src->frame_tx, src->arg);
+		mtx_unlock(&mix->pool_mtx);
+		work(mix);
+		mtx_lock(&mix->pool_mtx);
 
-		ts += src->fint;
+		if (--mix->pending == 0)
+			cnd_broadcast(&mix->done_cond);
 	}
 
-	mtx_unlock(src->mutex);
+	mtx_unlock(&mix->pool_mtx);
 
 	return 0;
 }
 
 
-static int content_thread(void *arg)
+/* Run a phase on the scheduler and all workers and wait for them */
+static void pool_run(struct vidmix *mix, pool_work_h *work)
 {
-	struct vidmix_source *src = arg;
-	struct vidmix *mix = src->mix;
-	uint64_t ts = tmr_jiffies_usec();
+	mtx_lock(&mix->pool_mtx);
 
-	mtx_lock(src->mutex);
+	mix->work    = work;
+	mix->pending = mix->workerc;
+	++mix->phase;
 
-	while (src->run) {
+	cnd_broadcast(&mix->job_cond);
+	mtx_unlock(&mix->pool_mtx);
 
-		struct le *le;
-		uint64_t now;
+	work(mix);
 
-		mtx_unlock(src->mutex);
-		sys_usleep(4000);
-		mtx_lock(src->mutex);
+	mtx_lock(&mix->pool_mtx);
 
-		now = tmr_jiffies_usec();
+	while (mix->pending)
+		cnd_wait(&mix->done_cond, &mix->pool_mtx);
+
+	mtx_unlock(&mix->pool_mtx);
+}
+
+
+/* Compose jobs until the list is empty */
+static void compose_work(struct vidmix *mix)
+{
+	struct le *le;
+
+	mtx_lock(&mix->pool_mtx);
+
+	while ((le = list_head(&mix->jobl))) {
+
+		list_unlink(le);
+
+		mtx_unlock(&mix->pool_mtx);
+		compose(le->data);
+		mtx_lock(&mix->pool_mtx);
+	}
+
+	mtx_unlock(&mix->pool_mtx);
+}
+
+
+static struct vidmix_source *next_due(const struct vidmix *mix)
+{
+	struct le *le;
+
+	LIST_FOREACH(&mix->runl, le) {
+
+		struct vidmix_source *src = le->data;
+
+		if (src->due)
+			return src;
+	}
+
+	return NULL;
+}
 
-		if (ts > now)
+
+static struct vidframe *content_frame(const struct vidmix *mix,
+				      const struct vidmix_source *src)
+{
+	struct le *le;
+
+	for (le=mix->srcl.head; le; le=le->next) {
+
+		const struct vidmix_source *lsrc = le->data;
+
+		if (!lsrc->content || !lsrc->frame_rx || lsrc == src)
 			continue;
 
+		return mem_ref(lsrc->frame_rx);
+	}
+
+	return NULL;
+}
+
+
+/* Call the frame handlers of due sources until none is left. A source
+   that is stopped meanwhile leaves runl and is skipped. */
+static void deliver_work(struct vidmix *mix)
+{
+	struct vidmix_cur cur = {.le = LE_INIT};
+	struct vidmix_source *src;
+
+	cur.thrd = thrd_current();
+
+	mtx_lock(&mix->rwlock);
+
+	while ((src = next_due(mix))) {
+
+		vidmix_frame_h *fh = src->fh;
+		void *arg = src->arg;
+		struct vidframe *frame;
+		uint64_t ts = src->ts;
+
+		src->due = false;
+		src->ts += src->fint;
+
+		if (src->content) {
+			frame = content_frame(mix, src);
+		}
+		else if (src->comp) {
+			frame = mem_ref(src->comp->frame);
+			++mix->stats.delivered;
+		}
+		else {
+			continue;
+		}
+
+		if (!frame)
+			continue;
+
+		cur.src = src;
+		list_append(&mix->curl, &cur.le, &cur);
+		mtx_unlock(&mix->rwlock);
+
+		fh(ts, frame, arg);
+		mem_deref(frame);
+
 		mtx_lock(&mix->rwlock);
+		list_unlink(&cur.le);
+		cnd_broadcast(&mix->cond);
+	}
 
-		for (le=mix->srcl.head; le; le=le->next) {
+	mtx_unlock(&mix->rwlock);
+}
 
-			const struct vidmix_source *lsrc = le->data;
 
-			if (!lsrc->content || !lsrc->frame_rx || lsrc == src)
-				continue;
+/* One scheduler tick, called and returns with rwlock held */
+static void sched_tick(struct vidmix *mix, uint64_t now)
+{
+	struct vidmix_source *src;
+	struct list jobl = LIST_INIT;
+	bool due = false;
+	struct le *le;
 
-			src->fh(ts, lsrc->frame_rx, src->arg);
-			break;
+	LIST_FOREACH(&mix->runl, le) {
+
+		struct vidmix_layout lay;
+
+		src = le->data;
+		src->comp = NULL;
+
+		if (src->ts > now)
+			continue;
+
+		src->due = true;
+		due = true;
+
+		if (src->content || !src->size.w || !src->size.h)
+			continue;
+
+		layout_get(&lay, src);
+
+		src->comp = comp_get(mix, &lay);
+		if (!src->comp)
+			continue;
+
+		src->comp->used = now;
+
+		if (src->comp->tick == mix->stats.ticks)
+			continue;
+
+		src->comp->tick = mix->stats.ticks;
+
+		if (comp_plan(mix, src->comp)) {
+			src->comp->valid = false;
+			continue;
 		}
 
+		list_append(&jobl, &src->comp->le_job, src->comp);
+		++mix->stats.composed;
+	}
+
+	if (!due)
+		return;
+
+	mtx_lock(&mix->pool_mtx);
+
+	while ((le = list_head(&jobl))) {
+		list_unlink(le);
+		list_append(&mix->jobl, le, le->data);
+	}
+
+	mtx_unlock(&mix->pool_mtx);
+
+	mtx_unlock(&mix->rwlock);
+	pool_run(mix, compose_work);
+	mtx_lock(&mix->rwlock);
+
+	LIST_FOREACH(&mix->compl, le) {
+
+		const struct vidmix_comp *comp = le->data;
+
+		if (comp->tick != mix->stats.ticks)
+			continue;
+
+		mix->stats.redraws += comp->full;
+		mix->stats.drawn   += comp->drawn;
+		mix->stats.clean   += comp->clean;
+	}
+
+	mtx_unlock(&mix->rwlock);
+	pool_run(mix, deliver_work);
+	mtx_lock(&mix->rwlock);
+
+	++mix->stats.ticks;
+
+	le = mix->compl.head;
+	while (le) {
+		struct vidmix_comp *comp = le->data;
+
+		le = le->next;
+
+		if (now > comp->used + COMP_TIMEOUT)
+			mem_deref(comp);
+	}
+}
+
+
+static uint64_t next_ts(const struct vidmix *mix)
+{
+	uint64_t ts = UINT64_MAX;
+	struct le *le;
+
+	LIST_FOREACH(&mix->runl, le) {
+
+		const struct vidmix_source *src = le->data;
+
+		ts = min(ts, src->ts);
+	}
+
+	return ts;
+}
+
+
+/* Wait for a change or up to usec, rwlock is held */
+static void sched_wait(struct vidmix *mix, uint64_t usec)
+{
+	struct timespec tp;
+	uint64_t nsec;
+
+	if (tmr_timespec_get(&tp, 0)) {
 		mtx_unlock(&mix->rwlock);
+		sys_usleep((unsigned)usec);
+		mtx_lock(&mix->rwlock);
+		return;
+	}
+
+	nsec = tp.tv_nsec + usec * 1000;
+
+	tp.tv_sec += nsec / 1000000000;
+	tp.tv_nsec = nsec % 1000000000;
+
+	(void)cnd_timedwait(&mix->cond, &mix->rwlock, &tp);
+}
+
+
+static int sched_thread(void *arg)
+{
+	struct vidmix *mix = arg;
+
+	mtx_lock(&mix->rwlock);
+
+	while (mix->run) {
+
+		uint64_t now, ts;
+
+		if (list_isempty(&mix->runl)) {
+			cnd_wait(&mix->cond, &mix->rwlock);
+			continue;
+		}
+
+		now = tmr_jiffies_usec();
+		ts  = next_ts(mix);
 
-		ts += src->fint;
+		if (ts > now) {
+			sched_wait(mix, ts - now);
+			continue;
+		}
+
+		sched_tick(mix, now);
+	}
+
+	mtx_unlock(&mix->rwlock);
+
+	return 0;
+}
+
+
+/* Start the scheduler and the worker pool, rwlock is held */
+static int sched_start(struct vidmix *mix)
+{
+	int err;
+
+	mix->pool_run = true;
+
+	for (; mix->workerc < POOL_SIZE; mix->workerc++) {
+
+		err = thread_create_name(&mix->workerv[mix->workerc],
+					 "vidmix_pool", worker_thread, mix);
+		if (err)
+			break;
 	}
 
-	mtx_unlock(src->mutex);
+	err = thread_create_name(&mix->thread, "vidmix", sched_thread, mix);
+	if (err)
+		return err;
+
+	mix->run = true;
 
 	return 0;
 }
@@ -339,6 +966,23 @@ int vidmix_alloc(struct vidmix **mixp)
 		goto out;
 	}
 
+	err = mtx_init(&mix->pool_mtx, mtx_plain) != thrd_success;
+	if (err) {
+		mtx_destroy(&mix->rwlock);
+		err = ENOMEM;
+		goto out;
+	}
+
+	err  = cnd_init(&mix->cond)      != thrd_success;
+	err |= cnd_init(&mix->job_cond)  != thrd_success;
+	err |= cnd_init(&mix->done_cond) != thrd_success;
+	if (err) {
+		mtx_destroy(&mix->rwlock);
+		mtx_destroy(&mix->pool_mtx);
+		err = ENOMEM;
+		goto out;
+	}
+
 	mix->fmt	 = VID_FMT_YUV420P;
 	mix->initialized = true;
 
@@ -385,7 +1029,6 @@ int vidmix_source_alloc(struct vidmix_source **srcp, struct vidmix *mix,
 			vidmix_frame_h *fh, void *arg)
 {
 	struct vidmix_source *src;
-	int err;
 
 	if (!srcp || !mix || !fps || !fh)
 		return EINVAL;
@@ -401,25 +1044,12 @@ int vidmix_source_alloc(struct vidmix_source **srcp, struct vidmix *mix,
 	src->arg     = arg;
 	src->pidx    = ++mix->next_pidx;
 
-	err = mutex_alloc(&src->mutex);
-	if (err)
-		goto out;
-
-	if (sz) {
-		err = vidframe_alloc(&src->frame_tx, mix->fmt, sz);
-		if (err)
-			goto out;
+	if (sz)
+		src->size = *sz;
 
-		clear_frame(src->frame_tx);
-	}
-
- out:
-	if (err)
-		mem_deref(src);
-	else
-		*srcp = src;
+	*srcp = src;
 
-	return err;
+	return 0;
 }
 
 
@@ -448,9 +1078,9 @@ bool vidmix_source_isrunning(const struct vidmix_source *src)
 	if (!src)
 		return false;
 
-	mtx_lock(src->mutex);
-	bool run = src->run;
-	mtx_unlock(src->mutex);
+	mtx_lock(&src->mix->rwlock);
+	bool run = src->rle.list != NULL;
+	mtx_unlock(&src->mix->rwlock);
 
 	return run;
 }
@@ -514,8 +1144,14 @@ void vidmix_source_enable(struct vidmix_source *src, bool enable)
 	mtx_lock(&src->mix->rwlock);
 
 	if (enable) {
-		if (src->frame_rx)
-			clear_frame(src->frame_rx);
+		/* the last frame is not shown again, composites may still
+		   reference it */
+		if (src->frame_rx) {
+			mem_deref(src->frame_put);
+			src->frame_put = src->frame_rx;
+			src->frame_rx  = NULL;
+			src->gen = ++src->mix->gen;
+		}
 
 		list_insert_sorted(&src->mix->srcl, sort_src_handler, NULL,
 				   &src->le, src);
@@ -529,7 +1165,10 @@ void vidmix_source_enable(struct vidmix_source *src, bool enable)
 
 
 /**
- * Start vidmix source thread
+ * Start vidmix source output
+ *
+ * All sources of a mixer are driven by one scheduler thread. Sources
+ * with the same layout and frame rate share one composed frame.
  *
  * @param src    Video mixer source
  *
@@ -537,55 +1176,95 @@ void vidmix_source_enable(struct vidmix_source *src, bool enable)
  */
 int vidmix_source_start(struct vidmix_source *src)
 {
-	int err;
+	struct vidmix *mix;
+	struct le *le;
+	int err = 0;
 
 	if (!src)
 		return EINVAL;
 
-	mtx_lock(src->mutex);
-	bool run = src->run;
-	mtx_unlock(src->mutex);
+	mix = src->mix;
 
-	if (run)
-		return EALREADY;
+	mtx_lock(&mix->rwlock);
 
-	mtx_lock(src->mutex);
-	src->run = true;
-	mtx_unlock(src->mutex);
+	if (src->rle.list) {
+		err = EALREADY;
+		goto out;
+	}
 
-	err = thread_create_name(&src->thread, "vidmix",
-				 src->content ? content_thread : vidmix_thread,
-				 src);
-	if (err) {
-		mtx_lock(src->mutex);
-		src->run = false;
-		mtx_unlock(src->mutex);
+	if (!mix->run) {
+		err = sched_start(mix);
+		if (err)
+			goto out;
+	}
+
+	/* same phase as a source with the same rate, to share composites */
+	src->ts  = tmr_jiffies_usec();
+	src->due = false;
+
+	LIST_FOREACH(&mix->runl, le) {
+
+		const struct vidmix_source *lsrc = le->data;
+
+		if (lsrc->fint == src->fint) {
+			src->ts = lsrc->ts;
+			break;
+		}
 	}
 
+	list_append(&mix->runl, &src->rle, src);
+	cnd_broadcast(&mix->cond);
+
+ out:
+	mtx_unlock(&mix->rwlock);
+
 	return err;
 }
 
 
+static bool source_busy(const struct vidmix *mix,
+			const struct vidmix_source *src)
+{
+	struct le *le;
+
+	LIST_FOREACH(&mix->curl, le) {
+
+		const struct vidmix_cur *cur = le->data;
+
+		if (cur->src == src && !thrd_equal(cur->thrd, thrd_current()))
+			return true;
+	}
+
+	return false;
+}
+
+
 /**
- * Stop vidmix source thread
+ * Stop vidmix source output
+ *
+ * The frame handler is not called after this function returns. The
+ * frame handlers of different sources run in parallel, so two frame
+ * handlers must not stop each other's source.
  *
  * @param src    Video mixer source
  */
 void vidmix_source_stop(struct vidmix_source *src)
 {
+	struct vidmix *mix;
+
 	if (!src)
 		return;
 
-	mtx_lock(src->mutex);
-	bool run = src->run;
-	mtx_unlock(src->mutex);
+	mix = src->mix;
 
-	if (run) {
-		mtx_lock(src->mutex);
-		src->run = false;
-		mtx_unlock(src->mutex);
-		thrd_join(src->thread, NULL);
-	}
+	mtx_lock(&mix->rwlock);
+
+	list_unlink(&src->rle);
+
+	while (source_busy(mix, src))
+		cnd_wait(&mix->cond, &mix->rwlock);
+
+	mtx_unlock(&mix->rwlock);
 }
 
 
@@ -599,25 +1278,12 @@ void vidmix_source_stop(struct vidmix_source *src)
  */
 int vidmix_source_set_size(struct vidmix_source *src, const struct vidsz *sz)
 {
-	struct vidframe *frame;
-	int err;
-
 	if (!src || !sz)
 		return EINVAL;
 
-	if (src->frame_tx && vidsz_cmp(&src->frame_tx->size, sz))
-		return 0;
-
-	err = vidframe_alloc(&frame, src->mix->fmt, sz);
-	if (err)
-		return err;
-
-	clear_frame(frame);
-
-	mtx_lock(src->mutex);
-	mem_deref(src->frame_tx);
-	src->frame_tx = frame;
-	mtx_unlock(src->mutex);
+	mtx_lock(&src->mix->rwlock);
+	src->size = *sz;
+	mtx_unlock(&src->mix->rwlock);
 
 	return 0;
 }
@@ -634,9 +1300,9 @@ void vidmix_source_set_rate(struct vidmix_source *src, unsigned fps)
 	if (!src || !fps)
 		return;
 
-	mtx_lock(src->mutex);
+	mtx_lock(&src->mix->rwlock);
 	src->fint = VIDEO_TIMEBASE/fps;
-	mtx_unlock(src->mutex);
+	mtx_unlock(&src->mix->rwlock);
 }
 
 
@@ -651,9 +1317,9 @@ void vidmix_source_set_content_hide(struct vidmix_source *src, bool hide)
 	if (!src)
 		return;
 
-	mtx_lock(src->mutex);
+	mtx_lock(&src->mix->rwlock);
 	src->content_hide = hide;
-	mtx_unlock(src->mutex);
+	mtx_unlock(&src->mix->rwlock);
 }
 
 
@@ -667,9 +1333,9 @@ void vidmix_source_toggle_selfview(struct vidmix_source *src)
 	if (!src)
 		return;
 
-	mtx_lock(src->mutex);
+	mtx_lock(&src->mix->rwlock);
 	src->selfview = !src->selfview;
-	mtx_unlock(src->mutex);
+	mtx_unlock(&src->mix->rwlock);
 }
 
 
@@ -687,10 +1353,10 @@ void vidmix_source_set_focus(struct vidmix_source *src,
 	if (!src)
 		return;
 
-	mtx_lock(src->mutex);
+	mtx_lock(&src->mix->rwlock);
 	src->focus_full = focus_full;
 	src->focus = (void *)focus_src;
-	mtx_unlock(src->mutex);
+	mtx_unlock(&src->mix->rwlock);
 }
 
 
@@ -708,12 +1374,12 @@ void vidmix_source_set_focus_idx(struct vidmix_source *src, uint32_t pidx)
 	if (!src)
 		return;
 
+	mtx_lock(&src->mix->rwlock);
+
 	if (pidx > 0) {
 
 		struct le *le;
 
-		mtx_lock(&src->mix->rwlock);
-
 		LIST_FOREACH(&src->mix->srcl, le) {
 			const struct vidmix_source *lsrc = le->data;
 
@@ -728,17 +1394,49 @@ void vidmix_source_set_focus_idx(struct vidmix_source *src, uint32_t pidx)
 				break;
 			}
 		}
-
-		mtx_unlock(&src->mix->rwlock);
 	}
 
 	if (focus && focus == src->focus)
 		focus_full = !src->focus_full;
 
-	mtx_lock(src->mutex);
 	src->focus_full = focus_full;
 	src->focus = focus;
-	mtx_unlock(src->mutex);
+
+	mtx_unlock(&src->mix->rwlock);
+}
+
+
+/**
+ * Video mixer debug handler, use with fmt %H
+ *
+ * @param pf  Print function
+ * @param mix Video mixer
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidmix_debug(struct re_printf *pf, const struct vidmix *mix)
+{
+	int err;
+
+	if (!mix)
+		return 0;
+
+	mtx_lock((mtx_t *)&mix->rwlock);
+
+	err = re_hprintf(pf, "vidmix: sources=%u running=%u composites=%u"
+			 " workers=%u\n",
+			 list_count(&mix->srcl), list_count(&mix->runl),
+			 list_count(&mix->compl), mix->workerc);
+	err |= re_hprintf(pf, " ticks=%llu composed=%llu delivered=%llu\n",
+			  mix->stats.ticks, mix->stats.composed,
+			  mix->stats.delivered);
+	err |= re_hprintf(pf, " redraws=%llu tiles drawn=%llu clean=%llu\n",
+			  mix->stats.redraws, mix->stats.drawn,
+			  mix->stats.clean);
+
+	mtx_unlock((mtx_t *)&mix->rwlock);
+
+	return err;
 }
 
 
@@ -750,27 +1448,32 @@ void vidmix_source_set_focus_idx(struct vidmix_source *src, uint32_t pidx)
  */
 void vidmix_source_put(struct vidmix_source *src, const struct vidframe *frame)
 {
+	struct vidframe *frm;
+
 	if (!src || !frame || frame->fmt != src->mix->fmt)
 		return;
 
-	if (!src->frame_rx || !vidsz_cmp(&src->frame_rx->size, &frame->size)) {
-
-		struct vidframe *frm;
-		int err;
-
-		err = vidframe_alloc(&frm, src->mix->fmt, &frame->size);
-		if (err)
-			return;
+	mtx_lock(&src->mix->rwlock);
+	frm = src->frame_put;
+	src->frame_put = NULL;
+	mtx_unlock(&src->mix->rwlock);
 
-		mtx_lock(&src->mix->rwlock);
+	/* the spare frame is reused once no composite references it */
+	if (!frm || mem_nrefs(frm) > 1 || frm->fmt != frame->fmt ||
+	    !vidsz_cmp(&frm->size, &frame->size)) {
 
-		mem_deref(src->frame_rx);
-		src->frame_rx = frm;
+		mem_deref(frm);
 
-		mtx_unlock(&src->mix->rwlock);
+		if (vidframe_alloc(&frm, frame->fmt, &frame->size))
+			return;
 	}
 
+	vidframe_copy(frm, frame);
+
 	mtx_lock(&src->mix->rwlock);
-	vidframe_copy(src->frame_rx, frame);
+	mem_deref(src->frame_put);
+	src->frame_put = src->frame_rx;
+	src->frame_rx  = frm;
+	src->gen = ++src->mix->gen;
 	mtx_unlock(&src->mix->rwlock);
 }
@@ -143,3 +143,32 @@ int aes_authenticate(struct aes *aes, const uint8_t *tag, size_t taglen)
 
 	return ENOSYS;
 }
+
+
+/**
+ * Encrypt or decrypt several AES-CTR segments
+ *
+ * @param aes  AES Context
+ * @param segv Array of segments
+ * @param segc Number of segments
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int aes_ctr_batch(struct aes *aes, const struct aes_seg *segv, size_t segc)
+{
+	int err;
+
+	if (!aes || (!segv && segc))
+		return EINVAL;
+
+	for (size_t i = 0; i < segc; i++) {
+
+		aes_set_iv(aes, segv[i].iv);
+
+		err = aes_encr(aes, segv[i].out, segv[i].in, segv[i].len);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
@@ -13,8 +13,14 @@
 #include <re_aes.h>
 
 
+enum {
+	KS_BLOCKS = 64,  /**< Keystream blocks per batch round */
+};
+
+
 struct aes {
 	EVP_CIPHER_CTX *ctx;
+	EVP_CIPHER_CTX *ecb;  /**< Keystream generator for CTR batches */
 	enum aes_mode mode;
 	bool encr;
 };
@@ -72,6 +78,36 @@ static void destructor(void *arg)
 
 	if (st->ctx)
 		EVP_CIPHER_CTX_free(st->ctx);
+	if (st->ecb)
+		EVP_CIPHER_CTX_free(st->ecb);
+}
+
+
+static int ecb_alloc(struct aes *st, const uint8_t *key, size_t key_bits)
+{
+	const EVP_CIPHER *cipher;
+
+	switch (key_bits) {
+
+	case 128: cipher = EVP_aes_128_ecb(); break;
+	case 256: cipher = EVP_aes_256_ecb(); break;
+	default:
+		return ENOTSUP;
+	}
+
+	st->ecb = EVP_CIPHER_CTX_new();
+	if (!st->ecb) {
+		ERR_clear_error();
+		return ENOMEM;
+	}
+
+	if (!EVP_EncryptInit_ex(st->ecb, cipher, NULL, key, NULL) ||
+	    !EVP_CIPHER_CTX_set_padding(st->ecb, 0)) {
+		ERR_clear_error();
+		return EPROTO;
+	}
+
+	return 0;
 }
 
 
@@ -108,8 +144,12 @@ int aes_alloc(struct aes **aesp, enum aes_mode mode,
 	if (!r) {
 		ERR_clear_error();
 		err = EPROTO;
+		goto out;
 	}
 
+	if (mode == AES_MODE_CTR)
+		err = ecb_alloc(st, key, key_bits);
+
  out:
 	if (err)
 		mem_deref(st);
@@ -247,3 +287,123 @@ int aes_authenticate(struct aes *aes, const uint8_t *tag, size_t taglen)
 		return ENOTSUP;
 	}
 }
+
+
+static inline void ctr_inc(uint8_t *ctr)
+{
+	for (int i = AES_BLOCK_SIZE - 1; i >= 0; i--) {
+		if (++ctr[i])
+			break;
+	}
+}
+
+
+static inline void ks_xor(uint8_t *out, const uint8_t *in,
+			  const uint8_t *ks, size_t len)
+{
+	uint64_t a, b;
+
+	for (; len >= 8; len -= 8, out += 8, in += 8, ks += 8) {
+		memcpy(&a, in, 8);
+		memcpy(&b, ks, 8);
+		a ^= b;
+		memcpy(out, &a, 8);
+	}
+
+	while (len--)
+		*out++ = *in++ ^ *ks++;
+}
+
+
+/**
+ * Encrypt or decrypt several AES-CTR segments
+ *
+ * The counter blocks of all segments are encrypted together, so the
+ * cipher runs over many blocks per call even for short segments like
+ * RTP packets. Each counter block is a 128-bit big-endian integer
+ * incremented per block, as in aes_encr().
+ *
+ * @param aes  AES Context
+ * @param segv Array of segments
+ * @param segc Number of segments
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int aes_ctr_batch(struct aes *aes, const struct aes_seg *segv, size_t segc)
+{
+	uint8_t ks[KS_BLOCKS * AES_BLOCK_SIZE];
+	uint8_t ctr[AES_BLOCK_SIZE];
+	const struct aes_seg *seg = segv, *end = segv + segc;
+	size_t off = 0;
+
+	if (!aes || (!segv && segc))
+		return EINVAL;
+
+	if (!aes->ecb)
+		return ENOTSUP;
+
+	while (seg < end) {
+
+		struct {
+			const struct aes_seg *seg;
+			size_t off;
+			size_t len;
+		} chv[KS_BLOCKS];
+		size_t chc = 0, nb = 0;
+		const uint8_t *k = ks;
+		int len;
+
+		/* fill the keystream buffer with counter blocks */
+		while (seg < end && nb < KS_BLOCKS) {
+
+			size_t n, blocks;
+
+			if (off == seg->len) {
+				++seg;
+				off = 0;
+				continue;
+			}
+
+			if (off == 0)
+				memcpy(ctr, seg->iv, sizeof(ctr));
+
+			n = min(seg->len - off,
+				(KS_BLOCKS - nb) * AES_BLOCK_SIZE);
+			blocks = (n + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE;
+
+			for (size_t i = 0; i < blocks; i++) {
+				memcpy(&ks[(nb + i) * AES_BLOCK_SIZE], ctr,
+				       AES_BLOCK_SIZE);
+				ctr_inc(ctr);
+			}
+
+			chv[chc].seg = seg;
+			chv[chc].off = off;
+			chv[chc].len = n;
+			++chc;
+
+			nb  += blocks;
+			off += n;
+		}
+
+		if (!nb)
+			break;
+
+		if (!EVP_EncryptUpdate(aes->ecb, ks, &len, ks,
+				       (int)(nb * AES_BLOCK_SIZE))) {
+			ERR_clear_error();
+			return EPROTO;
+		}
+
+		for (size_t i = 0; i < chc; i++) {
+
+			ks_xor(chv[i].seg->out + chv[i].off,
+			       chv[i].seg->in + chv[i].off, k, chv[i].len);
+
+			k += (chv[i].len + AES_BLOCK_SIZE - 1) &
+				~(size_t)(AES_BLOCK_SIZE - 1);
+		}
+	}
+
+	return 0;
+}
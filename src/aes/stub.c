@@ -65,3 +65,12 @@ int aes_authenticate(struct aes *aes, const uint8_t *tag, size_t taglen)
 
 	return ENOSYS;
 }
+
+
+int aes_ctr_batch(struct aes *aes, const struct aes_seg *segv, size_t segc)
+{
+	(void)aes;
+	(void)segv;
+	(void)segc;
+	return ENOSYS;
+}
@@ -262,7 +262,7 @@ static int reply_recv(struct dnsc *dnsc, struct mbuf *mb)
 	dq.type     = ntohs(mbuf_read_u16(mb));
 	dq.dnsclass = ntohs(mbuf_read_u16(mb));
 
-	q = list_ledata(hash_lookup(dnsc->ht_query, hash_joaat_str_ci(dq.name),
+	q = list_ledata(hash_lookup(dnsc->ht_query, hash_wyhash_str_ci(dq.name),
 				    query_cmp_handler, &dq));
 	if (!q) {
 		err = ENOENT;
@@ -355,7 +355,7 @@ static int reply_recv(struct dnsc *dnsc, struct mbuf *mb)
 	}
 
 	/* Cache DNS query with TTL timeout */
-	hash_append(dnsc->ht_query_cache, hash_joaat_str_ci(q->name), &q->le,
+	hash_append(dnsc->ht_query_cache, hash_wyhash_str_ci(q->name), &q->le,
 		    q);
 	DEBUG_INFO("cache %s. (id: %d) %d secs\n", q->name, q->id, ttl);
 	/* Fallback to 100ms for faster unit tests */
@@ -753,7 +753,7 @@ static bool query_cache_handler(struct dns_query *q)
 	dq.cache    = true;
 
 	qc = list_ledata(hash_lookup(q->dnsc->ht_query_cache,
-				     hash_joaat_str_ci(q->name),
+				     hash_wyhash_str_ci(q->name),
 				     query_cmp_handler, &dq));
 	if (!qc)
 		return false;
@@ -874,7 +874,7 @@ static void getaddrinfo_h(int err, void *arg)
 	struct dns_query *q;
 
 	q = list_ledata(hash_lookup(dq->dnsc->ht_query,
-				    hash_joaat_str_ci(dq->name),
+				    hash_wyhash_str_ci(dq->name),
 				    query_cmp_handler, dq));
 	if (!q) {
 		DEBUG_WARNING("getaddrinfo_h: no query found\n");
@@ -909,7 +909,7 @@ static void getaddrinfo_h(int err, void *arg)
 		goto out;
 	}
 
-	hash_append(q->dnsc->ht_query_cache, hash_joaat_str_ci(q->name),
+	hash_append(q->dnsc->ht_query_cache, hash_wyhash_str_ci(q->name),
 		    &q->le, q);
 	tmr_start(&q->tmr_ttl, GETADDRINFO_TTL * 1000, ttl_timeout_handler, q);
 
@@ -993,7 +993,7 @@ static int query(struct dns_query **qp, struct dnsc *dnsc, uint8_t opcode,
 	if (!q)
 		goto nmerr;
 
-	hash_append(dnsc->ht_query, hash_joaat_str_ci(name), &q->le, q);
+	hash_append(dnsc->ht_query, hash_wyhash_str_ci(name), &q->le, q);
 	tmr_init(&q->tmr);
 	tmr_init(&q->tmr_ttl);
 	mbuf_init(&q->mb);
@@ -1209,6 +1209,14 @@ static void dnsc_destructor(void *data)
 }
 
 
+static uint32_t query_cache_key(struct le *le)
+{
+	const struct dns_query *q = le->data;
+
+	return hash_wyhash_str_ci(q->name);
+}
+
+
 /**
  * Allocate a DNS Client
  *
@@ -1260,6 +1268,10 @@ int dnsc_alloc(struct dnsc **dcpp, const struct dnsc_conf *conf,
 	if (err)
 		goto out;
 
+	err = hash_grow_set(dnsc->ht_query_cache, query_cache_key);
+	if (err)
+		goto out;
+
 	err = hash_alloc(&dnsc->ht_tcpconn, dnsc->conf.tcp_hash_size);
 	if (err)
 		goto out;
@@ -1315,6 +1327,10 @@ int dnsc_conf_set(struct dnsc *dnsc, const struct dnsc_conf *conf)
 	if (err)
 		return err;
 
+	err = hash_grow_set(dnsc->ht_query_cache, query_cache_key);
+	if (err)
+		return err;
+
 	err = hash_alloc(&dnsc->ht_tcpconn, dnsc->conf.tcp_hash_size);
 	return err;
 }
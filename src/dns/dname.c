@@ -50,7 +50,7 @@ static void dname_append(struct hash *ht_dname, const char *name, size_t pos)
 		return;
 	}
 
-	hash_append(ht_dname, hash_joaat_str_ci(name), &dn->he, dn);
+	hash_append(ht_dname, hash_wyhash_str_ci(name), &dn->he, dn);
 	dn->pos = pos;
 }
 
@@ -66,7 +66,7 @@ static bool lookup_handler(struct le *le, void *arg)
 static inline struct dname *dname_lookup(struct hash *ht_dname,
 					 const char *name)
 {
-	return list_ledata(hash_lookup(ht_dname, hash_joaat_str_ci(name),
+	return list_ledata(hash_lookup(ht_dname, hash_wyhash_str_ci(name),
 				       lookup_handler, (void *)name));
 }
 
@@ -4,6 +4,7 @@
  * Copyright (C) 2010 Creytiv.com
  */
 #include <ctype.h>
+#include <string.h>
 #include <re_types.h>
 #include <re_fmt.h>
 #include <re_list.h>
@@ -185,3 +186,244 @@ uint32_t hash_fast_str(const char *str)
 
 	return h;
 }
+
+
+/*
+ * wyhash (final4) by Wang Yi, public domain.
+ *
+ * Reads the key a word at a time. The case-insensitive variant folds
+ * ASCII 'A'-'Z' in each word before mixing, so the _ci hash of a string
+ * equals the plain hash of its ASCII-lowercase form. Words are loaded in
+ * host byte order; the values must never be put on the wire.
+ */
+
+static const uint64_t wysecret[4] = {
+	UINT64_C(0xa0761d6478bd642f), UINT64_C(0xe7037ed1a0b428db),
+	UINT64_C(0x8ebc6af09c88c6e3), UINT64_C(0x589965cc75374cc3)
+};
+
+
+static inline void wymum(uint64_t *a, uint64_t *b)
+{
+#ifdef __SIZEOF_INT128__
+	__uint128_t r = *a;
+
+	r *= *b;
+	*a = (uint64_t)r;
+	*b = (uint64_t)(r >> 64);
+#else
+	uint64_t ha = *a >> 32, hb = *b >> 32;
+	uint64_t la = (uint32_t)*a, lb = (uint32_t)*b;
+	uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	uint64_t t = rl + (rm0 << 32), c = t < rl, lo;
+
+	lo = t + (rm1 << 32);
+	c += lo < t;
+	*a = lo;
+	*b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+
+static inline uint64_t wymix(uint64_t a, uint64_t b)
+{
+	wymum(&a, &b);
+
+	return a ^ b;
+}
+
+
+/* ASCII lowercase of all eight bytes, bytes >= 0x80 are left as is */
+static inline uint64_t wylower(uint64_t v)
+{
+	const uint64_t ones = UINT64_C(0x0101010101010101);
+	uint64_t h = v & (0x7f * ones);
+	uint64_t a = h + (0x80 - 'A') * ones;
+	uint64_t z = h + (0x80 - 'Z' - 1) * ones;
+
+	return v | (((a ^ z) & ~v & (0x80 * ones)) >> 2);
+}
+
+
+static inline uint64_t wyr8(const uint8_t *p, bool ci)
+{
+	uint64_t v;
+
+	memcpy(&v, p, 8);
+
+	return ci ? wylower(v) : v;
+}
+
+
+static inline uint64_t wyr4(const uint8_t *p, bool ci)
+{
+	uint32_t v;
+
+	memcpy(&v, p, 4);
+
+	return ci ? (uint32_t)wylower(v) : v;
+}
+
+
+static inline uint64_t wyr1(const uint8_t *p, bool ci)
+{
+	return ci ? (uint8_t)wylower(*p) : *p;
+}
+
+
+static inline uint32_t wyhash(const uint8_t *p, size_t len, bool ci)
+{
+	uint64_t seed = wymix(wysecret[0], wysecret[1]);
+	uint64_t a, b;
+
+	if (len <= 16) {
+		if (len >= 4) {
+			size_t d = (len >> 3) << 2;
+
+			a = wyr4(p, ci) << 32 | wyr4(p + d, ci);
+			b = wyr4(p + len - 4, ci) << 32 |
+				wyr4(p + len - 4 - d, ci);
+		}
+		else if (len > 0) {
+			a = wyr1(p, ci) << 16 | wyr1(p + (len >> 1), ci) << 8 |
+				wyr1(p + len - 1, ci);
+			b = 0;
+		}
+		else {
+			a = b = 0;
+		}
+	}
+	else {
+		size_t i = len;
+
+		if (i >= 48) {
+			uint64_t see1 = seed, see2 = seed;
+
+			do {
+				seed = wymix(wyr8(p, ci) ^ wysecret[1],
+					     wyr8(p + 8, ci) ^ seed);
+				see1 = wymix(wyr8(p + 16, ci) ^ wysecret[2],
+					     wyr8(p + 24, ci) ^ see1);
+				see2 = wymix(wyr8(p + 32, ci) ^ wysecret[3],
+					     wyr8(p + 40, ci) ^ see2);
+				p += 48;
+				i -= 48;
+			} while (i >= 48);
+
+			seed ^= see1 ^ see2;
+		}
+
+		while (i > 16) {
+			seed = wymix(wyr8(p, ci) ^ wysecret[1],
+				     wyr8(p + 8, ci) ^ seed);
+			i -= 16;
+			p += 16;
+		}
+
+		a = wyr8(p + i - 16, ci);
+		b = wyr8(p + i - 8, ci);
+	}
+
+	a ^= wysecret[1];
+	b ^= seed;
+	wymum(&a, &b);
+
+	a = wymix(a ^ wysecret[0] ^ len, b ^ wysecret[1]);
+
+	return (uint32_t)(a ^ a >> 32);
+}
+
+
+/**
+ * Calculate hash-value using the word-at-a-time wyhash algorithm.
+ *
+ * The value depends on the host byte order and must only be used for
+ * in-memory tables, use hash_joaat() for values that are exchanged.
+ *
+ * @param key  Pointer to key
+ * @param len  Key length
+ *
+ * @return Calculated hash-value
+ */
+uint32_t hash_wyhash(const uint8_t *key, size_t len)
+{
+	if (!key)
+		return 0;
+
+	return wyhash(key, len, false);
+}
+
+
+/**
+ * Calculate wyhash hash-value for a case-insensitive string
+ *
+ * @param str  String
+ * @param len  Length of string
+ *
+ * @return Calculated hash-value
+ */
+uint32_t hash_wyhash_ci(const char *str, size_t len)
+{
+	if (!str)
+		return 0;
+
+	return wyhash((const uint8_t *)str, len, true);
+}
+
+
+/**
+ * Calculate wyhash hash-value for a NULL-terminated string
+ *
+ * @param str  String
+ *
+ * @return Calculated hash-value
+ */
+uint32_t hash_wyhash_str(const char *str)
+{
+	if (!str)
+		return 0;
+
+	return wyhash((const uint8_t *)str, strlen(str), false);
+}
+
+
+/**
+ * Calculate wyhash hash-value for a case-insensitive NULL-terminated string
+ *
+ * @param str  String
+ *
+ * @return Calculated hash-value
+ */
+uint32_t hash_wyhash_str_ci(const char *str)
+{
+	if (!str)
+		return 0;
+
+	return wyhash((const uint8_t *)str, strlen(str), true);
+}
+
+
+/**
+ * Calculate wyhash hash-value for a pointer-length object
+ *
+ * @param pl Pointer-length object
+ *
+ * @return Calculated hash-value
+ */
+uint32_t hash_wyhash_pl(const struct pl *pl)
+{
+	return pl ? hash_wyhash((const uint8_t *)pl->p, pl->l) : 0;
+}
+
+
+/**
+ * Calculate wyhash hash-value for a case-insensitive pointer-length object
+ *
+ * @param pl Pointer-length object
+ *
+ * @return Calculated hash-value
+ */
+uint32_t hash_wyhash_pl_ci(const struct pl *pl)
+{
+	return pl ? hash_wyhash_ci(pl->p, pl->l) : 0;
+}
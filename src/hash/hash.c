@@ -11,10 +11,28 @@
 #include <re_hash.h>
 
 
+enum {
+	HASH_LOAD_MAX     = 2,        /**< Max. entries per bucket      */
+	HASH_REHASH_STEP  = 4,        /**< Old buckets moved per append */
+	HASH_BSIZE_MAX    = 1u << 20, /**< Max. size of growable table  */
+	HASH_CHAIN_HIST   = 8,        /**< Chain length histogram size  */
+};
+
+
 /** Defines a hashmap table */
 struct hash {
 	struct list *bucket;  /**< Bucket with linked lists */
 	uint32_t bsize;       /**< Bucket size              */
+
+	/* growable tables */
+	hash_key_h *keyh;     /**< Key of an element, NULL if fixed size */
+	struct list *old;     /**< Buckets being rehashed, or NULL       */
+	uint32_t old_bsize;   /**< Size of old buckets                   */
+	uint32_t rehashidx;   /**< Next old bucket to move               */
+	uint32_t nlast;       /**< Number of entries at last count       */
+	uint32_t nappend;     /**< Appends since last count              */
+	uint32_t resizes;     /**< Number of times the table has grown   */
+	uint32_t iter;        /**< Number of active hash_apply() calls   */
 };
 
 
@@ -23,6 +41,95 @@ static void hash_destructor(void *data)
 	struct hash *h = data;
 
 	mem_deref(h->bucket);
+	mem_deref(h->old);
+}
+
+
+/*
+ * Buckets below rehashidx have been moved to the new table, so every
+ * element is in exactly one list for its key.
+ */
+static inline struct list *bucket_get(const struct hash *h, uint32_t key)
+{
+	if (h->old) {
+		uint32_t i = key & (h->old_bsize - 1);
+
+		if (i >= h->rehashidx)
+			return &h->old[i];
+	}
+
+	return &h->bucket[key & (h->bsize - 1)];
+}
+
+
+static uint32_t hash_count(const struct hash *h)
+{
+	uint32_t i, n = 0;
+
+	for (i=0; i<h->bsize; i++)
+		n += (uint32_t)list_count(&h->bucket[i]);
+
+	for (i=h->rehashidx; h->old && i<h->old_bsize; i++)
+		n += (uint32_t)list_count(&h->old[i]);
+
+	return n;
+}
+
+
+static void rehash_step(struct hash *h, uint32_t n)
+{
+	while (n-- && h->rehashidx < h->old_bsize) {
+
+		struct list *lst = &h->old[h->rehashidx++];
+		struct le *le;
+
+		while ((le = list_head(lst))) {
+
+			void *data = le->data;
+
+			list_unlink(le);
+			list_append(&h->bucket[h->keyh(le) & (h->bsize - 1)],
+				    le, data);
+		}
+	}
+
+	if (h->rehashidx < h->old_bsize)
+		return;
+
+	h->old = mem_deref(h->old);
+	h->old_bsize = 0;
+	h->rehashidx = 0;
+}
+
+
+static void grow(struct hash *h)
+{
+	struct list *bucket;
+	uint32_t n;
+
+	if (h->nlast + ++h->nappend <= HASH_LOAD_MAX * h->bsize)
+		return;
+
+	/* the estimate is an upper bound, count the entries */
+	n = hash_count(h);
+
+	h->nlast   = n;
+	h->nappend = 0;
+
+	if (n <= HASH_LOAD_MAX * h->bsize || h->bsize >= HASH_BSIZE_MAX)
+		return;
+
+	bucket = mem_zalloc(2 * h->bsize * sizeof(*bucket), NULL);
+	if (!bucket)
+		return;
+
+	h->old       = h->bucket;
+	h->old_bsize = h->bsize;
+	h->rehashidx = 0;
+	h->bucket    = bucket;
+	h->bsize    *= 2;
+
+	++h->resizes;
 }
 
 
@@ -81,7 +188,44 @@ void hash_append(struct hash *h, uint32_t key, struct le *le, void *data)
 	if (!h || !le)
 		return;
 
-	list_append(&h->bucket[key & (h->bsize-1)], le, data);
+	if (h->keyh && !h->iter) {
+		if (h->old)
+			rehash_step(h, HASH_REHASH_STEP);
+		else
+			grow(h);
+	}
+
+	list_append(bucket_get(h, key), le, data);
+}
+
+
+/**
+ * Let a hashmap table grow with the number of entries. When the average
+ * chain length exceeds a fixed load factor, the bucket array is doubled
+ * and the entries are moved incrementally, a few buckets on each
+ * hash_append(), so no single call stalls. The key handler must return
+ * the same key that the element was appended with.
+ *
+ * While a table is being rehashed, hash_bsize() and hash_list_idx() cover
+ * both the old and the new buckets.
+ *
+ * @param h    Hashmap table
+ * @param keyh Key handler, NULL to keep the current size
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int hash_grow_set(struct hash *h, hash_key_h *keyh)
+{
+	if (!h)
+		return EINVAL;
+
+	/* finish a pending rehash with the current key handler */
+	if (!keyh && h->old)
+		rehash_step(h, h->old_bsize);
+
+	h->keyh = keyh;
+
+	return 0;
 }
 
 
@@ -112,7 +256,7 @@ struct le *hash_lookup(const struct hash *h, uint32_t key, list_apply_h *ah,
 	if (!h || !ah)
 		return NULL;
 
-	return list_apply(&h->bucket[key & (h->bsize-1)], true, ah, arg);
+	return list_apply(bucket_get(h, key), true, ah, arg);
 }
 
 
@@ -127,15 +271,23 @@ struct le *hash_lookup(const struct hash *h, uint32_t key, list_apply_h *ah,
  */
 struct le *hash_apply(const struct hash *h, list_apply_h *ah, void *arg)
 {
+	struct hash *hm = (struct hash *)h;  /* pause rehashing */
 	struct le *le = NULL;
 	uint32_t i;
 
 	if (!h || !ah)
 		return NULL;
 
+	++hm->iter;
+
+	for (i=h->rehashidx; h->old && (i<h->old_bsize) && !le; i++)
+		le = list_apply(&h->old[i], true, ah, arg);
+
 	for (i=0; (i<h->bsize) && !le; i++)
 		le = list_apply(&h->bucket[i], true, ah, arg);
 
+	--hm->iter;
+
 	return le;
 }
 
@@ -150,7 +302,17 @@ struct le *hash_apply(const struct hash *h, list_apply_h *ah, void *arg)
  */
 struct list *hash_list_idx(const struct hash *h, uint32_t i)
 {
-	if (!h || i >= h->bsize)
+	if (!h)
+		return NULL;
+
+	if (h->old) {
+		if (i < h->old_bsize)
+			return &h->old[i];
+
+		i -= h->old_bsize;
+	}
+
+	if (i >= h->bsize)
 		return NULL;
 
 	return &h->bucket[i];
@@ -167,7 +329,7 @@ struct list *hash_list_idx(const struct hash *h, uint32_t i)
  */
 struct list *hash_list(const struct hash *h, uint32_t key)
 {
-	return h ? &h->bucket[key & (h->bsize - 1)] : NULL;
+	return h ? bucket_get(h, key) : NULL;
 }
 
 
@@ -180,7 +342,7 @@ struct list *hash_list(const struct hash *h, uint32_t key)
  */
 uint32_t hash_bsize(const struct hash *h)
 {
-	return h ? h->bsize : 0;
+	return h ? h->bsize + h->old_bsize : 0;
 }
 
 
@@ -196,6 +358,9 @@ void hash_flush(struct hash *h)
 	if (!h)
 		return;
 
+	for (i=h->rehashidx; h->old && i<h->old_bsize; i++)
+		list_flush(&h->old[i]);
+
 	for (i=0; i<h->bsize; i++)
 		list_flush(&h->bucket[i]);
 }
@@ -213,6 +378,9 @@ void hash_clear(struct hash *h)
 	if (!h)
 		return;
 
+	for (i=h->rehashidx; h->old && i<h->old_bsize; i++)
+		list_clear(&h->old[i]);
+
 	for (i=0; i<h->bsize; i++)
 		list_clear(&h->bucket[i]);
 }
@@ -237,7 +405,7 @@ uint32_t hash_valid_size(uint32_t size)
 
 
 /**
- * Debug Hashmap table
+ * Debug Hashmap table, with chain length statistics
  *
  * @param pf  Print handler where debug output is printed to
  * @param h   Hashmap table
@@ -246,24 +414,52 @@ uint32_t hash_valid_size(uint32_t size)
  */
 int hash_debug(struct re_printf *pf, struct hash *h)
 {
+	uint32_t hist[HASH_CHAIN_HIST] = {0};
+	uint32_t n = 0, used = 0, maxc = 0;
+	uint32_t bsize;
 	int err;
 
 	if (!h)
 		return EINVAL;
 
-	err = re_hprintf(pf, "hash (bsize %u) list entries:\n", h->bsize);
-	for (uint32_t i = 0; i < h->bsize; i++) {
-		struct le *he = hash_list_idx(h, i)->head;
+	bsize = hash_bsize(h);
 
-		if (!he)
-			continue;
+	err = re_hprintf(pf, "hash (bsize %u) list entries:\n", bsize);
+	for (uint32_t i = 0; i < bsize; i++) {
+		uint32_t c = (uint32_t)list_count(hash_list_idx(h, i));
 
-		uint32_t c = list_count(he->list);
 		if (!c)
 			continue;
 
+		n += c;
+		++used;
+		maxc = max(maxc, c);
+		++hist[min(c, HASH_CHAIN_HIST) - 1];
+
 		err |= re_hprintf(pf, "  [%u]: %u\n", i, c);
 	}
 
+	err |= re_hprintf(pf, "  entries %u, load %u.%02u, used buckets %u,"
+			  " chain avg %u.%02u max %u\n",
+			  n, n / bsize, 100 * n / bsize % 100, used,
+			  used ? n / used : 0, used ? 100 * n / used % 100 : 0,
+			  maxc);
+
+	err |= re_hprintf(pf, "  chain length:");
+	for (uint32_t i = 0; i < HASH_CHAIN_HIST; i++) {
+		err |= re_hprintf(pf, " %s%u:%u",
+				  i == HASH_CHAIN_HIST - 1 ? ">=" : "",
+				  i + 1, hist[i]);
+	}
+	err |= re_hprintf(pf, "\n");
+
+	if (h->keyh) {
+		err |= re_hprintf(pf, "  growable: resizes %u", h->resizes);
+		if (h->old)
+			err |= re_hprintf(pf, ", rehashing %u/%u",
+					  h->rehashidx, h->old_bsize);
+		err |= re_hprintf(pf, "\n");
+	}
+
 	return err;
 }
@@ -7,16 +7,25 @@
 
 #include <openssl/hmac.h>
 #include <openssl/err.h>
+#if OPENSSL_VERSION_MAJOR >= 3
+#include <openssl/core_names.h>
+#endif
 #include <string.h>
 #include <re_types.h>
 #include <re_mem.h>
 #include <re_hmac.h>
 
 
+/*
+ * The context is keyed once, so every digest starts from the saved
+ * inner/outer hash states instead of hashing the padded key again.
+ */
 struct hmac {
-	const EVP_MD *evp;
-	uint8_t *key;
-	int key_len;
+#if OPENSSL_VERSION_MAJOR >= 3
+	EVP_MAC_CTX *ctx;
+#else
+	HMAC_CTX *ctx;
+#endif
 };
 
 
@@ -24,47 +33,99 @@ static void destructor(void *arg)
 {
 	struct hmac *hmac = arg;
 
-	mem_deref(hmac->key);
+#if OPENSSL_VERSION_MAJOR >= 3
+	EVP_MAC_CTX_free(hmac->ctx);
+#else
+	HMAC_CTX_free(hmac->ctx);
+#endif
 }
 
 
-int hmac_create(struct hmac **hmacp, enum hmac_hash hash, const uint8_t *key,
-		size_t key_len)
+#if OPENSSL_VERSION_MAJOR >= 3
+static int ctx_init(struct hmac *hmac, const char *digest,
+		    const uint8_t *key, size_t key_len)
 {
-	struct hmac *hmac;
+	OSSL_PARAM params[2];
+	EVP_MAC *mac;
 	int err = 0;
 
-	if (!hmacp || !key || !key_len)
-		return EINVAL;
+	mac = EVP_MAC_fetch(NULL, "HMAC", NULL);
+	if (!mac) {
+		ERR_clear_error();
+		return ENOTSUP;
+	}
 
-	hmac = mem_zalloc(sizeof(*hmac), destructor);
-	if (!hmac)
+	hmac->ctx = EVP_MAC_CTX_new(mac);
+	EVP_MAC_free(mac);
+	if (!hmac->ctx) {
+		ERR_clear_error();
 		return ENOMEM;
+	}
 
-	hmac->key = mem_zalloc(key_len, NULL);
-	if (!hmac->key) {
-		err = ENOMEM;
-		goto error;
+	params[0] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+						     (char *)digest, 0);
+	params[1] = OSSL_PARAM_construct_end();
+
+	if (!EVP_MAC_init(hmac->ctx, key, key_len, params)) {
+		ERR_clear_error();
+		err = EPROTO;
+	}
+
+	return err;
+}
+#else
+static int ctx_init(struct hmac *hmac, const char *digest,
+		    const uint8_t *key, size_t key_len)
+{
+	hmac->ctx = HMAC_CTX_new();
+	if (!hmac->ctx) {
+		ERR_clear_error();
+		return ENOMEM;
 	}
 
-	memcpy(hmac->key, key, key_len);
-	hmac->key_len = (int)key_len;
+	if (!HMAC_Init_ex(hmac->ctx, key, (int)key_len,
+			  EVP_get_digestbyname(digest), NULL)) {
+		ERR_clear_error();
+		return EPROTO;
+	}
+
+	return 0;
+}
+#endif
+
+
+int hmac_create(struct hmac **hmacp, enum hmac_hash hash, const uint8_t *key,
+		size_t key_len)
+{
+	struct hmac *hmac;
+	const char *digest;
+	int err = 0;
+
+	if (!hmacp || !key || !key_len)
+		return EINVAL;
 
 	switch (hash) {
 
 	case HMAC_HASH_SHA1:
-		hmac->evp = EVP_sha1();
+		digest = "SHA1";
 		break;
 
 	case HMAC_HASH_SHA256:
-		hmac->evp = EVP_sha256();
+		digest = "SHA256";
 		break;
 
 	default:
-		err = ENOTSUP;
-		goto error;
+		return ENOTSUP;
 	}
 
+	hmac = mem_zalloc(sizeof(*hmac), destructor);
+	if (!hmac)
+		return ENOMEM;
+
+	err = ctx_init(hmac, digest, key, key_len);
+	if (err)
+		goto error;
+
 	*hmacp = hmac;
 
 	return 0;
@@ -78,18 +139,33 @@ error:
 int hmac_digest(struct hmac *hmac, uint8_t *md, size_t md_len,
 		const uint8_t *data, size_t data_len)
 {
-	unsigned int len = (unsigned int)md_len;
-	unsigned char *rval;
+#if OPENSSL_VERSION_MAJOR >= 3
+	size_t len;
+#else
+	unsigned int len;
+#endif
+	uint8_t buf[EVP_MAX_MD_SIZE];
 
 	if (!hmac || !md || !md_len || !data || !data_len)
 		return EINVAL;
 
-	rval = HMAC(hmac->evp, hmac->key, hmac->key_len, data, data_len, md,
-		    &len);
-	if (!rval) {
+#if OPENSSL_VERSION_MAJOR >= 3
+	if (!EVP_MAC_init(hmac->ctx, NULL, 0, NULL) ||
+	    !EVP_MAC_update(hmac->ctx, data, data_len) ||
+	    !EVP_MAC_final(hmac->ctx, buf, &len, sizeof(buf))) {
+		ERR_clear_error();
+		return EPROTO;
+	}
+#else
+	if (!HMAC_Init_ex(hmac->ctx, NULL, 0, NULL, NULL) ||
+	    !HMAC_Update(hmac->ctx, data, data_len) ||
+	    !HMAC_Final(hmac->ctx, buf, &len)) {
 		ERR_clear_error();
 		return EPROTO;
 	}
+#endif
+
+	memcpy(md, buf, min((size_t)len, md_len));
 
 	return 0;
 }
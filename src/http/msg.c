@@ -4,6 +4,7 @@
  * Copyright (C) 2010 Creytiv.com
  */
 #include <re_types.h>
+#include <re_atomic.h>
 #include <re_mem.h>
 #include <re_mbuf.h>
 #include <re_sa.h>
@@ -16,9 +17,13 @@
 
 enum {
 	STARTLINE_MAX = 8192,
+	ARENA_SIZE    = 16384,  /* includes the 8K body buffer */
 };
 
 
+static RE_ATOMIC bool msg_arena;
+
+
 static void hdr_destructor(void *arg)
 {
 	struct http_hdr *hdr = arg;
@@ -142,9 +147,10 @@ static inline int hdr_add(struct http_msg *msg, const struct pl *name,
  */
 int http_msg_decode(struct http_msg **msgp, struct mbuf *mb, bool req)
 {
+	struct mem_arena *arena = NULL;
 	struct pl b, s, e, name, scode;
 	const char *p, *cv;
-	struct http_msg *msg;
+	struct http_msg *msg = NULL;
 	bool comsep, quote;
 	enum http_hdrid id = HTTP_HDR_NONE;
 	uint32_t ws, lf;
@@ -160,9 +166,19 @@ int http_msg_decode(struct http_msg **msgp, struct mbuf *mb, bool req)
 	if (re_regex(p, l, "[\r\n]*[^\r\n]+[\r]*[\n]1", &b, &s, NULL, &e))
 		return (l > STARTLINE_MAX) ? EBADMSG : ENODATA;
 
+	if (re_atomic_rlx(&msg_arena)) {
+		err = mem_arena_alloc(&arena, ARENA_SIZE);
+		if (err)
+			return err;
+
+		mem_arena_enter(arena);
+	}
+
 	msg = mem_zalloc(sizeof(*msg), destructor);
-	if (!msg)
-		return ENOMEM;
+	if (!msg) {
+		err = ENOMEM;
+		goto out;
+	}
 
 	msg->_mb = mem_ref(mb);
 
@@ -297,6 +313,11 @@ int http_msg_decode(struct http_msg **msgp, struct mbuf *mb, bool req)
 	err = ENODATA;
 
  out:
+	if (arena) {
+		mem_arena_leave();
+		mem_deref(arena);
+	}
+
 	if (err)
 		mem_deref(msg);
 	else {
@@ -308,6 +329,19 @@ int http_msg_decode(struct http_msg **msgp, struct mbuf *mb, bool req)
 }
 
 
+/**
+ * Enable or disable arena allocation for decoded HTTP messages. All objects
+ * of a message are then allocated from one memory arena, which is freed
+ * when the message is dereferenced.
+ *
+ * @param enable True to enable, false to disable
+ */
+void http_msg_arena_set(bool enable)
+{
+	re_atomic_rlx_set(&msg_arena, enable);
+}
+
+
 /**
  * Get a HTTP Header from a HTTP Message
  *
@@ -28,6 +28,9 @@
 #ifdef HAVE_EPOLL
 #include <sys/epoll.h>
 #endif
+#ifdef HAVE_IO_URING
+#include <poll.h>
+#endif
 #ifdef HAVE_KQUEUE
 #include <sys/types.h>
 #include <sys/event.h>
@@ -57,6 +60,8 @@
 enum {
 	RE_THREAD_WORKERS = 4,
 	MAX_BLOCKING	  = 500, /**< Maximum time spent in handler in [ms] */
+	DEFAULT_MAXEVENTS = 1024,/**< Maximum events per wakeup            */
+	DEFAULT_BUDGET	  = 16,  /**< Events per fd and loop iteration     */
 #if defined(FD_SETSIZE)
 	DEFAULT_MAXFDS = FD_SETSIZE
 #else
@@ -72,12 +77,43 @@ struct re_fhs {
 	fd_h* fh;            /**< Event handler                     */
 	void* arg;           /**< Handler argument                  */
 	struct re_fhs* next; /**< Next element in the delete list   */
+	struct le ple;       /**< Edge-triggered pending list elem. */
+	bool edge;           /**< Registered edge-triggered         */
+#ifdef HAVE_IO_URING
+	struct uring_poll *up; /**< Active io_uring poll request    */
+#endif
+};
+
+#ifdef HAVE_IO_URING
+/** io_uring oneshot poll request, re-armed on completion, refs the fhs */
+struct uring_poll {
+	struct le le;        /**< Linked list element               */
+	struct re_fhs *fhs;  /**< File descriptor handler           */
+	bool active;         /**< Request is current for the fhs    */
+};
+#endif
+
+/** Polling loop statistics */
+struct loop_stats {
+	uint64_t start;              /**< Start of the main loop [us]       */
+	uint64_t wakeups;            /**< Number of polling wakeups         */
+	uint64_t events;             /**< Number of polled events           */
+	uint32_t events_max;         /**< Maximum events per wakeup         */
+	uint64_t pending;            /**< Edge-triggered re-dispatches      */
+	uint64_t wait_us;            /**< Time spent waiting [us]           */
+	uint64_t fd_us;              /**< Time spent in fd handlers [us]    */
+	uint64_t tmr_us;             /**< Time spent in timer handlers [us] */
 };
 
 /** Polling loop data */
 struct re {
 	int maxfds;                  /**< Maximum number of polling fds     */
 	int nfds;                    /**< Number of active file descriptors */
+	int maxevents;               /**< Maximum events per wakeup         */
+	unsigned budget;             /**< Per-fd event budget per iteration */
+	bool edge;                   /**< Edge-triggered epoll mode         */
+	struct list pendl;           /**< Edge-triggered fds with data left */
+	struct loop_stats stats;     /**< Loop iteration statistics         */
 	enum poll_method method;     /**< The current polling method        */
 	RE_ATOMIC bool polling;      /**< Is polling flag                   */
 	int sig;                     /**< Last caught signal                */
@@ -94,6 +130,11 @@ struct re {
 #ifdef HAVE_KQUEUE
 	struct kevent *evlist;
 	int kqfd;
+#endif
+#ifdef HAVE_IO_URING
+	struct uring *uring;         /**< io_uring instance                 */
+	struct uring_event *uevents; /**< Completion set for io_uring       */
+	struct list upl;             /**< Pending io_uring poll requests    */
 #endif
 	mtx_t *mutex;                /**< Mutex for thread synchronization  */
 	mtx_t *mutexp;               /**< Pointer to active mutex           */
@@ -174,6 +215,7 @@ int re_alloc(struct re **rep)
 
 	re->async = NULL;
 	re->tid = thrd_current();
+	re->budget = DEFAULT_BUDGET;
 
 #ifdef HAVE_EPOLL
 	re->epfd = -1;
@@ -267,6 +309,14 @@ static void fd_handler(struct re_fhs *fhs, int flags)
 #endif
 
 
+static int poll_maxevents(const struct re *re)
+{
+	int n = re->maxevents ? re->maxevents : DEFAULT_MAXEVENTS;
+
+	return min(n, re->maxfds);
+}
+
+
 #ifdef HAVE_SELECT
 static int set_select_fds(struct re *re, struct re_fhs *fhs)
 {
@@ -335,6 +385,12 @@ static int set_epoll_fds(struct re *re, struct re_fhs *fhs)
 		if (flags & FD_EXCEPT)
 			event.events |= EPOLLERR;
 
+		fhs->edge = re->edge && (flags & FD_EDGE);
+		if (fhs->edge)
+			event.events |= EPOLLET;
+		else
+			list_unlink(&fhs->ple);
+
 		/* Try to add it first */
 		if (-1 == epoll_ctl(re->epfd, EPOLL_CTL_ADD, fd, &event)) {
 
@@ -417,6 +473,155 @@ static int set_kqueue_fds(struct re *re, struct re_fhs *fhs)
 #endif
 
 
+#ifdef HAVE_IO_URING
+static void uring_poll_destructor(void *arg)
+{
+	struct uring_poll *up = arg;
+
+	if (up->fhs->up == up)
+		up->fhs->up = NULL;
+
+	list_unlink(&up->le);
+	mem_deref(up->fhs);
+}
+
+
+static unsigned uring_events(int flags)
+{
+	unsigned events = 0;
+
+	if (flags & FD_READ)
+		events |= POLLIN;
+	if (flags & FD_WRITE)
+		events |= POLLOUT;
+	if (flags & FD_EXCEPT)
+		events |= POLLERR;
+
+	return events;
+}
+
+
+static int set_uring_fds(struct re *re, struct re_fhs *fhs)
+{
+	struct uring_poll *up;
+	int err = 0;
+
+	if (!re || !fhs)
+		return EINVAL;
+
+	if (!re->uring)
+		return EBADFD;
+
+	DEBUG_INFO("set_uring_fds: fd=%d flags=0x%02x\n", fhs->fd,
+		   fhs->flags);
+
+	if (fhs->up && fhs->flags) {
+		/* If already completed, it is re-armed with the new flags */
+		err = uring_poll_update(re->uring, fhs->up,
+					uring_events(fhs->flags));
+	}
+	else if (fhs->up) {
+		/* Cancel the current request, its completion frees it */
+		fhs->up->active = false;
+		err = uring_poll_remove(re->uring, fhs->up);
+		fhs->up = NULL;
+	}
+	else if (fhs->flags) {
+		up = mem_zalloc(sizeof(*up), uring_poll_destructor);
+		if (!up)
+			return ENOMEM;
+
+		up->fhs	   = mem_ref(fhs);
+		up->active = true;
+
+		err = uring_poll_add(re->uring, fhs->fd,
+				     uring_events(fhs->flags), up);
+		if (err) {
+			mem_deref(up);
+			goto out;
+		}
+
+		list_append(&re->upl, &up->le, up);
+		fhs->up = up;
+	}
+
+	/* The polling thread submits with the next wait */
+	if (!err && !thrd_equal(re->tid, thrd_current()))
+		err = uring_submit(re->uring);
+
+ out:
+	if (err) {
+		DEBUG_WARNING("set_uring_fds: fd=%d (%m)\n", fhs->fd, err);
+	}
+
+	return err;
+}
+
+
+static int uring_event_flags(const struct uring_event *ev)
+{
+	const struct uring_poll *up = ev->data;
+	int flags = 0;
+
+	if (!up->active || ev->res <= 0)
+		return 0;
+
+	if (ev->res & POLLIN)
+		flags |= FD_READ;
+	if (ev->res & POLLOUT)
+		flags |= FD_WRITE;
+	if (ev->res & (POLLERR|POLLHUP))
+		flags |= FD_EXCEPT;
+
+	/* The flags may have changed since the request was armed */
+	return flags & (up->fhs->flags | FD_EXCEPT);
+}
+
+
+static void uring_event_done(struct re *re, const struct uring_event *ev)
+{
+	struct uring_poll *up = ev->data;
+	struct re_fhs *fhs = up->fhs;
+
+	/* Re-arm the oneshot poll, unless changed by the handler */
+	if (up->active) {
+
+		if (ev->res < 0) {
+			DEBUG_WARNING("io_uring: poll fd=%d (%m)\n",
+				      fhs->fd, -ev->res);
+		}
+		else if (!uring_poll_add(re->uring, fhs->fd,
+					 uring_events(fhs->flags), up)) {
+			return;
+		}
+
+		up->active = false;
+	}
+
+	mem_deref(up);
+}
+
+
+/* Release cancelled requests outside of the polling loop */
+static void uring_flush(struct re *re)
+{
+	int n;
+
+	if (!re->uring || uring_submit(re->uring))
+		return;
+
+	while (!uring_reap(re->uring, re->uevents, re->maxfds, &n) && n) {
+
+		/* events are dropped, re-armed requests report them again */
+		for (int i = 0; i < n; i++) {
+			if (re->uevents[i].data)
+				uring_event_done(re, &re->uevents[i]);
+		}
+	}
+}
+#endif
+
+
 static int poll_init(struct re *re)
 {
 	DEBUG_INFO("poll init (maxfds=%d)\n", re->maxfds);
@@ -426,6 +631,17 @@ static int poll_init(struct re *re)
 		return EINVAL;
 	}
 
+#ifdef HAVE_IO_URING
+	if (re->method == METHOD_IO_URING && !re->uring) {
+		int err = uring_alloc(&re->uring);
+		if (err) {
+			DEBUG_NOTICE("io_uring not available (%m),"
+				     " fallback to epoll\n", err);
+			re->method = METHOD_EPOLL;
+		}
+	}
+#endif
+
 	switch (re->method) {
 
 #ifdef HAVE_SELECT
@@ -442,10 +658,10 @@ static int poll_init(struct re *re)
 #ifdef HAVE_EPOLL
 	case METHOD_EPOLL:
 		if (!re->events) {
-			DEBUG_INFO("allocate %u bytes for epoll set\n",
-				   re->maxfds * sizeof(*re->events));
-			re->events = mem_zalloc(re->maxfds*sizeof(*re->events),
-					      NULL);
+			size_t sz = poll_maxevents(re) * sizeof(*re->events);
+
+			DEBUG_INFO("allocate %zu bytes for epoll set\n", sz);
+			re->events = mem_zalloc(sz, NULL);
 			if (!re->events)
 				return ENOMEM;
 		}
@@ -467,7 +683,7 @@ static int poll_init(struct re *re)
 	case METHOD_KQUEUE:
 
 		if (!re->evlist) {
-			size_t sz = re->maxfds * sizeof(*re->evlist);
+			size_t sz = poll_maxevents(re) * sizeof(*re->evlist);
 			re->evlist = mem_zalloc(sz, NULL);
 			if (!re->evlist)
 				return ENOMEM;
@@ -483,6 +699,17 @@ static int poll_init(struct re *re)
 		break;
 #endif
 
+#ifdef HAVE_IO_URING
+	case METHOD_IO_URING:
+		if (!re->uevents) {
+			re->uevents = mem_zalloc(poll_maxevents(re) *
+						 sizeof(*re->uevents), NULL);
+			if (!re->uevents)
+				return ENOMEM;
+		}
+		break;
+#endif
+
 	default:
 		DEBUG_WARNING("poll init: no method\n");
 		return EINVAL;
@@ -503,6 +730,7 @@ static void poll_close(struct re *re)
 	re->maxfds = 0;
 	re->nfds   = 0;
 	re->method = METHOD_NULL;
+	list_clear(&re->pendl);
 
 #ifdef HAVE_SELECT
 	re->fhsl = mem_deref(re->fhsl);
@@ -527,6 +755,13 @@ static void poll_close(struct re *re)
 
 	re->evlist = mem_deref(re->evlist);
 #endif
+
+#ifdef HAVE_IO_URING
+	/* Closing the ring cancels all requests in the kernel */
+	re->uring   = mem_deref(re->uring);
+	re->uevents = mem_deref(re->uevents);
+	list_flush(&re->upl);
+#endif
 }
 
 
@@ -649,6 +884,11 @@ int fd_listen(struct re_fhs **fhsp, re_sock_t fd, int flags, fd_h *fh,
 		err = set_kqueue_fds(re, fhs);
 		break;
 #endif
+#ifdef HAVE_IO_URING
+	case METHOD_IO_URING:
+		err = set_uring_fds(re, fhs);
+		break;
+#endif
 
 	default:
 		err = ENOTSUP;
@@ -687,6 +927,7 @@ struct re_fhs *fd_close(struct re_fhs *fhs)
 	fhs->flags = 0;
 	fhs->fh	   = NULL;
 	fhs->arg   = NULL;
+	list_unlink(&fhs->ple);
 
 	switch (re->method) {
 #ifdef HAVE_SELECT
@@ -705,6 +946,11 @@ struct re_fhs *fd_close(struct re_fhs *fhs)
 		err = set_kqueue_fds(re, fhs);
 		break;
 #endif
+#ifdef HAVE_IO_URING
+	case METHOD_IO_URING:
+		err = set_uring_fds(re, fhs);
+		break;
+#endif
 
 	default:
 		err = ENOTSUP;
@@ -738,7 +984,9 @@ struct re_fhs *fd_close(struct re_fhs *fhs)
 static int fd_poll(struct re *re)
 {
 	const uint64_t to = tmr_next_timeout(re->tmrl);
-	int i, n;
+	const uint64_t t0 = tmr_jiffies_usec();
+	uint64_t t1 = 0;
+	int i, n, nev = 0;
 	int nfds = re->nfds;
 	int err = 0;
 	struct re_fhs *fhs = NULL;
@@ -801,11 +1049,19 @@ static int fd_poll(struct re *re)
 		break;
 #endif
 #ifdef HAVE_EPOLL
-	case METHOD_EPOLL:
+	case METHOD_EPOLL: {
+		/* do not block while edge-triggered fds have data left */
+		int timeout = to ? (int)to : -1;
+
+		if (!list_isempty(&re->pendl))
+			timeout = 0;
+
 		re_unlock(re);
-		n = epoll_wait(re->epfd, re->events, re->maxfds,
-			       to ? (int)to : -1);
+		n = epoll_wait(re->epfd, re->events, poll_maxevents(re),
+			       timeout);
 		re_lock(re);
+		nfds = n;
+	}
 		break;
 #endif
 
@@ -817,13 +1073,32 @@ static int fd_poll(struct re *re)
 		timeout.tv_nsec = (to % 1000) * 1000000;
 
 		re_unlock(re);
-		n = kevent(re->kqfd, NULL, 0, re->evlist, re->maxfds,
+		n = kevent(re->kqfd, NULL, 0, re->evlist, poll_maxevents(re),
 			   to ? &timeout : NULL);
 		re_lock(re);
 		}
 		break;
 #endif
 
+#ifdef HAVE_IO_URING
+	case METHOD_IO_URING:
+		/* Submit under lock, fd_listen() may queue from other threads
+		 * after re_thread_enter() */
+		err = uring_submit(re->uring);
+		if (err)
+			goto out;
+
+		re_unlock(re);
+		err = uring_wait(re->uring, re->uevents, poll_maxevents(re),
+				 &n, to);
+		re_lock(re);
+		if (err)
+			goto out;
+
+		nfds = n;
+		break;
+#endif
+
 	default:
 		(void)to;
 		DEBUG_WARNING("no polling method set\n");
@@ -836,6 +1111,9 @@ static int fd_poll(struct re *re)
 		goto out;
 	}
 
+	t1  = tmr_jiffies_usec();
+	nev = n;
+
 	/* Check for events */
 	for (i=0; (n > 0) && (i < nfds); i++) {
 		re_sock_t fd;
@@ -863,6 +1141,9 @@ static int fd_poll(struct re *re)
 			fhs = re->events[i].data.ptr;
 			fd = fhs->fd;
 
+			/* dispatched now, no need to call it again */
+			list_unlink(&fhs->ple);
+
 			if (re->events[i].events & EPOLLIN)
 				flags |= FD_READ;
 			if (re->events[i].events & EPOLLOUT)
@@ -910,6 +1191,33 @@ static int fd_poll(struct re *re)
 			break;
 #endif
 
+#ifdef HAVE_IO_URING
+		case METHOD_IO_URING: {
+			const struct uring_event *ev = &re->uevents[i];
+			struct uring_poll *up = ev->data;
+
+			/* poll remove completion */
+			if (!up)
+				break;
+
+			/* dispatch here, the request may be released after */
+			fhs   = up->fhs;
+			flags = uring_event_flags(ev);
+
+			if (flags && fhs->fh) {
+#if MAIN_DEBUG
+				fd_handler(fhs, flags);
+#else
+				fhs->fh(flags, fhs->arg);
+#endif
+			}
+
+			uring_event_done(re, ev);
+			flags = 0;
+		}
+			break;
+#endif
+
 		default:
 			err = EINVAL;
 			goto out;
@@ -930,7 +1238,44 @@ static int fd_poll(struct re *re)
 		--n;
 	}
 
+	/* Edge-triggered fds that exhausted their budget last time */
+	if (!list_isempty(&re->pendl)) {
+		struct list pendl = LIST_INIT;
+		struct le *le;
+
+		/* handlers may mark their fd pending again */
+		while ((le = list_head(&re->pendl))) {
+			list_unlink(le);
+			list_append(&pendl, le, le->data);
+		}
+
+		while ((le = list_head(&pendl))) {
+			fhs = le->data;
+			list_unlink(le);
+
+			if (!fhs->fh || !(fhs->flags & FD_READ))
+				continue;
+
+			++re->stats.pending;
+#if MAIN_DEBUG
+			fd_handler(fhs, FD_READ);
+#else
+			fhs->fh(FD_READ, fhs->arg);
+#endif
+		}
+	}
+
  out:
+	if (t1) {
+		struct loop_stats *st = &re->stats;
+
+		++st->wakeups;
+		st->events    += nev;
+		st->events_max = max(st->events_max, (uint32_t)nev);
+		st->wait_us   += t1 - t0;
+		st->fd_us     += tmr_jiffies_usec() - t1;
+	}
+
 	/* Delayed fhs deref to avoid dangling fhs pointers */
 	fhsld_flush(re);
 
@@ -988,6 +1333,128 @@ int fd_setsize(int maxfds)
 }
 
 
+/**
+ * Set the maximum number of events handled per polling wakeup. By default
+ * this is the minimum of maxfds and 1024.
+ *
+ * @note Not possible while the main loop is running
+ *
+ * @param maxevents Max events, 0 for default
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int re_maxevents_set(int maxevents)
+{
+	struct re *re = re_get();
+
+	if (!re || maxevents < 0)
+		return EINVAL;
+
+	if (re_atomic_rlx(&re->polling))
+		return EBUSY;
+
+	re->maxevents = maxevents;
+
+	/* re-allocated by the next poll setup */
+#ifdef HAVE_EPOLL
+	re->events = mem_deref(re->events);
+#endif
+#ifdef HAVE_KQUEUE
+	re->evlist = mem_deref(re->evlist);
+#endif
+#ifdef HAVE_IO_URING
+	re->uevents = mem_deref(re->uevents);
+#endif
+
+	return 0;
+}
+
+
+/**
+ * Enable or disable edge-triggered epoll mode. File descriptors added
+ * with the FD_EDGE flag are registered edge-triggered, their handlers
+ * must read until EAGAIN or call fd_pending() when the budget is used up.
+ * Other polling methods stay level-triggered.
+ *
+ * @note Only affects file descriptors added after this call
+ *
+ * @param enable True to enable, false to disable
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int re_edge_set(bool enable)
+{
+	struct re *re = re_get();
+
+	if (!re)
+		return EINVAL;
+
+	re->edge = enable;
+
+	return 0;
+}
+
+
+/**
+ * Set the per-fd event budget for edge-triggered mode. A handler that
+ * drains its socket in a loop handles at most this many events per loop
+ * iteration, for fairness between file descriptors.
+ *
+ * @param budget Event budget, 0 for default
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int re_budget_set(unsigned budget)
+{
+	struct re *re = re_get();
+
+	if (!re)
+		return EINVAL;
+
+	re->budget = budget ? budget : DEFAULT_BUDGET;
+
+	return 0;
+}
+
+
+/**
+ * Get the event budget of a file descriptor, i.e. the number of events its
+ * handler may drain per loop iteration. This is 1 unless the file
+ * descriptor is registered edge-triggered.
+ *
+ * @param fhs File descriptor handler struct pointer
+ *
+ * @return Event budget
+ */
+unsigned fd_budget(const struct re_fhs *fhs)
+{
+	struct re *re = re_get();
+
+	if (!re || !fhs || !fhs->edge)
+		return 1;
+
+	return re->budget;
+}
+
+
+/**
+ * Mark an edge-triggered file descriptor as still readable, the handler is
+ * called again with FD_READ in the next loop iteration. Must be called
+ * from the handler when it stopped reading before EAGAIN.
+ *
+ * @param fhs File descriptor handler struct pointer
+ */
+void fd_pending(struct re_fhs *fhs)
+{
+	struct re *re = re_get();
+
+	if (!re || !fhs || !fhs->edge || fhs->ple.list)
+		return;
+
+	list_append(&re->pendl, &fhs->ple, fhs);
+}
+
+
 #ifdef HAVE_SIGNAL
 /* Thread-safe signal handling */
 static void signal_handler(int sig)
@@ -1045,8 +1512,13 @@ int re_main(re_signal_h *signalh)
 
 	re_atomic_rlx_set(&re->polling, true);
 
+	memset(&re->stats, 0, sizeof(re->stats));
+	re->stats.start = tmr_jiffies_usec();
+
 	re_lock(re);
 	for (;;) {
+		uint64_t t;
+
 
 		if (re->sig) {
 			if (signalh)
@@ -1081,7 +1553,9 @@ int re_main(re_signal_h *signalh)
 			break;
 		}
 
+		t = tmr_jiffies_usec();
 		tmr_poll(re->tmrl);
+		re->stats.tmr_us += tmr_jiffies_usec() - t;
 	}
 	re_unlock(re);
 
@@ -1108,6 +1582,38 @@ void re_cancel(void)
 }
 
 
+static int loop_stats_debug(struct re_printf *pf,
+			    const struct loop_stats *st)
+{
+	uint64_t elapsed, wakeups, evx100;
+	int err = 0;
+
+	if (!st->start)
+		return 0;
+
+	elapsed = tmr_jiffies_usec() - st->start;
+	wakeups = st->wakeups ? st->wakeups : 1;
+	evx100  = 100 * st->events / wakeups;
+
+	err |= re_hprintf(pf, "  loop statistics:\n");
+	err |= re_hprintf(pf, "    wakeups:    %llu (%llu/s)\n",
+			  st->wakeups,
+			  1000000 * st->wakeups / max(elapsed, 1));
+	err |= re_hprintf(pf, "    events:     %llu (%llu.%02llu per wakeup,"
+			  " max %u)\n", st->events,
+			  evx100 / 100, evx100 % 100, st->events_max);
+	err |= re_hprintf(pf, "    pending:    %llu\n", st->pending);
+	err |= re_hprintf(pf, "    waiting:    %llu ms\n",
+			  st->wait_us / 1000);
+	err |= re_hprintf(pf, "    fd handler: %llu ms\n",
+			  st->fd_us / 1000);
+	err |= re_hprintf(pf, "    timers:     %llu ms\n",
+			  st->tmr_us / 1000);
+
+	return err;
+}
+
+
 /**
  * Debug the main polling loop
  *
@@ -1142,6 +1648,10 @@ int re_debug(struct re_printf *pf, void *unused)
 	err |= re_hprintf(pf, "  thread_enter: %d\n",
 			  re_atomic_rlx(&re->thread_enter));
 	err |= re_hprintf(pf, "  async:        %p\n", re->async);
+	err |= re_hprintf(pf, "  maxevents:    %d\n", poll_maxevents(re));
+	err |= re_hprintf(pf, "  budget:       %u\n", re->budget);
+	err |= re_hprintf(pf, "  edge:         %d\n", re->edge);
+	err |= loop_stats_debug(pf, &re->stats);
 
 	return err;
 }
@@ -1217,6 +1727,10 @@ int poll_method_set(enum poll_method method)
 #ifdef HAVE_KQUEUE
 	case METHOD_KQUEUE:
 		break;
+#endif
+#ifdef HAVE_IO_URING
+	case METHOD_IO_URING:
+		break;
 #endif
 	default:
 		DEBUG_WARNING("poll method not supported: '%s'\n",
@@ -1672,5 +2186,8 @@ void re_fhs_flush(void)
 		return;
 	}
 
+#ifdef HAVE_IO_URING
+	uring_flush(re);
+#endif
 	fhsld_flush(re);
 }
@@ -13,6 +13,25 @@ extern "C" {
 int  openssl_init(void);
 #endif
 
+#ifdef HAVE_IO_URING
+struct uring;
+
+/** io_uring completion event */
+struct uring_event {
+	void *data;  /**< Request completion data      */
+	int res;     /**< Result or negative errorcode */
+};
+
+int uring_alloc(struct uring **urp);
+int uring_submit(struct uring *ur);
+int uring_poll_add(struct uring *ur, int fd, unsigned events, void *data);
+int uring_poll_remove(struct uring *ur, void *data);
+int uring_poll_update(struct uring *ur, void *data, unsigned events);
+int uring_wait(struct uring *ur, struct uring_event *evv, int maxn, int *np,
+	       uint64_t to);
+int uring_reap(struct uring *ur, struct uring_event *evv, int maxn, int *np);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,438 @@
+/**
+ * @file uring.c  Minimal Linux io_uring interface for the polling loop
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <re_types.h>
+#include <re_fmt.h>
+#include <re_mem.h>
+#include <re_main.h>
+#include "main.h"
+
+
+#define DEBUG_MODULE "uring"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+enum {
+	URING_SQ_ENTRIES = 256,
+	URING_CQ_ENTRIES = 4096,
+};
+
+/** Required kernel features (Linux 5.11) */
+#define URING_FEATURES (IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG)
+
+struct uring {
+	int fd;                     /**< io_uring file descriptor         */
+
+	void *sq_ptr;               /**< Mapped submission ring           */
+	size_t sq_sz;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_array;
+	unsigned sq_mask;
+	unsigned sq_entries;
+	struct io_uring_sqe *sqes;  /**< Mapped submission queue entries  */
+	size_t sqes_sz;
+
+	void *cq_ptr;               /**< Mapped completion ring           */
+	size_t cq_sz;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned cq_mask;
+	struct io_uring_cqe *cqes;
+};
+
+
+static int sys_setup(unsigned entries, struct io_uring_params *p)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+
+static int sys_enter(int fd, unsigned to_submit, unsigned min_complete,
+		     unsigned flags, void *arg, size_t argsz)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+			    flags, arg, argsz);
+}
+
+
+static void destructor(void *arg)
+{
+	struct uring *ur = arg;
+
+	if (ur->sqes)
+		munmap(ur->sqes, ur->sqes_sz);
+
+	if (ur->cq_ptr && ur->cq_ptr != ur->sq_ptr)
+		munmap(ur->cq_ptr, ur->cq_sz);
+
+	if (ur->sq_ptr)
+		munmap(ur->sq_ptr, ur->sq_sz);
+
+	if (ur->fd >= 0)
+		(void)close(ur->fd);
+}
+
+
+static void *ring_mmap(int fd, size_t sz, off_t off)
+{
+	void *p = mmap(NULL, sz, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_POPULATE, fd, off);
+
+	return p == MAP_FAILED ? NULL : p;
+}
+
+
+/**
+ * Allocate an io_uring instance
+ *
+ * @param urp Pointer to allocated io_uring
+ *
+ * @return 0 if success, ENOSYS if not supported by kernel, otherwise errorcode
+ */
+int uring_alloc(struct uring **urp)
+{
+	struct io_uring_params p;
+	struct uring *ur;
+	uint8_t *sq, *cq;
+	int err = 0;
+
+	if (!urp)
+		return EINVAL;
+
+	ur = mem_zalloc(sizeof(*ur), destructor);
+	if (!ur)
+		return ENOMEM;
+
+	memset(&p, 0, sizeof(p));
+	p.flags	     = IORING_SETUP_CQSIZE;
+	p.cq_entries = URING_CQ_ENTRIES;
+
+	ur->fd = sys_setup(URING_SQ_ENTRIES, &p);
+	if (ur->fd < 0) {
+		err = errno;
+		goto out;
+	}
+
+	if ((p.features & URING_FEATURES) != URING_FEATURES) {
+		DEBUG_INFO("missing features: 0x%x\n",
+			   URING_FEATURES & ~p.features);
+		err = ENOSYS;
+		goto out;
+	}
+
+	ur->sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ur->cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		ur->sq_sz = ur->cq_sz = max(ur->sq_sz, ur->cq_sz);
+	}
+
+	ur->sq_ptr = ring_mmap(ur->fd, ur->sq_sz, IORING_OFF_SQ_RING);
+	if (!ur->sq_ptr) {
+		err = errno;
+		goto out;
+	}
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		ur->cq_ptr = ur->sq_ptr;
+	}
+	else {
+		ur->cq_ptr = ring_mmap(ur->fd, ur->cq_sz, IORING_OFF_CQ_RING);
+		if (!ur->cq_ptr) {
+			err = errno;
+			goto out;
+		}
+	}
+
+	ur->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	ur->sqes = ring_mmap(ur->fd, ur->sqes_sz, IORING_OFF_SQES);
+	if (!ur->sqes) {
+		err = errno;
+		goto out;
+	}
+
+	sq = ur->sq_ptr;
+	cq = ur->cq_ptr;
+
+	ur->sq_head    = (unsigned *)(void *)(sq + p.sq_off.head);
+	ur->sq_tail    = (unsigned *)(void *)(sq + p.sq_off.tail);
+	ur->sq_array   = (unsigned *)(void *)(sq + p.sq_off.array);
+	ur->sq_mask    = *(unsigned *)(void *)(sq + p.sq_off.ring_mask);
+	ur->sq_entries = p.sq_entries;
+
+	ur->cq_head = (unsigned *)(void *)(cq + p.cq_off.head);
+	ur->cq_tail = (unsigned *)(void *)(cq + p.cq_off.tail);
+	ur->cq_mask = *(unsigned *)(void *)(cq + p.cq_off.ring_mask);
+	ur->cqes    = (struct io_uring_cqe *)(void *)(cq + p.cq_off.cqes);
+
+	DEBUG_INFO("setup: fd=%d sq=%u cq=%u features=0x%x\n",
+		   ur->fd, p.sq_entries, p.cq_entries, p.features);
+
+ out:
+	if (err)
+		mem_deref(ur);
+	else
+		*urp = ur;
+
+	return err;
+}
+
+
+/* Number of queued requests not yet consumed by the kernel */
+static unsigned sq_pending(const struct uring *ur)
+{
+	return __atomic_load_n(ur->sq_tail, __ATOMIC_ACQUIRE) -
+	       __atomic_load_n(ur->sq_head, __ATOMIC_ACQUIRE);
+}
+
+
+/**
+ * Submit all queued requests to the kernel
+ *
+ * @param ur io_uring instance
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int uring_submit(struct uring *ur)
+{
+	unsigned n;
+
+	if (!ur)
+		return EINVAL;
+
+	while ((n = sq_pending(ur))) {
+		if (sys_enter(ur->fd, n, 0, 0, NULL, 0) < 0) {
+			if (errno == EINTR)
+				continue;
+
+			return errno;
+		}
+	}
+
+	return 0;
+}
+
+
+static struct io_uring_sqe *get_sqe(struct uring *ur)
+{
+	struct io_uring_sqe *sqe;
+	unsigned tail = *ur->sq_tail;
+	unsigned idx;
+
+	if (sq_pending(ur) >= ur->sq_entries) {
+
+		if (uring_submit(ur))
+			return NULL;
+	}
+
+	idx = tail & ur->sq_mask;
+	sqe = &ur->sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+
+	ur->sq_array[idx] = idx;
+
+	return sqe;
+}
+
+
+static void put_sqe(struct uring *ur)
+{
+	__atomic_store_n(ur->sq_tail, *ur->sq_tail + 1, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Queue a oneshot poll request. Readiness is checked when the request is
+ * armed, so re-arming after each completion gives level-triggered events.
+ *
+ * @param ur     io_uring instance
+ * @param fd     File descriptor
+ * @param events Poll events (POLLIN, POLLOUT, ..)
+ * @param data   Completion data, must not be NULL
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int uring_poll_add(struct uring *ur, int fd, unsigned events, void *data)
+{
+	struct io_uring_sqe *sqe;
+
+	if (!ur || !data)
+		return EINVAL;
+
+	sqe = get_sqe(ur);
+	if (!sqe)
+		return EBUSY;
+
+	sqe->opcode	   = IORING_OP_POLL_ADD;
+	sqe->fd		   = fd;
+	sqe->poll32_events = events;
+	sqe->user_data	   = (uintptr_t)data;
+
+	put_sqe(ur);
+
+	return 0;
+}
+
+
+/**
+ * Queue the removal of a poll request, the request completes with
+ * ECANCELED if it was still active
+ *
+ * @param ur   io_uring instance
+ * @param data Completion data of the poll request
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int uring_poll_remove(struct uring *ur, void *data)
+{
+	struct io_uring_sqe *sqe;
+
+	if (!ur || !data)
+		return EINVAL;
+
+	sqe = get_sqe(ur);
+	if (!sqe)
+		return EBUSY;
+
+	sqe->opcode    = IORING_OP_POLL_REMOVE;
+	sqe->fd	       = -1;
+	sqe->addr      = (uintptr_t)data;
+	sqe->user_data = 0;
+
+	put_sqe(ur);
+
+	return 0;
+}
+
+
+/**
+ * Queue an update of the events of a poll request
+ *
+ * @param ur     io_uring instance
+ * @param data   Completion data of the poll request
+ * @param events New poll events
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int uring_poll_update(struct uring *ur, void *data, unsigned events)
+{
+	struct io_uring_sqe *sqe;
+
+	if (!ur || !data)
+		return EINVAL;
+
+	sqe = get_sqe(ur);
+	if (!sqe)
+		return EBUSY;
+
+	sqe->opcode	   = IORING_OP_POLL_REMOVE;
+	sqe->fd		   = -1;
+	sqe->len	   = IORING_POLL_UPDATE_EVENTS;
+	sqe->addr	   = (uintptr_t)data;
+	sqe->poll32_events = events;
+	sqe->user_data	   = 0;
+
+	put_sqe(ur);
+
+	return 0;
+}
+
+
+static int reap(struct uring *ur, struct uring_event *evv, int maxn)
+{
+	unsigned head = *ur->cq_head;
+	unsigned tail = __atomic_load_n(ur->cq_tail, __ATOMIC_ACQUIRE);
+	int n = 0;
+
+	for (; head != tail && n < maxn; ++head, ++n) {
+		const struct io_uring_cqe *cqe = &ur->cqes[head & ur->cq_mask];
+
+		evv[n].data = (void *)(uintptr_t)cqe->user_data;
+		evv[n].res  = cqe->res;
+	}
+
+	__atomic_store_n(ur->cq_head, head, __ATOMIC_RELEASE);
+
+	return n;
+}
+
+
+/**
+ * Submit queued requests, wait for completions and copy them to the
+ * event array. Requests may be queued by another thread meanwhile.
+ *
+ * @param ur   io_uring instance
+ * @param evv  Event array
+ * @param maxn Size of event array
+ * @param np   Returned number of events
+ * @param to   Timeout in [ms], 0 to wait forever
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int uring_wait(struct uring *ur, struct uring_event *evv, int maxn, int *np,
+	       uint64_t to)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned submit;
+	bool empty;
+
+	if (!ur || !evv || !np)
+		return EINVAL;
+
+	empty  = *ur->cq_head == __atomic_load_n(ur->cq_tail, __ATOMIC_ACQUIRE);
+	submit = sq_pending(ur);
+
+	if (submit || empty) {
+		memset(&arg, 0, sizeof(arg));
+
+		if (to) {
+			ts.tv_sec  = (long long)(to / 1000);
+			ts.tv_nsec = (long long)(to % 1000) * 1000000;
+			arg.ts	   = (uintptr_t)&ts;
+		}
+
+		if (sys_enter(ur->fd, submit, empty ? 1 : 0,
+			      IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+			      &arg, sizeof(arg)) < 0) {
+
+			if (errno != ETIME && errno != EBUSY)
+				return errno;
+		}
+	}
+
+	*np = reap(ur, evv, maxn);
+
+	return 0;
+}
+
+
+/**
+ * Copy available completions to the event array without waiting
+ *
+ * @param ur   io_uring instance
+ * @param evv  Event array
+ * @param maxn Size of event array
+ * @param np   Returned number of events
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int uring_reap(struct uring *ur, struct uring_event *evv, int maxn, int *np)
+{
+	if (!ur || !evv || !np)
+		return EINVAL;
+
+	*np = reap(ur, evv, maxn);
+
+	return 0;
+}
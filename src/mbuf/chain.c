@@ -0,0 +1,139 @@
+/**
+ * @file chain.c  Memory buffer chains
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re_types.h>
+#include <re_mem.h>
+#include <re_mbuf.h>
+
+
+/**
+ * Initialize an empty mbuf chain
+ *
+ * @param mc Mbuf chain
+ */
+void mbuf_chain_init(struct mbuf_chain *mc)
+{
+	if (!mc)
+		return;
+
+	memset(mc, 0, sizeof(*mc));
+}
+
+
+/**
+ * Release all segments of an mbuf chain
+ *
+ * @param mc Mbuf chain
+ */
+void mbuf_chain_reset(struct mbuf_chain *mc)
+{
+	if (!mc)
+		return;
+
+	for (unsigned i = 0; i < mc->segc; i++)
+		mem_deref(mc->segv[i].mb);
+
+	mbuf_chain_init(mc);
+}
+
+
+static void seg_set(struct mbuf_seg *seg, struct mbuf *mb)
+{
+	seg->mb  = mem_ref(mb);
+	seg->pos = mb->pos;
+	seg->end = mb->end;
+}
+
+
+/**
+ * Append the unread part of a memory buffer to an mbuf chain. The buffer
+ * must be allocated with mbuf_alloc(). It is referenced, not copied, and
+ * must not be modified while the chain is in use.
+ *
+ * @param mc Mbuf chain
+ * @param mb Memory buffer, from current position to end
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mbuf_chain_append(struct mbuf_chain *mc, struct mbuf *mb)
+{
+	if (!mc || !mb)
+		return EINVAL;
+
+	if (!mbuf_get_left(mb))
+		return 0;
+
+	if (mc->segc >= MBUF_CHAIN_MAX)
+		return ENOSPC;
+
+	mc->len += mbuf_get_left(mb);
+	seg_set(&mc->segv[mc->segc++], mb);
+
+	return 0;
+}
+
+
+/**
+ * Prepend the unread part of a memory buffer to an mbuf chain, typically
+ * a protocol header. The buffer is referenced, not copied.
+ *
+ * @param mc Mbuf chain
+ * @param mb Memory buffer, from current position to end
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mbuf_chain_prepend(struct mbuf_chain *mc, struct mbuf *mb)
+{
+	if (!mc || !mb)
+		return EINVAL;
+
+	if (!mbuf_get_left(mb))
+		return 0;
+
+	if (mc->segc >= MBUF_CHAIN_MAX)
+		return ENOSPC;
+
+	memmove(&mc->segv[1], &mc->segv[0], mc->segc * sizeof(mc->segv[0]));
+	++mc->segc;
+
+	mc->len += mbuf_get_left(mb);
+	seg_set(&mc->segv[0], mb);
+
+	return 0;
+}
+
+
+/**
+ * Copy all segments of an mbuf chain into one memory buffer, for
+ * transports that need a contiguous buffer
+ *
+ * @param mc Mbuf chain
+ * @param mb Memory buffer, written at current position
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mbuf_chain_flatten(const struct mbuf_chain *mc, struct mbuf *mb)
+{
+	int err = 0;
+
+	if (!mc || !mb)
+		return EINVAL;
+
+	if (mbuf_get_space(mb) < mc->len) {
+		err = mbuf_resize(mb, mb->pos + mc->len);
+		if (err)
+			return err;
+	}
+
+	for (unsigned i = 0; i < mc->segc && !err; i++) {
+		const struct mbuf_seg *seg = &mc->segv[i];
+
+		err = mbuf_write_mem(mb, seg->mb->buf + seg->pos,
+				     seg->end - seg->pos);
+	}
+
+	return err;
+}
@@ -0,0 +1,212 @@
+/**
+ * @file pool.c  Memory buffer pools
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <re_types.h>
+#include <re_mem.h>
+#include <re_mbuf.h>
+#include <re_thread.h>
+
+
+/*
+ * The pool keeps the idle data buffers. A borrowed mbuf has its own
+ * destructor and a reference to the pool, so the pool is not destroyed
+ * while buffers are borrowed. When the last reference to a borrowed mbuf
+ * is dropped, its data buffer goes back to the pool.
+ */
+
+
+/** Defines a pool of receive buffers */
+struct mbuf_pool {
+	uint8_t **freev;              /**< Idle data buffers          */
+	size_t freec;                 /**< Number of idle buffers     */
+	mtx_t *lock;                  /**< Protects buffers and stats */
+	size_t bufsz;                 /**< Buffer size                */
+	struct mbuf_pool_stat stat;   /**< Statistics                 */
+};
+
+struct pool_mbuf {
+	struct mbuf mb;               /**< Must be first              */
+	struct mbuf_pool *mp;         /**< Owning pool, referenced    */
+};
+
+
+static void pool_mbuf_destructor(void *data)
+{
+	struct pool_mbuf *pm = data;
+	struct mbuf_pool *mp = pm->mp;
+	uint8_t *buf = pm->mb.buf;
+
+	mtx_lock(mp->lock);
+
+	/* keep the buffer, unless it was resized or is still shared */
+	if (buf && pm->mb.size == mp->bufsz && mem_nrefs(buf) == 1 &&
+	    mp->freec < mp->stat.size) {
+		mp->freev[mp->freec++] = buf;
+		buf = NULL;
+	}
+
+	--mp->stat.inuse;
+
+	mtx_unlock(mp->lock);
+
+	mem_deref(buf);
+	mem_deref(mp);
+}
+
+
+static void pool_destructor(void *data)
+{
+	struct mbuf_pool *mp = data;
+
+	for (size_t i = 0; i < mp->freec; i++)
+		mem_deref(mp->freev[i]);
+
+	mem_deref(mp->freev);
+	mem_deref(mp->lock);
+}
+
+
+/**
+ * Allocate a pool of memory buffers. Buffers taken with mbuf_pool_get()
+ * are returned to the pool when the last reference is dropped, so the
+ * buffers are not allocated and freed for each packet.
+ *
+ * @param mpp   Pointer to allocated mbuf pool
+ * @param n     Number of buffers in the pool
+ * @param bufsz Size of each buffer
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mbuf_pool_alloc(struct mbuf_pool **mpp, size_t n, size_t bufsz)
+{
+	struct mbuf_pool *mp;
+	int err;
+
+	if (!mpp || !n || !bufsz)
+		return EINVAL;
+
+	mp = mem_zalloc(sizeof(*mp), pool_destructor);
+	if (!mp)
+		return ENOMEM;
+
+	mp->bufsz     = bufsz;
+	mp->stat.size = n;
+
+	mp->freev = mem_zalloc(n * sizeof(*mp->freev), NULL);
+	if (!mp->freev) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = mutex_alloc(&mp->lock);
+
+ out:
+	if (err)
+		mem_deref(mp);
+	else
+		*mpp = mp;
+
+	return err;
+}
+
+
+/**
+ * Get an empty memory buffer from a pool. If the pool is exhausted, a
+ * new memory buffer is allocated from the heap.
+ *
+ * @param mp     Mbuf pool
+ * @param pooled Optional, returns true if the buffer is from the pool
+ *
+ * @return Memory buffer of the pool buffer size, NULL if no memory
+ */
+struct mbuf *mbuf_pool_get(struct mbuf_pool *mp, bool *pooled)
+{
+	struct pool_mbuf *pm;
+	uint8_t *buf;
+
+	if (pooled)
+		*pooled = false;
+
+	if (!mp)
+		return NULL;
+
+	mtx_lock(mp->lock);
+
+	++mp->stat.borrows;
+
+	if (mp->stat.inuse == mp->stat.size) {
+		++mp->stat.misses;
+		mtx_unlock(mp->lock);
+
+		return mbuf_alloc(mp->bufsz);
+	}
+
+	buf = mp->freec ? mp->freev[--mp->freec] : NULL;
+
+	if (++mp->stat.inuse > mp->stat.inuse_peak)
+		mp->stat.inuse_peak = mp->stat.inuse;
+
+	mtx_unlock(mp->lock);
+
+	pm = mem_zalloc(sizeof(*pm), NULL);
+
+	if (!buf && pm)
+		buf = mem_alloc(mp->bufsz, NULL);
+
+	if (!pm || !buf) {
+		mtx_lock(mp->lock);
+		if (buf)
+			mp->freev[mp->freec++] = buf;
+		--mp->stat.inuse;
+		mtx_unlock(mp->lock);
+
+		mem_deref(pm);
+		return NULL;
+	}
+
+	pm->mb.buf  = buf;
+	pm->mb.size = mp->bufsz;
+	pm->mp      = mem_ref(mp);
+	mem_destructor(pm, pool_mbuf_destructor);
+
+	if (pooled)
+		*pooled = true;
+
+	return &pm->mb;
+}
+
+
+/**
+ * Get the buffer size of an mbuf pool
+ *
+ * @param mp Mbuf pool
+ *
+ * @return Buffer size in bytes
+ */
+size_t mbuf_pool_bufsz(const struct mbuf_pool *mp)
+{
+	return mp ? mp->bufsz : 0;
+}
+
+
+/**
+ * Get the statistics of an mbuf pool
+ *
+ * @param mp   Mbuf pool
+ * @param stat Returned statistics
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mbuf_pool_get_stat(struct mbuf_pool *mp, struct mbuf_pool_stat *stat)
+{
+	if (!mp || !stat)
+		return EINVAL;
+
+	mtx_lock(mp->lock);
+	*stat = mp->stat;
+	mtx_unlock(mp->lock);
+
+	return 0;
+}
@@ -12,6 +12,7 @@
 #include <re_mbuf.h>
 #include <re_mem.h>
 #include <re_btrace.h>
+#include <re_tmr.h>
 #include <re_thread.h>
 #include <re_atomic.h>
 
@@ -25,6 +26,10 @@
 #define MEM_DEBUG 1  /**< Enable memory debugging */
 #endif
 
+#ifdef RE_MEM_CACHE
+#define MEM_CACHE 1  /**< Enable per-thread size-class caches */
+#endif
+
 
 /** Defines a reference-counting memory object */
 struct mem {
@@ -36,18 +41,162 @@ struct mem {
 	struct le le;          /**< Linked list element   */
 	struct btrace btraces; /**< Backtrace array       */
 #endif
+#if MEM_CACHE
+	struct mem_cache *cache; /**< Owning cache or NULL */
+	uint32_t cls;          /**< Size class            */
+#endif
 };
 
+/*
+ * Memory statistics, sharded per thread. Each counter is written only by
+ * its owning thread, without locks or atomic read-modify-write, and the
+ * shards are summed up on read. A block freed by another thread is
+ * accounted in the shard of the freeing thread. The shard of an exited
+ * thread is reused by the next new thread.
+ */
+struct mem_shard {
+	RE_ATOMIC int64_t bytes;     /**< Allocated bytes (delta)    */
+	RE_ATOMIC int64_t blocks;    /**< Allocated blocks (delta)   */
+	RE_ATOMIC uint64_t allocs;   /**< Number of allocations      */
+	RE_ATOMIC bool used;         /**< Owned by a running thread  */
+	struct mem_shard *next;      /**< Next shard, immutable      */
+};
+
+enum {
+	STAT_PEAK_INTERVAL = 256,    /**< Allocations per peak update */
+};
+
+static struct mem_shard * RE_ATOMIC shardl;
+static RE_ATOMIC size_t bytes_peak;
+static RE_ATOMIC size_t blocks_peak;
+static once_flag shard_flag = ONCE_FLAG_INIT;
+static tss_t shard_key;
+
+
+static void shard_destructor(void *arg)
+{
+	struct mem_shard *sh = arg;
+
+	re_atomic_rls_set(&sh->used, false);
+}
+
+
+static void shard_init(void)
+{
+	(void)tss_create(&shard_key, shard_destructor);
+}
+
+
+static struct mem_shard *shard_get(void)
+{
+	struct mem_shard *sh;
+
+	call_once(&shard_flag, shard_init);
+
+	sh = tss_get(shard_key);
+	if (sh)
+		return sh;
+
+	/* reuse the shard of an exited thread */
+	for (sh = re_atomic_acq(&shardl); sh; sh = sh->next) {
+		bool used = false;
+
+		if (re_atomic_compare_exchange_strong(&sh->used, &used, true,
+						     re_memory_order_acquire,
+						     re_memory_order_relaxed))
+			break;
+	}
+
+	if (!sh) {
+		sh = calloc(1, sizeof(*sh));
+		if (!sh)
+			return NULL;
+
+		re_atomic_rlx_set(&sh->used, true);
+		sh->next = re_atomic_rlx(&shardl);
+		while (!re_atomic_compare_exchange_weak(&shardl, &sh->next, sh,
+						       re_memory_order_release,
+						       re_memory_order_relaxed))
+			;
+	}
+
+	(void)tss_set(shard_key, sh);
+
+	return sh;
+}
+
+
+static void stat_sum(int64_t *bytes, int64_t *blocks, uint64_t *allocs)
+{
+	*bytes	= 0;
+	*blocks = 0;
+	*allocs = 0;
+
+	for (struct mem_shard *sh = re_atomic_acq(&shardl); sh;
+	     sh = sh->next) {
+		*bytes	+= re_atomic_rlx(&sh->bytes);
+		*blocks += re_atomic_rlx(&sh->blocks);
+		*allocs += re_atomic_rlx(&sh->allocs);
+	}
+
+	*bytes	= max(*bytes, 0);
+	*blocks = max(*blocks, 0);
+}
+
+
+static void stat_peak_set(RE_ATOMIC size_t *peak, size_t cur)
+{
+	size_t old = re_atomic_rlx(peak);
+
+	while (cur > old) {
+		if (re_atomic_compare_exchange_weak(peak, &old, cur,
+						   re_memory_order_relaxed,
+						   re_memory_order_relaxed))
+			break;
+	}
+}
+
+
+static void stat_peak_update(void)
+{
+	int64_t bytes, blocks;
+	uint64_t allocs;
+
+	stat_sum(&bytes, &blocks, &allocs);
+
+	stat_peak_set(&bytes_peak, (size_t)bytes);
+	stat_peak_set(&blocks_peak, (size_t)blocks);
+}
+
+
+static inline void stat_add(int64_t bytes, int64_t blocks)
+{
+	struct mem_shard *sh = shard_get();
+	uint64_t allocs;
+
+	if (!sh)
+		return;
+
+	re_atomic_rlx_set(&sh->bytes, re_atomic_rlx(&sh->bytes) + bytes);
+	re_atomic_rlx_set(&sh->blocks, re_atomic_rlx(&sh->blocks) + blocks);
+
+	if (blocks <= 0)
+		return;
+
+	allocs = re_atomic_rlx(&sh->allocs) + 1;
+	re_atomic_rlx_set(&sh->allocs, allocs);
+
+	if (allocs % STAT_PEAK_INTERVAL == 0)
+		stat_peak_update();
+}
+
+
 #if MEM_DEBUG
 /* Memory debugging */
 static struct list meml = LIST_INIT;
 static const size_t mem_magic = 0xe7fb9ac4;
 static ssize_t threshold = -1;  /**< Memory threshold, disabled by default */
 
-static struct memstat memstat = {
-	0,0
-};
-
 static once_flag flag = ONCE_FLAG_INIT;
 static mtx_t mtx;
 
@@ -68,28 +217,30 @@ static inline void mem_unlock(void)
 	mtx_unlock(&mtx);
 }
 
+static size_t stat_blocks(void)
+{
+	int64_t bytes, blocks;
+	uint64_t allocs;
+
+	stat_sum(&bytes, &blocks, &allocs);
+
+	return (size_t)blocks;
+}
+
 /** Update statistics for mem_zalloc() */
 #define STAT_ALLOC(_m, _size) \
-	mem_lock(); \
-	memstat.bytes_cur += (_size); \
-	++memstat.blocks_cur; \
-	mem_unlock(); \
+	stat_add((int64_t)(_size), 1); \
 	(_m)->size = (uint32_t)(_size); \
 	(_m)->magic = mem_magic;
 
 /** Update statistics for mem_realloc() */
 #define STAT_REALLOC(_m, _size) \
-	mem_lock(); \
-	memstat.bytes_cur += ((_size) - (_m)->size); \
-	mem_unlock(); \
+	stat_add((int64_t)(_size) - (int64_t)(_m)->size, 0); \
 	(_m)->size = (uint32_t)(_size)
 
 /** Update statistics for mem_deref() */
 #define STAT_DEREF(_m) \
-	mem_lock(); \
-	memstat.bytes_cur -= (_m)->size; \
-	--memstat.blocks_cur; \
-	mem_unlock(); \
+	stat_add(-(int64_t)(_m)->size, -1); \
 	memset((_m), 0xb5, (size_t)mem_header_size + (_m)->size)
 
 /** Check magic number in memory object */
@@ -100,9 +251,14 @@ static inline void mem_unlock(void)
 		RE_BREAKPOINT;					      \
 	}
 #else
-#define STAT_ALLOC(_m, _size) (_m)->size = (uint32_t)(_size);
-#define STAT_REALLOC(_m, _size) (_m)->size = (uint32_t)(_size);
-#define STAT_DEREF(_m)
+#define STAT_ALLOC(_m, _size) \
+	stat_add((int64_t)(_size), 1); \
+	(_m)->size = (uint32_t)(_size);
+#define STAT_REALLOC(_m, _size) \
+	stat_add((int64_t)(_size) - (int64_t)(_m)->size, 0); \
+	(_m)->size = (uint32_t)(_size);
+#define STAT_DEREF(_m) \
+	stat_add(-(int64_t)(_m)->size, -1)
 #define MAGIC_CHECK(_m)
 #endif
 
@@ -136,34 +292,243 @@ static inline void *get_mem_data(struct mem *m)
 }
 
 
-/**
- * Allocate a new reference-counted memory object
- *
- * @param size Size of memory object
- * @param dh   Optional destructor, called when destroyed
- *
- * @return Pointer to allocated object
+#if MEM_CACHE
+/*
+ * Per-thread caches of free memory blocks, bucketed by size class. Blocks
+ * are allocated with malloc() and tagged with the owning cache. Blocks
+ * freed by another thread are returned to the owner through a lock-free
+ * stack, which the owner drains when a free list runs empty. The cache of
+ * an exited thread is kept and adopted by the next new thread.
  */
-void *mem_alloc(size_t size, mem_destroy_h *dh)
+enum {
+	MEM_CACHE_CLASSES = 17,
+	MEM_CACHE_MAXSIZE = 8192,
+	MEM_CACHE_DEFAULT = 65536,  /**< Bytes per size class and thread */
+};
+
+static const uint32_t cache_class_size[MEM_CACHE_CLASSES] = {
+	32, 48, 64, 96, 128, 192, 256, 384, 512, 768,
+	1024, 1536, 2048, 3072, 4096, 6144, 8192
+};
+
+struct mem_cache {
+	struct mem *freel[MEM_CACHE_CLASSES]; /**< Free lists (owner only) */
+	size_t bytes[MEM_CACHE_CLASSES];      /**< Cached bytes per class  */
+	struct mem * RE_ATOMIC remote;        /**< Blocks from others      */
+	struct mem_cache *next;               /**< Next orphaned cache     */
+};
+
+static uint8_t cache_class_lut[MEM_CACHE_MAXSIZE / 16 + 1];
+static RE_ATOMIC size_t cache_maxsize = MEM_CACHE_DEFAULT;
+static struct mem_cache *cache_orphans;
+static once_flag cache_flag = ONCE_FLAG_INIT;
+static tss_t cache_key;
+static mtx_t cache_mtx;
+
+
+/* free blocks are linked through their data area */
+static inline struct mem **cache_link(struct mem *m)
+{
+	return (struct mem **)get_mem_data(m);
+}
+
+
+static void cache_put(struct mem_cache *c, struct mem *m)
 {
+	const uint32_t csize = cache_class_size[m->cls];
+
+	if (c->bytes[m->cls] + csize >
+	    re_atomic_rlx(&cache_maxsize)) {
+		free(m);
+		return;
+	}
+
+	*cache_link(m) = c->freel[m->cls];
+	c->freel[m->cls] = m;
+	c->bytes[m->cls] += csize;
+}
+
+
+static void cache_drain(struct mem_cache *c)
+{
+	struct mem *m = re_atomic_exchange(&c->remote, NULL,
+					    re_memory_order_acquire);
+
+	while (m) {
+		struct mem *next = *cache_link(m);
+
+		cache_put(c, m);
+		m = next;
+	}
+}
+
+
+static void cache_flush(struct mem_cache *c)
+{
+	cache_drain(c);
+
+	for (size_t i = 0; i < MEM_CACHE_CLASSES; i++) {
+
+		while (c->freel[i]) {
+			struct mem *m = c->freel[i];
+
+			c->freel[i] = *cache_link(m);
+			free(m);
+		}
+
+		c->bytes[i] = 0;
+	}
+}
+
+
+/* called on thread exit, the cache is kept for remote frees */
+static void cache_destructor(void *arg)
+{
+	struct mem_cache *c = arg;
+
+	cache_flush(c);
+
+	mtx_lock(&cache_mtx);
+	c->next = cache_orphans;
+	cache_orphans = c;
+	mtx_unlock(&cache_mtx);
+}
+
+
+static void cache_init(void)
+{
+	size_t cls = 0;
+
+	for (size_t i = 0; i < RE_ARRAY_SIZE(cache_class_lut); i++) {
+
+		while (cache_class_size[cls] < i * 16)
+			++cls;
+
+		cache_class_lut[i] = (uint8_t)cls;
+	}
+
+	mtx_init(&cache_mtx, mtx_plain);
+	(void)tss_create(&cache_key, cache_destructor);
+}
+
+
+static struct mem_cache *cache_get(void)
+{
+	struct mem_cache *c;
+
+	call_once(&cache_flag, cache_init);
+
+	c = tss_get(cache_key);
+	if (c)
+		return c;
+
+	mtx_lock(&cache_mtx);
+	c = cache_orphans;
+	if (c)
+		cache_orphans = c->next;
+	mtx_unlock(&cache_mtx);
+
+	if (!c) {
+		c = calloc(1, sizeof(*c));
+		if (!c)
+			return NULL;
+	}
+
+	c->next = NULL;
+
+	if (tss_set(cache_key, c) != thrd_success) {
+		cache_destructor(c);
+		return NULL;
+	}
+
+	return c;
+}
+
+
+static struct mem *cache_alloc(size_t size)
+{
+	struct mem_cache *c;
 	struct mem *m;
+	uint32_t cls;
 
-	if (size > MEM_SIZE_MAX)
+	if (size > MEM_CACHE_MAXSIZE || !re_atomic_rlx(&cache_maxsize))
 		return NULL;
 
-#if MEM_DEBUG
-	mem_lock();
-	if (-1 != threshold && (memstat.blocks_cur >= (size_t)threshold)) {
-		mem_unlock();
+	c = cache_get();
+	if (!c)
 		return NULL;
+
+	cls = cache_class_lut[(size + 15) >> 4];
+
+	m = c->freel[cls];
+	if (!m && re_atomic_rlx(&c->remote)) {
+		cache_drain(c);
+		m = c->freel[cls];
 	}
-	mem_unlock();
+
+	if (m) {
+		c->freel[cls] = *cache_link(m);
+		c->bytes[cls] -= cache_class_size[cls];
+	}
+	else {
+		m = malloc(mem_header_size + cache_class_size[cls]);
+		if (!m)
+			return NULL;
+	}
+
+	m->cache = c;
+	m->cls   = cls;
+
+	return m;
+}
+
+
+static void cache_free(struct mem *m, struct mem_cache *c, uint32_t cls)
+{
+	struct mem *head;
+
+	m->cache = c;
+	m->cls   = cls;
+
+	if (tss_get(cache_key) == c) {
+		cache_put(c, m);
+		return;
+	}
+
+	/* cross-thread free, push to the owner */
+	head = re_atomic_rlx(&c->remote);
+	do {
+		*cache_link(m) = head;
+	} while (!re_atomic_compare_exchange_weak(&c->remote, &head, m,
+						 re_memory_order_release,
+						 re_memory_order_relaxed));
+}
+#endif
+
+
+static inline struct mem *mem_malloc(size_t size)
+{
+	struct mem *m;
+
+#if MEM_CACHE
+	m = cache_alloc(size);
+	if (m)
+		return m;
 #endif
 
 	m = malloc(mem_header_size + size);
-	if (!m)
-		return NULL;
 
+#if MEM_CACHE
+	if (m)
+		m->cache = NULL;
+#endif
+
+	return m;
+}
+
+
+static void *mem_init(struct mem *m, size_t size, mem_destroy_h *dh)
+{
 #if MEM_DEBUG
 	btrace(&m->btraces);
 	memset(&m->le, 0, sizeof(struct le));
@@ -180,6 +545,297 @@ void *mem_alloc(size_t size, mem_destroy_h *dh)
 }
 
 
+static void *mem_heap_alloc(size_t size, mem_destroy_h *dh)
+{
+	struct mem *m;
+
+	m = mem_malloc(size);
+	if (!m)
+		return NULL;
+
+	return mem_init(m, size, dh);
+}
+
+
+/*
+ * Memory arenas. Objects are bump-allocated from chunks owned by the
+ * arena and prefixed with the arena pointer and the real destructor.
+ * Each object holds a reference to its arena, so all chunks are freed
+ * together when the last object and the arena itself are dereferenced.
+ * The arena destructor is set as the object destructor, which also marks
+ * the object as an arena object.
+ */
+enum {
+	ARENA_CHUNK_SIZE = 4096,  /**< Default chunk size */
+};
+
+struct arena_chunk {
+	struct arena_chunk *next;  /**< Next chunk in arena */
+};
+
+struct arena_obj {
+	struct mem_arena *arena;   /**< Owning arena        */
+	mem_destroy_h *dh;         /**< Object destructor   */
+};
+
+/** Defines a memory arena */
+struct mem_arena {
+	struct arena_chunk *chunkl; /**< List of chunks               */
+	uint8_t *pos;               /**< Free space in current chunk  */
+	uint8_t *end;               /**< End of current chunk         */
+	size_t chunksz;             /**< Size of new chunks           */
+	struct mem_arena *prev;     /**< Previous arena of the thread */
+};
+
+enum {
+	arena_chunk_size = (sizeof(struct arena_chunk) + alignment_mask) &
+		(~(size_t)alignment_mask),
+	arena_obj_size = (sizeof(struct arena_obj) + alignment_mask) &
+		(~(size_t)alignment_mask),
+};
+
+static RE_ATOMIC uint32_t arena_scopes;
+static once_flag arena_flag = ONCE_FLAG_INIT;
+static tss_t arena_key;
+
+
+static void arena_init(void)
+{
+	(void)tss_create(&arena_key, NULL);
+}
+
+
+static inline struct arena_obj *arena_obj(struct mem *m)
+{
+	return (struct arena_obj *)(void *)(((uint8_t *)m) - arena_obj_size);
+}
+
+
+static void arena_obj_destructor(void *data)
+{
+	struct arena_obj *o = arena_obj(get_mem(data));
+
+	if (o->dh)
+		o->dh(data);
+}
+
+
+static void arena_destructor(void *data)
+{
+	struct mem_arena *a = data;
+
+	while (a->chunkl) {
+		struct arena_chunk *chunk = a->chunkl;
+
+		a->chunkl = chunk->next;
+		free(chunk);
+	}
+}
+
+
+static uint8_t *arena_chunk_alloc(struct mem_arena *a, size_t size)
+{
+	struct arena_chunk *chunk;
+
+	chunk = malloc(arena_chunk_size + size);
+	if (!chunk)
+		return NULL;
+
+	chunk->next = a->chunkl;
+	a->chunkl   = chunk;
+
+	return (uint8_t *)chunk + arena_chunk_size;
+}
+
+
+static void *arena_alloc(struct mem_arena *a, size_t size, mem_destroy_h *dh)
+{
+	struct arena_obj *o;
+	struct mem *m;
+	size_t need;
+	uint8_t *p;
+
+	need = (arena_obj_size + mem_header_size + size + alignment_mask) &
+		(~(size_t)alignment_mask);
+
+	if (need <= (size_t)(a->end - a->pos)) {
+		p = a->pos;
+		a->pos += need;
+	}
+	else if (need > a->chunksz / 2) {
+		/* large objects get a chunk of their own */
+		p = arena_chunk_alloc(a, need);
+		if (!p)
+			return NULL;
+	}
+	else {
+		p = arena_chunk_alloc(a, a->chunksz);
+		if (!p)
+			return NULL;
+
+		a->pos = p + need;
+		a->end = p + a->chunksz;
+	}
+
+	o = (struct arena_obj *)(void *)p;
+	o->arena = mem_ref(a);
+	o->dh    = dh;
+
+	m = (struct mem *)(void *)(p + arena_obj_size);
+#if MEM_CACHE
+	m->cache = NULL;
+#endif
+
+	return mem_init(m, size, arena_obj_destructor);
+}
+
+
+static inline struct mem_arena *arena_current(void)
+{
+	if (!re_atomic_acq(&arena_scopes))
+		return NULL;
+
+	return tss_get(arena_key);
+}
+
+
+static void *arena_realloc(void *data, size_t size)
+{
+	struct mem *m = get_mem(data);
+	struct arena_obj *o = arena_obj(m);
+	void *p;
+
+	if (size <= m->size) {
+		STAT_REALLOC(m, size);
+		return data;
+	}
+
+	/* a growing object leaves the arena */
+	p = mem_heap_alloc(size, o->dh);
+	if (!p)
+		return NULL;
+
+	memcpy(p, data, m->size);
+
+	if (re_atomic_acq(&m->nrefs) == 1u)
+		o->dh = NULL;
+
+	mem_deref(data);
+
+	return p;
+}
+
+
+/**
+ * Allocate a memory arena. While the arena is entered with
+ * mem_arena_enter(), all objects allocated by the calling thread are
+ * taken from the arena chunks instead of malloc(). The objects keep their
+ * mem_ref()/mem_deref() semantics, and the chunks are freed together
+ * when the last reference to the arena and its objects is gone.
+ *
+ * @param arenap Pointer to allocated memory arena
+ * @param size   Size of the first chunk, 0 for default
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mem_arena_alloc(struct mem_arena **arenap, size_t size)
+{
+	struct mem_arena *a;
+
+	if (!arenap || size > MEM_SIZE_MAX)
+		return EINVAL;
+
+	a = mem_heap_alloc(sizeof(*a), arena_destructor);
+	if (!a)
+		return ENOMEM;
+
+	memset(a, 0, sizeof(*a));
+
+	a->chunksz = size ? size : ARENA_CHUNK_SIZE;
+
+	a->pos = arena_chunk_alloc(a, a->chunksz);
+	if (!a->pos) {
+		mem_deref(a);
+		return ENOMEM;
+	}
+
+	a->end = a->pos + a->chunksz;
+
+	*arenap = a;
+
+	return 0;
+}
+
+
+/**
+ * Enter a memory arena. Subsequent allocations of the calling thread are
+ * taken from the arena until mem_arena_leave() is called. Arenas can be
+ * nested, but an arena must only be entered by one thread at a time.
+ * Objects from an arena can be dereferenced in any thread.
+ *
+ * @param arena Memory arena
+ */
+void mem_arena_enter(struct mem_arena *arena)
+{
+	if (!arena)
+		return;
+
+	call_once(&arena_flag, arena_init);
+
+	arena->prev = tss_get(arena_key);
+	(void)tss_set(arena_key, mem_ref(arena));
+
+	re_atomic_fetch_add(&arena_scopes, 1u, re_memory_order_release);
+}
+
+
+/**
+ * Leave the memory arena entered last by the calling thread
+ */
+void mem_arena_leave(void)
+{
+	struct mem_arena *a = arena_current();
+
+	if (!a)
+		return;
+
+	(void)tss_set(arena_key, a->prev);
+	a->prev = NULL;
+
+	re_atomic_fetch_sub(&arena_scopes, 1u, re_memory_order_relaxed);
+
+	mem_deref(a);
+}
+
+
+/**
+ * Allocate a new reference-counted memory object
+ *
+ * @param size Size of memory object
+ * @param dh   Optional destructor, called when destroyed
+ *
+ * @return Pointer to allocated object
+ */
+void *mem_alloc(size_t size, mem_destroy_h *dh)
+{
+	struct mem_arena *a;
+
+	if (size > MEM_SIZE_MAX)
+		return NULL;
+
+#if MEM_DEBUG
+	if (-1 != threshold && (stat_blocks() >= (size_t)threshold))
+		return NULL;
+#endif
+
+	a = arena_current();
+	if (a)
+		return arena_alloc(a, size, dh);
+
+	return mem_heap_alloc(size, dh);
+}
+
+
 /**
  * Allocate a new reference-counted memory object. Memory is zeroed.
  *
@@ -226,6 +882,9 @@ void *mem_realloc(void *data, size_t size)
 
 	MAGIC_CHECK(m);
 
+	if (m->dh == arena_obj_destructor)
+		return arena_realloc(data, size);
+
 	if (re_atomic_acq(&m->nrefs) > 1u) {
 		void* p = mem_alloc(size, m->dh);
 		if (p) {
@@ -235,12 +894,20 @@ void *mem_realloc(void *data, size_t size)
 		return p;
 	}
 
+#if MEM_CACHE
+	/* fits into the size class of the cached block */
+	if (m->cache && size <= cache_class_size[m->cls]) {
+		STAT_REALLOC(m, size);
+		return data;
+	}
+#endif
+
 #if MEM_DEBUG
 	mem_lock();
 
 	/* Simulate OOM */
 	if (-1 != threshold && size > m->size) {
-		if (memstat.blocks_cur >= (size_t)threshold) {
+		if (stat_blocks() >= (size_t)threshold) {
 			mem_unlock();
 			return NULL;
 		}
@@ -251,6 +918,11 @@ void *mem_realloc(void *data, size_t size)
 	mem_unlock();
 #endif
 
+#if MEM_CACHE
+	/* the block leaves the cache, it was allocated with malloc() */
+	m->cache = NULL;
+#endif
+
 	m2 = realloc(m, mem_header_size + size);
 
 #if MEM_DEBUG
@@ -316,7 +988,10 @@ void mem_destructor(void *data, mem_destroy_h *dh)
 
 	MAGIC_CHECK(m);
 
-	m->dh = dh;
+	if (m->dh == arena_obj_destructor)
+		arena_obj(m)->dh = dh;
+	else
+		m->dh = dh;
 }
 
 
@@ -382,6 +1057,25 @@ void *mem_deref(void *data)
 	mem_unlock();
 #endif
 
+	if (m->dh == arena_obj_destructor) {
+		struct mem_arena *a = arena_obj(m)->arena;
+
+		STAT_DEREF(m);
+		mem_deref(a);
+		return NULL;
+	}
+
+#if MEM_CACHE
+	if (m->cache) {
+		struct mem_cache *c = m->cache;
+		uint32_t cls = m->cls;
+
+		STAT_DEREF(m);
+		cache_free(m, c, cls);
+		return NULL;
+	}
+#endif
+
 	STAT_DEREF(m);
 
 	free(m);
@@ -510,17 +1204,22 @@ void mem_threshold_set(ssize_t n)
  */
 int mem_status(struct re_printf *pf, void *unused)
 {
-#if MEM_DEBUG
+	static RE_ATOMIC uint64_t last_allocs;
+	static RE_ATOMIC uint64_t last_usec;
 	struct memstat stat;
-	uint32_t c;
+	uint64_t now, usec, allocs, rate = 0;
 	int err = 0;
 
 	(void)unused;
 
-	mem_lock();
-	memcpy(&stat, &memstat, sizeof(stat));
-	c = list_count(&meml);
-	mem_unlock();
+	(void)mem_get_stat(&stat);
+
+	now    = tmr_jiffies_usec();
+	usec   = re_atomic_exchange(&last_usec, now, re_memory_order_relaxed);
+	allocs = re_atomic_exchange(&last_allocs, stat.allocs,
+				    re_memory_order_relaxed);
+	if (usec && now > usec)
+		rate = (stat.allocs - allocs) * 1000000 / (now - usec);
 
 	err |= re_hprintf(pf,
 			  "Memory status: (%zu bytes overhead per block)\n",
@@ -530,19 +1229,67 @@ int mem_status(struct re_printf *pf, void *unused)
 			  stat.blocks_cur, stat.bytes_cur,
 			  stat.bytes_cur
 			  + (stat.blocks_cur * (size_t)mem_header_size));
-	err |= re_hprintf(pf, " Total %u blocks allocated\n", c);
+	err |= re_hprintf(pf,
+			  " Peak: %zu blocks, %zu bytes\n",
+			  stat.blocks_peak, stat.bytes_peak);
+	err |= re_hprintf(pf, " Total %llu allocations", stat.allocs);
+	if (usec)
+		err |= re_hprintf(pf, " (%llu/sec)", rate);
+	err |= re_hprintf(pf, "\n");
+
+#if MEM_DEBUG
+	mem_lock();
+	err |= re_hprintf(pf, " Total %u blocks allocated\n",
+			  list_count(&meml));
+	mem_unlock();
+#endif
 
 	return err;
-#else
-	(void)pf;
-	(void)unused;
+}
+
+
+/**
+ * Set the size of the per-thread memory caches. Small blocks are kept in
+ * thread-local free lists, bucketed by size class, instead of returning
+ * them to malloc(). Only available if built with RE_MEM_CACHE.
+ *
+ * @param maxsize Maximum cached bytes per size class and thread,
+ *                0 to disable caching
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mem_cache_set(size_t maxsize)
+{
+#if MEM_CACHE
+	re_atomic_rlx_set(&cache_maxsize, maxsize);
 	return 0;
+#else
+	(void)maxsize;
+	return ENOSYS;
+#endif
+}
+
+
+/**
+ * Return all cached memory blocks of the calling thread to malloc()
+ */
+void mem_cache_flush(void)
+{
+#if MEM_CACHE
+	struct mem_cache *c;
+
+	call_once(&cache_flag, cache_init);
+
+	c = tss_get(cache_key);
+	if (c)
+		cache_flush(c);
 #endif
 }
 
 
 /**
- * Get memory statistics
+ * Get memory statistics. The counters are always enabled, also in release
+ * builds, and are summed up from the per-thread shards on each call.
  *
  * @param mstat Returned memory statistics
  *
@@ -550,14 +1297,21 @@ int mem_status(struct re_printf *pf, void *unused)
  */
 int mem_get_stat(struct memstat *mstat)
 {
+	int64_t bytes, blocks;
+
 	if (!mstat)
 		return EINVAL;
-#if MEM_DEBUG
-	mem_lock();
-	memcpy(mstat, &memstat, sizeof(*mstat));
-	mem_unlock();
+
+	stat_sum(&bytes, &blocks, &mstat->allocs);
+
+	mstat->bytes_cur  = (size_t)bytes;
+	mstat->blocks_cur = (size_t)blocks;
+
+	stat_peak_set(&bytes_peak, mstat->bytes_cur);
+	stat_peak_set(&blocks_peak, mstat->blocks_cur);
+
+	mstat->bytes_peak  = re_atomic_rlx(&bytes_peak);
+	mstat->blocks_peak = re_atomic_rlx(&blocks_peak);
+
 	return 0;
-#else
-	return ENOSYS;
-#endif
 }
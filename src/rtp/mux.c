@@ -0,0 +1,402 @@
+/**
+ * @file rtp/mux.c  Shared UDP socket for many RTP sessions
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <re_types.h>
+#include <re_fmt.h>
+#include <re_mem.h>
+#include <re_mbuf.h>
+#include <re_list.h>
+#include <re_hash.h>
+#include <re_sa.h>
+#include <re_udp.h>
+#include <re_rtp.h>
+#include "rtcp.h"
+
+
+#define DEBUG_MODULE "rtp_mux"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+enum {
+	MUX_BSIZE = 64,   /**< Initial size of the demux tables */
+};
+
+
+/** Defines a shared RTP/RTCP socket */
+struct rtp_mux {
+	struct udp_sock *us;    /**< Shared UDP socket               */
+	struct sa local;        /**< Local address                   */
+	struct hash *ht_addr;   /**< Entries by remote address       */
+	struct hash *ht_ssrc;   /**< Entries by remote SSRC          */
+	uint32_t entc;          /**< Number of attached RTP sockets  */
+	struct {
+		uint64_t rx;        /**< Received packets            */
+		uint64_t ssrc;      /**< Matched by SSRC only        */
+		uint64_t latched;   /**< Remote addresses learned    */
+		uint64_t unmatched; /**< Dropped, no RTP socket      */
+	} stats;
+};
+
+
+/** One RTP socket attached to a shared socket */
+struct rtp_muxent {
+	struct le he_addr;      /**< Hash element, by remote address */
+	struct le he_ssrc;      /**< Hash element, by remote SSRC    */
+	struct sa peer;         /**< Remote address                  */
+	uint32_t ssrc;          /**< Remote SSRC                     */
+	bool has_ssrc;          /**< Remote SSRC is set              */
+	struct rtp_mux *mux;    /**< Shared socket                   */
+	struct rtp_sock *rs;    /**< RTP socket (not referenced)     */
+};
+
+/** Demux key, an RTP socket is found by remote address and SSRC */
+struct mux_key {
+	const struct rtp_muxent *self;  /**< Entry to skip or NULL   */
+	const struct sa *peer;          /**< Remote address or NULL  */
+	uint32_t ssrc;
+	bool has_ssrc;
+};
+
+
+static void mux_destructor(void *arg)
+{
+	struct rtp_mux *mux = arg;
+
+	hash_clear(mux->ht_addr);
+	hash_clear(mux->ht_ssrc);
+	mem_deref(mux->ht_addr);
+	mem_deref(mux->ht_ssrc);
+	mem_deref(mux->us);
+}
+
+
+static void ent_destructor(void *arg)
+{
+	struct rtp_muxent *e = arg;
+
+	hash_unlink(&e->he_addr);
+	hash_unlink(&e->he_ssrc);
+
+	--e->mux->entc;
+	mem_deref(e->mux);
+}
+
+
+static uint32_t addr_key(struct le *le)
+{
+	const struct rtp_muxent *e = le->data;
+
+	return sa_hash(&e->peer, SA_ALL);
+}
+
+
+static uint32_t ssrc_key(struct le *le)
+{
+	const struct rtp_muxent *e = le->data;
+
+	return e->ssrc;
+}
+
+
+/* same remote address, and same SSRC or both without one */
+static bool addr_cmp_handler(struct le *le, void *arg)
+{
+	const struct rtp_muxent *e = le->data;
+	const struct mux_key *key = arg;
+
+	return e != key->self && sa_cmp(&e->peer, key->peer, SA_ALL) &&
+		e->has_ssrc == key->has_ssrc &&
+		(!e->has_ssrc || e->ssrc == key->ssrc);
+}
+
+
+/* same remote address, any SSRC */
+static bool peer_cmp_handler(struct le *le, void *arg)
+{
+	const struct rtp_muxent *e = le->data;
+
+	return sa_cmp(&e->peer, arg, SA_ALL);
+}
+
+
+/* same SSRC, and no remote address yet */
+static bool ssrc_cmp_handler(struct le *le, void *arg)
+{
+	const struct rtp_muxent *e = le->data;
+	const struct mux_key *key = arg;
+
+	return e != key->self && e->has_ssrc && e->ssrc == key->ssrc &&
+		!sa_isset(&e->peer, SA_ALL);
+}
+
+
+static struct rtp_muxent *addr_lookup(const struct rtp_mux *mux,
+				      const struct mux_key *key)
+{
+	return list_ledata(hash_lookup(mux->ht_addr,
+				       sa_hash(key->peer, SA_ALL),
+				       addr_cmp_handler, (void *)key));
+}
+
+
+static struct rtp_muxent *ssrc_lookup(const struct rtp_mux *mux,
+				      const struct mux_key *key)
+{
+	return list_ledata(hash_lookup(mux->ht_ssrc, key->ssrc,
+				       ssrc_cmp_handler, (void *)key));
+}
+
+
+/* another entry would receive the same packets */
+static bool ent_dup(const struct rtp_muxent *e, const struct sa *peer,
+		    bool has_ssrc, uint32_t ssrc)
+{
+	struct mux_key key = {e, peer, ssrc, has_ssrc};
+
+	if (peer && sa_isset(peer, SA_ALL))
+		return addr_lookup(e->mux, &key) != NULL;
+
+	return has_ssrc && ssrc_lookup(e->mux, &key) != NULL;
+}
+
+
+/* Sender SSRC of an RTP or RTCP packet */
+static bool pkt_ssrc(uint32_t *ssrc, const struct mbuf *mb)
+{
+	const uint8_t *p = mbuf_buf(mb);
+	size_t offs;
+
+	if (mbuf_get_left(mb) < RTP_HEADER_SIZE || (p[0] >> 6) != RTP_VERSION)
+		return false;
+
+	offs = rtp_pt_is_rtcp(p[1] & 0x7f) ? 4 : 8;
+
+	*ssrc = (uint32_t)p[offs] << 24 | (uint32_t)p[offs+1] << 16 |
+		(uint32_t)p[offs+2] << 8 | (uint32_t)p[offs+3];
+
+	return true;
+}
+
+
+static void udp_recv_handler(const struct sa *src, struct mbuf *mb, void *arg)
+{
+	struct rtp_mux *mux = arg;
+	struct mux_key key = {NULL, src, 0, false};
+	struct rtp_muxent *e;
+
+	++mux->stats.rx;
+
+	/* not RTP or RTCP, e.g. STUN -- match the address only */
+	if (!pkt_ssrc(&key.ssrc, mb)) {
+		e = list_ledata(hash_lookup(mux->ht_addr, sa_hash(src, SA_ALL),
+					    peer_cmp_handler, (void *)src));
+		if (!e)
+			goto drop;
+
+		goto recv;
+	}
+
+	/* a remote address may carry several sessions, e.g. a shared
+	   port on the remote side, which are told apart by the SSRC */
+	key.has_ssrc = true;
+	e = addr_lookup(mux, &key);
+	if (e)
+		goto recv;
+
+	key.has_ssrc = false;
+	e = addr_lookup(mux, &key);
+	if (e)
+		goto recv;
+
+	/* the first packet of a session that only knows the remote SSRC,
+	   its address is learned once. An address is never moved, since
+	   the SSRC is not authenticated. */
+	key.has_ssrc = true;
+	e = ssrc_lookup(mux, &key);
+	if (!e)
+		goto drop;
+
+	++mux->stats.ssrc;
+
+	if (rtp_muxent_peer_set(e, src))
+		goto drop;
+
+	++mux->stats.latched;
+
+ recv:
+	rtp_sock_recv(e->rs, src, mb);
+	return;
+
+ drop:
+	++mux->stats.unmatched;
+}
+
+
+/**
+ * Allocate a shared RTP/RTCP socket
+ *
+ * Many RTP sockets can be attached with rtp_mux_listen(). Incoming
+ * packets are demultiplexed by their remote address, and by the sender
+ * SSRC. The remote address of a socket that only knows the remote SSRC
+ * is learned from its first packet. RTP and RTCP
+ * are always multiplexed on the same port (RFC 5761).
+ *
+ * @param muxp  Pointer to allocated shared socket
+ * @param laddr Local address, port 0 picks a free port
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int rtp_mux_alloc(struct rtp_mux **muxp, const struct sa *laddr)
+{
+	struct rtp_mux *mux;
+	int err;
+
+	if (!muxp || !laddr)
+		return EINVAL;
+
+	mux = mem_zalloc(sizeof(*mux), mux_destructor);
+	if (!mux)
+		return ENOMEM;
+
+	err  = hash_alloc(&mux->ht_addr, MUX_BSIZE);
+	err |= hash_alloc(&mux->ht_ssrc, MUX_BSIZE);
+	if (err)
+		goto out;
+
+	err  = hash_grow_set(mux->ht_addr, addr_key);
+	err |= hash_grow_set(mux->ht_ssrc, ssrc_key);
+	if (err)
+		goto out;
+
+	err = udp_listen(&mux->us, laddr, udp_recv_handler, mux);
+	if (err)
+		goto out;
+
+	err = udp_local_get(mux->us, &mux->local);
+	if (err)
+		goto out;
+
+ out:
+	if (err)
+		mem_deref(mux);
+	else
+		*muxp = mux;
+
+	return err;
+}
+
+
+/**
+ * Get the local address of a shared RTP/RTCP socket
+ *
+ * @param mux Shared socket
+ *
+ * @return Local address
+ */
+const struct sa *rtp_mux_local(const struct rtp_mux *mux)
+{
+	return mux ? &mux->local : NULL;
+}
+
+
+/**
+ * Get the UDP socket of a shared RTP/RTCP socket
+ *
+ * @param mux Shared socket
+ *
+ * @return UDP socket
+ *
+ * @note UDP helpers registered on it see the packets of all sessions
+ */
+void *rtp_mux_sock(const struct rtp_mux *mux)
+{
+	return mux ? mux->us : NULL;
+}
+
+
+/**
+ * Shared RTP/RTCP socket debug handler, use with fmt %H
+ *
+ * @param pf  Print function
+ * @param mux Shared socket
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int rtp_mux_debug(struct re_printf *pf, const struct rtp_mux *mux)
+{
+	if (!mux)
+		return 0;
+
+	return re_hprintf(pf, "rtp_mux %J: sessions=%u rx=%llu ssrc=%llu"
+			  " latched=%llu unmatched=%llu\n",
+			  &mux->local, mux->entc,
+			  mux->stats.rx, mux->stats.ssrc,
+			  mux->stats.latched, mux->stats.unmatched);
+}
+
+
+int rtp_mux_attach(struct rtp_muxent **ep, struct rtp_mux *mux,
+		   struct rtp_sock *rs)
+{
+	struct rtp_muxent *e;
+
+	if (!ep || !mux || !rs)
+		return EINVAL;
+
+	e = mem_zalloc(sizeof(*e), ent_destructor);
+	if (!e)
+		return ENOMEM;
+
+	sa_init(&e->peer, AF_UNSPEC);
+	e->mux = mem_ref(mux);
+	e->rs  = rs;
+	++mux->entc;
+
+	*ep = e;
+
+	return 0;
+}
+
+
+int rtp_muxent_peer_set(struct rtp_muxent *e, const struct sa *peer)
+{
+	if (!e)
+		return EINVAL;
+
+	if (ent_dup(e, peer, e->has_ssrc, e->ssrc))
+		return EADDRINUSE;
+
+	hash_unlink(&e->he_addr);
+
+	if (peer && sa_isset(peer, SA_ALL)) {
+		e->peer = *peer;
+		hash_append(e->mux->ht_addr, sa_hash(peer, SA_ALL),
+			    &e->he_addr, e);
+	}
+	else {
+		sa_init(&e->peer, AF_UNSPEC);
+	}
+
+	return 0;
+}
+
+
+int rtp_muxent_ssrc_set(struct rtp_muxent *e, uint32_t ssrc)
+{
+	if (!e)
+		return EINVAL;
+
+	if (ent_dup(e, &e->peer, true, ssrc))
+		return EADDRINUSE;
+
+	hash_unlink(&e->he_ssrc);
+
+	e->ssrc     = ssrc;
+	e->has_ssrc = true;
+	hash_append(e->mux->ht_ssrc, ssrc, &e->he_ssrc, e);
+
+	return 0;
+}
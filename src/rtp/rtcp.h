@@ -68,6 +68,15 @@ uint64_t ntp_compact2us(uint32_t ntpc);
 
 /* RTP Socket */
 struct rtcp_sess *rtp_rtcp_sess(const struct rtp_sock *rs);
+void rtp_sock_recv(struct rtp_sock *rs, const struct sa *src,
+		   struct mbuf *mb);
+
+/* Shared RTP/RTCP socket */
+struct rtp_muxent;
+int  rtp_mux_attach(struct rtp_muxent **ep, struct rtp_mux *mux,
+		    struct rtp_sock *rs);
+int  rtp_muxent_peer_set(struct rtp_muxent *e, const struct sa *peer);
+int  rtp_muxent_ssrc_set(struct rtp_muxent *e, uint32_t ssrc);
 
 /* RTCP message */
 typedef int (rtcp_encode_h)(struct mbuf *mb, void *arg);
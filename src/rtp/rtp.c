@@ -38,6 +38,7 @@ struct rtp_sock {
 	void *arg;              /**< Handler argument      */
 	struct rtcp_sess *rtcp; /**< RTCP Session          */
 	RE_ATOMIC bool rtcp_mux;  /**< RTP/RTCP multiplexing */
+	struct rtp_muxent *muxe;  /**< Shared socket entry    */
 };
 
 
@@ -141,8 +142,14 @@ static void destructor(void *data)
 {
 	struct rtp_sock *rs = data;
 
-	udp_handler_set(rs->sock_rtp, NULL, NULL);
-	udp_handler_set(rs->sock_rtcp, NULL, NULL);
+	/* the shared socket keeps its handler */
+	if (rs->muxe) {
+		mem_deref(rs->muxe);
+	}
+	else {
+		udp_handler_set(rs->sock_rtp, NULL, NULL);
+		udp_handler_set(rs->sock_rtcp, NULL, NULL);
+	}
 
 	/* Destroy RTCP Session now */
 	mem_deref(rs->rtcp);
@@ -213,6 +220,13 @@ static void udp_recv_handler(const struct sa *src, struct mbuf *mb, void *arg)
 }
 
 
+void rtp_sock_recv(struct rtp_sock *rs, const struct sa *src,
+		   struct mbuf *mb)
+{
+	udp_recv_handler(src, mb, rs);
+}
+
+
 static int udp_range_listen(struct rtp_sock *rs, const struct sa *ip,
 			    uint16_t min_port, uint16_t max_port)
 {
@@ -342,6 +356,108 @@ int rtp_listen(struct rtp_sock **rsp, int proto, const struct sa *ip,
 }
 
 
+/**
+ * Listen on a shared RTP/RTCP Socket
+ *
+ * The RTP socket receives the packets of the shared socket that come
+ * from its remote address, see rtp_mux_peer_set(), or carry its remote
+ * SSRC, see rtp_mux_ssrc_set(). RTCP is multiplexed on the RTP port.
+ *
+ * @param rsp         Pointer to returned RTP socket
+ * @param mux         Shared RTP/RTCP socket
+ * @param enable_rtcp True to enable RTCP Session
+ * @param recvh       RTP Receive handler
+ * @param rtcph       RTCP Receive handler
+ * @param arg         Handler argument
+ *
+ * @return 0 for success, otherwise errorcode
+ */
+int rtp_mux_listen(struct rtp_sock **rsp, struct rtp_mux *mux,
+		   bool enable_rtcp, rtp_recv_h *recvh, rtcp_recv_h *rtcph,
+		   void *arg)
+{
+	struct rtp_sock *rs;
+	int err;
+
+	if (!rsp || !mux || !recvh)
+		return EINVAL;
+
+	err = rtp_alloc(&rs);
+	if (err)
+		return err;
+
+	rs->recvh = recvh;
+	rs->rtcph = rtcph;
+	rs->arg   = arg;
+	rs->local = *rtp_mux_local(mux);
+	re_atomic_rlx_set(&rs->rtcp_mux, true);
+
+	if (enable_rtcp) {
+		err = rtcp_sess_alloc(&rs->rtcp, rs);
+		if (err)
+			goto out;
+	}
+
+	err = rtp_mux_attach(&rs->muxe, mux, rs);
+	if (err)
+		goto out;
+
+	rs->sock_rtp = mem_ref(rtp_mux_sock(mux));
+
+ out:
+	if (err)
+		mem_deref(rs);
+	else
+		*rsp = rs;
+
+	return err;
+}
+
+
+/**
+ * Set the remote address of an RTP socket on a shared socket
+ *
+ * The address is never moved by received packets. After a NAT
+ * rebinding, confirmed e.g. by SRTP authentication, the application
+ * sets the new address.
+ *
+ * @param rs   RTP Socket
+ * @param peer Remote RTP/RTCP address, NULL to learn it from the SSRC
+ *
+ * @return 0 if success, EADDRINUSE if another RTP socket has the same
+ *         remote address and SSRC, otherwise errorcode
+ */
+int rtp_mux_peer_set(struct rtp_sock *rs, const struct sa *peer)
+{
+	if (!rs)
+		return EINVAL;
+
+	return rtp_muxent_peer_set(rs->muxe, peer);
+}
+
+
+/**
+ * Set the remote SSRC of an RTP socket on a shared socket
+ *
+ * Without a remote address, the address is learned once from the first
+ * packet with this SSRC. Sockets that share a remote address are told
+ * apart by their remote SSRC, set it before the address.
+ *
+ * @param rs   RTP Socket
+ * @param ssrc Remote SSRC
+ *
+ * @return 0 if success, EADDRINUSE if another RTP socket has the same
+ *         remote address and SSRC, otherwise errorcode
+ */
+int rtp_mux_ssrc_set(struct rtp_sock *rs, uint32_t ssrc)
+{
+	if (!rs)
+		return EINVAL;
+
+	return rtp_muxent_ssrc_set(rs->muxe, ssrc);
+}
+
+
 /**
  * Open RTP Socket without bind.
  *
@@ -686,6 +802,10 @@ void rtcp_enable_mux(struct rtp_sock *rs, bool enabled)
 	if (!rs)
 		return;
 
+	/* a shared socket has no separate RTCP port */
+	if (rs->muxe)
+		enabled = true;
+
 	re_atomic_rlx_set(&rs->rtcp_mux, enabled);
 }
 
@@ -727,6 +847,10 @@ int rtp_clear(struct rtp_sock *rs)
 	if (!rs)
 		return EINVAL;
 
+	/* the shared socket also buffers other sessions */
+	if (rs->muxe)
+		return 0;
+
 	udp_flush(rs->sock_rtp);
 
 	return 0;
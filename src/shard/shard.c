@@ -0,0 +1,427 @@
+/**
+ * @file shard.c  Sharded reactors
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#ifndef WIN32
+#include <sys/types.h>
+#include <sys/socket.h>
+#endif
+#ifdef LINUX
+#include <linux/filter.h>
+#endif
+#include <re_types.h>
+#include <re_fmt.h>
+#include <re_mem.h>
+#include <re_list.h>
+#include <re_thread.h>
+#include <re_async.h>
+#include <re_main.h>
+#include <re_mqueue.h>
+#include <re_shard.h>
+
+
+#define DEBUG_MODULE "shard"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+enum {
+	SHARD_WAKEUP = 0,
+	SHARD_QUIT   = 1,
+};
+
+struct shard {
+	struct shards *shs;
+	struct mqueue *mq;
+	struct list msgl;
+	mtx_t *mtx;
+	cnd_t ready;
+	thrd_t thrd;
+	unsigned idx;
+	bool started;
+	bool running;
+	int err;
+};
+
+struct shards {
+	struct shard **shv;
+	unsigned n;
+	shard_init_h *inith;
+	shard_close_h *closeh;
+	void *arg;
+};
+
+struct shard_msg {
+	struct le le;
+	re_async_h *cb;
+	void *arg;
+};
+
+
+static void msg_flush(struct shard *sh, int err)
+{
+	for (;;) {
+		struct shard_msg *msg;
+		struct le *le;
+
+		mtx_lock(sh->mtx);
+		le = list_head(&sh->msgl);
+		list_unlink(le);
+		mtx_unlock(sh->mtx);
+
+		if (!le)
+			break;
+
+		msg = le->data;
+		msg->cb(err, msg->arg);
+		mem_deref(msg);
+	}
+}
+
+
+static void mqueue_handler(int id, void *data, void *arg)
+{
+	struct shard *sh = arg;
+	(void)data;
+
+	if (id == SHARD_QUIT) {
+		re_cancel();
+		return;
+	}
+
+	msg_flush(sh, 0);
+}
+
+
+static int shard_thread(void *arg)
+{
+	struct shard *sh = arg;
+	struct shards *shs = sh->shs;
+	int err;
+
+	err = re_thread_init();
+	if (err)
+		goto ready;
+
+	err = mqueue_alloc(&sh->mq, mqueue_handler, sh);
+	if (err)
+		goto ready;
+
+	err = shs->inith(sh, shs->arg);
+
+ ready:
+	mtx_lock(sh->mtx);
+	sh->err     = err;
+	sh->running = !err;
+	cnd_signal(&sh->ready);
+	mtx_unlock(sh->mtx);
+
+	if (err)
+		goto out;
+
+	err = re_main(NULL);
+
+	mtx_lock(sh->mtx);
+	sh->running = false;
+	mtx_unlock(sh->mtx);
+
+	msg_flush(sh, ECANCELED);
+
+	if (shs->closeh)
+		shs->closeh(sh, shs->arg);
+
+ out:
+	sh->mq = mem_deref(sh->mq);
+	re_thread_close();
+
+	return err;
+}
+
+
+static void shard_destructor(void *data)
+{
+	struct shard *sh = data;
+
+	if (sh->started) {
+		mtx_lock(sh->mtx);
+		if (sh->running)
+			(void)mqueue_push(sh->mq, SHARD_QUIT, NULL);
+		sh->running = false;
+		mtx_unlock(sh->mtx);
+
+		thrd_join(sh->thrd, NULL);
+		cnd_destroy(&sh->ready);
+	}
+
+	list_flush(&sh->msgl);
+	mem_deref(sh->mtx);
+}
+
+
+static void shards_destructor(void *data)
+{
+	struct shards *shs = data;
+
+	/* stop the shards in reverse order of their creation */
+	for (unsigned i = shs->n; i > 0; i--)
+		mem_deref(shs->shv[i - 1]);
+
+	mem_deref(shs->shv);
+}
+
+
+static int shard_start(struct shard *sh)
+{
+	char name[16];
+	int err;
+
+	if (cnd_init(&sh->ready) != thrd_success)
+		return ENOMEM;
+
+	(void)re_snprintf(name, sizeof(name), "re_shard%u", sh->idx);
+
+	mtx_lock(sh->mtx);
+
+	err = thread_create_name(&sh->thrd, name, shard_thread, sh);
+	if (err) {
+		mtx_unlock(sh->mtx);
+		cnd_destroy(&sh->ready);
+		return err;
+	}
+
+	sh->started = true;
+	sh->err     = -1;
+
+	/* wait for the init handler, so shards join the reuseport
+	   group in index order */
+	while (sh->err == -1)
+		cnd_wait(&sh->ready, sh->mtx);
+
+	err = sh->err;
+	mtx_unlock(sh->mtx);
+
+	return err;
+}
+
+
+/**
+ * Allocate a set of sharded reactors. Each shard runs its own thread with
+ * its own re main loop. The init handler is called in each shard thread,
+ * one shard at a time in index order, and typically opens the shard's
+ * SO_REUSEPORT listeners (udp_listen_reuseport, tcp_listen).
+ *
+ * @param shsp   Pointer to allocated shards
+ * @param n      Number of shards
+ * @param inith  Init handler, called in the shard thread
+ * @param closeh Close handler, called in the shard thread (optional)
+ * @param arg    Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int shards_alloc(struct shards **shsp, unsigned n, shard_init_h *inith,
+		 shard_close_h *closeh, void *arg)
+{
+	struct shards *shs;
+	int err = 0;
+
+	if (!shsp || !n || !inith)
+		return EINVAL;
+
+	shs = mem_zalloc(sizeof(*shs), shards_destructor);
+	if (!shs)
+		return ENOMEM;
+
+	shs->shv = mem_zalloc(n * sizeof(*shs->shv), NULL);
+	if (!shs->shv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	shs->inith  = inith;
+	shs->closeh = closeh;
+	shs->arg    = arg;
+
+	for (unsigned i = 0; i < n; i++) {
+		struct shard *sh;
+
+		sh = mem_zalloc(sizeof(*sh), shard_destructor);
+		if (!sh) {
+			err = ENOMEM;
+			goto out;
+		}
+
+		sh->shs = shs;
+		sh->idx = i;
+		shs->shv[i] = sh;
+		shs->n = i + 1;
+
+		err = mutex_alloc(&sh->mtx);
+		if (err)
+			goto out;
+
+		err = shard_start(sh);
+		if (err) {
+			DEBUG_WARNING("shard %u: start failed (%m)\n", i, err);
+			goto out;
+		}
+	}
+
+ out:
+	if (err)
+		mem_deref(shs);
+	else
+		*shsp = shs;
+
+	return err;
+}
+
+
+/**
+ * Get the number of shards
+ *
+ * @param shs Shards
+ *
+ * @return Number of shards
+ */
+unsigned shards_count(const struct shards *shs)
+{
+	return shs ? shs->n : 0;
+}
+
+
+/**
+ * Get a shard by index
+ *
+ * @param shs Shards
+ * @param idx Shard index
+ *
+ * @return Shard if found, otherwise NULL
+ */
+struct shard *shards_get(const struct shards *shs, unsigned idx)
+{
+	if (!shs || idx >= shs->n)
+		return NULL;
+
+	return shs->shv[idx];
+}
+
+
+/**
+ * Get the index of a shard
+ *
+ * @param sh Shard
+ *
+ * @return Shard index
+ */
+unsigned shard_index(const struct shard *sh)
+{
+	return sh ? sh->idx : 0;
+}
+
+
+/**
+ * Run a callback in the thread of a shard. This is used to hand objects
+ * over to the shard that owns the related sockets. The callback is
+ * called with err=0 from the shard main loop, or with ECANCELED if the
+ * shard stops before the message was handled.
+ *
+ * @param sh  Target shard
+ * @param cb  Callback handler
+ * @param arg Callback argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int shard_async(struct shard *sh, re_async_h *cb, void *arg)
+{
+	struct shard_msg *msg;
+	bool wakeup;
+	int err = 0;
+
+	if (!sh || !cb)
+		return EINVAL;
+
+	msg = mem_zalloc(sizeof(*msg), NULL);
+	if (!msg)
+		return ENOMEM;
+
+	msg->cb  = cb;
+	msg->arg = arg;
+
+	mtx_lock(sh->mtx);
+	if (!sh->running) {
+		err = ECANCELED;
+	}
+	else {
+		wakeup = list_isempty(&sh->msgl);
+		list_append(&sh->msgl, &msg->le, msg);
+		if (wakeup)
+			err = mqueue_push(sh->mq, SHARD_WAKEUP, NULL);
+		if (err)
+			list_unlink(&msg->le);
+	}
+	mtx_unlock(sh->mtx);
+
+	if (err)
+		mem_deref(msg);
+
+	return err;
+}
+
+
+/**
+ * Attach a reuseport steering program to a socket of a SO_REUSEPORT
+ * group. The program selects the shard socket by index, so the group
+ * must be joined in shard order (see shards_alloc).
+ *
+ * @param fd    Socket file descriptor of any group member
+ * @param steer Steering program
+ * @param n     Number of shards
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int shard_steer_attach(re_sock_t fd, enum shard_steer steer, unsigned n)
+{
+#if defined(LINUX) && defined(SO_ATTACH_REUSEPORT_CBPF)
+	struct sock_filter code[] = {
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 0),
+		BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, n),
+		BPF_STMT(BPF_RET | BPF_A, 0),
+	};
+	struct sock_fprog prog = {
+		.len    = RE_ARRAY_SIZE(code),
+		.filter = code,
+	};
+
+	if (fd == RE_BAD_SOCK || !n)
+		return EINVAL;
+
+	switch (steer) {
+
+	case SHARD_STEER_KERNEL:
+		return 0;
+
+	case SHARD_STEER_HASH:
+		code[0].k = (uint32_t)(SKF_AD_OFF + SKF_AD_RXHASH);
+		break;
+
+	case SHARD_STEER_CPU:
+		code[0].k = (uint32_t)(SKF_AD_OFF + SKF_AD_CPU);
+		break;
+
+	default:
+		return EINVAL;
+	}
+
+	if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+		       &prog, sizeof(prog)) < 0)
+		return errno;
+
+	return 0;
+#else
+	if (fd == RE_BAD_SOCK || !n)
+		return EINVAL;
+
+	return steer == SHARD_STEER_KERNEL ? 0 : ENOSYS;
+#endif
+}
@@ -283,7 +283,7 @@ static bool response_handler(const struct sip_msg *msg, void *arg)
 	struct sip *sip = arg;
 
 	ct = list_ledata(hash_lookup(sip->ht_ctrans,
-				     hash_joaat_pl(&msg->via.branch),
+				     hash_wyhash_pl(&msg->via.branch),
 				     cmp_handler, (void *)msg));
 	if (!ct)
 		return false;
@@ -339,7 +339,7 @@ int sip_ctrans_request(struct sip_ctrans **ctp, struct sip *sip,
 	if (!ct)
 		return ENOMEM;
 
-	hash_append(sip->ht_ctrans, hash_joaat_str(branch), &ct->he, ct);
+	hash_append(sip->ht_ctrans, hash_wyhash_str(branch), &ct->he, ct);
 
 	ct->invite = !strcmp(met, "INVITE");
 	ct->branch = mem_ref(branch);
@@ -417,6 +417,14 @@ int sip_ctrans_cancel(struct sip_ctrans *ct)
 }
 
 
+static uint32_t ctrans_key(struct le *le)
+{
+	const struct sip_ctrans *ct = le->data;
+
+	return hash_wyhash_str(ct->branch);
+}
+
+
 int sip_ctrans_init(struct sip *sip, uint32_t sz)
 {
 	int err;
@@ -425,7 +433,11 @@ int sip_ctrans_init(struct sip *sip, uint32_t sz)
 	if (err)
 		return err;
 
-	return hash_alloc(&sip->ht_ctrans, sz);
+	err = hash_alloc(&sip->ht_ctrans, sz);
+	if (err)
+		return err;
+
+	return hash_grow_set(sip->ht_ctrans, ctrans_key);
 }
 
 
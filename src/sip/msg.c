@@ -4,7 +4,9 @@
  * Copyright (C) 2010 Creytiv.com
  */
 #include <ctype.h>
+#include <string.h>
 #include <re_types.h>
+#include <re_atomic.h>
 #include <re_mem.h>
 #include <re_sys.h>
 #include <re_mbuf.h>
@@ -20,32 +22,225 @@
 
 
 enum {
-	HDR_HASH_SIZE = 32,
 	STARTLINE_MAX = 8192,
+	ARENA_SIZE    = 4096,
+	HDR_MAX       = 65535,
 };
 
 
-static void hdr_destructor(void *arg)
-{
-	struct sip_hdr *hdr = arg;
+/* Structured values that a lazy decode leaves for the accessors */
+enum {
+	LAZY_URI   = 1<<0,
+	LAZY_VIA   = 1<<1,
+	LAZY_TO    = 1<<2,
+	LAZY_FROM  = 1<<3,
+	LAZY_CSEQ  = 1<<4,
+	LAZY_RACK  = 1<<5,
+	LAZY_CTYPE = 1<<6,
+
+	LAZY_HDRS  = LAZY_VIA | LAZY_TO | LAZY_FROM | LAZY_CSEQ |
+		     LAZY_RACK | LAZY_CTYPE,
+};
 
-	list_unlink(&hdr->le);
-	hash_unlink(&hdr->he);
-}
+
+/* Header table slot of each well-known header ID, 0 for extensions */
+static const uint8_t hdr_slotv[4096] = {
+	[SIP_HDR_ACCEPT]                        =   1,
+	[SIP_HDR_ACCEPT_CONTACT]                =   2,
+	[SIP_HDR_ACCEPT_ENCODING]               =   3,
+	[SIP_HDR_ACCEPT_LANGUAGE]               =   4,
+	[SIP_HDR_ACCEPT_RESOURCE_PRIORITY]      =   5,
+	[SIP_HDR_ALERT_INFO]                    =   6,
+	[SIP_HDR_ALLOW]                         =   7,
+	[SIP_HDR_ALLOW_EVENTS]                  =   8,
+	[SIP_HDR_ANSWER_MODE]                   =   9,
+	[SIP_HDR_AUTHENTICATION_INFO]           =  10,
+	[SIP_HDR_AUTHORIZATION]                 =  11,
+	[SIP_HDR_CALL_ID]                       =  12,
+	[SIP_HDR_CALL_INFO]                     =  13,
+	[SIP_HDR_CONTACT]                       =  14,
+	[SIP_HDR_CONTENT_DISPOSITION]           =  15,
+	[SIP_HDR_CONTENT_ENCODING]              =  16,
+	[SIP_HDR_CONTENT_LANGUAGE]              =  17,
+	[SIP_HDR_CONTENT_LENGTH]                =  18,
+	[SIP_HDR_CONTENT_TYPE]                  =  19,
+	[SIP_HDR_CSEQ]                          =  20,
+	[SIP_HDR_DATE]                          =  21,
+	[SIP_HDR_ENCRYPTION]                    =  22,
+	[SIP_HDR_ERROR_INFO]                    =  23,
+	[SIP_HDR_EVENT]                         =  24,
+	[SIP_HDR_EXPIRES]                       =  25,
+	[SIP_HDR_FLOW_TIMER]                    =  26,
+	[SIP_HDR_FROM]                          =  27,
+	[SIP_HDR_HIDE]                          =  28,
+	[SIP_HDR_HISTORY_INFO]                  =  29,
+	[SIP_HDR_IDENTITY]                      =  30,
+	[SIP_HDR_IDENTITY_INFO]                 =  31,
+	[SIP_HDR_IN_REPLY_TO]                   =  32,
+	[SIP_HDR_JOIN]                          =  33,
+	[SIP_HDR_MAX_BREADTH]                   =  34,
+	[SIP_HDR_MAX_FORWARDS]                  =  35,
+	[SIP_HDR_MIME_VERSION]                  =  36,
+	[SIP_HDR_MIN_EXPIRES]                   =  37,
+	[SIP_HDR_MIN_SE]                        =  38,
+	[SIP_HDR_ORGANIZATION]                  =  39,
+	[SIP_HDR_P_ACCESS_NETWORK_INFO]         =  40,
+	[SIP_HDR_P_ANSWER_STATE]                =  41,
+	[SIP_HDR_P_ASSERTED_IDENTITY]           =  42,
+	[SIP_HDR_P_ASSOCIATED_URI]              =  43,
+	[SIP_HDR_P_CALLED_PARTY_ID]             =  44,
+	[SIP_HDR_P_CHARGING_FUNCTION_ADDRESSES] =  45,
+	[SIP_HDR_P_CHARGING_VECTOR]             =  46,
+	[SIP_HDR_P_DCS_TRACE_PARTY_ID]          =  47,
+	[SIP_HDR_P_DCS_OSPS]                    =  48,
+	[SIP_HDR_P_DCS_BILLING_INFO]            =  49,
+	[SIP_HDR_P_DCS_LAES]                    =  50,
+	[SIP_HDR_P_DCS_REDIRECT]                =  51,
+	[SIP_HDR_P_EARLY_MEDIA]                 =  52,
+	[SIP_HDR_P_MEDIA_AUTHORIZATION]         =  53,
+	[SIP_HDR_P_PREFERRED_IDENTITY]          =  54,
+	[SIP_HDR_P_PROFILE_KEY]                 =  55,
+	[SIP_HDR_P_REFUSED_URI_LIST]            =  56,
+	[SIP_HDR_P_SERVED_USER]                 =  57,
+	[SIP_HDR_P_USER_DATABASE]               =  58,
+	[SIP_HDR_P_VISITED_NETWORK_ID]          =  59,
+	[SIP_HDR_PATH]                          =  60,
+	[SIP_HDR_PERMISSION_MISSING]            =  61,
+	[SIP_HDR_PRIORITY]                      =  62,
+	[SIP_HDR_PRIV_ANSWER_MODE]              =  63,
+	[SIP_HDR_PRIVACY]                       =  64,
+	[SIP_HDR_PROXY_AUTHENTICATE]            =  65,
+	[SIP_HDR_PROXY_AUTHORIZATION]           =  66,
+	[SIP_HDR_PROXY_REQUIRE]                 =  67,
+	[SIP_HDR_RACK]                          =  68,
+	[SIP_HDR_REASON]                        =  69,
+	[SIP_HDR_RECORD_ROUTE]                  =  70,
+	[SIP_HDR_REFER_SUB]                     =  71,
+	[SIP_HDR_REFER_TO]                      =  72,
+	[SIP_HDR_REFERRED_BY]                   =  73,
+	[SIP_HDR_REJECT_CONTACT]                =  74,
+	[SIP_HDR_REPLACES]                      =  75,
+	[SIP_HDR_REPLY_TO]                      =  76,
+	[SIP_HDR_REQUEST_DISPOSITION]           =  77,
+	[SIP_HDR_REQUIRE]                       =  78,
+	[SIP_HDR_RESOURCE_PRIORITY]             =  79,
+	[SIP_HDR_RESPONSE_KEY]                  =  80,
+	[SIP_HDR_RETRY_AFTER]                   =  81,
+	[SIP_HDR_ROUTE]                         =  82,
+	[SIP_HDR_RSEQ]                          =  83,
+	[SIP_HDR_SECURITY_CLIENT]               =  84,
+	[SIP_HDR_SECURITY_SERVER]               =  85,
+	[SIP_HDR_SECURITY_VERIFY]               =  86,
+	[SIP_HDR_SERVER]                        =  87,
+	[SIP_HDR_SERVICE_ROUTE]                 =  88,
+	[SIP_HDR_SESSION_EXPIRES]               =  89,
+	[SIP_HDR_SIP_ETAG]                      =  90,
+	[SIP_HDR_SIP_IF_MATCH]                  =  91,
+	[SIP_HDR_SUBJECT]                       =  92,
+	[SIP_HDR_SUBSCRIPTION_STATE]            =  93,
+	[SIP_HDR_SUPPORTED]                     =  94,
+	[SIP_HDR_TARGET_DIALOG]                 =  95,
+	[SIP_HDR_TIMESTAMP]                     =  96,
+	[SIP_HDR_TO]                            =  97,
+	[SIP_HDR_TRIGGER_CONSENT]               =  98,
+	[SIP_HDR_UNSUPPORTED]                   =  99,
+	[SIP_HDR_USER_AGENT]                    = 100,
+	[SIP_HDR_VIA]                           = 101,
+	[SIP_HDR_WARNING]                       = 102,
+	[SIP_HDR_WWW_AUTHENTICATE]              = 103,
+};
+
+
+static RE_ATOMIC bool msg_arena;
 
 
 static void destructor(void *arg)
 {
 	struct sip_msg *msg = arg;
 
-	list_flush(&msg->hdrl);
-	hash_flush(msg->hdrht);
-	mem_deref(msg->hdrht);
 	mem_deref(msg->sock);
 	mem_deref(msg->mb);
 }
 
 
+static inline uint32_t hdr_slot(enum sip_hdrid id)
+{
+	if ((unsigned)id >= RE_ARRAY_SIZE(hdr_slotv))
+		return 0;
+
+	return hdr_slotv[id];
+}
+
+
+static void hdr_link(struct sip_msg *msg, struct sip_hdr *hdr)
+{
+	struct sip_hdrslot *slot = &msg->hdrt[hdr_slot(hdr->id)];
+	const uint16_t idx = (uint16_t)(hdr - msg->hdrv) + 1;
+
+	hdr->he.data = hdr;
+
+	if (slot->tail) {
+		struct sip_hdr *tail = &msg->hdrv[slot->tail - 1];
+
+		tail->he.next = &hdr->he;
+		hdr->he.prev  = &tail->he;
+	}
+	else {
+		slot->head = idx;
+	}
+
+	slot->tail = idx;
+}
+
+
+static struct le *hdr_first(const struct sip_msg *msg, uint32_t slot,
+			    bool fwd)
+{
+	const struct sip_hdrslot *hs = &msg->hdrt[slot];
+	uint16_t idx = fwd ? hs->head : hs->tail;
+
+	return idx ? &msg->hdrv[idx - 1].he : NULL;
+}
+
+
+/*
+ * Upper bound of the number of headers in the header block, which is at
+ * most one atomic and one line entry per line plus one per comma.
+ */
+static size_t hdr_bound(const char *p, size_t l)
+{
+	uint32_t lf = 0;
+	size_t n = 0;
+
+	for (; l > 0; p++, l--) {
+
+		switch (*p) {
+
+		case '\r':
+			break;
+
+		case '\n':
+			if (lf++)
+				return n;
+
+			n += 2;
+			break;
+
+		case ',':
+			++n;
+			lf = 0;
+			break;
+
+		default:
+			lf = 0;
+			break;
+		}
+	}
+
+	return n;
+}
+
+
 static enum sip_hdrid hdr_hash(const struct pl *name)
 {
 	if (!name->l)
@@ -149,95 +344,119 @@ static inline bool hdr_comma_separated(enum sip_hdrid id)
 }
 
 
-static inline int hdr_add(struct sip_msg *msg, const struct pl *name,
-			  enum sip_hdrid id, const char *p, ssize_t l,
-			  bool atomic, bool line)
+static int hdr_parse(struct sip_msg *msg, enum sip_hdrid id,
+		     const struct pl *val)
 {
-	struct sip_hdr *hdr;
-	int err = 0;
+	int err;
 
-	hdr = mem_zalloc(sizeof(*hdr), hdr_destructor);
-	if (!hdr)
-		return ENOMEM;
+	switch (id) {
 
-	hdr->name  = *name;
-	hdr->val.p = p;
-	hdr->val.l = MAX(l, 0);
-	hdr->id    = id;
+	case SIP_HDR_VIA:
+		return sip_via_decode(&msg->via, val);
+
+	case SIP_HDR_TO:
+		err = sip_addr_decode((struct sip_addr *)&msg->to, val);
+		if (err)
+			return err;
+
+		(void)msg_param_decode(&msg->to.params, "tag", &msg->to.tag);
+		msg->to.val = *val;
+		return 0;
+
+	case SIP_HDR_FROM:
+		err = sip_addr_decode((struct sip_addr *)&msg->from, val);
+		if (err)
+			return err;
+
+		(void)msg_param_decode(&msg->from.params, "tag",
+				       &msg->from.tag);
+		msg->from.val = *val;
+		return 0;
+
+	case SIP_HDR_CSEQ:
+		return sip_cseq_decode(&msg->cseq, val);
+
+	case SIP_HDR_RACK:
+		return sip_rack_decode(&msg->rack, val);
+
+	case SIP_HDR_CONTENT_TYPE:
+		return msg_ctype_decode(&msg->ctyp, val);
+
+	default:
+		return 0;
+	}
+}
+
+
+static inline int hdr_add(struct sip_msg *msg, size_t hdrn,
+			  const struct pl *name, enum sip_hdrid id,
+			  const char *p, ssize_t l, bool atomic, bool line)
+{
+	struct sip_hdr *hdr;
+	int err = 0;
 
 	switch (id) {
 
 	case SIP_HDR_VIA:
 	case SIP_HDR_ROUTE:
 		if (!atomic)
-			break;
+			return 0;
 
-		hash_append(msg->hdrht, id, &hdr->he, mem_ref(hdr));
-		list_append(&msg->hdrl, &hdr->le, mem_ref(hdr));
+		line = true;
 		break;
 
 	default:
-		if (atomic)
-			hash_append(msg->hdrht, id, &hdr->he, mem_ref(hdr));
-		if (line)
-			list_append(&msg->hdrl, &hdr->le, mem_ref(hdr));
 		break;
 	}
 
+	if (msg->hdrc >= hdrn)
+		return EOVERFLOW;
+
+	hdr = &msg->hdrv[msg->hdrc++];
+	memset(hdr, 0, sizeof(*hdr));
+
+	hdr->name  = *name;
+	hdr->val.p = p;
+	hdr->val.l = MAX(l, 0);
+	hdr->id    = id;
+
+	if (atomic)
+		hdr_link(msg, hdr);
+	if (line)
+		list_append(&msg->hdrl, &hdr->le, hdr);
+
 	/* parse common headers */
 	switch (id) {
 
 	case SIP_HDR_VIA:
-		if (!atomic || pl_isset(&msg->via.sentby))
+		if (pl_isset(&msg->via.sentby))
 			break;
 
-		err = sip_via_decode(&msg->via, &hdr->val);
-		break;
+		/*@fallthrough@*/
 
 	case SIP_HDR_TO:
-		err = sip_addr_decode((struct sip_addr *)&msg->to, &hdr->val);
-		if (err)
-			break;
-
-		(void)msg_param_decode(&msg->to.params, "tag", &msg->to.tag);
-		msg->to.val = hdr->val;
-		break;
-
 	case SIP_HDR_FROM:
-		err = sip_addr_decode((struct sip_addr *)&msg->from,
-				      &hdr->val);
-		if (err)
-			break;
+	case SIP_HDR_CSEQ:
+	case SIP_HDR_RACK:
+	case SIP_HDR_CONTENT_TYPE:
+		if (msg->lazy)
+			break;  /* parsed on first access */
 
-		(void)msg_param_decode(&msg->from.params, "tag",
-				       &msg->from.tag);
-		msg->from.val = hdr->val;
+		err = hdr_parse(msg, id, &hdr->val);
 		break;
 
 	case SIP_HDR_CALL_ID:
 		msg->callid = hdr->val;
 		break;
 
-	case SIP_HDR_CSEQ:
-		err = sip_cseq_decode(&msg->cseq, &hdr->val);
-		break;
-
 	case SIP_HDR_RSEQ:
 		msg->rel_seq = pl_u32(&hdr->val);
 		break;
 
-	case SIP_HDR_RACK:
-		err = sip_rack_decode(&msg->rack, &hdr->val);
-		break;
-
 	case SIP_HDR_MAX_FORWARDS:
 		msg->maxfwd = hdr->val;
 		break;
 
-	case SIP_HDR_CONTENT_TYPE:
-		err = msg_ctype_decode(&msg->ctyp, &hdr->val);
-		break;
-
 	case SIP_HDR_CONTENT_LENGTH:
 		msg->clen = hdr->val;
 		break;
@@ -251,29 +470,20 @@ static inline int hdr_add(struct sip_msg *msg, const struct pl *name,
 		break;
 	}
 
-	mem_deref(hdr);
-
 	return err;
 }
 
 
-/**
- * Decode a SIP message
- *
- * @param msgp Pointer to allocated SIP Message
- * @param mb   Buffer containing SIP Message
- *
- * @return 0 if success, otherwise errorcode
- */
-int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb)
+static int msg_decode(struct sip_msg **msgp, struct mbuf *mb, bool lazy)
 {
+	struct mem_arena *arena = NULL;
 	struct pl x, y, z, e, name;
 	const char *p, *v, *cv;
-	struct sip_msg *msg;
+	struct sip_msg *msg = NULL;
 	bool comsep, quote;
 	enum sip_hdrid id = SIP_HDR_NONE;
 	uint32_t ws, lf;
-	size_t l;
+	size_t l, hdrn;
 	int err;
 
 	if (!msgp || !mb)
@@ -286,25 +496,42 @@ int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb)
 		     &x, &y, &z, NULL, &e) || x.p != (char *)mbuf_buf(mb))
 		return (l > STARTLINE_MAX) ? EBADMSG : ENODATA;
 
-	msg = mem_zalloc(sizeof(*msg), destructor);
-	if (!msg)
-		return ENOMEM;
+	if (re_atomic_rlx(&msg_arena)) {
+		err = mem_arena_alloc(&arena, ARENA_SIZE);
+		if (err)
+			return err;
 
-	err = hash_alloc(&msg->hdrht, HDR_HASH_SIZE);
-	if (err)
+		mem_arena_enter(arena);
+	}
+
+	hdrn = hdr_bound(e.p + e.l, l - (e.p + e.l - p));
+	hdrn = MIN(hdrn, HDR_MAX);
+
+	/* headers are stored in a vector after the message */
+	msg = mem_alloc(sizeof(*msg) + hdrn * sizeof(struct sip_hdr),
+			destructor);
+	if (!msg) {
+		err = ENOMEM;
 		goto out;
+	}
+
+	memset(msg, 0, sizeof(*msg));
+	msg->hdrv = (struct sip_hdr *)(void *)(msg + 1);
 
 	msg->tag = rand_u64();
 	msg->mb  = mem_ref(mb);
 	msg->req = (0 == pl_strcmp(&z, "SIP/2.0"));
 
+	if (lazy)
+		msg->lazy = LAZY_HDRS | (msg->req ? LAZY_URI : 0);
+
 	if (msg->req) {
 
 		msg->met = x;
 		msg->ruri = y;
 		msg->ver = z;
 
-		if (uri_decode(&msg->uri, &y)) {
+		if (!lazy && uri_decode(&msg->uri, &y)) {
 			err = EBADMSG;
 			goto out;
 		}
@@ -360,7 +587,8 @@ int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb)
 					goto out;
 				}
 
-				err = hdr_add(msg, &name, id, cv ? cv : p,
+				err = hdr_add(msg, hdrn, &name, id,
+					      cv ? cv : p,
 					      cv ? p - cv - ws : 0,
 					      true, cv == v && lf);
 				if (err)
@@ -372,7 +600,7 @@ int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb)
 				}
 
 				if (cv != v) {
-					err = hdr_add(msg, &name, id,
+					err = hdr_add(msg, hdrn, &name, id,
 						      v ? v : p,
 						      v ? p - v - ws : 0,
 						      false, true);
@@ -434,6 +662,11 @@ int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb)
 	err = ENODATA;
 
  out:
+	if (arena) {
+		mem_arena_leave();
+		mem_deref(arena);
+	}
+
 	if (err)
 		mem_deref(msg);
 	else {
@@ -445,6 +678,185 @@ int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb)
 }
 
 
+/**
+ * Decode a SIP message
+ *
+ * @param msgp Pointer to allocated SIP Message
+ * @param mb   Buffer containing SIP Message
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb)
+{
+	return msg_decode(msgp, mb, false);
+}
+
+
+/**
+ * Decode a SIP message lazily. Only the start-line and the header
+ * boundaries are decoded, along with the plain cached values (Call-ID,
+ * Max-Forwards, Expires, Content-Length and RSeq). The request URI, Via,
+ * To, From, CSeq, RAck and Content-Type are parsed on first use of
+ * sip_msg_uri(), sip_msg_via(), sip_msg_to(), sip_msg_from(),
+ * sip_msg_cseq(), sip_msg_rack() and sip_msg_ctype(). Until then the
+ * corresponding fields in struct sip_msg are empty.
+ *
+ * This suits stateless routing, where most messages are forwarded based
+ * on a few header values. Malformed values are only detected when they
+ * are accessed.
+ *
+ * @param msgp Pointer to allocated SIP Message
+ * @param mb   Buffer containing SIP Message
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int sip_msg_decode_lazy(struct sip_msg **msgp, struct mbuf *mb)
+{
+	return msg_decode(msgp, mb, true);
+}
+
+
+/**
+ * Enable or disable arena allocation for decoded SIP messages. All objects
+ * of a message are then allocated from one memory arena, which is freed
+ * when the message is dereferenced.
+ *
+ * @param enable True to enable, false to disable
+ */
+void sip_msg_arena_set(bool enable)
+{
+	re_atomic_rlx_set(&msg_arena, enable);
+}
+
+
+static bool lazy_parse(const struct sip_msg *cmsg, enum sip_hdrid id,
+		       uint16_t flag)
+{
+	struct sip_msg *msg = (struct sip_msg *)cmsg;  /* parse cache */
+	const struct sip_hdr *hdr;
+
+	if (!msg)
+		return false;
+
+	if (!(msg->lazy & flag))
+		return true;
+
+	/* the first Via, otherwise the last header as in sip_msg_decode */
+	hdr = sip_msg_hdr_apply(msg, id == SIP_HDR_VIA, id, NULL, NULL);
+	if (hdr && hdr_parse(msg, id, &hdr->val))
+		return false;
+
+	msg->lazy &= ~flag;
+
+	return true;
+}
+
+
+/**
+ * Get the request URI of a SIP Message, parsing it on first access
+ *
+ * @param msg SIP Message
+ *
+ * @return Request URI, NULL if malformed
+ */
+const struct uri *sip_msg_uri(const struct sip_msg *msg)
+{
+	struct sip_msg *m = (struct sip_msg *)msg;  /* parse cache */
+
+	if (!m)
+		return NULL;
+
+	if (m->lazy & LAZY_URI) {
+
+		if (uri_decode(&m->uri, &m->ruri))
+			return NULL;
+
+		m->lazy &= ~LAZY_URI;
+	}
+
+	return &m->uri;
+}
+
+
+/**
+ * Get the first Via header of a SIP Message, parsing it on first access
+ *
+ * @param msg SIP Message
+ *
+ * @return Via header (empty if missing), NULL if malformed
+ */
+const struct sip_via *sip_msg_via(const struct sip_msg *msg)
+{
+	return lazy_parse(msg, SIP_HDR_VIA, LAZY_VIA) ? &msg->via : NULL;
+}
+
+
+/**
+ * Get the To header of a SIP Message, parsing it on first access
+ *
+ * @param msg SIP Message
+ *
+ * @return To header (empty if missing), NULL if malformed
+ */
+const struct sip_taddr *sip_msg_to(const struct sip_msg *msg)
+{
+	return lazy_parse(msg, SIP_HDR_TO, LAZY_TO) ? &msg->to : NULL;
+}
+
+
+/**
+ * Get the From header of a SIP Message, parsing it on first access
+ *
+ * @param msg SIP Message
+ *
+ * @return From header (empty if missing), NULL if malformed
+ */
+const struct sip_taddr *sip_msg_from(const struct sip_msg *msg)
+{
+	return lazy_parse(msg, SIP_HDR_FROM, LAZY_FROM) ? &msg->from : NULL;
+}
+
+
+/**
+ * Get the CSeq header of a SIP Message, parsing it on first access
+ *
+ * @param msg SIP Message
+ *
+ * @return CSeq header (empty if missing), NULL if malformed
+ */
+const struct sip_cseq *sip_msg_cseq(const struct sip_msg *msg)
+{
+	return lazy_parse(msg, SIP_HDR_CSEQ, LAZY_CSEQ) ? &msg->cseq : NULL;
+}
+
+
+/**
+ * Get the RAck header of a SIP Message, parsing it on first access
+ *
+ * @param msg SIP Message
+ *
+ * @return RAck header (empty if missing), NULL if malformed
+ */
+const struct sip_rack *sip_msg_rack(const struct sip_msg *msg)
+{
+	return lazy_parse(msg, SIP_HDR_RACK, LAZY_RACK) ? &msg->rack : NULL;
+}
+
+
+/**
+ * Get the Content-Type of a SIP Message, parsing it on first access
+ *
+ * @param msg SIP Message
+ *
+ * @return Content-Type (empty if missing), NULL if malformed
+ */
+const struct msg_ctype *sip_msg_ctype(const struct sip_msg *msg)
+{
+	return lazy_parse(msg, SIP_HDR_CONTENT_TYPE, LAZY_CTYPE) ?
+		&msg->ctyp : NULL;
+}
+
+
 /**
  * Get a SIP Header from a SIP Message
  *
@@ -474,15 +886,12 @@ const struct sip_hdr *sip_msg_hdr_apply(const struct sip_msg *msg,
 					bool fwd, enum sip_hdrid id,
 					sip_hdr_h *h, void *arg)
 {
-	struct list *lst;
 	struct le *le;
 
 	if (!msg)
 		return NULL;
 
-	lst = hash_list(msg->hdrht, id);
-
-	le = fwd ? list_head(lst) : list_tail(lst);
+	le = hdr_first(msg, hdr_slot(id), fwd);
 
 	while (le) {
 		const struct sip_hdr *hdr = le->data;
@@ -529,7 +938,7 @@ const struct sip_hdr *sip_msg_xhdr_apply(const struct sip_msg *msg,
 					 bool fwd, const char *name,
 					 sip_hdr_h *h, void *arg)
 {
-	struct list *lst;
+	enum sip_hdrid id;
 	struct le *le;
 	struct pl pl;
 
@@ -538,16 +947,15 @@ const struct sip_hdr *sip_msg_xhdr_apply(const struct sip_msg *msg,
 
 	pl_set_str(&pl, name);
 
-	lst = hash_list(msg->hdrht, hdr_hash(&pl));
-
-	le = fwd ? list_head(lst) : list_tail(lst);
+	id = hdr_hash(&pl);
+	le = hdr_first(msg, hdr_slot(id), fwd);
 
 	while (le) {
 		const struct sip_hdr *hdr = le->data;
 
 		le = fwd ? le->next : le->prev;
 
-		if (pl_casecmp(&hdr->name, &pl))
+		if (hdr->id != id || pl_casecmp(&hdr->name, &pl))
 			continue;
 
 		if (!h || h(hdr, msg, arg))
@@ -663,9 +1071,9 @@ void sip_msg_dump(const struct sip_msg *msg)
 	if (!msg)
 		return;
 
-	for (i=0; i<HDR_HASH_SIZE; i++) {
+	for (i=0; i<SIP_HDR_SLOTS; i++) {
 
-		le = list_head(hash_list(msg->hdrht, i));
+		le = hdr_first(msg, i, true);
 
 		while (le) {
 			const struct sip_hdr *hdr = le->data;
@@ -171,7 +171,7 @@ static bool ack_handler(struct sip *sip, const struct sip_msg *msg)
 	struct sip_strans *st;
 
 	st = list_ledata(hash_lookup(sip->ht_strans,
-				     hash_joaat_pl(&msg->via.branch),
+				     hash_wyhash_pl(&msg->via.branch),
 				     cmp_ack_handler, (void *)msg));
 	if (!st)
 		return false;
@@ -206,7 +206,7 @@ static bool cancel_handler(struct sip *sip, const struct sip_msg *msg)
 	struct sip_strans *st;
 
 	st = list_ledata(hash_lookup(sip->ht_strans,
-				     hash_joaat_pl(&msg->via.branch),
+				     hash_wyhash_pl(&msg->via.branch),
 				     cmp_cancel_handler, (void *)msg));
 	if (!st)
 		return false;
@@ -239,7 +239,7 @@ static bool request_handler(const struct sip_msg *msg, void *arg)
 		return ack_handler(sip, msg);
 
 	st = list_ledata(hash_lookup(sip->ht_strans,
-				     hash_joaat_pl(&msg->via.branch),
+				     hash_wyhash_pl(&msg->via.branch),
 				     cmp_handler, (void *)msg));
 	if (st) {
 		switch (st->state) {
@@ -259,7 +259,7 @@ static bool request_handler(const struct sip_msg *msg, void *arg)
 	else if (!pl_isset(&msg->to.tag)) {
 
 		st = list_ledata(hash_lookup(sip->ht_strans_mrg,
-					     hash_joaat_pl(&msg->callid),
+					     hash_wyhash_pl(&msg->callid),
 					     cmp_merge_handler, (void *)msg));
 		if (st) {
 			(void)sip_reply(sip, msg, 482, "Loop Detected");
@@ -298,10 +298,10 @@ int sip_strans_alloc(struct sip_strans **stp, struct sip *sip,
 	if (!st)
 		return ENOMEM;
 
-	hash_append(sip->ht_strans, hash_joaat_pl(&msg->via.branch),
+	hash_append(sip->ht_strans, hash_wyhash_pl(&msg->via.branch),
 		    &st->he, st);
 
-	hash_append(sip->ht_strans_mrg, hash_joaat_pl(&msg->callid),
+	hash_append(sip->ht_strans_mrg, hash_wyhash_pl(&msg->callid),
 		    &st->he_mrg, st);
 
 	st->invite  = !pl_strcmp(&msg->met, "INVITE");
@@ -399,6 +399,14 @@ int sip_strans_reply(struct sip_strans **stp, struct sip *sip,
 }
 
 
+static uint32_t strans_key(struct le *le)
+{
+	const struct sip_strans *st = le->data;
+
+	return hash_wyhash_pl(&st->msg->via.branch);
+}
+
+
 int sip_strans_init(struct sip *sip, uint32_t sz)
 {
 	int err;
@@ -411,7 +419,11 @@ int sip_strans_init(struct sip *sip, uint32_t sz)
 	if (err)
 		return err;
 
-	return hash_alloc(&sip->ht_strans, sz);
+	err = hash_alloc(&sip->ht_strans, sz);
+	if (err)
+		return err;
+
+	return hash_grow_set(sip->ht_strans, strans_key);
 }
 
 
@@ -80,6 +80,11 @@ struct sip_conn {
 	struct tcp_conn *tc;
 	struct mbuf *mb;
 	struct sip *sip;
+	size_t scan;        /**< Framer: offset of next header line   */
+	size_t msglen;      /**< Framer: message size, 0 if unknown   */
+	uint32_t clen;      /**< Framer: Content-Length value         */
+	bool clenv;         /**< Framer: Content-Length value is set  */
+	bool clenh;         /**< Framer: current header is Content-Length */
 	uint32_t ka_interval;
 	bool established;
 
@@ -463,41 +468,161 @@ static void udp_recv_handler(const struct sa *src, struct mbuf *mb, void *arg)
 }
 
 
-static void tcp_recv_handler(struct mbuf *mb, void *arg)
+static void framer_reset(struct sip_conn *conn)
 {
-	struct sip_conn *conn = arg;
-	size_t pos;
-	int err = 0;
+	conn->scan   = 0;
+	conn->msglen = 0;
+	conn->clen   = 0;
+	conn->clenv  = false;
+	conn->clenh  = false;
+}
 
-	if (conn->mb) {
-		pos = conn->mb->pos;
 
-		conn->mb->pos = conn->mb->end;
+static void framer_clen(struct sip_conn *conn, const char *p, size_t n)
+{
+	struct pl val;
 
-		err = mbuf_write_mem(conn->mb, mbuf_buf(mb),mbuf_get_left(mb));
-		if (err)
-			goto out;
+	val.p = p;
+	val.l = n;
 
-		conn->mb->pos = pos;
+	pl_trim(&val);
+	if (!pl_isset(&val))
+		return;  /* value on a folded line */
 
-		if (mbuf_get_left(conn->mb) > TCP_BUFSIZE_MAX) {
-			err = EOVERFLOW;
-			goto out;
+	conn->clen  = pl_u32(&val);
+	conn->clenv = true;
+}
+
+
+/*
+ * Scan the header lines received since the last call. Once the empty line
+ * ending the header block is seen, the total message size is known from
+ * Content-Length and stored in conn->msglen. The scan position is kept in
+ * the connection, so each byte of the header is only looked at once no
+ * matter how the message is fragmented.
+ */
+static int framer_scan(struct sip_conn *conn)
+{
+	const char *base = (const char *)mbuf_buf(conn->mb);
+	const size_t left = mbuf_get_left(conn->mb);
+
+	while (conn->scan < left) {
+
+		const char *p = base + conn->scan;
+		const char *nl = memchr(p, '\n', left - conn->scan);
+		const char *colon;
+		struct pl name;
+		size_t n;
+
+		if (!nl)
+			break;
+
+		n = nl - p;
+		conn->scan += n + 1;
+
+		if (n && p[n-1] == '\r')
+			--n;
+
+		if (p == base)
+			continue;  /* start-line */
+
+		if (!n) {
+			if (!conn->clenv)
+				return EBADMSG;
+
+			conn->msglen = conn->scan + conn->clen;
+			return 0;
 		}
+
+		if (*p == ' ' || *p == '\t') {
+			if (conn->clenh && !conn->clenv)
+				framer_clen(conn, p, n);
+			continue;
+		}
+
+		conn->clenh = false;
+
+		colon = memchr(p, ':', n);
+		if (!colon)
+			continue;
+
+		name.p = p;
+		name.l = colon - p;
+		pl_trim(&name);
+
+		if (pl_strcasecmp(&name, "Content-Length") &&
+		    pl_strcasecmp(&name, "l"))
+			continue;
+
+		conn->clenh = true;
+		framer_clen(conn, colon + 1, p + n - colon - 1);
 	}
-	else {
+
+	return ENODATA;
+}
+
+
+static int framer_append(struct sip_conn *conn, struct mbuf *mb)
+{
+	struct mbuf *mbn;
+	size_t left;
+	int err;
+
+	if (!conn->mb) {
 		conn->mb = mem_ref(mb);
+		return 0;
 	}
 
-	for (;;) {
-		struct sip_msg *msg;
-		uint32_t clen;
-		size_t end;
+	left = mbuf_get_left(conn->mb);
 
-		if (mbuf_get_left(conn->mb) < 2)
-			break;
+	if (left + mbuf_get_left(mb) > TCP_BUFSIZE_MAX)
+		return EOVERFLOW;
+
+	if (!conn->mb->pos) {
+		conn->mb->pos = conn->mb->end;
+
+		err = mbuf_write_mem(conn->mb, mbuf_buf(mb),
+				     mbuf_get_left(mb));
+
+		conn->mb->pos = 0;
+
+		return err;
+	}
+
+	/* move the unconsumed tail to the front of a new buffer */
+	mbn = mbuf_alloc(left + mbuf_get_left(mb));
+	if (!mbn)
+		return ENOMEM;
+
+	(void)mbuf_write_mem(mbn, mbuf_buf(conn->mb), left);
+	(void)mbuf_write_mem(mbn, mbuf_buf(mb), mbuf_get_left(mb));
+
+	mbn->pos = 0;
 
-		if (!memcmp(mbuf_buf(conn->mb), "\r\n", 2)) {
+	mem_deref(conn->mb);
+	conn->mb = mbn;
+
+	return 0;
+}
+
+
+static void tcp_recv_handler(struct mbuf *mb, void *arg)
+{
+	struct sip_conn *conn = arg;
+	int err;
+
+	err = framer_append(conn, mb);
+	if (err)
+		goto out;
+
+	while (conn->mb) {
+		struct sip_msg *msg;
+		struct mbuf *mbm;
+		size_t left = mbuf_get_left(conn->mb);
+		size_t start;
+
+		if (!conn->scan && left >= 2 &&
+		    !memcmp(mbuf_buf(conn->mb), "\r\n", 2)) {
 
 			tmr_start(&conn->tmr, TCP_IDLE_TIMEOUT * 1000,
 				  conn_tmr_handler, conn);
@@ -521,68 +646,67 @@ static void tcp_recv_handler(struct mbuf *mb, void *arg)
 					break;
 			}
 
-			if (mbuf_get_left(conn->mb))
-				continue;
+			if (!mbuf_get_left(conn->mb))
+				conn->mb = mem_deref(conn->mb);
 
-			conn->mb = mem_deref(conn->mb);
-			break;
+			continue;
 		}
 
-		pos = conn->mb->pos;
+		if (!conn->msglen) {
+			err = framer_scan(conn);
+			if (err) {
+				if (err == ENODATA)
+					err = 0;
+				break;
+			}
+		}
 
-		err = sip_msg_decode(&msg, conn->mb);
-		if (err) {
-			if (err == ENODATA)
-				err = 0;
+		if (left < conn->msglen)
 			break;
+
+		/* hand over the buffer if it holds exactly one message,
+		 * otherwise decode from a view that shares the buffer */
+		if (left == conn->msglen) {
+			mbm = conn->mb;
+			conn->mb = NULL;
 		}
+		else {
+			mbm = mbuf_alloc_ref(conn->mb);
+			if (!mbm) {
+				err = ENOMEM;
+				break;
+			}
 
-		if (!msg->clen.p) {
-			mem_deref(msg);
-			err = EBADMSG;
-			break;
+			mbm->end = mbm->pos + conn->msglen;
+			conn->mb->pos += conn->msglen;
 		}
 
-		clen = pl_u32(&msg->clen);
+		framer_reset(conn);
 
-		if (mbuf_get_left(conn->mb) < clen) {
-			conn->mb->pos = pos;
+		start = mbm->pos;
+
+		err = sip_msg_decode(&msg, mbm);
+		mem_deref(mbm);
+		if (err)
+			break;
+
+		if (!msg->clen.p ||
+		    pl_u32(&msg->clen) != mbuf_get_left(msg->mb)) {
 			mem_deref(msg);
+			err = EBADMSG;
 			break;
 		}
 
 		tmr_start(&conn->tmr, TCP_IDLE_TIMEOUT * 1000,
 			  conn_tmr_handler, conn);
 
-		end = conn->mb->end;
-
-		msg->mb->end = msg->mb->pos + clen;
 		msg->sock = mem_ref(conn);
 		msg->src = conn->paddr;
 		msg->dst = conn->laddr;
 		msg->tp = conn->sc ? SIP_TRANSP_TLS : SIP_TRANSP_TCP;
 
-		sip_recv(conn->sip, msg, 0);
+		sip_recv(conn->sip, msg, start);
 		mem_deref(msg);
-
-		if (end <= conn->mb->end) {
-			conn->mb = mem_deref(conn->mb);
-			break;
-		}
-
-		mb = mbuf_alloc(end - conn->mb->end);
-		if (!mb) {
-			err = ENOMEM;
-			goto out;
-		}
-
-		(void)mbuf_write_mem(mb, &conn->mb->buf[conn->mb->end],
-				     end - conn->mb->end);
-
-		mb->pos = 0;
-
-		mem_deref(conn->mb);
-		conn->mb = mb;
 	}
 
  out:
@@ -751,7 +875,7 @@ static uint32_t get_hash_of_fromhdr(struct mbuf *mb)
 		goto out;
 
 	mbuf_set_pos(sup, 0);
-	hsup = hash_joaat(mbuf_buf(sup), mbuf_get_left(sup));
+	hsup = hash_wyhash(mbuf_buf(sup), mbuf_get_left(sup));
 	mbuf_set_pos(mb, 0);
 
  out:
@@ -1148,13 +1272,24 @@ static int dst_set_scopeid(struct sip *sip, struct sa *dst, enum sip_transp tp)
 }
 
 
+static uint32_t conn_key(struct le *le)
+{
+	const struct sip_conn *conn = le->data;
+
+	return sa_hash(&conn->paddr, SA_ALL);
+}
+
+
 int sip_transp_init(struct sip *sip, uint32_t sz)
 {
 	int err;
 
 	err  = hash_alloc(&sip->ht_conn, sz);
 	err |= hash_alloc(&sip->ht_conncfg, sz);
-	return err;
+	if (err)
+		return err;
+
+	return hash_grow_set(sip->ht_conn, conn_key);
 }
 
 
@@ -1491,7 +1626,7 @@ int sip_transp_add_ccert(struct sip *sip, const struct uri *uri,
 	}
 	pl_set_str(&ccert->file, cert);
 
-	cc_data.hsup = hash_joaat(mbuf_buf(sup), mbuf_get_left(sup));
+	cc_data.hsup = hash_wyhash(mbuf_buf(sup), mbuf_get_left(sup));
 	cc_data.ccert = ccert;
 
 	(void)transp_apply_all(sip, SIP_TRANSP_TLS, AF_INET, add_ccert_handler,
@@ -370,6 +370,14 @@ static bool response_handler(const struct sip_msg *msg, void *arg)
 }
 
 
+static uint32_t sess_key(struct le *le)
+{
+	const struct sipsess *sess = le->data;
+
+	return hash_wyhash_str(sip_dialog_callid(sess->dlg));
+}
+
+
 /**
  * Listen to a SIP Session socket for incoming connections
  *
@@ -406,6 +414,10 @@ int sipsess_listen(struct sipsess_sock **sockp, struct sip *sip,
 	if (err)
 		goto out;
 
+	err = hash_grow_set(sock->ht_sess, sess_key);
+	if (err)
+		goto out;
+
 	err = hash_alloc(&sock->ht_ack, htsize);
 	if (err)
 		goto out;
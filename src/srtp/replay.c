@@ -3,7 +3,9 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <string.h>
 #include <re_types.h>
+#include <re_mem.h>
 #include <re_mbuf.h>
 #include <re_list.h>
 #include <re_aes.h>
@@ -16,13 +18,84 @@ enum {
 };
 
 
-void srtp_replay_init(struct replay *replay)
+/*
+ * Windows larger than 64 packets use a ring of 64-bit words indexed by
+ * the packet index (RFC 6479). The ring has one spare word, so a word is
+ * only reused once all of its packets have left the window.
+ */
+int srtp_replay_init(struct replay *replay, uint32_t window)
 {
+	uint32_t wordc = 1;
+
 	if (!replay)
-		return;
+		return EINVAL;
 
 	replay->bitmap = 0;
 	replay->lix    = 0;
+	replay->wordv  = NULL;
+	replay->wordc  = 0;
+	replay->window = SRTP_WINDOW_SIZE;
+
+	if (window <= SRTP_WINDOW_SIZE)
+		return 0;
+
+	while (wordc < (window + 63) / 64 + 1)
+		wordc <<= 1;
+
+	replay->wordv = mem_zalloc(wordc * sizeof(*replay->wordv), NULL);
+	if (!replay->wordv)
+		return ENOMEM;
+
+	replay->wordc  = wordc;
+	replay->window = window;
+
+	return 0;
+}
+
+
+void srtp_replay_close(struct replay *replay)
+{
+	if (!replay)
+		return;
+
+	replay->wordv = mem_deref(replay->wordv);
+}
+
+
+static bool replay_check_ring(struct replay *replay, uint64_t ix)
+{
+	const uint32_t mask = replay->wordc - 1;
+	const uint64_t bit = 1ULL << (ix & 63);
+	uint64_t *word;
+
+	if (ix > replay->lix) {
+		uint64_t i   = replay->lix >> 6;
+		uint64_t cur = ix >> 6;
+
+		/* clear the words that the window slides over */
+		if (cur - i >= replay->wordc) {
+			memset(replay->wordv, 0,
+			       replay->wordc * sizeof(*replay->wordv));
+		}
+		else {
+			while (i++ < cur)
+				replay->wordv[i & mask] = 0;
+		}
+
+		replay->lix = ix;
+	}
+	else if (replay->lix - ix >= replay->window) {
+		return false;
+	}
+
+	word = &replay->wordv[(ix >> 6) & mask];
+	if (*word & bit)
+		return false; /* already seen */
+
+	/* mark as seen */
+	*word |= bit;
+
+	return true;
 }
 
 
@@ -36,6 +109,9 @@ bool srtp_replay_check(struct replay *replay, uint64_t ix)
 	if (!replay)
 		return false;
 
+	if (replay->wordv)
+		return replay_check_ring(replay, ix);
+
 	if (ix > replay->lix) {
 		diff = ix - replay->lix;
 
@@ -9,6 +9,7 @@
 #include <re_mem.h>
 #include <re_mbuf.h>
 #include <re_list.h>
+#include <re_hash.h>
 #include <re_hmac.h>
 #include <re_sha.h>
 #include <re_aes.h>
@@ -20,7 +21,9 @@
 
 /** SRTP protocol values */
 enum {
-	MAX_KEYLEN  = 32,  /**< Maximum keylength in bytes     */
+	MAX_KEYLEN   = 32,  /**< Maximum keylength in bytes     */
+	STREAM_BSIZE =  4,  /**< Initial stream table size      */
+	BATCH_MAX    = 32,  /**< Packets per cipher pass        */
 };
 
 
@@ -79,7 +82,8 @@ static void destructor(void *arg)
 	mem_deref(srtp->rtp.hmac);
 	mem_deref(srtp->rtcp.hmac);
 
-	list_flush(&srtp->streaml);
+	hash_flush(srtp->ht_strm);
+	mem_deref(srtp->ht_strm);
 }
 
 
@@ -168,6 +172,19 @@ int srtp_alloc(struct srtp **srtpp, enum srtp_suite suite,
 	if (err)
 		goto out;
 
+	err = hash_alloc(&srtp->ht_strm, STREAM_BSIZE);
+	if (err)
+		goto out;
+
+	err = hash_grow_set(srtp->ht_strm, stream_key);
+	if (err)
+		goto out;
+
+	if (flags & SRTP_REPLAY_WINDOW_4K)
+		srtp->replay_win = 4096;
+	else if (flags & SRTP_REPLAY_WINDOW_1K)
+		srtp->replay_win = 1024;
+
  out:
 	if (err)
 		mem_deref(srtp);
@@ -178,20 +195,35 @@ int srtp_alloc(struct srtp **srtpp, enum srtp_suite suite,
 }
 
 
-int srtp_encrypt(struct srtp *srtp, struct mbuf *mb)
+/* Per-packet state while a batch is processed */
+struct pkt {
+	struct mbuf *mb;
+	struct srtp_stream *strm;
+	union vect128 iv;   /* AES-CTR IV, if the payload is deferred */
+	size_t start;
+	uint32_t roc;
+};
+
+
+static inline bool ctr_deferred(const struct comp *comp)
 {
+	return comp->aes && comp->mode == AES_MODE_CTR;
+}
+
+
+static int encr_begin(struct srtp *srtp, struct pkt *pkt)
+{
+	struct comp *comp = &srtp->rtp;
+	struct mbuf *mb = pkt->mb;
 	struct srtp_stream *strm;
 	struct rtp_header hdr;
-	struct comp *comp;
 	size_t start;
 	uint64_t ix;
 	int err;
 
-	if (!srtp || !mb)
+	if (!mb)
 		return EINVAL;
 
-	comp = &srtp->rtp;
-
 	start = mb->pos;
 
 	err = rtp_hdr_decode(&hdr, mb);
@@ -210,16 +242,8 @@ int srtp_encrypt(struct srtp *srtp, struct mbuf *mb)
 
 	ix = 65536ULL * strm->roc + hdr.seq;
 
-	if (comp->aes && comp->mode == AES_MODE_CTR) {
-		union vect128 iv;
-		uint8_t *p = mbuf_buf(mb);
-
-		srtp_iv_calc(&iv, &comp->k_s, strm->ssrc, ix);
-
-		aes_set_iv(comp->aes, iv.u8);
-		err = aes_encr(comp->aes, p, p, mbuf_get_left(mb));
-		if (err)
-			return err;
+	if (ctr_deferred(comp)) {
+		srtp_iv_calc(&pkt->iv, &comp->k_s, strm->ssrc, ix);
 	}
 	else if (comp->aes && comp->mode == AES_MODE_GCM) {
 		union vect128 iv;
@@ -250,17 +274,35 @@ int srtp_encrypt(struct srtp *srtp, struct mbuf *mb)
 			return err;
 	}
 
+	/* the next packet of the stream may be in the same batch */
+	if (hdr.seq > strm->s_l)
+		strm->s_l = hdr.seq;
+
+	pkt->strm  = strm;
+	pkt->start = start;
+	pkt->roc   = strm->roc;
+
+	return 0;
+}
+
+
+static int encr_end(struct srtp *srtp, struct pkt *pkt)
+{
+	struct comp *comp = &srtp->rtp;
+	struct mbuf *mb = pkt->mb;
+	int err;
+
 	if (comp->hmac) {
 		const size_t tag_start = mb->end;
 		uint8_t tag[SHA_DIGEST_LENGTH] = {0};
 
 		mb->pos = tag_start;
 
-		err = mbuf_write_u32(mb, htonl(strm->roc));
+		err = mbuf_write_u32(mb, htonl(pkt->roc));
 		if (err)
 			return err;
 
-		mb->pos = start;
+		mb->pos = pkt->start;
 
 		err = hmac_digest(comp->hmac, tag, sizeof(tag),
 				  mbuf_buf(mb), mbuf_get_left(mb));
@@ -274,30 +316,26 @@ int srtp_encrypt(struct srtp *srtp, struct mbuf *mb)
 			return err;
 	}
 
-	if (hdr.seq > strm->s_l)
-		strm->s_l = hdr.seq;
-
-	mb->pos = start;
+	mb->pos = pkt->start;
 
 	return 0;
 }
 
 
-int srtp_decrypt(struct srtp *srtp, struct mbuf *mb)
+static int decr_begin(struct srtp *srtp, struct pkt *pkt)
 {
+	struct comp *comp = &srtp->rtp;
+	struct mbuf *mb = pkt->mb;
 	struct srtp_stream *strm;
 	struct rtp_header hdr;
-	struct comp *comp;
 	uint64_t ix;
 	size_t start;
 	int diff;
 	int err;
 
-	if (!srtp || !mb)
+	if (!mb)
 		return EINVAL;
 
-	comp = &srtp->rtp;
-
 	start = mb->pos;
 
 	err = rtp_hdr_decode(&hdr, mb);
@@ -366,17 +404,8 @@ int srtp_decrypt(struct srtp *srtp, struct mbuf *mb)
 			return EALREADY;
 	}
 
-	if (comp->aes && comp->mode == AES_MODE_CTR) {
-
-		union vect128 iv;
-		uint8_t *p = mbuf_buf(mb);
-
-		srtp_iv_calc(&iv, &comp->k_s, strm->ssrc, ix);
-
-		aes_set_iv(comp->aes, iv.u8);
-		err = aes_decr(comp->aes, p, p, mbuf_get_left(mb));
-		if (err)
-			return err;
+	if (ctr_deferred(comp)) {
+		srtp_iv_calc(&pkt->iv, &comp->k_s, strm->ssrc, ix);
 	}
 	else if (comp->aes && comp->mode == AES_MODE_GCM) {
 
@@ -424,7 +453,146 @@ int srtp_decrypt(struct srtp *srtp, struct mbuf *mb)
 	if (hdr.seq > strm->s_l)
 		strm->s_l = hdr.seq;
 
-	mb->pos = start;
+	pkt->strm  = strm;
+	pkt->start = start;
 
 	return 0;
 }
+
+
+/*
+ * Process up to BATCH_MAX packets. Header, stream state and
+ * authentication are handled one packet at a time in order, the AES-CTR
+ * payloads of all packets are then run through one aes_ctr_batch().
+ */
+static void rtp_crypt(struct srtp *srtp, bool encr, struct mbuf **mbv,
+		      int *errv, size_t n)
+{
+	struct pkt pktv[BATCH_MAX];
+	struct aes_seg segv[BATCH_MAX];
+	const bool ctr = ctr_deferred(&srtp->rtp);
+	size_t segc = 0;
+	int err;
+
+	for (size_t i = 0; i < n; i++) {
+
+		struct pkt *pkt = &pktv[i];
+
+		pkt->mb = mbv[i];
+		errv[i] = encr ? encr_begin(srtp, pkt) : decr_begin(srtp, pkt);
+		if (errv[i] || !ctr)
+			continue;
+
+		segv[segc].iv  = pkt->iv.u8;
+		segv[segc].in  = mbuf_buf(pkt->mb);
+		segv[segc].out = mbuf_buf(pkt->mb);
+		segv[segc].len = mbuf_get_left(pkt->mb);
+		++segc;
+	}
+
+	if (segc) {
+		err = aes_ctr_batch(srtp->rtp.aes, segv, segc);
+		if (err) {
+			for (size_t i = 0; i < n; i++) {
+				if (!errv[i])
+					errv[i] = err;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < n; i++) {
+
+		if (errv[i])
+			continue;
+
+		if (encr)
+			errv[i] = encr_end(srtp, &pktv[i]);
+		else
+			pktv[i].mb->pos = pktv[i].start;
+	}
+}
+
+
+static int rtp_crypt_batch(struct srtp *srtp, bool encr, struct mbuf **mbv,
+			   int *errv, size_t n)
+{
+	if (!srtp || ((!mbv || !errv) && n))
+		return EINVAL;
+
+	for (size_t i = 0; i < n; i += BATCH_MAX)
+		rtp_crypt(srtp, encr, &mbv[i], &errv[i], min(n - i, BATCH_MAX));
+
+	for (size_t i = 0; i < n; i++) {
+		if (errv[i])
+			return errv[i];
+	}
+
+	return 0;
+}
+
+
+int srtp_encrypt(struct srtp *srtp, struct mbuf *mb)
+{
+	int err;
+
+	if (!srtp || !mb)
+		return EINVAL;
+
+	rtp_crypt(srtp, true, &mb, &err, 1);
+
+	return err;
+}
+
+
+int srtp_decrypt(struct srtp *srtp, struct mbuf *mb)
+{
+	int err;
+
+	if (!srtp || !mb)
+		return EINVAL;
+
+	rtp_crypt(srtp, false, &mb, &err, 1);
+
+	return err;
+}
+
+
+/**
+ * Encrypt several RTP packets of an SRTP session
+ *
+ * The packets are processed in order, the payload encryption of up to
+ * 32 packets is done in one pass of the cipher.
+ *
+ * @param srtp SRTP session
+ * @param mbv  Array of RTP packets, encrypted in place
+ * @param errv Array with the result of each packet
+ * @param n    Number of packets
+ *
+ * @return 0 if all packets were encrypted, otherwise the first error
+ */
+int srtp_encrypt_batch(struct srtp *srtp, struct mbuf **mbv, int *errv,
+		       size_t n)
+{
+	return rtp_crypt_batch(srtp, true, mbv, errv, n);
+}
+
+
+/**
+ * Decrypt several SRTP packets of an SRTP session
+ *
+ * The packets are authenticated and replay checked in order, the
+ * payload decryption of up to 32 packets is done in one pass of the
+ * cipher.
+ *
+ * @param srtp SRTP session
+ * @param mbv  Array of SRTP packets, decrypted in place
+ * @param errv Array with the result of each packet
+ * @param n    Number of packets
+ *
+ * @return 0 if all packets were decrypted, otherwise the first error
+ */
+int srtp_decrypt_batch(struct srtp *srtp, struct mbuf **mbv, int *errv,
+		       size_t n)
+{
+	return rtp_crypt_batch(srtp, false, mbv, errv, n);
+}
@@ -23,11 +23,14 @@ union vect128 {
 struct replay {
 	uint64_t bitmap;   /**< Session state - must be 64 bits */
 	uint64_t lix;      /**< Last received index             */
+	uint64_t *wordv;   /**< Bitmap ring for large windows   */
+	uint32_t wordc;    /**< Number of words, power of two   */
+	uint32_t window;   /**< Window size in packets          */
 };
 
 /** SRTP stream/context -- shared state between RTP/RTCP */
 struct srtp_stream {
-	struct le le;              /**< Linked-list element                */
+	struct le he;              /**< Hash-table element                 */
 	struct replay replay_rtp;  /**< recv -- replay protection for RTP  */
 	struct replay replay_rtcp; /**< recv -- replay protection for RTCP */
 	uint32_t ssrc;             /**< SSRC -- lookup key                 */
@@ -47,10 +50,14 @@ struct srtp {
 		size_t tag_len;     /**< CTR Auth. tag length [bytes]      */
 	} rtp, rtcp;
 
-	struct list streaml;        /**< SRTP-streams (struct srtp_stream) */
+	struct hash *ht_strm;       /**< SRTP-streams (struct srtp_stream) */
+	struct srtp_stream *last;   /**< Last looked up SRTP-stream        */
+	uint32_t strmc;             /**< Number of SRTP-streams            */
+	uint32_t replay_win;        /**< RTP replay window in packets      */
 };
 
 
+uint32_t stream_key(struct le *le);
 int stream_get(struct srtp_stream **strmp, struct srtp *srtp, uint32_t ssrc);
 int stream_get_seq(struct srtp_stream **strmp, struct srtp *srtp,
 		   uint32_t ssrc, uint16_t seq);
@@ -68,5 +75,6 @@ uint64_t srtp_get_index(uint32_t roc, uint16_t s_l, uint16_t seq);
 
 /* Replay protection */
 
-void srtp_replay_init(struct replay *replay);
+int  srtp_replay_init(struct replay *replay, uint32_t window);
+void srtp_replay_close(struct replay *replay);
 bool srtp_replay_check(struct replay *replay, uint64_t ix);
@@ -7,6 +7,7 @@
 #include <re_mem.h>
 #include <re_mbuf.h>
 #include <re_list.h>
+#include <re_hash.h>
 #include <re_aes.h>
 #include <re_srtp.h>
 #include "srtp.h"
@@ -22,7 +23,9 @@ static void stream_destructor(void *arg)
 {
 	struct srtp_stream *strm = arg;
 
-	list_unlink(&strm->le);
+	hash_unlink(&strm->he);
+	srtp_replay_close(&strm->replay_rtp);
+	srtp_replay_close(&strm->replay_rtcp);
 }
 
 
@@ -30,24 +33,48 @@ static struct srtp_stream *stream_find(struct srtp *srtp, uint32_t ssrc)
 {
 	struct le *le;
 
-	for (le = srtp->streaml.head; le; le = le->next) {
+	/* most packets belong to the same stream as the previous one */
+	if (srtp->last && srtp->last->ssrc == ssrc)
+		return srtp->last;
+
+	/* SSRCs are random, so they are used as hash key directly */
+	for (le = list_head(hash_list(srtp->ht_strm, ssrc)); le;
+	     le = le->next) {
 
 		struct srtp_stream *strm = le->data;
 
-		if (strm->ssrc == ssrc)
+		if (strm->ssrc == ssrc) {
+			srtp->last = strm;
 			return strm;
+		}
 	}
 
 	return NULL;
 }
 
 
+/**
+ * Get the hash key of an SRTP stream, used when the table grows
+ *
+ * @param le Hash-table element of the SRTP stream
+ *
+ * @return SSRC of the stream
+ */
+uint32_t stream_key(struct le *le)
+{
+	const struct srtp_stream *strm = le->data;
+
+	return strm->ssrc;
+}
+
+
 static int stream_new(struct srtp_stream **strmp, struct srtp *srtp,
 		      uint32_t ssrc)
 {
 	struct srtp_stream *strm;
+	int err;
 
-	if (list_count(&srtp->streaml) >= SRTP_MAX_STREAMS)
+	if (srtp->strmc >= SRTP_MAX_STREAMS)
 		return ENOSR;
 
 	strm = mem_zalloc(sizeof(*strm), stream_destructor);
@@ -55,10 +82,17 @@ static int stream_new(struct srtp_stream **strmp, struct srtp *srtp,
 		return ENOMEM;
 
 	strm->ssrc = ssrc;
-	srtp_replay_init(&strm->replay_rtp);
-	srtp_replay_init(&strm->replay_rtcp);
 
-	list_append(&srtp->streaml, &strm->le, strm);
+	err  = srtp_replay_init(&strm->replay_rtp, srtp->replay_win);
+	err |= srtp_replay_init(&strm->replay_rtcp, 0);
+	if (err) {
+		mem_deref(strm);
+		return err;
+	}
+
+	hash_append(srtp->ht_strm, ssrc, &strm->he, strm);
+	++srtp->strmc;
+	srtp->last = strm;
 
 	if (strmp)
 		*strmp = strm;
@@ -4,6 +4,7 @@
  * Copyright (C) 2010 Creytiv.com
  */
 #include <stdlib.h>
+#include <limits.h>
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
@@ -12,6 +13,11 @@
 #endif
 #if !defined(WIN32)
 #include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#endif
+#ifdef LINUX
+#include <linux/errqueue.h>
 #endif
 #include <string.h>
 #include <re_types.h>
@@ -41,6 +47,18 @@
 #endif
 
 
+#if defined(LINUX) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+#define TCP_ZEROCOPY 1  /**< Zero-copy send (MSG_ZEROCOPY) */
+#endif
+
+/** Maximum number of queued buffers per vectored write */
+#ifdef IOV_MAX
+#define TCP_IOV_MAX IOV_MAX
+#else
+#define TCP_IOV_MAX 16
+#endif
+
+
 enum {
 	TCP_TXQSZ_DEFAULT = 524288,
 	TCP_RXSZ_DEFAULT  = 8192
@@ -70,8 +88,15 @@ struct tcp_conn {
 	tcp_close_h *closeh;  /**< Connection close handler          */
 	void *arg;            /**< Handler argument                  */
 	size_t rxsz;          /**< Maximum receive chunk size        */
+	struct mbuf_pool *rxpool; /**< Receive buffer pool           */
 	size_t txqsz;
 	size_t txqsz_max;
+	size_t txqsz_peak;    /**< High-water mark of queued bytes   */
+	size_t txqlen;        /**< Number of queued buffers          */
+	struct list zcl;      /**< Buffers of pending zero-copy sends */
+	uint32_t zc_id;       /**< Next zero-copy send counter       */
+	bool zc_on;           /**< SO_ZEROCOPY is enabled            */
+	bool zc_nosup;        /**< SO_ZEROCOPY is not supported      */
 	bool active;          /**< We are connecting flag            */
 	bool connected;       /**< Connection is connected flag      */
 	uint8_t tos;          /**< Type-of-service field             */
@@ -94,6 +119,13 @@ struct tcp_qent {
 	struct mbuf mb;
 };
 
+/** Buffer of a zero-copy send, kept until the kernel is done with it */
+struct tcp_zcent {
+	struct le le;
+	uint32_t id;
+	struct mbuf *mb;
+};
+
 
 static void tcp_recv_handler(int flags, void *arg);
 
@@ -162,6 +194,8 @@ static void conn_destructor(void *data)
 
 	list_flush(&tc->helpers);
 	list_flush(&tc->sendq);
+	list_flush(&tc->zcl);
+	mem_deref(tc->rxpool);
 
 	if (tc->fdc != RE_BAD_SOCK) {
 		tc->fhs = fd_close(tc->fhs);
@@ -187,6 +221,15 @@ static void qent_destructor(void *arg)
 }
 
 
+static void zcent_destructor(void *arg)
+{
+	struct tcp_zcent *zc = arg;
+
+	list_unlink(&zc->le);
+	mem_deref(zc->mb);
+}
+
+
 static int enqueue(struct tcp_conn *tc, struct mbuf *mb)
 {
 	const size_t n = mbuf_get_left(mb);
@@ -215,15 +258,25 @@ static int enqueue(struct tcp_conn *tc, struct mbuf *mb)
 	err = mbuf_write_mem(&qe->mb, mbuf_buf(mb), n);
 	qe->mb.pos = 0;
 
-	if (err)
+	if (err) {
 		mem_deref(qe);
-	else
-		tc->txqsz += qe->mb.end;
+		return err;
+	}
 
-	return err;
+	tc->txqsz += qe->mb.end;
+	++tc->txqlen;
+
+	if (tc->txqsz > tc->txqsz_peak)
+		tc->txqsz_peak = tc->txqsz;
+
+	return 0;
 }
 
 
+/*
+ * Send as much of the queue as possible. Without Windows, up to
+ * TCP_IOV_MAX queued buffers are gathered with one vectored write.
+ */
 static int dequeue(struct tcp_conn *tc)
 {
 	struct tcp_qent *qe = list_ledata(tc->sendq.head);
@@ -233,6 +286,11 @@ static int dequeue(struct tcp_conn *tc)
 	const int flags = MSG_NOSIGNAL; /* disable SIGPIPE signal */
 #else
 	const int flags = 0;
+#endif
+#ifndef WIN32
+	struct iovec iov[TCP_IOV_MAX];
+	struct msghdr msg;
+	int iovc = 0;
 #endif
 	if (!qe) {
 		if (tc->sendh)
@@ -241,8 +299,25 @@ static int dequeue(struct tcp_conn *tc)
 		return 0;
 	}
 
+#ifndef WIN32
+	for (struct le *le = tc->sendq.head; le && iovc < TCP_IOV_MAX;
+	     le = le->next) {
+		struct tcp_qent *q = le->data;
+
+		iov[iovc].iov_base = mbuf_buf(&q->mb);
+		iov[iovc].iov_len  = q->mb.end - q->mb.pos;
+		++iovc;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov    = iov;
+	msg.msg_iovlen = iovc;
+
+	n = sendmsg(tc->fdc, &msg, flags);
+#else
 	n = send(tc->fdc, BUF_CAST mbuf_buf(&qe->mb),
 		 SIZ_CAST (qe->mb.end - qe->mb.pos), flags);
+#endif
 	if (n < 0) {
 		err = RE_ERRNO_SOCK;
 		if (err == EAGAIN)
@@ -254,20 +329,135 @@ static int dequeue(struct tcp_conn *tc)
 		return err;
 	}
 
-	tc->txqsz  -= n;
-	qe->mb.pos += n;
+	tc->txqsz -= n;
+
+	while ((qe = list_ledata(tc->sendq.head))) {
+
+		const size_t left = qe->mb.end - qe->mb.pos;
+
+		if ((size_t)n < left) {
+			qe->mb.pos += n;
+			break;
+		}
+
+		n -= left;
 
-	if (qe->mb.pos >= qe->mb.end)
+		--tc->txqlen;
 		mem_deref(qe);
+	}
 
 	return 0;
 }
 
 
+#ifdef TCP_ZEROCOPY
+/*
+ * Release the buffers of completed zero-copy sends, reported on the
+ * socket error queue as ranges of send counters.
+ */
+static bool zc_complete(struct tcp_conn *tc)
+{
+	bool done = false;
+
+	for (;;) {
+		uint8_t ctrl[128];
+		struct msghdr msg;
+		struct cmsghdr *cmsg;
+
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control    = ctrl;
+		msg.msg_controllen = sizeof(ctrl);
+
+		if (recvmsg(tc->fdc, &msg, MSG_ERRQUEUE) < 0)
+			break;
+
+		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+		     cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+
+			struct sock_extended_err ee;
+			struct le *le;
+
+			if (!(cmsg->cmsg_level == SOL_IP &&
+			      cmsg->cmsg_type == IP_RECVERR) &&
+			    !(cmsg->cmsg_level == SOL_IPV6 &&
+			      cmsg->cmsg_type == IPV6_RECVERR))
+				continue;
+
+			memcpy(&ee, CMSG_DATA(cmsg), sizeof(ee));
+
+			if (ee.ee_errno != 0 ||
+			    ee.ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+				continue;
+
+			/* range of send counters, may wrap */
+			le = tc->zcl.head;
+			while (le) {
+				struct tcp_zcent *zc = le->data;
+				uint32_t off = zc->id - ee.ee_info;
+
+				le = le->next;
+
+				if (off <= ee.ee_data - ee.ee_info)
+					mem_deref(zc);
+			}
+
+			done = true;
+		}
+	}
+
+	return done;
+}
+
+
+static ssize_t zc_send(struct tcp_conn *tc, struct mbuf *mb, int flags)
+{
+	const size_t len = mb->end - mb->pos;
+	struct tcp_zcent *zc;
+	int on = 1;
+	ssize_t n;
+
+	if (!tc->zc_on && !tc->zc_nosup) {
+
+		if (0 == setsockopt(tc->fdc, SOL_SOCKET, SO_ZEROCOPY,
+				    &on, sizeof(on)))
+			tc->zc_on = true;
+		else
+			tc->zc_nosup = true;
+	}
+
+	if (!tc->zc_on)
+		return send(tc->fdc, mbuf_buf(mb), len, flags);
+
+	zc = mem_zalloc(sizeof(*zc), zcent_destructor);
+	if (!zc)
+		return send(tc->fdc, mbuf_buf(mb), len, flags);
+
+	n = send(tc->fdc, mbuf_buf(mb), len, flags | MSG_ZEROCOPY);
+	if (n < 0) {
+		mem_deref(zc);
+
+		/* out of option memory, send with a copy */
+		if (errno == ENOBUFS)
+			return send(tc->fdc, mbuf_buf(mb), len, flags);
+
+		return n;
+	}
+
+	zc->id = tc->zc_id++;
+	zc->mb = mem_ref(mb);
+	list_append(&tc->zcl, &zc->le, zc);
+
+	return n;
+}
+#endif
+
+
 static void conn_close(struct tcp_conn *tc, int err)
 {
 	list_flush(&tc->sendq);
-	tc->txqsz = 0;
+	list_flush(&tc->zcl);
+	tc->txqsz  = 0;
+	tc->txqlen = 0;
 
 	/* Stop polling */
 	if (tc->fdc != RE_BAD_SOCK) {
@@ -286,11 +476,19 @@ static void tcp_recv_handler(int flags, void *arg)
 	struct tcp_conn *tc = arg;
 	struct mbuf *mb = NULL;
 	bool hlp_estab = false;
+	bool pooled;
 	struct le *le;
 	ssize_t n;
 	int err = 0;
 	socklen_t err_len = sizeof(err);
 
+#ifdef TCP_ZEROCOPY
+	/* zero-copy completions, select() reports them as readable */
+	if (!list_isempty(&tc->zcl) && (flags & (FD_READ | FD_EXCEPT)) &&
+	    zc_complete(tc) && flags == FD_EXCEPT)
+		return;
+#endif
+
 	if (flags & FD_EXCEPT) {
 		DEBUG_INFO("recv handler: got FD_EXCEPT on fd=%d\n", tc->fdc);
 	}
@@ -385,7 +583,13 @@ static void tcp_recv_handler(int flags, void *arg)
 	}
 
  read:
-	mb = mbuf_alloc(tc->rxsz);
+	if (tc->rxpool && mbuf_pool_bufsz(tc->rxpool) >= tc->rxsz) {
+		mb = mbuf_pool_get(tc->rxpool, &pooled);
+	}
+	else {
+		mb = mbuf_alloc(tc->rxsz);
+		pooled = false;
+	}
 	if (!mb)
 		return;
 
@@ -397,6 +601,9 @@ static void tcp_recv_handler(int flags, void *arg)
 	}
 	else if (n < 0) {
 		err = RE_ERRNO_SOCK;
+		if (err == EAGAIN)
+			goto out;
+
 		DEBUG_WARNING("recv handler: recv(): %m\n", err);
 #ifdef WIN32
 		if (err == WSAECONNRESET || err == WSAECONNABORTED) {
@@ -439,7 +646,9 @@ static void tcp_recv_handler(int flags, void *arg)
 			goto out;
 	}
 
-	mbuf_trim(mb);
+	/* pooled buffers keep their size */
+	if (!pooled)
+		mbuf_trim(mb);
 
 	if (hlp_estab && tc->estabh) {
 
@@ -1123,7 +1332,7 @@ int tcp_conn_connect(struct tcp_conn *tc, const struct sa *peer)
 
 
 static int tcp_send_internal(struct tcp_conn *tc, struct mbuf *mb,
-			     struct le *le)
+			     struct le *le, bool zc)
 {
 	int err = 0;
 	ssize_t n;
@@ -1155,8 +1364,15 @@ static int tcp_send_internal(struct tcp_conn *tc, struct mbuf *mb,
 	if (tc->sendq.head)
 		return enqueue(tc, mb);
 
-	n = send(tc->fdc, BUF_CAST mbuf_buf(mb),
-		 SIZ_CAST (mb->end - mb->pos), flags);
+#ifdef TCP_ZEROCOPY
+	if (zc && !tc->helpers.head)
+		n = zc_send(tc, mb, flags);
+	else
+#else
+	(void)zc;
+#endif
+		n = send(tc->fdc, BUF_CAST mbuf_buf(mb),
+			 SIZ_CAST (mb->end - mb->pos), flags);
 	if (n < 0) {
 		err = RE_ERRNO_SOCK;
 
@@ -1199,7 +1415,128 @@ int tcp_send(struct tcp_conn *tc, struct mbuf *mb)
 	if (!tc || !mb)
 		return EINVAL;
 
-	return tcp_send_internal(tc, mb, tc->helpers.tail);
+	return tcp_send_internal(tc, mb, tc->helpers.tail, false);
+}
+
+
+/**
+ * Send data on a TCP Connection without copying it (MSG_ZEROCOPY).
+ * A reference to the buffer is held until the kernel reports that the
+ * send has completed, the caller must not modify the data afterwards.
+ * With TCP helpers, while data is queued or without kernel support
+ * the data is copied as by tcp_send().
+ *
+ * @param tc TCP Connection
+ * @param mb Buffer to send, allocated with mbuf_alloc()
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int tcp_send_zc(struct tcp_conn *tc, struct mbuf *mb)
+{
+	if (!tc || !mb)
+		return EINVAL;
+
+	return tcp_send_internal(tc, mb, tc->helpers.tail, true);
+}
+
+
+static int tcp_sendv_flat(struct tcp_conn *tc, const struct mbuf_chain *mc,
+			  bool queue, size_t pos)
+{
+	struct mbuf *mb;
+	int err;
+
+	mb = mbuf_alloc(mbuf_chain_len(mc));
+	if (!mb)
+		return ENOMEM;
+
+	err = mbuf_chain_flatten(mc, mb);
+	if (err)
+		goto out;
+
+	mb->pos = pos;
+
+	if (queue)
+		err = enqueue(tc, mb);
+	else
+		err = tcp_send_internal(tc, mb, tc->helpers.tail, false);
+
+ out:
+	mem_deref(mb);
+
+	return err;
+}
+
+
+/**
+ * Send data on a TCP Connection, gathered from an mbuf chain with one
+ * vectored write. If TCP helpers (e.g. TLS) are registered or data is
+ * queued, the chain is copied into one buffer and sent via tcp_send.
+ *
+ * @param tc TCP Connection
+ * @param mc Mbuf chain to send
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int tcp_sendv(struct tcp_conn *tc, const struct mbuf_chain *mc)
+{
+#ifndef WIN32
+	struct iovec iov[MBUF_CHAIN_MAX];
+	struct msghdr msg;
+	ssize_t n;
+	int err;
+#ifdef MSG_NOSIGNAL
+	const int flags = MSG_NOSIGNAL; /* disable SIGPIPE signal */
+#else
+	const int flags = 0;
+#endif
+#endif
+
+	if (!tc || !mc)
+		return EINVAL;
+
+	if (tc->fdc == RE_BAD_SOCK)
+		return ENOTCONN;
+
+	if (!mbuf_chain_len(mc))
+		return EINVAL;
+
+#ifndef WIN32
+	if (tc->helpers.head || tc->sendq.head)
+		return tcp_sendv_flat(tc, mc, false, 0);
+
+	for (unsigned i = 0; i < mc->segc; i++) {
+		const struct mbuf_seg *seg = &mc->segv[i];
+
+		iov[i].iov_base = seg->mb->buf + seg->pos;
+		iov[i].iov_len  = seg->end - seg->pos;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov    = iov;
+	msg.msg_iovlen = mc->segc;
+
+	n = sendmsg(tc->fdc, &msg, flags);
+	if (n < 0) {
+		err = RE_ERRNO_SOCK;
+
+		if (err == EAGAIN)
+			return tcp_sendv_flat(tc, mc, true, 0);
+
+		DEBUG_WARNING("sendv: sendmsg(): %m (fdc=%d)\n",
+			      err, tc->fdc);
+
+		return err;
+	}
+
+	/* queue the remaining part */
+	if ((size_t)n < mbuf_chain_len(mc))
+		return tcp_sendv_flat(tc, mc, true, n);
+
+	return 0;
+#else
+	return tcp_sendv_flat(tc, mc, false, 0);
+#endif
 }
 
 
@@ -1219,7 +1556,7 @@ int tcp_send_helper(struct tcp_conn *tc, struct mbuf *mb,
 	if (!tc || !mb || !th)
 		return EINVAL;
 
-	return tcp_send_internal(tc, mb, th->le.prev);
+	return tcp_send_internal(tc, mb, th->le.prev, false);
 }
 
 
@@ -1365,6 +1702,23 @@ void tcp_conn_rxsz_set(struct tcp_conn *tc, size_t rxsz)
 }
 
 
+/**
+ * Set the receive buffer pool on a TCP Connection. Receive buffers are
+ * taken from the pool if its buffer size fits the receive chunk size.
+ *
+ * @param tc TCP Connection
+ * @param mp Mbuf pool, or NULL to allocate receive buffers from the heap
+ */
+void tcp_conn_rxpool_set(struct tcp_conn *tc, struct mbuf_pool *mp)
+{
+	if (!tc)
+		return;
+
+	mem_deref(tc->rxpool);
+	tc->rxpool = mem_ref(mp);
+}
+
+
 /**
  * Set the maximum send queue size on a TCP Connection
  *
@@ -1393,6 +1747,29 @@ size_t tcp_conn_txqsz(const struct tcp_conn *tc)
 }
 
 
+/**
+ * Get the send queue statistics of a TCP Connection. Applications can
+ * use the number of queued bytes for backpressure.
+ *
+ * @param tc   TCP Connection
+ * @param stat Returned statistics
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int tcp_conn_txq_stat(const struct tcp_conn *tc, struct tcp_txq_stat *stat)
+{
+	if (!tc || !stat)
+		return EINVAL;
+
+	stat->entries    = tc->txqlen;
+	stat->bytes      = tc->txqsz;
+	stat->bytes_peak = tc->txqsz_peak;
+	stat->zc_pending = list_count(&tc->zcl);
+
+	return 0;
+}
+
+
 static bool sort_handler(struct le *le1, struct le *le2, void *arg)
 {
 	struct tcp_helper *th1 = le1->data, *th2 = le2->data;
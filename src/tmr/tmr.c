@@ -35,8 +35,35 @@ enum {
 	MAX_BLOCKING = 500   /**< Maximum time spent in handler [ms] */
 };
 
+
+/*
+ * Hierarchical timer wheel
+ *
+ * Each level has WHEEL_SIZE slots, level N covers a resolution of
+ * 2^(WHEEL_BITS * N) [ms]. A timer is stored at the level of the most
+ * significant digit in which its expiry differs from the wheel time,
+ * so all timers in a level 0 slot expire at the same millisecond and
+ * are kept in insertion order. When the wheel time enters a new block,
+ * the matching slot of the next level is cascaded down. Timers beyond
+ * the outermost level are kept in the overflow list.
+ */
+enum {
+	WHEEL_BITS   = 8,
+	WHEEL_SIZE   = 1 << WHEEL_BITS,
+	WHEEL_MASK   = WHEEL_SIZE - 1,
+	WHEEL_LEVELS = 4,
+	WHEEL_WORDS  = WHEEL_SIZE / 64,
+};
+
+struct wheel {
+	struct list slot[WHEEL_SIZE];
+	uint64_t bitmap[WHEEL_WORDS];  /**< Non-empty slots (may be stale) */
+};
+
 struct tmrl {
-	struct list list;
+	struct wheel wheel[WHEEL_LEVELS];
+	struct list overflow;   /**< Timers beyond the outermost level */
+	uint64_t jfs;           /**< Current wheel time [ms]            */
 	mtx_t *lock;
 };
 
@@ -46,7 +73,14 @@ static void tmrl_destructor(void *arg)
 	struct tmrl *tmrl = arg;
 
 	mtx_lock(tmrl->lock);
-	list_clear(&tmrl->list);
+
+	for (int lvl = 0; lvl < WHEEL_LEVELS; lvl++) {
+		for (int i = 0; i < WHEEL_SIZE; i++)
+			list_clear(&tmrl->wheel[lvl].slot[i]);
+	}
+
+	list_clear(&tmrl->overflow);
+
 	mtx_unlock(tmrl->lock);
 
 	mem_deref(tmrl->lock);
@@ -65,7 +99,7 @@ int tmrl_alloc(struct tmrl **tmrl)
 	if (!l)
 		return ENOMEM;
 
-	list_init(&l->list);
+	l->jfs = tmr_jiffies();
 
 	err = mutex_alloc(&l->lock);
 	if (err) {
@@ -90,12 +124,214 @@ static bool inspos_handler(struct le *le, void *arg)
 }
 
 
-static bool inspos_handler_0(struct le *le, void *arg)
+static inline unsigned bit_ctz(uint64_t v)
 {
-	struct tmr *tmr = le->data;
-	const uint64_t now = *(uint64_t *)arg;
+#if defined(__GNUC__) || defined(__clang__)
+	return (unsigned)__builtin_ctzll(v);
+#else
+	unsigned n = 0;
+
+	while (!(v & 1)) {
+		v >>= 1;
+		++n;
+	}
+
+	return n;
+#endif
+}
+
+
+/* Find the first non-empty slot >= from, clears stale bits on the way */
+static int wheel_next_slot(struct wheel *w, unsigned from)
+{
+	unsigned i = from;
+
+	while (i < WHEEL_SIZE) {
+		uint64_t word = w->bitmap[i / 64] >> (i % 64);
+
+		if (!word) {
+			i = (i / 64 + 1) * 64;
+			continue;
+		}
+
+		i += bit_ctz(word);
+
+		if (w->slot[i].head)
+			return (int)i;
+
+		w->bitmap[i / 64] &= ~(1ULL << (i % 64));
+		++i;
+	}
+
+	return -1;
+}
+
+
+static void wheel_insert(struct tmrl *tmrl, struct tmr *tmr)
+{
+	const uint64_t diff = tmr->jfs ^ tmrl->jfs;
+	struct wheel *w;
+	unsigned idx;
+	int lvl;
+
+	if (tmr->jfs <= tmrl->jfs) {
+		struct list *lst;
+		struct le *le;
+
+		/* due now or already expired, keep sorted by expiry */
+		w   = &tmrl->wheel[0];
+		idx = tmrl->jfs & WHEEL_MASK;
+		lst = &w->slot[idx];
+
+		le = list_apply(lst, false, inspos_handler, &tmr->jfs);
+		if (le)
+			list_insert_after(lst, le, &tmr->le, tmr);
+		else
+			list_prepend(lst, &tmr->le, tmr);
+
+		w->bitmap[idx / 64] |= 1ULL << (idx % 64);
+		return;
+	}
+
+	for (lvl = 0; lvl < WHEEL_LEVELS; lvl++) {
+		const unsigned shift = WHEEL_BITS * lvl;
+
+		if (diff >> (shift + WHEEL_BITS))
+			continue;
+
+		w   = &tmrl->wheel[lvl];
+		idx = (tmr->jfs >> shift) & WHEEL_MASK;
+
+		list_append(&w->slot[idx], &tmr->le, tmr);
+		w->bitmap[idx / 64] |= 1ULL << (idx % 64);
+		return;
+	}
+
+	list_append(&tmrl->overflow, &tmr->le, tmr);
+}
+
+
+static void wheel_redistribute(struct tmrl *tmrl, struct list *lst)
+{
+	struct le *le;
+
+	while ((le = lst->head)) {
+		list_unlink(le);
+		wheel_insert(tmrl, le->data);
+	}
+}
+
+
+/* Earliest wheel time where a slot expires or must be cascaded */
+static uint64_t wheel_next_event(struct tmrl *tmrl)
+{
+	const uint64_t base = tmrl->jfs;
+
+	for (int lvl = 0; lvl < WHEEL_LEVELS; lvl++) {
+		const unsigned shift = WHEEL_BITS * lvl;
+		const unsigned idx = (base >> shift) & WHEEL_MASK;
+		uint64_t block;
+		int n;
+
+		/* Only level 0 may have timers in the current slot */
+		n = wheel_next_slot(&tmrl->wheel[lvl], lvl ? idx + 1 : idx);
+		if (n < 0)
+			continue;
+
+		block = base >> (shift + WHEEL_BITS) << (shift + WHEEL_BITS);
+
+		return block | ((uint64_t)n << shift);
+	}
+
+	if (!list_isempty(&tmrl->overflow)) {
+		const unsigned shift = WHEEL_BITS * WHEEL_LEVELS;
+
+		return ((base >> shift) + 1) << shift;
+	}
+
+	return UINT64_MAX;
+}
+
+
+static void wheel_cascade(struct tmrl *tmrl)
+{
+	const uint64_t base = tmrl->jfs;
 
-	return tmr->jfs > now;
+	if (!(base & ((1ULL << (WHEEL_BITS * WHEEL_LEVELS)) - 1)))
+		wheel_redistribute(tmrl, &tmrl->overflow);
+
+	for (int lvl = WHEEL_LEVELS - 1; lvl > 0; lvl--) {
+		const unsigned shift = WHEEL_BITS * lvl;
+
+		if (base & ((1ULL << shift) - 1))
+			continue;
+
+		wheel_redistribute(tmrl,
+			&tmrl->wheel[lvl].slot[(base >> shift) & WHEEL_MASK]);
+	}
+}
+
+
+/* Advance the wheel up to now and return the first expired timer */
+static struct tmr *wheel_expired(struct tmrl *tmrl, uint64_t now)
+{
+	for (;;) {
+		struct list *cur = &tmrl->wheel[0].slot[tmrl->jfs & WHEEL_MASK];
+		uint64_t t;
+
+		if (cur->head)
+			return cur->head->data;
+
+		if (tmrl->jfs >= now)
+			return NULL;
+
+		t = wheel_next_event(tmrl);
+		if (t > now) {
+			tmrl->jfs = now;
+			return NULL;
+		}
+
+		tmrl->jfs = t;
+		wheel_cascade(tmrl);
+	}
+}
+
+
+static const struct tmr *slot_first(const struct list *lst)
+{
+	const struct tmr *first = NULL;
+
+	for (struct le *le = list_head(lst); le; le = le->next) {
+		const struct tmr *tmr = le->data;
+
+		if (!first || tmr->jfs < first->jfs)
+			first = tmr;
+	}
+
+	return first;
+}
+
+
+/* Timer with the earliest expiry */
+static const struct tmr *wheel_first(struct tmrl *tmrl)
+{
+	for (int lvl = 0; lvl < WHEEL_LEVELS; lvl++) {
+		const unsigned shift = WHEEL_BITS * lvl;
+		const unsigned idx = (tmrl->jfs >> shift) & WHEEL_MASK;
+		int n;
+
+		n = wheel_next_slot(&tmrl->wheel[lvl], lvl ? idx + 1 : idx);
+		if (n < 0)
+			continue;
+
+		/* level 0 slots are sorted by expiry */
+		if (!lvl)
+			return list_ledata(tmrl->wheel[lvl].slot[n].head);
+
+		return slot_first(&tmrl->wheel[lvl].slot[n]);
+	}
+
+	return slot_first(&tmrl->overflow);
 }
 
 
@@ -136,7 +372,7 @@ void tmr_poll(struct tmrl *tmrl)
 		void *th_arg;
 
 		mtx_lock(tmrl->lock);
-		tmr = list_ledata(tmrl->list.head);
+		tmr = wheel_expired(tmrl, jfs);
 
 		if (!tmr || (tmr->jfs > jfs)) {
 			mtx_unlock(tmrl->lock);
@@ -306,7 +542,7 @@ uint64_t tmr_next_timeout(struct tmrl *tmrl)
 
 	mtx_lock(tmrl->lock);
 
-	tmr = list_ledata(tmrl->list.head);
+	tmr = wheel_first(tmrl);
 	if (!tmr)
 		goto out;
 
@@ -322,10 +558,38 @@ out:
 }
 
 
+static uint32_t wheel_count(const struct tmrl *tmrl)
+{
+	uint32_t n = list_count(&tmrl->overflow);
+
+	for (int lvl = 0; lvl < WHEEL_LEVELS; lvl++) {
+		for (int i = 0; i < WHEEL_SIZE; i++)
+			n += list_count(&tmrl->wheel[lvl].slot[i]);
+	}
+
+	return n;
+}
+
+
+static int slot_status(struct re_printf *pf, const struct list *lst)
+{
+	int err = 0;
+
+	for (struct le *le = list_head(lst); le; le = le->next) {
+		const struct tmr *tmr = le->data;
+		err |= re_hprintf(pf, "  %p: th=%p expire=%llums file=%s:%d\n",
+				  tmr, tmr->th,
+				  (unsigned long long)tmr_get_expire(tmr),
+				  tmr->file, tmr->line);
+	}
+
+	return err;
+}
+
+
 int tmr_status(struct re_printf *pf, void *unused)
 {
 	struct tmrl *tmrl = re_tmrl_get();
-	struct le *le;
 	uint32_t n;
 	int err = 0;
 
@@ -336,20 +600,24 @@ int tmr_status(struct re_printf *pf, void *unused)
 
 	mtx_lock(tmrl->lock);
 
-	n = list_count(&tmrl->list);
+	n = wheel_count(tmrl);
 	if (!n)
 		goto out;
 
 	err = re_hprintf(pf, "Timers (%u):\n", n);
 
-	for (le = tmrl->list.head; le; le = le->next) {
-		const struct tmr *tmr = le->data;
-		err |= re_hprintf(pf, "  %p: th=%p expire=%llums file=%s:%d\n",
-				  tmr, tmr->th,
-				  (unsigned long long)tmr_get_expire(tmr),
-				  tmr->file, tmr->line);
+	/* dump in wheel order, starting at the current slot of each level */
+	for (int lvl = 0; lvl < WHEEL_LEVELS; lvl++) {
+		const unsigned shift = WHEEL_BITS * lvl;
+		const struct wheel *w = &tmrl->wheel[lvl];
+		unsigned i = (tmrl->jfs >> shift) & WHEEL_MASK;
+
+		for (; i < WHEEL_SIZE; i++)
+			err |= slot_status(pf, &w->slot[i]);
 	}
 
+	err |= slot_status(pf, &tmrl->overflow);
+
 	if (n > 100)
 		err |= re_hprintf(pf, "    (Dumped Timers: %u)\n", n);
 
@@ -387,7 +655,6 @@ static void tmr_startcont_dbg(struct tmr *tmr, uint64_t delay, bool syncnow,
 		   const char *file, int line)
 {
 	struct tmrl *tmrl = re_tmrl_get();
-	struct le *le;
 	mtx_t *lock;
 
 	if (!tmr || !tmrl)
@@ -431,25 +698,7 @@ static void tmr_startcont_dbg(struct tmr *tmr, uint64_t delay, bool syncnow,
 		tmr->jfs = tmr_jiffies();
 	tmr->jfs += delay;
 
-	if (delay == 0) {
-		le = list_apply(&tmrl->list, true, inspos_handler_0,
-				&tmr->jfs);
-		if (le) {
-			list_insert_before(&tmrl->list, le, &tmr->le, tmr);
-		}
-		else {
-			list_append(&tmrl->list, &tmr->le, tmr);
-		}
-	}
-	else {
-		le = list_apply(&tmrl->list, false, inspos_handler, &tmr->jfs);
-		if (le) {
-			list_insert_after(&tmrl->list, le, &tmr->le, tmr);
-		}
-		else {
-			list_prepend(&tmrl->list, &tmr->le, tmr);
-		}
-	}
+	wheel_insert(tmrl, tmr);
 
 	re_atomic_rls_set(&tmr->active, true);
 
@@ -517,7 +766,7 @@ uint32_t tmrl_count(struct tmrl *tmrl)
 		return 0;
 
 	mtx_lock(tmrl->lock);
-	c = list_count(&tmrl->list);
+	c = wheel_count(tmrl);
 	mtx_unlock(tmrl->lock);
 
 	return c;
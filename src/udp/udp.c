@@ -12,6 +12,9 @@
 #endif
 #if !defined(WIN32)
 #include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
 #endif
 #include <string.h>
 #ifdef HAVE_STRINGS_H
@@ -58,9 +61,30 @@ typedef UINT32 *PQOS_FLOWID;
 #define SIZ_CAST
 #endif
 
+#if defined(UDP_SEGMENT) && defined(UDP_GRO)
+#define UDP_OFFLOAD 1  /**< UDP segmentation offload (GSO/GRO) */
+#endif
+
+/** Non-blocking receive, sockets from udp_open() are blocking */
+#ifdef MSG_DONTWAIT
+#define UDP_DONTWAIT MSG_DONTWAIT
+#else
+#define UDP_DONTWAIT 0
+#endif
+
 
 enum {
-	UDP_RXSZ_DEFAULT = 8192
+	UDP_RXSZ_DEFAULT = 8192,
+	UDP_BATCH_MAX    = 32,   /**< Max datagrams per batch syscall */
+	UDP_GRO_RXSZ     = 65535,
+	UDP_GSO_SEGS     = 64,   /**< Max segments per GSO send       */
+	UDP_GSO_MAXSZ    = 65000,
+};
+
+enum udp_gso {
+	UDP_GSO_UNKNOWN = 0,
+	UDP_GSO_ON,
+	UDP_GSO_OFF,
 };
 
 
@@ -76,6 +100,11 @@ struct udp_sock {
 	bool conn;           /**< Connected socket flag       */
 	size_t rxsz;         /**< Maximum receive chunk size  */
 	size_t rx_presz;     /**< Preallocated rx buffer size */
+	unsigned rxbatch;    /**< Datagrams per receive call  */
+	bool gro;            /**< Receive coalesced datagrams */
+	enum udp_gso gso;    /**< Kernel GSO support          */
+	struct mbuf *rxv[UDP_BATCH_MAX]; /**< Batch and GRO rx bufs */
+	struct mbuf_pool *rxpool; /**< Receive buffer pool     */
 #ifdef WIN32
 	HANDLE qos;          /**< QOS subsystem handle        */
 	QOS_FLOWID qos_id;   /**< QOS flow id                 */
@@ -130,6 +159,11 @@ static void udp_destructor(void *data)
 
 	list_flush(&us->helpers);
 
+	for (unsigned i = 0; i < UDP_BATCH_MAX; i++)
+		mem_deref(us->rxv[i]);
+
+	mem_deref(us->rxpool);
+
 	mem_deref(us->lock);
 
 #ifdef WIN32
@@ -146,46 +180,70 @@ static void udp_destructor(void *data)
 }
 
 
-static void udp_read(struct udp_sock *us, re_sock_t fd)
+/* get a receive buffer, from the pool if it is large enough */
+static struct mbuf *udp_rxbuf(const struct udp_sock *us, size_t size,
+			      bool *pooled)
 {
-	struct mbuf *mb = mbuf_alloc(us->rxsz);
+	if (us->rxpool && mbuf_pool_bufsz(us->rxpool) >= size)
+		return mbuf_pool_get(us->rxpool, pooled);
+
+	if (pooled)
+		*pooled = false;
+
+	return mbuf_alloc(size);
+}
+
+
+/* normalize would-block errors, and report all others */
+static int udp_read_error(struct udp_sock *us)
+{
+	int err = RE_ERRNO_SOCK;
+
+#ifdef WIN32
+	if (WSAEWOULDBLOCK == err)
+		return EAGAIN;
+#endif
+
+#if defined (EWOULDBLOCK) && EWOULDBLOCK != EAGAIN
+	if (EWOULDBLOCK == err)
+		return EAGAIN;
+#endif
+
+	if (EAGAIN != err && us->eh)
+		us->eh(err, us->arg);
+
+	return err;
+}
+
+
+static int udp_read(struct udp_sock *us, re_sock_t fd, int flags)
+{
+	struct mbuf *mb;
 	struct sa src;
 	struct le *le;
+	bool pooled;
 	int err = 0;
 	ssize_t n;
 
+	mb = udp_rxbuf(us, us->rxsz, &pooled);
 	if (!mb)
-		return;
+		return ENOMEM;
 
 	src.len = sizeof(src.u);
 	n = recvfrom(fd, BUF_CAST mb->buf + us->rx_presz,
-		     SIZ_CAST (mb->size - us->rx_presz), 0,
+		     SIZ_CAST (mb->size - us->rx_presz), flags,
 		     &src.u.sa, &src.len);
 	if (n < 0) {
-		err = RE_ERRNO_SOCK;
-
-		if (EAGAIN == err)
-			goto out;
-
-#ifdef WIN32
-		if (WSAEWOULDBLOCK == err)
-			goto out;
-#endif
-
-#if defined (EWOULDBLOCK) && EWOULDBLOCK != EAGAIN
-		if (EWOULDBLOCK == err)
-			goto out;
-#endif
-		if (us->eh)
-			us->eh(err, us->arg);
-
+		err = udp_read_error(us);
 		goto out;
 	}
 
 	mb->pos = us->rx_presz;
 	mb->end = n + us->rx_presz;
 
-	(void)mbuf_resize(mb, mb->end);
+	/* pooled buffers keep their size */
+	if (!pooled)
+		(void)mbuf_resize(mb, mb->end);
 
 	/* call helpers */
 	mtx_lock(us->lock);
@@ -208,16 +266,273 @@ static void udp_read(struct udp_sock *us, re_sock_t fd)
 
  out:
 	mem_deref(mb);
+
+	return err;
+}
+
+
+#ifdef UDP_OFFLOAD
+enum {
+	UDP_GRO_CMSG_SIZE = CMSG_SPACE(sizeof(int)),
+};
+
+
+static size_t udp_gro_size(struct msghdr *msg)
+{
+	struct cmsghdr *cmsg;
+
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		int segsz;
+
+		if (cmsg->cmsg_level != IPPROTO_UDP ||
+		    cmsg->cmsg_type != UDP_GRO)
+			continue;
+
+		memcpy(&segsz, CMSG_DATA(cmsg), sizeof(segsz));
+
+		return segsz > 0 ? (size_t)segsz : 0;
+	}
+
+	return 0;
+}
+
+
+/*
+ * Split a coalesced GRO datagram into one mbuf per datagram, so helpers
+ * and the receive handler see the original packets. A datagram that was
+ * not coalesced is copied as well, so the 64K receive buffer is reused
+ * and the handler gets a right-sized mbuf. The caller must hold a
+ * reference to the socket.
+ */
+static void udp_recv_gro(struct udp_sock *us, const struct sa *src,
+			 struct mbuf *mb, size_t segsz)
+{
+	if (!segsz)
+		segsz = mbuf_get_left(mb);
+
+	do {
+		size_t len = min(segsz, mbuf_get_left(mb));
+		struct mbuf *seg;
+		bool pooled;
+
+		seg = udp_rxbuf(us, us->rx_presz + len, &pooled);
+		if (!seg)
+			break;
+
+		seg->pos = us->rx_presz;
+		(void)mbuf_write_mem(seg, mbuf_buf(mb), len);
+		seg->pos = us->rx_presz;
+
+		if (!pooled)
+			(void)mbuf_resize(seg, seg->end);
+
+		mb->pos += len;
+
+		udp_recv_packet(us, src, seg);
+
+		mem_deref(seg);
+
+	} while (mbuf_get_left(mb) && mem_nrefs(us) > 1 && us->fhs);
+}
+
+
+static int udp_read_gro(struct udp_sock *us, int flags)
+{
+	uint8_t ctrl[UDP_GRO_CMSG_SIZE];
+	struct mbuf *mb = us->rxv[0];
+	struct msghdr msg;
+	struct iovec iov;
+	struct sa src;
+	ssize_t n;
+	int err = 0;
+
+	/* the receive buffer is kept, the datagrams are copied out */
+	us->rxv[0] = NULL;
+
+	if (!mb || mb->size < us->rxsz) {
+		mem_deref(mb);
+		mb = udp_rxbuf(us, us->rxsz, NULL);
+		if (!mb)
+			return ENOMEM;
+	}
+
+	iov.iov_base = mb->buf + us->rx_presz;
+	iov.iov_len  = mb->size - us->rx_presz;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_name       = &src.u.sa;
+	msg.msg_namelen    = sizeof(src.u);
+	msg.msg_iov        = &iov;
+	msg.msg_iovlen     = 1;
+	msg.msg_control    = ctrl;
+	msg.msg_controllen = sizeof(ctrl);
+
+	n = recvmsg(us->fd, &msg, flags);
+	if (n < 0) {
+		err = udp_read_error(us);
+		goto out;
+	}
+
+	src.len = msg.msg_namelen;
+
+	mb->pos = us->rx_presz;
+	mb->end = n + us->rx_presz;
+
+	udp_recv_gro(us, &src, mb, udp_gro_size(&msg));
+
+ out:
+	if (mem_nrefs(mb) == 1 && !us->rxv[0])
+		us->rxv[0] = mb;
+	else
+		mem_deref(mb);
+
+	return err;
+}
+#endif
+
+
+#ifdef HAVE_MMSG
+/*
+ * Receive up to rxbatch datagrams with one recvmmsg() call. The receive
+ * buffers are kept in the socket and reused, unless a handler keeps a
+ * reference. The caller must hold a reference to the socket.
+ */
+static int udp_read_batch(struct udp_sock *us, int flags)
+{
+	struct mmsghdr msgv[UDP_BATCH_MAX];
+	struct mbuf *mbv[UDP_BATCH_MAX];
+	struct iovec iov[UDP_BATCH_MAX];
+	struct sa srcv[UDP_BATCH_MAX];
+#ifdef UDP_OFFLOAD
+	uint8_t ctrl[UDP_BATCH_MAX][UDP_GRO_CMSG_SIZE];
+#endif
+	unsigned n = min(us->rxbatch, (unsigned)UDP_BATCH_MAX);
+	int r;
+
+	for (unsigned i = 0; i < n; i++) {
+		struct mbuf *mb = us->rxv[i];
+
+		if (!mb) {
+			mb = udp_rxbuf(us, us->rxsz, NULL);
+			if (!mb) {
+				n = i;
+				break;
+			}
+
+			us->rxv[i] = mb;
+		}
+
+		iov[i].iov_base = mb->buf + us->rx_presz;
+		iov[i].iov_len  = mb->size - us->rx_presz;
+
+		memset(&msgv[i], 0, sizeof(msgv[i]));
+		msgv[i].msg_hdr.msg_name    = &srcv[i].u.sa;
+		msgv[i].msg_hdr.msg_namelen = sizeof(srcv[i].u);
+		msgv[i].msg_hdr.msg_iov     = &iov[i];
+		msgv[i].msg_hdr.msg_iovlen  = 1;
+#ifdef UDP_OFFLOAD
+		if (us->gro) {
+			msgv[i].msg_hdr.msg_control    = ctrl[i];
+			msgv[i].msg_hdr.msg_controllen = sizeof(ctrl[i]);
+		}
+#endif
+	}
+
+	if (!n)
+		return ENOMEM;
+
+	r = recvmmsg(us->fd, msgv, n, flags, NULL);
+	if (r < 0)
+		return udp_read_error(us);
+
+	/* the handlers may change the batch size, i.e. rxv */
+	for (int i = 0; i < r; i++) {
+		mbv[i] = us->rxv[i];
+		us->rxv[i] = NULL;
+	}
+
+	for (int i = 0; i < r; i++) {
+		struct mbuf *mb = mbv[i];
+
+		/* the receive handler may have closed the socket */
+		if (mem_nrefs(us) <= 1 || !us->fhs)
+			break;
+
+		srcv[i].len = msgv[i].msg_hdr.msg_namelen;
+
+		mb->pos = us->rx_presz;
+		mb->end = msgv[i].msg_len + us->rx_presz;
+
+#ifdef UDP_OFFLOAD
+		if (us->gro) {
+			udp_recv_gro(us, &srcv[i], mb,
+				     udp_gro_size(&msgv[i].msg_hdr));
+		}
+		else
+#endif
+			udp_recv_packet(us, &srcv[i], mb);
+
+		/* keep the buffer for the next batch, unless still in use */
+		if (mem_nrefs(mb) == 1 && mb->size >= us->rxsz &&
+		    (unsigned)i < us->rxbatch && !us->rxv[i]) {
+			us->rxv[i] = mb;
+			mbv[i] = NULL;
+		}
+	}
+
+	for (int i = 0; i < r; i++)
+		mem_deref(mbv[i]);
+
+	/* most likely drained */
+	return (unsigned)r < n ? EAGAIN : 0;
+}
+#endif
+
+
+static inline int udp_read_next(struct udp_sock *us, int flags)
+{
+#ifdef HAVE_MMSG
+	if (us->rxbatch > 1)
+		return udp_read_batch(us, flags ? flags : MSG_WAITFORONE);
+#endif
+#ifdef UDP_OFFLOAD
+	if (us->gro)
+		return udp_read_gro(us, flags);
+#endif
+
+	return udp_read(us, us->fd, flags);
 }
 
 
 static void udp_read_handler(int flags, void *arg)
 {
 	struct udp_sock *us = arg;
+	unsigned budget = fd_budget(us->fhs);
 
 	(void)flags;
 
-	udp_read(us, us->fd);
+	/* the receive handler may destroy the socket */
+	mem_ref(us);
+
+	if (udp_read_next(us, 0) == EAGAIN)
+		goto out;
+
+	/* edge-triggered, drain the socket within the budget. An exhausted
+	   budget marks the socket pending, this is a no-op when level-
+	   triggered */
+	while (mem_nrefs(us) > 1 && us->fhs) {
+
+		if (--budget == 0) {
+			fd_pending(us->fhs);
+			break;
+		}
+
+		if (udp_read_next(us, UDP_DONTWAIT) == EAGAIN)
+			break;
+	}
+
+ out:
+	mem_deref(us);
 }
 
 
@@ -252,18 +567,8 @@ static int udp_alloc(struct udp_sock **usp)
 }
 
 
-/**
- * Create and listen on a UDP Socket
- *
- * @param usp   Pointer to returned UDP Socket
- * @param local Local network address
- * @param rh    Receive handler
- * @param arg   Handler argument
- *
- * @return 0 if success, otherwise errorcode
- */
-int udp_listen(struct udp_sock **usp, const struct sa *local,
-	       udp_recv_h *rh, void *arg)
+static int udp_listen_sock(struct udp_sock **usp, const struct sa *local,
+			   bool reuseport, udp_recv_h *rh, void *arg)
 {
 	struct addrinfo hints, *res = NULL, *r;
 	struct udp_sock *us;
@@ -333,6 +638,16 @@ int udp_listen(struct udp_sock **usp, const struct sa *local,
 		if (r->ai_family == AF_INET6)
 			(void)net_sockopt_v6only(fd, false);
 
+		if (reuseport) {
+			err = net_sockopt_reuse_set(fd, true);
+			if (err) {
+				DEBUG_WARNING("udp listen: reuse set: %m\n",
+					      err);
+				(void)close(fd);
+				continue;
+			}
+		}
+
 		if (bind(fd, r->ai_addr, SIZ_CAST r->ai_addrlen) < 0) {
 			err = RE_ERRNO_SOCK;
 			DEBUG_INFO("listen: bind(): %m (%J)\n", err, local);
@@ -372,6 +687,42 @@ int udp_listen(struct udp_sock **usp, const struct sa *local,
 }
 
 
+/**
+ * Create and listen on a UDP Socket
+ *
+ * @param usp   Pointer to returned UDP Socket
+ * @param local Local network address
+ * @param rh    Receive handler
+ * @param arg   Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int udp_listen(struct udp_sock **usp, const struct sa *local,
+	       udp_recv_h *rh, void *arg)
+{
+	return udp_listen_sock(usp, local, false, rh, arg);
+}
+
+
+/**
+ * Create and listen on a UDP Socket that shares its port with other
+ * sockets (SO_REUSEPORT). The kernel distributes incoming flows between
+ * all sockets bound to the same address, e.g. one per shard thread.
+ *
+ * @param usp   Pointer to returned UDP Socket
+ * @param local Local network address
+ * @param rh    Receive handler
+ * @param arg   Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int udp_listen_reuseport(struct udp_sock **usp, const struct sa *local,
+			 udp_recv_h *rh, void *arg)
+{
+	return udp_listen_sock(usp, local, true, rh, arg);
+}
+
+
 int udp_alloc_sockless(struct udp_sock **usp,
 		       udp_send_h *sendh, udp_recv_h *recvh, void *arg)
 {
@@ -549,6 +900,316 @@ int udp_send(struct udp_sock *us, const struct sa *dst, struct mbuf *mb)
 }
 
 
+static int udp_sendv_flat(struct udp_sock *us, const struct sa *dst,
+			  const struct mbuf_chain *mc, struct le *le)
+{
+	struct mbuf *mb;
+	int err;
+
+	mb = mbuf_alloc(mbuf_chain_len(mc));
+	if (!mb)
+		return ENOMEM;
+
+	err = mbuf_chain_flatten(mc, mb);
+	if (err)
+		goto out;
+
+	mb->pos = 0;
+
+	err = udp_send_internal(us, dst, mb, le);
+
+ out:
+	mem_deref(mb);
+
+	return err;
+}
+
+
+/**
+ * Send a UDP Datagram to a peer, gathered from an mbuf chain with one
+ * vectored write. If UDP helpers or an external send handler are
+ * registered, the chain is copied into one buffer and sent via udp_send.
+ *
+ * @param us  UDP Socket
+ * @param dst Destination network address
+ * @param mc  Mbuf chain to send
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int udp_sendv(struct udp_sock *us, const struct sa *dst,
+	      const struct mbuf_chain *mc)
+{
+#ifndef WIN32
+	struct iovec iov[MBUF_CHAIN_MAX];
+	struct msghdr msg;
+#endif
+	struct le *le;
+
+	if (!us || !dst || !mc)
+		return EINVAL;
+
+	mtx_lock(us->lock);
+	le = us->helpers.tail;
+	mtx_unlock(us->lock);
+
+#ifndef WIN32
+	if (le || us->sendh)
+		return udp_sendv_flat(us, dst, mc, le);
+
+	for (unsigned i = 0; i < mc->segc; i++) {
+		const struct mbuf_seg *seg = &mc->segv[i];
+
+		iov[i].iov_base = seg->mb->buf + seg->pos;
+		iov[i].iov_len  = seg->end - seg->pos;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov    = iov;
+	msg.msg_iovlen = mc->segc;
+
+	/* Connected socket? */
+	if (!us->conn) {
+		msg.msg_name    = (void *)&dst->u.sa;
+		msg.msg_namelen = dst->len;
+	}
+
+	if (sendmsg(us->fd, &msg, 0) < 0)
+		return RE_ERRNO_SOCK;
+
+	return 0;
+#else
+	return udp_sendv_flat(us, dst, mc, le);
+#endif
+}
+
+
+/**
+ * Send a batch of UDP Datagrams, with one sendmmsg() call per up to 32
+ * datagrams. If UDP helpers or an external send handler are registered,
+ * or sendmmsg() is not supported, the datagrams are sent one by one via
+ * the helpers.
+ *
+ * @param us   UDP Socket
+ * @param dstv Array of destination network addresses, one per datagram
+ * @param mbv  Array of buffers to send
+ * @param n    Number of datagrams
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int udp_send_batch(struct udp_sock *us, const struct sa *dstv,
+		   struct mbuf * const *mbv, size_t n)
+{
+	struct le *le;
+	int err = 0;
+
+	if (!us || !dstv || !mbv)
+		return EINVAL;
+
+	mtx_lock(us->lock);
+	le = us->helpers.tail;
+	mtx_unlock(us->lock);
+
+#ifdef HAVE_MMSG
+	if (!le && !us->sendh) {
+		struct mmsghdr msgv[UDP_BATCH_MAX];
+		struct iovec iov[UDP_BATCH_MAX];
+		size_t i = 0;
+
+		while (i < n) {
+			unsigned cnt = (unsigned)min(n - i,
+						     (size_t)UDP_BATCH_MAX);
+			int r;
+
+			for (unsigned j = 0; j < cnt; j++) {
+				const struct sa *dst = &dstv[i + j];
+				struct mbuf *mb = mbv[i + j];
+
+				iov[j].iov_base = mbuf_buf(mb);
+				iov[j].iov_len  = mbuf_get_left(mb);
+
+				memset(&msgv[j], 0, sizeof(msgv[j]));
+				msgv[j].msg_hdr.msg_iov    = &iov[j];
+				msgv[j].msg_hdr.msg_iovlen = 1;
+
+				/* Connected socket? */
+				if (!us->conn) {
+					msgv[j].msg_hdr.msg_name =
+						(void *)&dst->u.sa;
+					msgv[j].msg_hdr.msg_namelen =
+						dst->len;
+				}
+			}
+
+			r = sendmmsg(us->fd, msgv, cnt, 0);
+			if (r < 0)
+				return RE_ERRNO_SOCK;
+
+			i += r;
+		}
+
+		return 0;
+	}
+#endif
+
+	for (size_t i = 0; i < n && !err; i++)
+		err = udp_send_internal(us, &dstv[i], mbv[i], le);
+
+	return err;
+}
+
+
+#ifdef UDP_OFFLOAD
+static bool udp_gso_probe(struct udp_sock *us)
+{
+	int v = 0;
+
+	if (us->gso == UDP_GSO_UNKNOWN) {
+		us->gso = setsockopt(us->fd, IPPROTO_UDP, UDP_SEGMENT,
+				     &v, sizeof(v)) ? UDP_GSO_OFF : UDP_GSO_ON;
+	}
+
+	return us->gso == UDP_GSO_ON;
+}
+
+
+static int udp_send_segments(struct udp_sock *us, const struct sa *dst,
+			     const uint8_t *buf, size_t len, size_t segsz)
+{
+	uint8_t ctrl[CMSG_SPACE(sizeof(uint16_t))];
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	uint16_t v = (uint16_t)segsz;
+
+	iov.iov_base = (void *)buf;
+	iov.iov_len  = len;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov    = &iov;
+	msg.msg_iovlen = 1;
+
+	/* Connected socket? */
+	if (!us->conn) {
+		msg.msg_name    = (void *)&dst->u.sa;
+		msg.msg_namelen = dst->len;
+	}
+
+	if (len > segsz) {
+		memset(ctrl, 0, sizeof(ctrl));
+		msg.msg_control    = ctrl;
+		msg.msg_controllen = sizeof(ctrl);
+
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = IPPROTO_UDP;
+		cmsg->cmsg_type  = UDP_SEGMENT;
+		cmsg->cmsg_len   = CMSG_LEN(sizeof(v));
+		memcpy(CMSG_DATA(cmsg), &v, sizeof(v));
+	}
+
+	if (sendmsg(us->fd, &msg, 0) < 0)
+		return RE_ERRNO_SOCK;
+
+	return 0;
+}
+#endif
+
+
+/**
+ * Send a buffer of same-size datagrams to one peer. The buffer is split
+ * into datagrams of segsz bytes, the last one may be shorter. On Linux
+ * the datagrams are sent with UDP segmentation offload (UDP_SEGMENT),
+ * otherwise, or if UDP helpers are registered, the datagrams are sent
+ * one by one and each keeps the headroom of the buffer.
+ *
+ * On return the buffer position is at the first byte that was not sent,
+ * i.e. at the end if all datagrams were sent.
+ *
+ * @param us    UDP Socket
+ * @param dst   Destination network address
+ * @param mb    Buffer with the datagrams
+ * @param segsz Size of each datagram
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int udp_send_gso(struct udp_sock *us, const struct sa *dst, struct mbuf *mb,
+		 size_t segsz)
+{
+	struct mbuf *seg = NULL;
+	size_t headroom;
+	struct le *le;
+	int err = 0;
+
+	if (!us || !dst || !mb || !segsz || segsz > UDP_GSO_MAXSZ)
+		return EINVAL;
+
+	headroom = mb->pos;
+
+	mtx_lock(us->lock);
+	le = us->helpers.tail;
+	mtx_unlock(us->lock);
+
+#ifdef UDP_OFFLOAD
+	if (!le && !us->sendh && udp_gso_probe(us)) {
+
+		const size_t maxlen = segsz * min((size_t)UDP_GSO_SEGS,
+						  UDP_GSO_MAXSZ / segsz);
+		const uint8_t *p = mbuf_buf(mb);
+		size_t left = mbuf_get_left(mb);
+
+		while (left) {
+			size_t len = min(left, maxlen);
+
+			err = udp_send_segments(us, dst, p, len, segsz);
+			if (err == EIO) {
+				/* no checksum offload on the device */
+				us->gso = UDP_GSO_OFF;
+				err = 0;
+				break;
+			}
+			else if (err) {
+				mb->pos = p - mb->buf;
+				return err;
+			}
+
+			p    += len;
+			left -= len;
+		}
+
+		mb->pos = p - mb->buf;
+
+		if (!left)
+			return 0;
+	}
+#endif
+
+	while (mbuf_get_left(mb) && !err) {
+		size_t len = min(segsz, mbuf_get_left(mb));
+
+		/* a helper may keep the buffer */
+		if (!seg || mem_nrefs(seg) > 1) {
+			mem_deref(seg);
+			seg = mbuf_alloc(headroom + segsz);
+			if (!seg)
+				return ENOMEM;
+		}
+
+		seg->pos = seg->end = headroom;
+		err = mbuf_write_mem(seg, mbuf_buf(mb), len);
+		seg->pos = headroom;
+
+		if (!err)
+			err = udp_send_internal(us, dst, seg, le);
+
+		if (!err)
+			mb->pos += len;
+	}
+
+	mem_deref(seg);
+
+	return err;
+}
+
+
 /**
  * Get the local network address on the UDP Socket
  *
@@ -709,6 +1370,97 @@ void udp_rxbuf_presz_set(struct udp_sock *us, size_t rx_presz)
 }
 
 
+/**
+ * Set the number of datagrams received per system call. With a batch
+ * size above 1, up to n datagrams are received with one recvmmsg() call
+ * into buffers that are kept in the socket. The helpers and the receive
+ * handler are still called once per datagram. Only supported on
+ * platforms with recvmmsg().
+ *
+ * @param us UDP Socket
+ * @param n  Number of datagrams per receive call, 1 to disable batching
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int udp_rxbatch_set(struct udp_sock *us, unsigned n)
+{
+	if (!us || !n || n > UDP_BATCH_MAX)
+		return EINVAL;
+
+#ifdef HAVE_MMSG
+	us->rxbatch = n;
+
+	for (unsigned i = n; i < UDP_BATCH_MAX; i++)
+		us->rxv[i] = mem_deref(us->rxv[i]);
+
+	return 0;
+#else
+	return n == 1 ? 0 : ENOSYS;
+#endif
+}
+
+
+/**
+ * Enable or disable receiving of coalesced datagrams (UDP_GRO). The
+ * kernel may then merge datagrams of the same flow, which are split
+ * again before the helpers and the receive handler are called. The
+ * receive size is raised to 64K, so coalesced datagrams fit.
+ *
+ * @param us     UDP Socket
+ * @param enable True to enable, false to disable
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int udp_gro_set(struct udp_sock *us, bool enable)
+{
+#ifdef UDP_OFFLOAD
+	int v = enable;
+	int err;
+
+	if (!us)
+		return EINVAL;
+
+	err = udp_setsockopt(us, IPPROTO_UDP, UDP_GRO, &v, sizeof(v));
+	if (err)
+		return err;
+
+	us->gro = enable;
+
+	if (enable && us->rxsz < UDP_GRO_RXSZ)
+		us->rxsz = UDP_GRO_RXSZ;
+
+	return 0;
+#else
+	if (!us)
+		return EINVAL;
+
+	return enable ? ENOSYS : 0;
+#endif
+}
+
+
+/**
+ * Set the receive buffer pool of a UDP Socket. Receive buffers are taken
+ * from the pool if its buffer size fits the receive size, and go back to
+ * the pool when the last reference is dropped.
+ *
+ * @param us UDP Socket
+ * @param mp Mbuf pool, or NULL to allocate receive buffers from the heap
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int udp_rxpool_set(struct udp_sock *us, struct mbuf_pool *mp)
+{
+	if (!us)
+		return EINVAL;
+
+	mem_deref(us->rxpool);
+	us->rxpool = mem_ref(mp);
+
+	return 0;
+}
+
+
 /**
  * Set receive handler on a UDP Socket
  *
@@ -774,8 +1526,8 @@ int udp_thread_attach(struct udp_sock *us)
 		return EINVAL;
 
 	if (RE_BAD_SOCK != us->fd) {
-		err = fd_listen(&us->fhs, us->fd, FD_READ, udp_read_handler,
-				us);
+		err = fd_listen(&us->fhs, us->fd, FD_READ | FD_EDGE,
+				udp_read_handler, us);
 		if (err)
 			goto out;
 	}
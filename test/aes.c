@@ -96,6 +96,88 @@ static int test_aes_ctr_loop(void)
 }
 
 
+/* aes_ctr_batch() must match aes_set_iv() + aes_encr() per segment */
+static int test_aes_ctr_batch(void)
+{
+	static const size_t lenv[] = {
+		0, 1, 15, 16, 17, 160, 0, 1023, 1200, 2000, 33
+	};
+	enum { N = RE_ARRAY_SIZE(lenv) };
+	struct aes_seg segv[N];
+	uint8_t key[32];
+	uint8_t ivv[N][AES_BLOCK_SIZE];
+	uint8_t *clear = NULL, *ref = NULL, *out = NULL;
+	struct aes *aes = NULL;
+	size_t total = 0, off;
+	int err = 0;
+
+	for (size_t i = 0; i < N; i++)
+		total += lenv[i];
+
+	clear = mem_alloc(total, NULL);
+	ref   = mem_alloc(total, NULL);
+	out   = mem_alloc(total, NULL);
+	if (!clear || !ref || !out) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	rand_bytes(key, sizeof(key));
+	rand_bytes(clear, total);
+
+	for (size_t bits = 128; bits <= 256; bits += 128) {
+
+		err = aes_alloc(&aes, AES_MODE_CTR, key, bits, NULL);
+		TEST_ERR(err);
+
+		off = 0;
+		for (size_t i = 0; i < N; i++) {
+
+			rand_bytes(ivv[i], sizeof(ivv[i]));
+
+			/* counter carries into the upper 64 bits */
+			if (i == 8)
+				memset(&ivv[i][7], 0xff, 9);
+
+			aes_set_iv(aes, ivv[i]);
+			err = aes_encr(aes, &ref[off], &clear[off], lenv[i]);
+			TEST_ERR(err);
+
+			segv[i].iv  = ivv[i];
+			segv[i].in  = &clear[off];
+			segv[i].out = &out[off];
+			segv[i].len = lenv[i];
+
+			off += lenv[i];
+		}
+
+		err = aes_ctr_batch(aes, segv, N);
+		TEST_ERR(err);
+		TEST_MEMCMP(ref, total, out, total);
+
+		/* in place, which is how SRTP uses it */
+		for (size_t i = 0; i < N; i++)
+			segv[i].in = segv[i].out;
+
+		err = aes_ctr_batch(aes, segv, N);
+		TEST_ERR(err);
+		TEST_MEMCMP(clear, total, out, total);
+
+		aes = mem_deref(aes);
+	}
+
+	TEST_EQUALS(EINVAL, aes_ctr_batch(NULL, segv, N));
+
+ out:
+	mem_deref(aes);
+	mem_deref(clear);
+	mem_deref(ref);
+	mem_deref(out);
+
+	return err;
+}
+
+
 static bool have_aes(enum aes_mode mode)
 {
 	static const uint8_t nullkey[AES_BLOCK_SIZE];
@@ -122,6 +204,9 @@ int test_aes(void)
 	err = test_aes_ctr_loop();
 	TEST_ERR(err);
 
+	err = test_aes_ctr_batch();
+	TEST_ERR(err);
+
 out:
 	return err;
 }
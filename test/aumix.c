@@ -0,0 +1,524 @@
+/**
+ * @file test/aumix.c  Audio mixer testcode
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include <rem.h>
+#include "test.h"
+
+
+#define DEBUG_MODULE "test_aumix"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+enum {
+	SRATE = 8000,
+	PTIME = 20,
+	FRAME_SIZE = SRATE * PTIME / 1000,
+};
+
+
+static int test_aumix_kernels(void)
+{
+	static const int16_t edgev[] = {
+		32767, -32768, 32767, -32768, 1, -1, 0, 16384,
+		-16384, 32767, 32767, -32768, -32768, 2, -2, 100,
+		-100, 20000, -20000, 30000, -30000, 12345, -12345,
+	};
+	int32_t accv[64 + 3];
+	int16_t sampv[64 + 3];
+	int16_t dstv[64 + 3];
+	int32_t ref[64 + 3];
+	int err = 0;
+
+	/* every length covers a different vector/tail split */
+	for (size_t n = 0; n <= 64; n++) {
+
+		for (size_t i = 0; i < n; i++) {
+			sampv[i] = edgev[(i * 7 + n) % RE_ARRAY_SIZE(edgev)];
+			accv[i] = ref[i] = (int32_t)(rand_u32() % 200000)
+				- 100000;
+		}
+
+		aumix_acc(accv, sampv, n);
+
+		for (size_t i = 0; i < n; i++)
+			TEST_EQUALS(ref[i] + sampv[i], accv[i]);
+
+		/* unaligned */
+		memset(dstv, 0, sizeof(dstv));
+		aumix_sub_sat(dstv + 1, accv, sampv, n);
+
+		for (size_t i = 0; i < n; i++)
+			TEST_EQUALS(saturate_s16(ref[i]), dstv[i + 1]);
+
+		TEST_EQUALS(0, dstv[n + 1]);
+
+		aumix_sub_sat(dstv, accv, NULL, n);
+
+		for (size_t i = 0; i < n; i++)
+			TEST_EQUALS(saturate_s16(accv[i]), dstv[i]);
+	}
+
+ out:
+	return err;
+}
+
+
+struct mix_src {
+	struct aumix_source *src;
+	int16_t level;
+	int16_t sampv[FRAME_SIZE];
+	RE_ATOMIC bool *rec;
+	RE_ATOMIC uint32_t n;
+};
+
+
+static void mix_read_handler(struct auframe *af, void *arg)
+{
+	struct mix_src *ms = arg;
+	int16_t *sampv = af->sampv;
+
+	for (size_t i = 0; i < af->sampc; i++)
+		sampv[i] = ms->level;
+}
+
+
+static void mix_frame_handler(const int16_t *sampv, size_t sampc, void *arg)
+{
+	struct mix_src *ms = arg;
+
+	if (!re_atomic_acq(ms->rec))
+		return;
+
+	memcpy(ms->sampv, sampv, min(sampc, RE_ARRAY_SIZE(ms->sampv)) * 2);
+	re_atomic_seq_add(&ms->n, 1);
+}
+
+
+static int test_aumix_minus(void)
+{
+	static const struct {
+		int16_t levelv[3];
+		bool mutev[3];
+		int16_t outv[3];
+	} testv[] = {
+		{{1000, 2000,  -500}, {0, 0, 0}, { 1500,   500,   3000}},
+		{{1000, 2000,  -500}, {0, 0, 1}, { 2000,  1000,   3000}},
+		{{30000, 30000, -30000}, {0, 0, 0}, {0, 0, 32767}},
+		{{-30000, -30000, 100}, {0, 0, 0}, {-29900, -29900, -32768}},
+	};
+	struct mix_src srcv[3];
+	struct aumix *mix = NULL;
+	RE_ATOMIC bool rec;
+	int err = 0;
+
+	memset(srcv, 0, sizeof(srcv));
+
+	for (size_t t = 0; t < RE_ARRAY_SIZE(testv); t++) {
+
+		err = aumix_alloc(&mix, SRATE, 1, PTIME);
+		TEST_ERR(err);
+
+		for (size_t i = 0; i < RE_ARRAY_SIZE(srcv); i++) {
+
+			struct mix_src *ms = &srcv[i];
+
+			ms->level = testv[t].levelv[i];
+			ms->rec   = &rec;
+			re_atomic_rlx_set(&ms->n, 0);
+
+			err = aumix_source_alloc(&ms->src, mix,
+						 mix_frame_handler, ms);
+			TEST_ERR(err);
+
+			aumix_source_readh(ms->src, mix_read_handler);
+			aumix_source_mute(ms->src, testv[t].mutev[i]);
+		}
+
+		re_atomic_rls_set(&rec, true);
+
+		for (size_t i = 0; i < RE_ARRAY_SIZE(srcv); i++)
+			aumix_source_enable(srcv[i].src, true);
+
+		/* the first tick may run before all sources are enabled */
+		for (int i = 0; i < 500; i++) {
+
+			if (re_atomic_acq(&srcv[0].n) >= 2 &&
+			    re_atomic_acq(&srcv[1].n) >= 2 &&
+			    re_atomic_acq(&srcv[2].n) >= 2)
+				break;
+
+			sys_msleep(2);
+		}
+
+		/* stop recording before the sources are removed */
+		re_atomic_rls_set(&rec, false);
+
+		for (size_t i = 0; i < RE_ARRAY_SIZE(srcv); i++)
+			srcv[i].src = mem_deref(srcv[i].src);
+		mix = mem_deref(mix);
+
+		for (size_t i = 0; i < RE_ARRAY_SIZE(srcv); i++) {
+
+			struct mix_src *ms = &srcv[i];
+
+			TEST_ASSERT(re_atomic_acq(&ms->n) >= 2);
+			TEST_EQUALS(testv[t].outv[i], ms->sampv[0]);
+			TEST_EQUALS(testv[t].outv[i],
+				    ms->sampv[FRAME_SIZE - 1]);
+		}
+	}
+
+ out:
+	for (size_t i = 0; i < RE_ARRAY_SIZE(srcv); i++)
+		mem_deref(srcv[i].src);
+	mem_deref(mix);
+
+	return err;
+}
+
+
+static void silent_read_handler(struct auframe *af, void *arg)
+{
+	(void)arg;
+
+	memset(af->sampv, 0, auframe_size(af));
+}
+
+
+/* the mixer runs on its own clock, one frame per ptime */
+static int test_aumix_clock(void)
+{
+	struct aumix_source *src = NULL;
+	struct aumix *mix = NULL;
+	char *debug = NULL;
+	struct pl ticks;
+	uint64_t t0;
+	uint32_t n, max_n;
+	int err;
+
+	err = aumix_alloc(&mix, SRATE, 1, PTIME);
+	TEST_ERR(err);
+
+	err = aumix_thread_sched(mix, -1, -1);
+	TEST_EQUALS(EINVAL, err);
+
+	err = aumix_thread_sched(mix, 0, -1);
+	if (err == ENOSYS)
+		err = 0;
+	TEST_ERR(err);
+
+	err = aumix_source_alloc(&src, mix, NULL, NULL);
+	TEST_ERR(err);
+
+	aumix_source_readh(src, silent_read_handler);
+
+	t0 = tmr_jiffies();
+	aumix_source_enable(src, true);
+
+	sys_msleep(10 * PTIME);
+
+	err = re_sdprintf(&debug, "%H", aumix_debug, mix);
+	TEST_ERR(err);
+
+	max_n = (uint32_t)(tmr_jiffies() - t0) / PTIME + 1;
+
+	err = re_regex(debug, str_len(debug), "ticks=[0-9]+", &ticks);
+	TEST_ERR(err);
+
+	/* the first frame is mixed at once, then one per ptime */
+	n = pl_u32(&ticks);
+	TEST_ASSERT(n >= 2 && n <= max_n);
+
+	TEST_ASSERT(NULL != strstr(debug, "wakeup late:"));
+	TEST_ASSERT(NULL != strstr(debug, "deadline miss:"));
+
+ out:
+	mem_deref(debug);
+	mem_deref(src);
+	mem_deref(mix);
+
+	return err;
+}
+
+
+struct spk_src {
+	struct aumix_source *src;
+	RE_ATOMIC int level;
+	RE_ATOMIC int out;
+	RE_ATOMIC bool active;
+	RE_ATOMIC uint32_t changes;
+};
+
+struct spk_test {
+	struct spk_src srcv[4];
+};
+
+
+static void spk_read_handler(struct auframe *af, void *arg)
+{
+	struct spk_src *s = arg;
+	int16_t *sampv = af->sampv;
+	int level = re_atomic_acq(&s->level);
+
+	for (size_t i = 0; i < af->sampc; i++)
+		sampv[i] = (int16_t)level;
+}
+
+
+static void spk_frame_handler(const int16_t *sampv, size_t sampc, void *arg)
+{
+	struct spk_src *s = arg;
+
+	if (sampc)
+		re_atomic_rls_set(&s->out, sampv[0]);
+}
+
+
+static void speaker_handler(struct aumix_source *src, bool active,
+			    void *arg)
+{
+	struct spk_test *test = arg;
+
+	for (size_t i = 0; i < RE_ARRAY_SIZE(test->srcv); i++) {
+
+		struct spk_src *s = &test->srcv[i];
+
+		if (s->src != src)
+			continue;
+
+		re_atomic_rls_set(&s->active, active);
+		re_atomic_seq_add(&s->changes, 1);
+	}
+}
+
+
+/* waits until every source hears the expected mix */
+static bool spk_wait(struct spk_test *test, const int *outv)
+{
+	for (int i = 0; i < 500; i++) {
+
+		size_t n = 0;
+
+		for (size_t j = 0; j < RE_ARRAY_SIZE(test->srcv); j++) {
+			if (re_atomic_acq(&test->srcv[j].out) == outv[j])
+				++n;
+		}
+
+		if (n == RE_ARRAY_SIZE(test->srcv))
+			return true;
+
+		sys_msleep(2);
+	}
+
+	return false;
+}
+
+
+static int test_aumix_speakers(void)
+{
+	static const int levelv[] = {8000, 4000, 1000, 100};
+	static const int out1[] = {4000, 8000, 12000, 12000};
+	static const int out2[] = {16000, 24000, 8000, 24000};
+	static const int out3[] = {29000, 32767, 21000, 28000};
+	struct spk_test test;
+	struct aumix *mix = NULL;
+	int err;
+
+	memset(&test, 0, sizeof(test));
+
+	err = aumix_alloc(&mix, SRATE, 1, PTIME);
+	TEST_ERR(err);
+
+	err = aumix_speakers(mix, 2, speaker_handler, &test);
+	TEST_ERR(err);
+
+	for (size_t i = 0; i < RE_ARRAY_SIZE(test.srcv); i++) {
+
+		struct spk_src *s = &test.srcv[i];
+
+		re_atomic_rlx_set(&s->level, levelv[i]);
+		re_atomic_rlx_set(&s->out, -1);
+
+		err = aumix_source_alloc(&s->src, mix, spk_frame_handler, s);
+		TEST_ERR(err);
+
+		aumix_source_readh(s->src, spk_read_handler);
+	}
+
+	/* the two loudest are mixed, the others hear both */
+	for (size_t i = 0; i < RE_ARRAY_SIZE(test.srcv); i++)
+		aumix_source_enable(test.srcv[i].src, true);
+
+	TEST_ASSERT(spk_wait(&test, out1));
+	TEST_EQUALS(true,  re_atomic_acq(&test.srcv[0].active));
+	TEST_EQUALS(true,  re_atomic_acq(&test.srcv[1].active));
+	TEST_EQUALS(false, re_atomic_acq(&test.srcv[2].active));
+	TEST_EQUALS(false, re_atomic_acq(&test.srcv[3].active));
+
+	/* a much louder source takes over from the weakest speaker */
+	re_atomic_rls_set(&test.srcv[2].level, 16000);
+
+	TEST_ASSERT(spk_wait(&test, out2));
+	TEST_EQUALS(true,  re_atomic_acq(&test.srcv[0].active));
+	TEST_EQUALS(false, re_atomic_acq(&test.srcv[1].active));
+	TEST_EQUALS(true,  re_atomic_acq(&test.srcv[2].active));
+	TEST_EQUALS(2, re_atomic_acq(&test.srcv[1].changes));
+
+	/* slightly louder than a speaker is not enough */
+	re_atomic_rls_set(&test.srcv[3].level, 9000);
+	sys_msleep(5 * PTIME);
+
+	TEST_EQUALS(false, re_atomic_acq(&test.srcv[3].active));
+	TEST_EQUALS(0, re_atomic_acq(&test.srcv[3].changes));
+
+	/* back to mixing everyone */
+	err = aumix_speakers(mix, 0, NULL, NULL);
+	TEST_ERR(err);
+
+	TEST_ASSERT(spk_wait(&test, out3));
+
+	for (size_t i = 0; i < RE_ARRAY_SIZE(test.srcv); i++)
+		TEST_EQUALS(false, re_atomic_acq(&test.srcv[i].active));
+
+ out:
+	for (size_t i = 0; i < RE_ARRAY_SIZE(test.srcv); i++)
+		mem_deref(test.srcv[i].src);
+	mem_deref(mix);
+
+	return err;
+}
+
+
+/* the previous O(N^2) mixer, for comparison. Only the first outc
+   outputs are mixed, each one costs the same. */
+static void mix_naive(int16_t *dstv, int16_t **srcv, size_t srcc,
+		      size_t outc, size_t sampc)
+{
+	for (size_t s = 0; s < outc; s++) {
+
+		memset(dstv, 0, sampc * 2);
+
+		for (size_t c = 0; c < srcc; c++) {
+
+			if (c == s)
+				continue;
+
+			for (size_t i = 0; i < sampc; i++) {
+				int32_t sample = dstv[i] + srcv[c][i];
+
+				if (sample >= 32767)
+					sample = 32767;
+				if (sample <= -32767)
+					sample = -32767;
+
+				dstv[i] = (int16_t)sample;
+			}
+		}
+	}
+}
+
+
+static void mix_acc(int16_t *dstv, int32_t *accv, int16_t **srcv,
+		    size_t srcc, size_t sampc)
+{
+	memset(accv, 0, sampc * sizeof(*accv));
+
+	for (size_t s = 0; s < srcc; s++)
+		aumix_acc(accv, srcv[s], sampc);
+
+	for (size_t s = 0; s < srcc; s++)
+		aumix_sub_sat(dstv, accv, srcv[s], sampc);
+}
+
+
+static int aumix_perf(void)
+{
+	static const size_t srccv[] = {10, 100, 500};
+	const size_t sampc = 48000 * 2 * PTIME / 1000;
+	int16_t **srcv = NULL;
+	int16_t *dstv = NULL;
+	int32_t *accv = NULL;
+	size_t srcn = srccv[RE_ARRAY_SIZE(srccv) - 1];
+	int err = 0;
+
+	srcv = mem_zalloc(srcn * sizeof(*srcv), NULL);
+	dstv = mem_alloc(sampc * sizeof(*dstv), NULL);
+	accv = mem_alloc(sampc * sizeof(*accv), NULL);
+	if (!srcv || !dstv || !accv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (size_t s = 0; s < srcn; s++) {
+
+		srcv[s] = mem_alloc(sampc * sizeof(int16_t), NULL);
+		if (!srcv[s]) {
+			err = ENOMEM;
+			goto out;
+		}
+
+		for (size_t i = 0; i < sampc; i++)
+			srcv[s][i] = (int16_t)(rand_u16() % 2001) - 1000;
+	}
+
+	for (size_t j = 0; j < RE_ARRAY_SIZE(srccv); j++) {
+
+		size_t srcc = srccv[j];
+		size_t outc = min(srcc, 10);
+		uint32_t n = (uint32_t)max(1000 / srcc, 1);
+		uint64_t t0, t1, t2;
+
+		t0 = tmr_jiffies_usec();
+		for (uint32_t i = 0; i < n; i++)
+			mix_naive(dstv, srcv, srcc, outc, sampc);
+		t1 = tmr_jiffies_usec();
+		for (uint32_t i = 0; i < n; i++)
+			mix_acc(dstv, accv, srcv, srcc, sampc);
+		t2 = tmr_jiffies_usec();
+
+		re_printf("aumix: %3zu sources, 48kHz stereo %ums:"
+			  " naive %8llu usec, mix-minus %5llu usec\n",
+			  srcc, PTIME, (t1 - t0) * srcc / outc / n,
+			  (t2 - t1) / n);
+	}
+
+ out:
+	for (size_t s = 0; srcv && s < srcn; s++)
+		mem_deref(srcv[s]);
+	mem_deref(srcv);
+	mem_deref(dstv);
+	mem_deref(accv);
+
+	return err;
+}
+
+
+int test_aumix(void)
+{
+	int err;
+
+	err = test_aumix_kernels();
+	TEST_ERR(err);
+
+	err = test_aumix_minus();
+	TEST_ERR(err);
+
+	err = test_aumix_clock();
+	TEST_ERR(err);
+
+	err = test_aumix_speakers();
+	TEST_ERR(err);
+
+	if (test_mode == TEST_PERF) {
+		err = aumix_perf();
+		TEST_ERR(err);
+	}
+
+ out:
+	return err;
+}
@@ -215,6 +215,303 @@ static int test_hash_large(void)
 }
 
 
+static uint32_t obj_key(struct le *le)
+{
+	const struct object *obj = le->data;
+
+	return obj->key;
+}
+
+
+static bool count_apply_handler(struct le *le, void *arg)
+{
+	(void)le;
+
+	++(*(uint32_t *)arg);
+
+	return false;
+}
+
+
+static uint32_t hash_max_chain(const struct hash *ht)
+{
+	uint32_t maxc = 0;
+
+	for (uint32_t i = 0; i < hash_bsize(ht); i++)
+		maxc = max(maxc, list_count(hash_list_idx(ht, i)));
+
+	return maxc;
+}
+
+
+static int test_hash_grow(void)
+{
+	const uint32_t n = 10000;
+	struct object **objv;
+	struct hash *ht = NULL;
+	char *debug = NULL;
+	uint32_t i, c;
+	int err;
+
+	objv = mem_zalloc(n * sizeof(*objv), NULL);
+	if (!objv)
+		return ENOMEM;
+
+	err = hash_alloc(&ht, 4);
+	TEST_ERR(err);
+
+	TEST_EQUALS(EINVAL, hash_grow_set(NULL, obj_key));
+
+	err = hash_grow_set(ht, obj_key);
+	TEST_ERR(err);
+
+	for (i=0; i<n; i++) {
+
+		struct object *obj;
+
+		obj = mem_zalloc(sizeof(*obj), obj_destructor);
+		if (!obj) {
+			err = ENOMEM;
+			goto out;
+		}
+
+		obj->magic1 = MAGIC1;
+		obj->magic2 = MAGIC2;
+		obj->key    = hash_joaat((uint8_t *)&i, sizeof(i));
+		objv[i]     = obj;
+
+		hash_append(ht, obj->key, &obj->he, obj);
+
+		/* all entries must be found, also while rehashing */
+		if (i % 1000 == 999) {
+
+			for (uint32_t j = 0; j <= i; j++) {
+
+				struct object *o;
+
+				o = list_ledata(hash_lookup(ht, objv[j]->key,
+							    cmp_handler,
+							    &objv[j]->key));
+				TEST_ASSERT(o == objv[j]);
+				TEST_ASSERT(list_head(hash_list(ht, o->key)));
+			}
+
+			c = 0;
+			hash_apply(ht, count_apply_handler, &c);
+			TEST_EQUALS(i + 1, c);
+		}
+	}
+
+	TEST_ASSERT(hash_bsize(ht) >= n / 4);
+	TEST_ASSERT(hash_max_chain(ht) < 16);
+
+	err = re_sdprintf(&debug, "%H", hash_debug, ht);
+	TEST_ERR(err);
+	TEST_ASSERT(NULL != strstr(debug, "entries 10000"));
+	TEST_ASSERT(NULL != strstr(debug, "growable"));
+
+	/* remove every other entry */
+	for (i=0; i<n; i+=2)
+		objv[i] = mem_deref(objv[i]);
+
+	/* fixed size again, a pending rehash is completed */
+	err = hash_grow_set(ht, NULL);
+	TEST_ERR(err);
+
+	c = hash_bsize(ht);
+	TEST_EQUALS(0, c & (c - 1));
+
+	for (i=0; i<n; i++) {
+
+		struct object *o;
+		uint32_t key = hash_joaat((uint8_t *)&i, sizeof(i));
+
+		o = list_ledata(hash_lookup(ht, key, cmp_handler, &key));
+		TEST_ASSERT(o == objv[i]);
+	}
+
+	c = 0;
+	hash_apply(ht, count_apply_handler, &c);
+	TEST_EQUALS(n / 2, c);
+
+ out:
+	hash_flush(ht);
+	mem_deref(ht);
+	mem_deref(objv);
+	mem_deref(debug);
+
+	return err;
+}
+
+
+static int hash_chisq(uint32_t (*hashh)(uint32_t i, char *buf), uint32_t n)
+{
+	enum { BUCKETS = 1024 };
+	uint32_t *bucketv;
+	uint32_t minc = UINT32_MAX, maxc = 0;
+	uint64_t e = n / BUCKETS, chi = 0;
+	char buf[64];
+	int err = 0;
+
+	bucketv = mem_zalloc(BUCKETS * sizeof(*bucketv), NULL);
+	if (!bucketv)
+		return ENOMEM;
+
+	for (uint32_t i = 0; i < n; i++)
+		++bucketv[hashh(i, buf) & (BUCKETS - 1)];
+
+	for (uint32_t i = 0; i < BUCKETS; i++) {
+		int64_t d = (int64_t)bucketv[i] - (int64_t)e;
+
+		chi  += (uint64_t)(d * d);
+		minc = min(minc, bucketv[i]);
+		maxc = max(maxc, bucketv[i]);
+	}
+
+	chi /= e;
+
+	/* chi-square with 1023 degrees of freedom, mean 1023 sd 45 */
+	TEST_ASSERT(chi < 1023 + 6 * 45);
+	TEST_ASSERT(minc > e / 2);
+	TEST_ASSERT(maxc < e * 2);
+
+ out:
+	mem_deref(bucketv);
+	return err;
+}
+
+
+static uint32_t key_int(uint32_t i, char *buf)
+{
+	(void)buf;
+
+	return hash_wyhash((uint8_t *)&i, sizeof(i));
+}
+
+
+static uint32_t key_branch(uint32_t i, char *buf)
+{
+	int n = re_snprintf(buf, 64, "z9hG4bK%08x", i);
+
+	return hash_wyhash((uint8_t *)buf, n);
+}
+
+
+static uint32_t key_callid_ci(uint32_t i, char *buf)
+{
+	int n = re_snprintf(buf, 64, "%u@SIP.EXAMPLE.COM", i * 7919);
+
+	return hash_wyhash_ci(buf, n);
+}
+
+
+static void hash_perf(void)
+{
+	static const size_t lenv[] = {4, 16, 32, 64, 256};
+	const uint32_t n = 200000;
+	uint8_t key[256 + 64];
+	volatile uint32_t sink = 0;
+
+	for (size_t i = 0; i < sizeof(key); i++)
+		key[i] = 'a' + i % 29;
+
+	for (size_t j = 0; j < RE_ARRAY_SIZE(lenv); j++) {
+
+		size_t len = lenv[j];
+		uint64_t t0, t1, t2, t3;
+
+		t0 = tmr_jiffies_usec();
+		for (uint32_t i = 0; i < n; i++) {
+			sink += hash_joaat(key + (i & 63), len);
+		}
+		t1 = tmr_jiffies_usec();
+		for (uint32_t i = 0; i < n; i++) {
+			sink += hash_fast((char *)key + (i & 63), len);
+		}
+		t2 = tmr_jiffies_usec();
+		for (uint32_t i = 0; i < n; i++) {
+			sink += hash_wyhash(key + (i & 63), len);
+		}
+		t3 = tmr_jiffies_usec();
+
+		re_printf("hash: %3zu bytes: joaat %5llu nsec, fast %5llu nsec,"
+			  " wyhash %5llu nsec\n", len,
+			  1000 * (t1 - t0) / n, 1000 * (t2 - t1) / n,
+			  1000 * (t3 - t2) / n);
+	}
+
+	(void)sink;
+}
+
+
+static int test_hash_wyhash(void)
+{
+	static const char mixed[] =
+		"Via: SIP/2.0/UDP [::1]:5060;BRANCH=z9hG4bK@`{Z\xc4\xd6\xe5\x80"
+		"INVITE sip:Alice@Atlanta.COM SIP/2.0 Call-ID: A84B4C76E66710"
+		"\xff\xdf\xc0 Max-Forwards: 70 To: <sip:bob@BILOXI.example>";
+	char lower[sizeof(mixed)];
+	uint8_t unaligned[sizeof(mixed) + 1];
+	struct pl pl;
+	int err = 0;
+
+	for (size_t i = 0; i < sizeof(mixed); i++) {
+		char c = mixed[i];
+
+		lower[i] = (c >= 'A' && c <= 'Z') ? c + 32 : c;
+	}
+
+	/* every length exercises a different read pattern */
+	for (size_t len = 0; len < sizeof(mixed); len++) {
+
+		uint32_t h = hash_wyhash((uint8_t *)lower, len);
+
+		TEST_EQUALS(h, hash_wyhash_ci(mixed, len));
+		TEST_EQUALS(h, hash_wyhash_ci(lower, len));
+
+		pl.p = lower;
+		pl.l = len;
+		TEST_EQUALS(h, hash_wyhash_pl(&pl));
+		pl.p = mixed;
+		pl.l = len;
+		TEST_EQUALS(h, hash_wyhash_pl_ci(&pl));
+
+		/* unaligned keys */
+		memcpy(unaligned + 1, lower, len);
+		TEST_EQUALS(h, hash_wyhash(unaligned + 1, len));
+
+		if (len > 0) {
+			TEST_ASSERT(h != hash_wyhash((uint8_t *)lower,
+						     len - 1));
+		}
+	}
+
+	TEST_EQUALS(hash_wyhash((uint8_t *)mixed, sizeof(mixed) - 1),
+		    hash_wyhash_str(mixed));
+	TEST_EQUALS(hash_wyhash((uint8_t *)lower, sizeof(lower) - 1),
+		    hash_wyhash_str_ci(mixed));
+
+	TEST_EQUALS(0, hash_wyhash(NULL, 4));
+	TEST_EQUALS(0, hash_wyhash_str(NULL));
+	TEST_EQUALS(0, hash_wyhash_str_ci(NULL));
+	TEST_EQUALS(0, hash_wyhash_pl(NULL));
+
+	/* distribution over the low bits, as used by hash_list() */
+	err = hash_chisq(key_int, 65536);
+	TEST_ERR(err);
+	err = hash_chisq(key_branch, 65536);
+	TEST_ERR(err);
+	err = hash_chisq(key_callid_ci, 65536);
+	TEST_ERR(err);
+
+	if (test_mode == TEST_PERF)
+		hash_perf();
+
+ out:
+	return err;
+}
+
+
 int test_hash(void)
 {
 	int err;
@@ -231,5 +528,13 @@ int test_hash(void)
 	if (err)
 		return err;
 
+	err = test_hash_grow();
+	if (err)
+		return err;
+
+	err = test_hash_wyhash();
+	if (err)
+		return err;
+
 	return 0;
 }
@@ -126,6 +126,122 @@ int test_http(void)
 }
 
 
+static const char http_arena_msg[] =
+	"HTTP/1.1 200 OK\r\n"
+	"Date: Mon, 27 Jul 2009 12:28:53 GMT\r\n"
+	"Server: Apache/2.2.14 (Win32)\r\n"
+	"Last-Modified: Wed, 22 Jul 2009 19:15:56 GMT\r\n"
+	"ETag: \"34aa387-d-1568eb00\"\r\n"
+	"Accept-Ranges: bytes\r\n"
+	"Cache-Control: no-cache, no-store, must-revalidate\r\n"
+	"Vary: Authorization, Accept\r\n"
+	"Connection: keep-alive\r\n"
+	"Content-Type: text/html; charset=utf-8\r\n"
+	"Content-Length: 0\r\n"
+	"\r\n";
+
+
+static int http_arena_decode(struct mbuf *mb, uint32_t *nhdr)
+{
+	struct http_msg *msg = NULL;
+	int err;
+
+	mb->pos = 0;
+
+	err = http_msg_decode(&msg, mb, false);
+	if (err)
+		return err;
+
+	*nhdr = list_count(&msg->hdrl);
+
+	TEST_EQUALS(200, msg->scode);
+	TEST_STRCMP("text", 4, msg->ctyp.type.p, msg->ctyp.type.l);
+	TEST_EQUALS(3, http_msg_hdr_count(msg, HTTP_HDR_CACHE_CONTROL));
+	TEST_ASSERT(http_msg_hdr_has_value(msg, HTTP_HDR_VARY, "Accept"));
+
+	/* the body buffer can grow out of the arena */
+	err = mbuf_fill(msg->mb, 0xa5, 16384);
+	TEST_ERR(err);
+
+ out:
+	mem_deref(msg);
+	return err;
+}
+
+
+static int http_arena_perf(struct mbuf *mb)
+{
+	const size_t n = 10000;
+	uint64_t t0, t1, t2;
+	int err = 0;
+
+	t0 = tmr_jiffies_usec();
+
+	for (size_t i = 0; i < n && !err; i++) {
+		struct http_msg *msg = NULL;
+
+		mb->pos = 0;
+		err = http_msg_decode(&msg, mb, false);
+		mem_deref(msg);
+	}
+
+	http_msg_arena_set(true);
+
+	t1 = tmr_jiffies_usec();
+
+	for (size_t i = 0; i < n && !err; i++) {
+		struct http_msg *msg = NULL;
+
+		mb->pos = 0;
+		err = http_msg_decode(&msg, mb, false);
+		mem_deref(msg);
+	}
+
+	t2 = tmr_jiffies_usec();
+
+	http_msg_arena_set(false);
+
+	re_printf("http: decode %zu bytes: heap %llu nsec, arena %llu nsec\n",
+		  mb->end, 1000 * (t1 - t0) / n, 1000 * (t2 - t1) / n);
+
+	return err;
+}
+
+
+int test_http_msg_arena(void)
+{
+	struct mbuf *mb;
+	uint32_t nhdr_heap = 0, nhdr_arena = 0;
+	int err;
+
+	mb = mbuf_alloc(1024);
+	if (!mb)
+		return ENOMEM;
+
+	err = mbuf_write_str(mb, http_arena_msg);
+	TEST_ERR(err);
+
+	if (test_mode == TEST_PERF) {
+		err = http_arena_perf(mb);
+		goto out;
+	}
+
+	err = http_arena_decode(mb, &nhdr_heap);
+	TEST_ERR(err);
+
+	http_msg_arena_set(true);
+	err = http_arena_decode(mb, &nhdr_arena);
+	http_msg_arena_set(false);
+	TEST_ERR(err);
+
+	TEST_EQUALS(nhdr_heap, nhdr_arena);
+
+ out:
+	mem_deref(mb);
+	return err;
+}
+
+
 struct test {
 	struct mbuf *mb_body;
 	size_t clen;
@@ -160,6 +160,225 @@ out:
 }
 
 
+static int test_mbuf_chain(void)
+{
+	struct mbuf_chain mc;
+	struct mbuf *hdr = NULL, *pld = NULL, *mb = NULL;
+	int err;
+
+	mbuf_chain_init(&mc);
+
+	hdr = mbuf_alloc(16);
+	pld = mbuf_alloc(16);
+	mb  = mbuf_alloc(4);
+	if (!hdr || !pld || !mb) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err  = mbuf_write_str(hdr, "..hdr:");
+	err |= mbuf_write_str(pld, "payload");
+	TEST_ERR(err);
+
+	hdr->pos = 2;
+	pld->pos = 0;
+
+	err = mbuf_chain_append(&mc, pld);
+	TEST_ERR(err);
+
+	err = mbuf_chain_prepend(&mc, hdr);
+	TEST_ERR(err);
+
+	/* segments are referenced */
+	TEST_EQUALS(2, mem_nrefs(hdr));
+	TEST_EQUALS(2, mc.segc);
+	TEST_EQUALS(11, mbuf_chain_len(&mc));
+
+	/* empty buffers are ignored */
+	hdr->pos = hdr->end;
+	err = mbuf_chain_append(&mc, hdr);
+	TEST_ERR(err);
+	TEST_EQUALS(2, mc.segc);
+
+	err = mbuf_chain_flatten(&mc, mb);
+	TEST_ERR(err);
+
+	TEST_MEMCMP("hdr:payload", 11, mb->buf, mb->end);
+
+	for (unsigned i = mc.segc; i < MBUF_CHAIN_MAX; i++) {
+		pld->pos = 0;
+		err = mbuf_chain_append(&mc, pld);
+		TEST_ERR(err);
+	}
+
+	err = mbuf_chain_prepend(&mc, pld);
+	TEST_EQUALS(ENOSPC, err);
+
+	mbuf_chain_reset(&mc);
+	TEST_EQUALS(0, mbuf_chain_len(&mc));
+	TEST_EQUALS(1, mem_nrefs(pld));
+
+	err = 0;
+
+out:
+	mbuf_chain_reset(&mc);
+	mem_deref(mb);
+	mem_deref(pld);
+	mem_deref(hdr);
+	return err;
+}
+
+
+static int pool_deref_thread(void *arg)
+{
+	mem_deref(arg);
+
+	return 0;
+}
+
+
+/* a borrowed buffer and its pool are released on different threads */
+static int test_mbuf_pool_thread(void)
+{
+	int err = 0;
+
+	for (unsigned i = 0; i < 64; i++) {
+		struct mbuf_pool *mp;
+		struct mbuf *mb;
+		thrd_t tid;
+
+		err = mbuf_pool_alloc(&mp, 1, 64);
+		TEST_ERR(err);
+
+		mb = mbuf_pool_get(mp, NULL);
+		if (!mb) {
+			mem_deref(mp);
+			err = ENOMEM;
+			goto out;
+		}
+
+		err = thread_create_name(&tid, "mbuf_pool", pool_deref_thread,
+					 mb);
+		if (err) {
+			mem_deref(mb);
+			mem_deref(mp);
+			goto out;
+		}
+
+		mem_deref(mp);
+		thrd_join(tid, NULL);
+	}
+
+ out:
+	return err;
+}
+
+
+static int test_mbuf_pool(void)
+{
+	struct mbuf_pool *mp = NULL;
+	struct mbuf *mb[3] = {NULL, NULL, NULL}, *ref = NULL;
+	struct mbuf_pool_stat stat;
+	uint8_t *buf;
+	int err;
+
+	err = mbuf_pool_alloc(&mp, 2, 256);
+	TEST_ERR(err);
+
+	for (unsigned i = 0; i < RE_ARRAY_SIZE(mb); i++) {
+		bool pooled;
+
+		mb[i] = mbuf_pool_get(mp, &pooled);
+		if (!mb[i]) {
+			err = ENOMEM;
+			goto out;
+		}
+
+		/* the pool is exhausted by the last one */
+		TEST_EQUALS(i < 2, pooled);
+		TEST_EQUALS(256, mb[i]->size);
+		TEST_EQUALS(0, mbuf_get_left(mb[i]));
+	}
+
+	err = mbuf_pool_get_stat(mp, &stat);
+	TEST_ERR(err);
+	TEST_EQUALS(2, stat.size);
+	TEST_EQUALS(2, stat.inuse);
+	TEST_EQUALS(3, stat.borrows);
+	TEST_EQUALS(1, stat.misses);
+
+	err = mbuf_write_str(mb[0], "pooled");
+	TEST_ERR(err);
+
+	mem_ref(mb[0]);
+	mem_deref(mb[0]);
+	mb[0] = mem_deref(mb[0]);
+
+	err = mbuf_pool_get_stat(mp, &stat);
+	TEST_ERR(err);
+	TEST_EQUALS(1, stat.inuse);
+	TEST_EQUALS(2, stat.inuse_peak);
+
+	/* the pool outlives its borrowed buffers */
+	mp = mem_deref(mp);
+
+	mb[2] = mem_deref(mb[2]);
+	mb[1] = mem_deref(mb[1]);
+
+	err = mbuf_pool_alloc(&mp, 1, 64);
+	TEST_ERR(err);
+
+	mb[0] = mbuf_pool_get(mp, NULL);
+	if (!mb[0]) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	buf = mb[0]->buf;
+	mb[0] = mem_deref(mb[0]);
+
+	/* recycled with the same buffer */
+	mb[0] = mbuf_pool_get(mp, NULL);
+	if (!mb[0]) {
+		err = ENOMEM;
+		goto out;
+	}
+	TEST_ASSERT(mb[0]->buf == buf);
+
+	/* a shared buffer is not recycled */
+	ref = mbuf_alloc_ref(mb[0]);
+	if (!ref) {
+		err = ENOMEM;
+		goto out;
+	}
+	mb[0] = mem_deref(mb[0]);
+
+	mb[0] = mbuf_pool_get(mp, NULL);
+	if (!mb[0]) {
+		err = ENOMEM;
+		goto out;
+	}
+	TEST_ASSERT(mb[0]->buf != buf);
+	TEST_EQUALS(64, mb[0]->size);
+	mb[0] = mem_deref(mb[0]);
+
+	err = mbuf_pool_get_stat(mp, &stat);
+	TEST_ERR(err);
+	TEST_EQUALS(0, stat.inuse);
+	TEST_EQUALS(1, stat.inuse_peak);
+	TEST_EQUALS(3, stat.borrows);
+	TEST_EQUALS(0, stat.misses);
+
+ out:
+	for (unsigned i = 0; i < RE_ARRAY_SIZE(mb); i++)
+		mem_deref(mb[i]);
+	mem_deref(ref);
+	mem_deref(mp);
+
+	return err;
+}
+
+
 int test_mbuf(void)
 {
 	int err;
@@ -173,6 +392,15 @@ int test_mbuf(void)
 	err = test_mbuf_ptr();
 	TEST_ERR(err);
 
+	err = test_mbuf_chain();
+	TEST_ERR(err);
+
+	err = test_mbuf_pool();
+	TEST_ERR(err);
+
+	err = test_mbuf_pool_thread();
+	TEST_ERR(err);
+
 out:
 	return err;
 }
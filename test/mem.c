@@ -3,6 +3,8 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <stdlib.h>
+#include <string.h>
 #include <re.h>
 #include "test.h"
 
@@ -144,3 +146,289 @@ int test_mem_secure(void)
  out:
 	return err;
 }
+
+
+enum {
+	CACHE_BLOCKS = 256,
+};
+
+
+static int cache_alloc_thread(void *arg)
+{
+	void **blockv = arg;
+
+	for (size_t i = 0; i < CACHE_BLOCKS; i++) {
+		blockv[i] = mem_alloc(16 + i * 16, NULL);
+		if (!blockv[i])
+			return ENOMEM;
+
+		memset(blockv[i], (int)i, 16);
+	}
+
+	return 0;
+}
+
+
+static int cache_perf(void)
+{
+	const size_t n = 100000;
+	const size_t sz = 1500;
+	uint64_t t0, t1, t2;
+	int err = 0;
+
+	t0 = tmr_jiffies_usec();
+
+	for (size_t i = 0; i < n; i++) {
+		struct mbuf *mb = mbuf_alloc(sz);
+		if (!mb)
+			return ENOMEM;
+
+		mb->buf[0] = (uint8_t)i;
+		mem_deref(mb);
+	}
+
+	t1 = tmr_jiffies_usec();
+
+	/* same pattern as mbuf_alloc() with plain malloc() */
+	for (size_t i = 0; i < n; i++) {
+		struct mbuf *mb = malloc(sizeof(*mb));
+		if (!mb)
+			return ENOMEM;
+
+		mb->buf = malloc(sz);
+		if (!mb->buf) {
+			free(mb);
+			return ENOMEM;
+		}
+
+		mb->buf[0] = (uint8_t)i;
+		free(mb->buf);
+		free(mb);
+	}
+
+	t2 = tmr_jiffies_usec();
+
+	re_printf("mem: mbuf alloc/free %zu bytes: mem_alloc %llu nsec,"
+		  " malloc %llu nsec\n", sz,
+		  1000 * (t1 - t0) / n, 1000 * (t2 - t1) / n);
+
+	return err;
+}
+
+
+int test_mem_cache(void)
+{
+	void *blockv[CACHE_BLOCKS] = {NULL};
+	thrd_t tid;
+	uint8_t *p = NULL, *q;
+	bool cache;
+	int ret, err;
+
+	if (test_mode == TEST_PERF)
+		return cache_perf();
+
+	cache = mem_cache_set(65536) == 0;
+
+	/* allocated in another thread, freed here */
+	err = thread_create_name(&tid, "mem_cache", cache_alloc_thread,
+				 blockv);
+	TEST_ERR(err);
+
+	thrd_join(tid, &ret);
+	err = ret;
+	TEST_ERR(err);
+
+	for (size_t i = 0; i < CACHE_BLOCKS; i++) {
+		TEST_EQUALS((uint8_t)i, ((uint8_t *)blockv[i])[15]);
+		blockv[i] = mem_deref(blockv[i]);
+	}
+
+	/* reuse the returned blocks from a new thread */
+	err = thread_create_name(&tid, "mem_cache", cache_alloc_thread,
+				 blockv);
+	TEST_ERR(err);
+
+	thrd_join(tid, &ret);
+	err = ret;
+	TEST_ERR(err);
+
+	/* realloc within the size class is done in place */
+	p = mem_alloc(100, NULL);
+	if (!p) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	memset(p, 0xa5, 100);
+
+	q = mem_realloc(p, 120);
+	TEST_ASSERT(q != NULL);
+	if (cache)
+		TEST_ASSERT(q == p);
+	p = q;
+
+	/* and grows out of it */
+	q = mem_realloc(p, 4000);
+	TEST_ASSERT(q != NULL);
+	p = q;
+	TEST_EQUALS(0xa5, p[99]);
+
+ out:
+	for (size_t i = 0; i < CACHE_BLOCKS; i++)
+		mem_deref(blockv[i]);
+
+	mem_deref(p);
+	mem_cache_flush();
+
+	return err;
+}
+
+
+enum {
+	STAT_BLOCKS = 64,
+	STAT_SIZE   = 128,
+};
+
+
+static int stat_alloc_thread(void *arg)
+{
+	void **blockv = arg;
+
+	for (size_t i = 0; i < STAT_BLOCKS; i++) {
+		blockv[i] = mem_alloc(STAT_SIZE, NULL);
+		if (!blockv[i])
+			return ENOMEM;
+	}
+
+	return 0;
+}
+
+
+int test_mem_stat(void)
+{
+	void *blockv[STAT_BLOCKS] = {NULL};
+	struct memstat before, after;
+	thrd_t tid;
+	int ret, err;
+
+	err = mem_get_stat(&before);
+	TEST_ERR(err);
+
+	TEST_ASSERT(before.bytes_peak >= before.bytes_cur);
+	TEST_ASSERT(before.blocks_peak >= before.blocks_cur);
+
+	/* allocated in another thread, accounted when freed here */
+	err = thread_create_name(&tid, "mem_stat", stat_alloc_thread, blockv);
+	TEST_ERR(err);
+
+	thrd_join(tid, &ret);
+	err = ret;
+	TEST_ERR(err);
+
+	err = mem_get_stat(&after);
+	TEST_ERR(err);
+
+	TEST_ASSERT(after.allocs >= before.allocs + STAT_BLOCKS);
+	TEST_ASSERT(after.bytes_peak >= STAT_BLOCKS * STAT_SIZE);
+	TEST_ASSERT(after.bytes_peak >= after.bytes_cur);
+	TEST_ASSERT(after.blocks_peak >= after.blocks_cur);
+
+	for (size_t i = 0; i < STAT_BLOCKS; i++)
+		blockv[i] = mem_deref(blockv[i]);
+
+	err = mem_get_stat(&before);
+	TEST_ERR(err);
+
+	TEST_ASSERT(before.bytes_peak >= after.bytes_peak);
+	TEST_ASSERT(before.allocs >= after.allocs);
+
+ out:
+	for (size_t i = 0; i < STAT_BLOCKS; i++)
+		mem_deref(blockv[i]);
+
+	return err;
+}
+
+
+static void arena_destructor(void *arg)
+{
+	uint32_t **cntp = arg;
+
+	++(**cntp);
+}
+
+
+int test_mem_arena(void)
+{
+	struct mem_arena *arena = NULL;
+	uint32_t **objv[16] = {NULL};
+	uint32_t **obj = NULL;
+	uint32_t cnt = 0;
+	uint8_t *p = NULL, *q;
+	int err;
+
+	err = mem_arena_alloc(&arena, 1024);
+	TEST_ERR(err);
+
+	mem_arena_enter(arena);
+
+	for (size_t i = 0; i < RE_ARRAY_SIZE(objv); i++) {
+		objv[i] = mem_zalloc(sizeof(*objv[i]), arena_destructor);
+		if (!objv[i]) {
+			err = ENOMEM;
+			break;
+		}
+		*objv[i] = &cnt;
+	}
+
+	/* larger than the chunk */
+	p = mem_alloc(4000, NULL);
+	if (!p)
+		err = ENOMEM;
+
+	mem_arena_leave();
+	TEST_ERR(err);
+
+	/* allocated from the heap */
+	obj = mem_zalloc(sizeof(*obj), arena_destructor);
+	if (!obj) {
+		err = ENOMEM;
+		goto out;
+	}
+	*obj = &cnt;
+
+	/* arena objects keep the arena alive */
+	arena = mem_deref(arena);
+
+	mem_ref(objv[0]);
+	mem_deref(objv[0]);
+	TEST_EQUALS(0, cnt);
+
+	for (size_t i = 0; i < RE_ARRAY_SIZE(objv); i++)
+		objv[i] = mem_deref(objv[i]);
+
+	TEST_EQUALS(RE_ARRAY_SIZE(objv), cnt);
+
+	/* a growing object leaves the arena */
+	memset(p, 0xa5, 4000);
+	q = mem_realloc(p, 8000);
+	if (!q) {
+		err = ENOMEM;
+		goto out;
+	}
+	p = q;
+	TEST_EQUALS(0xa5, p[3999]);
+
+	obj = mem_deref(obj);
+	TEST_EQUALS(RE_ARRAY_SIZE(objv) + 1, cnt);
+
+ out:
+	for (size_t i = 0; i < RE_ARRAY_SIZE(objv); i++)
+		mem_deref(objv[i]);
+
+	mem_deref(obj);
+	mem_deref(p);
+	mem_deref(arena);
+
+	return err;
+}
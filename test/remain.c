@@ -146,3 +146,200 @@ int test_remain(void)
 
 	return err;
 }
+
+
+enum {
+	FLOOD_BURST = 32,
+	FLOOD_SIZE  = 172,
+};
+
+struct flood {
+	enum poll_method method;
+	bool edge;
+	struct udp_sock *us_tx;
+	struct udp_sock *us_rx;
+	struct sa rx;
+	struct mbuf *mb;
+	struct tmr tmr;
+	uint32_t n;
+	uint32_t sent;
+	uint32_t recv;
+	uint64_t usec;
+	int err;
+};
+
+
+static int flood_send(struct flood *fl)
+{
+	for (int i = 0; i < FLOOD_BURST && fl->sent < fl->n; i++) {
+
+		fl->mb->pos = 0;
+
+		int err = udp_send(fl->us_tx, &fl->rx, fl->mb);
+		if (err)
+			return err;
+
+		++fl->sent;
+	}
+
+	return 0;
+}
+
+
+static void flood_recv_handler(const struct sa *src, struct mbuf *mb,
+			       void *arg)
+{
+	struct flood *fl = arg;
+	int err = 0;
+	(void)src;
+
+	TEST_EQUALS(FLOOD_SIZE, mbuf_get_left(mb));
+
+	if (++fl->recv == fl->n) {
+		re_cancel();
+		return;
+	}
+
+	/* next burst when the previous one is drained */
+	if (fl->recv == fl->sent)
+		err = flood_send(fl);
+
+ out:
+	if (err) {
+		fl->err = err;
+		re_cancel();
+	}
+}
+
+
+static void flood_timeout(void *arg)
+{
+	struct flood *fl = arg;
+
+	fl->err = ETIMEDOUT;
+	re_cancel();
+}
+
+
+static int flood_thread(void *arg)
+{
+	struct flood *fl = arg;
+	struct sa laddr;
+	uint64_t start;
+	int err;
+
+	tmr_init(&fl->tmr);
+
+	err = re_thread_init();
+	if (err)
+		goto out;
+
+	/* skip unsupported methods and the io_uring fallback */
+	if (poll_method_set(fl->method) ||
+	    poll_method_get() != fl->method) {
+		err = ESKIPPED;
+		goto out;
+	}
+
+	/* a budget of one re-dispatches every edge-triggered event */
+	if (fl->edge) {
+		err  = re_edge_set(true);
+		err |= re_budget_set(test_mode == TEST_PERF ? 0 : 1);
+		TEST_ERR(err);
+	}
+
+	err = sa_set_str(&laddr, "127.0.0.1", 0);
+	TEST_ERR(err);
+
+	err  = udp_listen(&fl->us_rx, &laddr, flood_recv_handler, fl);
+	err |= udp_listen(&fl->us_tx, &laddr, NULL, NULL);
+	TEST_ERR(err);
+
+	err = udp_local_get(fl->us_rx, &fl->rx);
+	TEST_ERR(err);
+
+	fl->mb = mbuf_alloc(FLOOD_SIZE);
+	if (!fl->mb) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	mbuf_fill(fl->mb, 0xa5, FLOOD_SIZE);
+
+	tmr_start(&fl->tmr, 10000, flood_timeout, fl);
+
+	start = tmr_jiffies_usec();
+
+	err = flood_send(fl);
+	TEST_ERR(err);
+
+	err = re_main(NULL);
+	TEST_ERR(err);
+
+	fl->usec = tmr_jiffies_usec() - start;
+
+	if (test_mode == TEST_PERF && fl->edge)
+		re_printf("%H", re_debug, NULL);
+
+ out:
+	if (err)
+		fl->err = err;
+
+	tmr_cancel(&fl->tmr);
+	fl->us_tx = mem_deref(fl->us_tx);
+	fl->us_rx = mem_deref(fl->us_rx);
+	fl->mb	  = mem_deref(fl->mb);
+
+	re_thread_close();
+
+	return err;
+}
+
+
+/*
+ * Loopback UDP packet flood, in perf mode the packet rate of each polling
+ * method is printed
+ */
+int test_remain_udp_flood(void)
+{
+	static const struct {
+		enum poll_method method;
+		bool edge;
+	} methodv[] = {
+		{METHOD_SELECT,   false},
+		{METHOD_EPOLL,    false},
+		{METHOD_EPOLL,    true},
+		{METHOD_KQUEUE,   false},
+		{METHOD_IO_URING, false},
+	};
+	const uint32_t n = test_mode == TEST_PERF ? 50000 : 1000;
+	int err = 0;
+
+	for (size_t i = 0; i < RE_ARRAY_SIZE(methodv); i++) {
+		struct flood fl = {.method = methodv[i].method,
+				   .edge   = methodv[i].edge, .n = n};
+		thrd_t tid;
+
+		err = thread_create_name(&tid, "flood", flood_thread, &fl);
+		TEST_ERR(err);
+
+		thrd_join(tid, NULL);
+
+		if (fl.err == ESKIPPED)
+			continue;
+
+		err = fl.err;
+		TEST_ERR(err);
+		TEST_EQUALS(n, fl.recv);
+
+		if (test_mode == TEST_PERF) {
+			re_printf("remain: %-8s%s %u packets: %8llu pps\n",
+				  poll_method_name(methodv[i].method),
+				  methodv[i].edge ? "+et" : "   ", n,
+				  1000000ULL * n / max(fl.usec, 1));
+		}
+	}
+
+ out:
+	return err;
+}
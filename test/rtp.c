@@ -604,6 +604,338 @@ out:
 }
 
 
+enum {MUX_SESSIONS = 16};
+
+struct mux_test;
+
+struct mux_sess {
+	struct mux_test *test;
+	struct rtp_sock *rs;    /* on the shared socket */
+	struct rtp_sock *tx;    /* remote encoder       */
+	struct udp_sock *us;    /* remote socket        */
+	struct sa peer;
+	uint32_t rtp;
+	uint32_t rtcp;
+	uint32_t back;
+};
+
+struct mux_test {
+	struct mux_sess sessv[MUX_SESSIONS];
+	uint32_t n;
+	uint32_t f;
+};
+
+
+static void mux_done(struct mux_test *test)
+{
+	if (++test->n == 2 * MUX_SESSIONS)
+		re_cancel();
+}
+
+
+static void mux_rtp_handler(const struct sa *src,
+			    const struct rtp_header *hdr, struct mbuf *mb,
+			    void *arg)
+{
+	struct mux_sess *s = arg;
+	(void)mb;
+
+	if (hdr->ssrc != rtp_sess_ssrc(s->tx) ||
+	    !sa_cmp(src, &s->peer, SA_ALL)) {
+		++s->test->f;
+		return;
+	}
+
+	++s->rtp;
+	mux_done(s->test);
+}
+
+
+static void mux_rtcp_handler(const struct sa *src, struct rtcp_msg *msg,
+			     void *arg)
+{
+	struct mux_sess *s = arg;
+
+	if (msg->hdr.pt != RTCP_APP ||
+	    msg->r.app.src != rtp_sess_ssrc(s->tx) ||
+	    !sa_cmp(src, &s->peer, SA_ALL)) {
+		++s->test->f;
+		return;
+	}
+
+	++s->rtcp;
+	mux_done(s->test);
+}
+
+
+static void mux_back_handler(const struct sa *src, struct mbuf *mb,
+			     void *arg)
+{
+	struct mux_sess *s = arg;
+	struct rtcp_msg *msg;
+	(void)src;
+
+	while (0 == rtcp_decode(&msg, mb)) {
+
+		if (msg->hdr.pt == RTCP_APP &&
+		    msg->r.app.src == rtp_sess_ssrc(s->rs)) {
+			++s->back;
+			re_cancel();
+		}
+
+		mem_deref(msg);
+	}
+}
+
+
+static int mux_send(struct mux_sess *s, const struct sa *dst, bool rtcp)
+{
+	struct mbuf *mb;
+	int err;
+
+	mb = mbuf_alloc(RTP_HEADER_SIZE + 4);
+	if (!mb)
+		return ENOMEM;
+
+	if (rtcp) {
+		err = rtcp_encode(mb, RTCP_APP, 0, rtp_sess_ssrc(s->tx),
+				  "mux!", NULL, (size_t)0);
+	}
+	else {
+		err  = rtp_encode(s->tx, false, false, 0, 160, mb);
+		err |= mbuf_write_u32(mb, 0);
+	}
+	if (err)
+		goto out;
+
+	mb->pos = 0;
+	err = udp_send(s->us, dst, mb);
+
+ out:
+	mem_deref(mb);
+	return err;
+}
+
+
+/*
+ * Many RTP sockets on one shared socket. The even sessions know the
+ * remote address, the odd ones only the remote SSRC and latch the
+ * address from the first packet, once.
+ */
+int test_rtp_mux(void)
+{
+	struct mux_test test;
+	struct mux_sess shv[2];
+	struct rtp_mux *mux = NULL;
+	struct udp_sock *stray = NULL, *shared = NULL;
+	struct rtp_sock *tx = NULL, *dup = NULL;
+	struct sa laddr, maddr;
+	struct mux_sess *s;
+	char *debug = NULL;
+	size_t i;
+	int err;
+
+	memset(&test, 0, sizeof(test));
+	memset(shv, 0, sizeof(shv));
+
+	err = sa_set_str(&laddr, "127.0.0.1", 0);
+	TEST_ERR(err);
+
+	err = rtp_mux_alloc(&mux, &laddr);
+	TEST_ERR(err);
+
+	maddr = *rtp_mux_local(mux);
+	TEST_ASSERT(sa_port(&maddr) != 0);
+
+	for (i = 0; i < MUX_SESSIONS; i++) {
+
+		s = &test.sessv[i];
+		s->test = &test;
+
+		err = rtp_mux_listen(&s->rs, mux, true, mux_rtp_handler,
+				     mux_rtcp_handler, s);
+		TEST_ERR(err);
+
+		err = rtp_alloc(&s->tx);
+		TEST_ERR(err);
+
+		err = udp_listen(&s->us, &laddr, mux_back_handler, s);
+		TEST_ERR(err);
+
+		err = udp_local_get(s->us, &s->peer);
+		TEST_ERR(err);
+
+		if (i & 1)
+			err = rtp_mux_ssrc_set(s->rs, rtp_sess_ssrc(s->tx));
+		else
+			err = rtp_mux_peer_set(s->rs, &s->peer);
+		TEST_ERR(err);
+
+		TEST_ASSERT(sa_cmp(rtp_local(s->rs), &maddr, SA_ALL));
+		TEST_ASSERT(rtp_sock(s->rs) == rtp_mux_sock(mux));
+	}
+
+	/* unknown address and SSRC are dropped */
+	err = rtp_alloc(&tx);
+	TEST_ERR(err);
+
+	err = udp_listen(&stray, &laddr, NULL, NULL);
+	TEST_ERR(err);
+
+	{
+		struct mux_sess x = {.tx = tx, .us = stray};
+
+		err = mux_send(&x, &maddr, false);
+		TEST_ERR(err);
+	}
+
+	/* RTP and RTCP on the same port */
+	for (i = 0; i < MUX_SESSIONS; i++) {
+
+		err = mux_send(&test.sessv[i], &maddr, false);
+		TEST_ERR(err);
+
+		err = mux_send(&test.sessv[i], &maddr, true);
+		TEST_ERR(err);
+	}
+
+	err = re_main_timeout(1000);
+	TEST_ERR(err);
+
+	TEST_EQUALS(2 * MUX_SESSIONS, test.n);
+	TEST_EQUALS(0, test.f);
+
+	for (i = 0; i < MUX_SESSIONS; i++) {
+		TEST_EQUALS(1, test.sessv[i].rtp);
+		TEST_EQUALS(1, test.sessv[i].rtcp);
+	}
+
+	/* RTCP is sent from the shared socket */
+	s = &test.sessv[1];
+	rtcp_start(s->rs, "mux", &s->peer);
+	rtcp_enable_mux(s->rs, false);
+
+	err = rtcp_send_app(s->rs, "mux!", NULL, 0);
+	TEST_ERR(err);
+
+	err = re_main_timeout(1000);
+	TEST_ERR(err);
+
+	TEST_EQUALS(1, s->back);
+
+	/* a closed session no longer receives */
+	s->rs = mem_deref(s->rs);
+
+	err = mux_send(s, &maddr, false);
+	TEST_ERR(err);
+
+	err = mux_send(&test.sessv[0], &maddr, false);
+	TEST_ERR(err);
+
+	test.n = 2 * MUX_SESSIONS - 1;
+
+	err = re_main_timeout(1000);
+	TEST_ERR(err);
+
+	TEST_EQUALS(2, test.sessv[0].rtp);
+	TEST_EQUALS(0, test.f);
+
+	/* a known SSRC from another address does not move the remote */
+	for (i = 2; i < 4; i++) {
+		struct mux_sess x = {.tx = test.sessv[i].tx, .us = stray};
+
+		err = mux_send(&x, &maddr, false);
+		TEST_ERR(err);
+
+		err = mux_send(&test.sessv[i], &maddr, false);
+		TEST_ERR(err);
+
+		test.n = 2 * MUX_SESSIONS - 1;
+
+		err = re_main_timeout(1000);
+		TEST_ERR(err);
+
+		TEST_EQUALS(2, test.sessv[i].rtp);
+		TEST_EQUALS(0, test.f);
+	}
+
+	err = re_sdprintf(&debug, "%H", rtp_mux_debug, mux);
+	TEST_ERR(err);
+	TEST_ASSERT(NULL != strstr(debug, "latched=8 "));
+
+	/* sessions behind one remote address are told apart by SSRC */
+	err = udp_listen(&shared, &laddr, NULL, NULL);
+	TEST_ERR(err);
+
+	for (i = 0; i < RE_ARRAY_SIZE(shv); i++) {
+
+		s = &shv[i];
+		s->test = &test;
+		s->us   = shared;
+
+		err = rtp_mux_listen(&s->rs, mux, false, mux_rtp_handler,
+				     NULL, s);
+		TEST_ERR(err);
+
+		err = rtp_alloc(&s->tx);
+		TEST_ERR(err);
+
+		err = udp_local_get(shared, &s->peer);
+		TEST_ERR(err);
+
+		err = rtp_mux_ssrc_set(s->rs, rtp_sess_ssrc(s->tx));
+		TEST_ERR(err);
+
+		err = rtp_mux_peer_set(s->rs, &s->peer);
+		TEST_ERR(err);
+	}
+
+	/* the same remote address and SSRC twice is rejected */
+	err = rtp_mux_listen(&dup, mux, false, mux_rtp_handler, NULL,
+			     &shv[0]);
+	TEST_ERR(err);
+
+	err = rtp_mux_ssrc_set(dup, rtp_sess_ssrc(shv[0].tx));
+	TEST_ERR(err);
+
+	err = rtp_mux_peer_set(dup, &shv[0].peer);
+	TEST_EQUALS(EADDRINUSE, err);
+
+	for (i = 0; i < RE_ARRAY_SIZE(shv); i++) {
+		err = mux_send(&shv[i], &maddr, false);
+		TEST_ERR(err);
+	}
+
+	test.n = 2 * MUX_SESSIONS - 2;
+
+	err = re_main_timeout(1000);
+	TEST_ERR(err);
+
+	TEST_EQUALS(1, shv[0].rtp);
+	TEST_EQUALS(1, shv[1].rtp);
+	TEST_EQUALS(0, test.f);
+
+ out:
+	for (i = 0; i < MUX_SESSIONS; i++) {
+		mem_deref(test.sessv[i].rs);
+		mem_deref(test.sessv[i].tx);
+		mem_deref(test.sessv[i].us);
+	}
+	for (i = 0; i < RE_ARRAY_SIZE(shv); i++) {
+		mem_deref(shv[i].rs);
+		mem_deref(shv[i].tx);
+	}
+	mem_deref(dup);
+	mem_deref(shared);
+	mem_deref(stray);
+	mem_deref(tx);
+	mem_deref(mux);
+	mem_deref(debug);
+
+	return err;
+}
+
+
 int test_rtcp_twcc(void)
 {
 	/*
@@ -0,0 +1,226 @@
+/**
+ * @file shard.c Sharded reactors testcode
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+#include <string.h>
+#include <re.h>
+#include "test.h"
+
+
+#define DEBUG_MODULE "shardtest"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+enum {
+	NUM_SHARDS  = 2,
+	NUM_SOURCES = 8,
+	NUM_PACKETS = 10,
+};
+
+struct shard_ctx {
+	struct shard_test *st;
+	struct udp_sock *us;
+	unsigned idx;
+	unsigned n_recv;
+};
+
+struct shard_test {
+	struct shard_ctx ctx[NUM_SHARDS];
+	struct sa laddr;
+	uint16_t src_port[NUM_SOURCES];
+	int src_shard[NUM_SOURCES];
+	mtx_t *mtx;
+	unsigned n_recv;
+	unsigned n_async;
+	bool sticky;
+	int async_err;
+};
+
+
+static void udp_recv(const struct sa *src, struct mbuf *mb, void *arg)
+{
+	struct shard_ctx *ctx = arg;
+	struct shard_test *st = ctx->st;
+	(void)mb;
+
+	mtx_lock(st->mtx);
+
+	++ctx->n_recv;
+	++st->n_recv;
+
+	for (unsigned i = 0; i < NUM_SOURCES; i++) {
+
+		if (st->src_port[i] != sa_port(src))
+			continue;
+
+		if (st->src_shard[i] < 0)
+			st->src_shard[i] = (int)ctx->idx;
+		else if (st->src_shard[i] != (int)ctx->idx)
+			st->sticky = false;
+	}
+
+	mtx_unlock(st->mtx);
+}
+
+
+static int shard_init(struct shard *sh, void *arg)
+{
+	struct shard_test *st = arg;
+	struct shard_ctx *ctx = &st->ctx[shard_index(sh)];
+	int err;
+
+	ctx->st  = st;
+	ctx->idx = shard_index(sh);
+
+	err = udp_listen_reuseport(&ctx->us, &st->laddr, udp_recv, ctx);
+	if (err)
+		return err;
+
+	/* the first shard picks the port, all others share it */
+	if (ctx->idx == 0) {
+		err = udp_local_get(ctx->us, &st->laddr);
+		if (err)
+			return err;
+
+		err = shard_steer_attach(udp_sock_fd(ctx->us, AF_INET),
+					 SHARD_STEER_HASH, NUM_SHARDS);
+		if (err && err != ENOSYS)
+			return err;
+	}
+
+	return 0;
+}
+
+
+static void shard_close(struct shard *sh, void *arg)
+{
+	struct shard_test *st = arg;
+
+	st->ctx[shard_index(sh)].us = mem_deref(st->ctx[shard_index(sh)].us);
+}
+
+
+static void async_handler(int err, void *arg)
+{
+	struct shard_test *st = arg;
+
+	mtx_lock(st->mtx);
+	++st->n_async;
+	if (err)
+		st->async_err = err;
+	mtx_unlock(st->mtx);
+}
+
+
+static bool test_done(struct shard_test *st)
+{
+	bool done;
+
+	mtx_lock(st->mtx);
+	done = st->n_recv >= NUM_SOURCES * NUM_PACKETS &&
+		st->n_async >= NUM_SHARDS;
+	mtx_unlock(st->mtx);
+
+	return done;
+}
+
+
+int test_shard(void)
+{
+	struct shard_test st;
+	struct shards *shs = NULL;
+	struct udp_sock *src[NUM_SOURCES] = {NULL};
+	struct mbuf *mb = NULL;
+	struct sa local;
+	int err;
+
+	memset(&st, 0, sizeof(st));
+	st.sticky = true;
+
+	err = mutex_alloc(&st.mtx);
+	TEST_ERR(err);
+
+	err = sa_set_str(&st.laddr, "127.0.0.1", 0);
+	TEST_ERR(err);
+
+	err = sa_set_str(&local, "127.0.0.1", 0);
+	TEST_ERR(err);
+
+	for (unsigned i = 0; i < NUM_SOURCES; i++) {
+		struct sa sa;
+
+		err = udp_listen(&src[i], &local, NULL, NULL);
+		TEST_ERR(err);
+
+		err = udp_local_get(src[i], &sa);
+		TEST_ERR(err);
+
+		st.src_port[i]  = sa_port(&sa);
+		st.src_shard[i] = -1;
+	}
+
+	err = shards_alloc(&shs, NUM_SHARDS, shard_init, shard_close, &st);
+	TEST_ERR(err);
+
+	TEST_EQUALS(NUM_SHARDS, shards_count(shs));
+	TEST_ASSERT(shards_get(shs, NUM_SHARDS) == NULL);
+
+	for (unsigned i = 0; i < NUM_SHARDS; i++) {
+		struct shard *sh = shards_get(shs, i);
+
+		TEST_EQUALS(i, shard_index(sh));
+
+		err = shard_async(sh, async_handler, &st);
+		TEST_ERR(err);
+	}
+
+	mb = mbuf_alloc(64);
+	if (!mb) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (unsigned i = 0; i < NUM_PACKETS; i++) {
+		for (unsigned j = 0; j < NUM_SOURCES; j++) {
+
+			mbuf_rewind(mb);
+			err = mbuf_printf(mb, "packet %u", i);
+			TEST_ERR(err);
+			mb->pos = 0;
+
+			err = udp_send(src[j], &st.laddr, mb);
+			TEST_ERR(err);
+		}
+	}
+
+	for (unsigned i = 0; i < 2000 && !test_done(&st); i++)
+		sys_msleep(1);
+
+	mtx_lock(st.mtx);
+	err = st.async_err;
+	if (!err && st.n_async != NUM_SHARDS)
+		err = ETIMEDOUT;
+	if (!err && st.n_recv != NUM_SOURCES * NUM_PACKETS)
+		err = ETIMEDOUT;
+	if (!err && !st.sticky)
+		err = EPROTO;
+	if (!err &&
+	    st.ctx[0].n_recv + st.ctx[1].n_recv != st.n_recv)
+		err = EPROTO;
+	mtx_unlock(st.mtx);
+	TEST_ERR(err);
+
+ out:
+	mem_deref(shs);
+
+	for (unsigned i = 0; i < NUM_SOURCES; i++)
+		mem_deref(src[i]);
+
+	mem_deref(mb);
+	mem_deref(st.mtx);
+
+	return err;
+}
@@ -601,6 +601,284 @@ int test_sip_parse(void)
 }
 
 
+static const char sip_arena_msg[] =
+	"INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+	"Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776asdhds\r\n"
+	"Via: SIP/2.0/UDP 10.0.0.1:5060;branch=z9hG4bK77ef4c2312\r\n"
+	"Max-Forwards: 70\r\n"
+	"Route: <sip:p1.example.com;lr>, <sip:p2.example.com;lr>\r\n"
+	"To: Bob <sip:bob@biloxi.com>\r\n"
+	"From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+	"Call-ID: a84b4c76e66710@pc33.atlanta.com\r\n"
+	"CSeq: 314159 INVITE\r\n"
+	"Contact: <sip:alice@pc33.atlanta.com>\r\n"
+	"Allow: INVITE, ACK, CANCEL, BYE, OPTIONS, UPDATE, PRACK\r\n"
+	"Supported: replaces, timer, 100rel\r\n"
+	"User-Agent: libre test\r\n"
+	"X-Custom: value\r\n"
+	"Content-Type: application/sdp\r\n"
+	"Content-Length: 0\r\n"
+	"\r\n";
+
+
+static int sip_arena_decode(struct mbuf *mb, uint32_t *nhdr)
+{
+	const struct sip_hdr *hdr;
+	struct sip_msg *msg = NULL;
+	int err;
+
+	mb->pos = 0;
+
+	err = sip_msg_decode(&msg, mb);
+	if (err)
+		return err;
+
+	*nhdr = list_count(&msg->hdrl);
+
+	TEST_STRCMP("a84b4c76e66710@pc33.atlanta.com", 31,
+		    msg->callid.p, msg->callid.l);
+	TEST_EQUALS(314159, msg->cseq.num);
+	TEST_STRCMP("z9hG4bK776asdhds", 16,
+		    msg->via.branch.p, msg->via.branch.l);
+
+	hdr = sip_msg_xhdr(msg, "X-Custom");
+	TEST_ASSERT(hdr != NULL);
+	TEST_STRCMP("value", 5, hdr->val.p, hdr->val.l);
+	TEST_ASSERT(sip_msg_hdr_has_value(msg, SIP_HDR_SUPPORTED, "100rel"));
+
+ out:
+	mem_deref(msg);
+	return err;
+}
+
+
+static int sip_arena_perf(struct mbuf *mb)
+{
+	const size_t n = 10000;
+	uint64_t t0, t1, t2;
+	int err = 0;
+
+	t0 = tmr_jiffies_usec();
+
+	for (size_t i = 0; i < n && !err; i++) {
+		struct sip_msg *msg = NULL;
+
+		mb->pos = 0;
+		err = sip_msg_decode(&msg, mb);
+		mem_deref(msg);
+	}
+
+	sip_msg_arena_set(true);
+
+	t1 = tmr_jiffies_usec();
+
+	for (size_t i = 0; i < n && !err; i++) {
+		struct sip_msg *msg = NULL;
+
+		mb->pos = 0;
+		err = sip_msg_decode(&msg, mb);
+		mem_deref(msg);
+	}
+
+	t2 = tmr_jiffies_usec();
+
+	sip_msg_arena_set(false);
+
+	re_printf("sip: decode %zu bytes: heap %llu nsec (%llu msg/s), "
+		  "arena %llu nsec (%llu msg/s)\n",
+		  mb->end,
+		  1000 * (t1 - t0) / n, 1000000 * n / MAX(t1 - t0, 1),
+		  1000 * (t2 - t1) / n, 1000000 * n / MAX(t2 - t1, 1));
+
+	return err;
+}
+
+
+int test_sip_msg_arena(void)
+{
+	struct mbuf *mb;
+	uint32_t nhdr_heap = 0, nhdr_arena = 0;
+	int err;
+
+	mb = mbuf_alloc(1024);
+	if (!mb)
+		return ENOMEM;
+
+	err = mbuf_write_str(mb, sip_arena_msg);
+	TEST_ERR(err);
+
+	if (test_mode == TEST_PERF) {
+		err = sip_arena_perf(mb);
+		goto out;
+	}
+
+	err = sip_arena_decode(mb, &nhdr_heap);
+	TEST_ERR(err);
+
+	sip_msg_arena_set(true);
+	err = sip_arena_decode(mb, &nhdr_arena);
+	sip_msg_arena_set(false);
+	TEST_ERR(err);
+
+	TEST_EQUALS(nhdr_heap, nhdr_arena);
+
+ out:
+	mem_deref(mb);
+	return err;
+}
+
+
+static int sip_lazy_perf(struct mbuf *mb)
+{
+	const size_t n = 10000;
+	uint64_t t0, t1, t2;
+	int err = 0;
+
+	t0 = tmr_jiffies_usec();
+
+	for (size_t i = 0; i < n && !err; i++) {
+		struct sip_msg *msg = NULL;
+
+		mb->pos = 0;
+		err = sip_msg_decode(&msg, mb);
+		mem_deref(msg);
+	}
+
+	t1 = tmr_jiffies_usec();
+
+	/* stateless routing: Call-ID and branch only */
+	for (size_t i = 0; i < n && !err; i++) {
+		struct sip_msg *msg = NULL;
+
+		mb->pos = 0;
+		err = sip_msg_decode_lazy(&msg, mb);
+		if (!err && !sip_msg_via(msg))
+			err = EBADMSG;
+		mem_deref(msg);
+	}
+
+	t2 = tmr_jiffies_usec();
+
+	re_printf("sip: decode %zu bytes: eager %llu nsec (%llu msg/s), "
+		  "lazy %llu nsec (%llu msg/s)\n",
+		  mb->end,
+		  1000 * (t1 - t0) / n, 1000000 * n / MAX(t1 - t0, 1),
+		  1000 * (t2 - t1) / n, 1000000 * n / MAX(t2 - t1, 1));
+
+	return err;
+}
+
+
+int test_sip_msg_lazy(void)
+{
+	static const char bad_cseq[] =
+		"OPTIONS sip:bob@biloxi.com SIP/2.0\r\n"
+		"Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776\r\n"
+		"To: <sip:bob@biloxi.com>\r\n"
+		"From: <sip:alice@atlanta.com>;tag=1928301774\r\n"
+		"Call-ID: a84b4c76e66710\r\n"
+		"CSeq: OPTIONS\r\n"
+		"Content-Length: 0\r\n"
+		"\r\n";
+	const struct sip_via *via;
+	const struct sip_taddr *to, *from;
+	const struct sip_cseq *cseq;
+	const struct msg_ctype *ctyp;
+	const struct uri *uri;
+	struct sip_msg *msg = NULL;
+	struct mbuf *mb;
+	int err;
+
+	mb = mbuf_alloc(1024);
+	if (!mb)
+		return ENOMEM;
+
+	err = mbuf_write_str(mb, sip_arena_msg);
+	TEST_ERR(err);
+
+	if (test_mode == TEST_PERF) {
+		err = sip_lazy_perf(mb);
+		goto out;
+	}
+
+	mb->pos = 0;
+	err = sip_msg_decode_lazy(&msg, mb);
+	TEST_ERR(err);
+
+	/* plain values are always decoded */
+	TEST_STRCMP("a84b4c76e66710@pc33.atlanta.com", 31,
+		    msg->callid.p, msg->callid.l);
+	TEST_STRCMP("70", 2, msg->maxfwd.p, msg->maxfwd.l);
+	TEST_ASSERT(!pl_isset(&msg->via.branch));
+	TEST_ASSERT(!pl_isset(&msg->uri.user));
+	TEST_EQUALS(2, sip_msg_hdr_count(msg, SIP_HDR_VIA));
+
+	via = sip_msg_via(msg);
+	TEST_ASSERT(via != NULL);
+	TEST_STRCMP("z9hG4bK776asdhds", 16, via->branch.p, via->branch.l);
+	TEST_ASSERT(via == sip_msg_via(msg));
+
+	cseq = sip_msg_cseq(msg);
+	TEST_ASSERT(cseq != NULL);
+	TEST_EQUALS(314159, cseq->num);
+	TEST_STRCMP("INVITE", 6, cseq->met.p, cseq->met.l);
+
+	to = sip_msg_to(msg);
+	TEST_ASSERT(to != NULL);
+	TEST_STRCMP("sip:bob@biloxi.com", 18, to->auri.p, to->auri.l);
+	TEST_ASSERT(!pl_isset(&to->tag));
+
+	from = sip_msg_from(msg);
+	TEST_ASSERT(from != NULL);
+	TEST_STRCMP("1928301774", 10, from->tag.p, from->tag.l);
+
+	ctyp = sip_msg_ctype(msg);
+	TEST_ASSERT(ctyp != NULL);
+	TEST_STRCMP("sdp", 3, ctyp->subtype.p, ctyp->subtype.l);
+
+	TEST_ASSERT(sip_msg_rack(msg) != NULL);
+	TEST_EQUALS(0, sip_msg_rack(msg)->cseq);
+
+	uri = sip_msg_uri(msg);
+	TEST_ASSERT(uri != NULL);
+	TEST_STRCMP("bob", 3, uri->user.p, uri->user.l);
+
+	TEST_EQUALS(0, msg->lazy);
+	msg = mem_deref(msg);
+
+	/* eager decoding gives the same values without accessors */
+	mb->pos = 0;
+	err = sip_msg_decode(&msg, mb);
+	TEST_ERR(err);
+
+	TEST_EQUALS(0, msg->lazy);
+	TEST_ASSERT(sip_msg_cseq(msg) == &msg->cseq);
+	TEST_EQUALS(314159, msg->cseq.num);
+	msg = mem_deref(msg);
+
+	/* malformed values are only detected on access */
+	mbuf_rewind(mb);
+	err = mbuf_write_str(mb, bad_cseq);
+	TEST_ERR(err);
+
+	mb->pos = 0;
+	err = sip_msg_decode(&msg, mb);
+	TEST_ASSERT(err != 0);
+
+	mb->pos = 0;
+	err = sip_msg_decode_lazy(&msg, mb);
+	TEST_ERR(err);
+
+	TEST_ASSERT(sip_msg_via(msg) != NULL);
+	TEST_ASSERT(sip_msg_cseq(msg) == NULL);
+
+ out:
+	mem_deref(msg);
+	mem_deref(mb);
+	return err;
+}
+
+
 static bool count_handler(const struct sip_hdr *hdr, const struct sip_msg *msg,
 			  void *arg)
 {
@@ -639,6 +917,7 @@ int test_sip_hdr(void)
 		"Supported: replaces,100rel,timer\r\n"
 		"Content-Length: 0\r\n"
 		"\r\n";
+	const struct sip_hdr *hdr;
 	struct mbuf *mb;
 	struct sip_msg *msg = NULL;
 	int err = EINVAL;
@@ -676,6 +955,27 @@ int test_sip_hdr(void)
 		goto out;
 	}
 
+	/* well-known headers, also when looked up by name */
+	TEST_EQUALS(2, sip_msg_hdr_count(msg, SIP_HDR_VIA));
+	TEST_EQUALS(2, xhdr_count(msg, "via"));
+	TEST_EQUALS(3, sip_msg_hdr_count(msg, SIP_HDR_SUPPORTED));
+	TEST_EQUALS(0, sip_msg_hdr_count(msg, SIP_HDR_ROUTE));
+	TEST_EQUALS(0, sip_msg_hdr_count(msg, SIP_HDR_NONE));
+
+	hdr = sip_msg_hdr_apply(msg, false, SIP_HDR_VIA, NULL, NULL);
+	TEST_ASSERT(hdr != NULL);
+	TEST_ASSERT(0 == pl_strcasecmp(&hdr->name, "Via"));
+	TEST_ASSERT(hdr->val.l > 15);
+	TEST_MEMCMP("SIP/2.0/TCP 172", 15, hdr->val.p, 15);
+
+	hdr = sip_msg_hdr(msg, SIP_HDR_EXPIRES);
+	TEST_ASSERT(hdr != NULL);
+	TEST_STRCMP("3600", 4, hdr->val.p, hdr->val.l);
+
+	hdr = sip_msg_xhdr(msg, "user-agent");
+	TEST_ASSERT(hdr != NULL);
+	TEST_EQUALS(SIP_HDR_USER_AGENT, hdr->id);
+
 
  out:
 	mem_deref(msg);
@@ -770,6 +1070,270 @@ out:
 }
 
 
+/** SIP stream framer over TCP */
+struct sip_framer {
+	struct sip *sip;
+	struct sip_lsnr *lsnr;
+	struct tcp_conn *tc;
+	struct tmr tmr;
+	struct mbuf *mb;
+	size_t chunk;
+	uint32_t nmsg;
+	uint32_t nrecv;
+	int err;
+};
+
+
+static void framer_abort(struct sip_framer *fr, int err)
+{
+	fr->err = err;
+	re_cancel();
+}
+
+
+static bool framer_msg_handler(const struct sip_msg *msg, void *arg)
+{
+	struct sip_framer *fr = arg;
+	int err = 0;
+
+	TEST_EQUALS(fr->nrecv + 1, msg->cseq.num);
+	TEST_EQUALS(SIP_TRANSP_TCP, msg->tp);
+	TEST_EQUALS(pl_u32(&msg->clen), mbuf_get_left(msg->mb));
+	TEST_ASSERT(mbuf_get_left(msg->mb) > 0);
+	TEST_ASSERT(mbuf_buf(msg->mb)[0] == 'v');
+	TEST_ASSERT(mbuf_buf(msg->mb)[mbuf_get_left(msg->mb) - 1] == '\n');
+
+	if (++fr->nrecv == fr->nmsg)
+		re_cancel();
+
+ out:
+	if (err)
+		framer_abort(fr, err);
+
+	return true;
+}
+
+
+static void framer_send_handler(void *arg)
+{
+	struct sip_framer *fr = arg;
+	struct mbuf mb;
+	int err;
+
+	mb.buf  = fr->mb->buf;
+	mb.size = fr->mb->size;
+	mb.pos  = fr->mb->pos;
+	mb.end  = min(fr->mb->pos + fr->chunk, fr->mb->end);
+
+	err = tcp_send(fr->tc, &mb);
+	if (err) {
+		framer_abort(fr, err);
+		return;
+	}
+
+	fr->mb->pos = mb.end;
+
+	if (mbuf_get_left(fr->mb))
+		tmr_start(&fr->tmr, 0, framer_send_handler, fr);
+}
+
+
+static void framer_estab_handler(void *arg)
+{
+	struct sip_framer *fr = arg;
+
+	tmr_start(&fr->tmr, 0, framer_send_handler, fr);
+}
+
+
+static void framer_recv_handler(struct mbuf *mb, void *arg)
+{
+	(void)mb;
+	(void)arg;
+}
+
+
+static void framer_close_handler(int err, void *arg)
+{
+	struct sip_framer *fr = arg;
+
+	framer_abort(fr, err ? err : ECONNRESET);
+}
+
+
+static int framer_encode(struct mbuf *mb, uint32_t nmsg)
+{
+	int err = 0;
+
+	for (uint32_t i = 1; i <= nmsg && !err; i++) {
+
+		char body[512];
+		char pad[1200];
+
+		memset(body, 0, sizeof(body));
+		memset(pad, 'x', sizeof(pad) - 1);
+		pad[sizeof(pad) - 1] = '\0';
+
+		(void)re_snprintf(body, sizeof(body),
+				  "v=0\r\n"
+				  "o=- %u 1 IN IP4 127.0.0.1\r\n"
+				  "s=-\r\n"
+				  "c=IN IP4 127.0.0.1\r\n"
+				  "t=0 0\r\n"
+				  "m=audio 5004 RTP/AVP 0 8 101\r\n"
+				  "a=rtpmap:101 telephone-event/8000\r\n",
+				  i);
+
+		/* keep-alive between messages, compact and folded
+		   Content-Length headers */
+		if (i == 2)
+			err |= mbuf_write_str(mb, "\r\n\r\n");
+
+		err |= mbuf_printf(mb,
+				   "INVITE sip:bob@127.0.0.1 SIP/2.0\r\n"
+				   "Via: SIP/2.0/TCP 127.0.0.1"
+				   ";branch=z9hG4bK%08x\r\n"
+				   "Max-Forwards: 70\r\n"
+				   "To: <sip:bob@127.0.0.1>\r\n"
+				   "From: <sip:alice@127.0.0.1>;tag=%u\r\n"
+				   "Call-ID: framer-%u@127.0.0.1\r\n"
+				   "CSeq: %u INVITE\r\n"
+				   "X-Pad: %s\r\n"
+				   "Content-Type: application/sdp\r\n"
+				   "%s %zu\r\n"
+				   "\r\n"
+				   "%s",
+				   i, i, i, i, pad,
+				   i % 3 == 0 ? "l:" :
+				   i % 3 == 1 ? "Content-Length:" :
+				   "content-length :\r\n",
+				   str_len(body), body);
+	}
+
+	mb->pos = 0;
+
+	return err;
+}
+
+
+static int framer_run(struct sip_framer *fr, size_t chunk, uint32_t nmsg,
+		      uint64_t *usec)
+{
+	struct sa laddr;
+	uint64_t t0;
+	int err;
+
+	fr->mb = mem_deref(fr->mb);
+	fr->tc = mem_deref(fr->tc);
+	fr->chunk = chunk;
+	fr->nmsg  = nmsg;
+	fr->nrecv = 0;
+	fr->err   = 0;
+
+	fr->mb = mbuf_alloc(nmsg * 2048);
+	if (!fr->mb)
+		return ENOMEM;
+
+	err = framer_encode(fr->mb, nmsg);
+	if (err)
+		return err;
+
+	err = sip_transp_laddr(fr->sip, &laddr, SIP_TRANSP_TCP, NULL);
+	if (err)
+		return err;
+
+	t0 = tmr_jiffies_usec();
+
+	err = tcp_connect(&fr->tc, &laddr, framer_estab_handler,
+			  framer_recv_handler, framer_close_handler, fr);
+	if (err)
+		return err;
+
+	err = re_main_timeout(10000);
+	if (err)
+		return err;
+
+	if (usec)
+		*usec = tmr_jiffies_usec() - t0;
+
+	tmr_cancel(&fr->tmr);
+
+	if (fr->err)
+		return fr->err;
+
+	return fr->nrecv == nmsg ? 0 : EPROTO;
+}
+
+
+/*
+ * Feed a stream of pipelined messages to the SIP TCP transport in small
+ * chunks, so that both headers and bodies are split at arbitrary points.
+ */
+int test_sip_transp_framer(void)
+{
+	static const size_t chunkv[] = {1, 7, 1448, 65536};
+	struct sip_framer fr;
+	struct sa laddr;
+	int err;
+
+	if (test_mode == TEST_MEMORY) {
+		/* An allocation failure on the receiving side closes the
+		 * connection, which the sender sees as a socket error. */
+		return ESKIPPED;
+	}
+
+	memset(&fr, 0, sizeof(fr));
+	tmr_init(&fr.tmr);
+
+	err = sa_set_str(&laddr, "127.0.0.1", 0);
+	TEST_ERR(err);
+
+	err = sip_alloc(&fr.sip, NULL, 32, 32, 32, "retest", NULL, NULL);
+	TEST_ERR(err);
+
+	err = sip_transp_add(fr.sip, SIP_TRANSP_TCP, &laddr);
+	TEST_ERR(err);
+
+	err = sip_listen(&fr.lsnr, fr.sip, true, framer_msg_handler, &fr);
+	TEST_ERR(err);
+
+	if (test_mode == TEST_PERF) {
+
+		const uint32_t nmsg = 100;
+
+		for (size_t i = 0; i < RE_ARRAY_SIZE(chunkv); i++) {
+
+			uint64_t usec = 0;
+
+			err = framer_run(&fr, chunkv[i], nmsg, &usec);
+			TEST_ERR(err);
+
+			re_printf("sip: framer %5zu byte chunks: "
+				  "%llu usec/msg (%zu bytes)\n",
+				  chunkv[i], usec / nmsg,
+				  fr.mb->end / nmsg);
+		}
+
+		goto out;
+	}
+
+	for (size_t i = 0; i < RE_ARRAY_SIZE(chunkv); i++) {
+
+		err = framer_run(&fr, chunkv[i], 4, NULL);
+		TEST_ERR(err);
+	}
+
+ out:
+	tmr_cancel(&fr.tmr);
+	mem_deref(fr.tc);
+	mem_deref(fr.mb);
+	mem_deref(fr.lsnr);
+	mem_deref(fr.sip);
+
+	return err;
+}
+
+
 #ifdef USE_TLS
 struct sip_transp_tls {
 	struct sip *sip;
@@ -738,6 +738,432 @@ static int test_srtp_replay(enum srtp_suite suite)
 }
 
 
+static int srtp_roundtrip(struct srtp *tx, struct srtp *rx, struct mbuf *mb,
+			  uint32_t ssrc, uint16_t seq)
+{
+	struct rtp_header hdr;
+	int err;
+
+	memset(&hdr, 0, sizeof(hdr));
+
+	hdr.ver  = RTP_VERSION;
+	hdr.seq  = seq;
+	hdr.ssrc = ssrc;
+
+	mb->pos = mb->end = 0;
+	err  = rtp_hdr_encode(mb, &hdr);
+	err |= mbuf_write_mem(mb, fixed_payload, sizeof(fixed_payload));
+	if (err)
+		return err;
+
+	mb->pos = 0;
+	err = srtp_encrypt(tx, mb);
+	if (err)
+		return err;
+
+	return srtp_decrypt(rx, mb);
+}
+
+
+static int srtp_expect(struct srtp *tx, struct srtp *rx, struct mbuf *mb,
+		       uint32_t ssrc, uint16_t seq, int expected)
+{
+	int e, err = 0;
+
+	e = srtp_roundtrip(tx, rx, mb, ssrc, seq);
+	if (e == ENOMEM)
+		return e;
+
+	TEST_EQUALS(expected, e);
+
+ out:
+	return err;
+}
+
+
+static int test_srtp_replay_window(void)
+{
+	static const uint8_t key[16+14] = {
+		0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22,
+		0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22,
+		0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44,
+		0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44,
+	};
+	static const struct {
+		uint16_t seq;
+		int err;
+		int err64;
+	} stepv[] = {
+		/* a packet delayed by 2800 packets is only accepted once */
+		{  100, 0,        0        },
+		{ 3000, 0,        0        },
+		{  200, 0,        EALREADY },
+		{  200, EALREADY, EALREADY },
+		{ 3000, EALREADY, EALREADY },
+		{ 2999, 0,        0        },
+
+		/* window edge */
+		{ 9000,        0,        0        },
+		{ 9000 - 4095, 0,        EALREADY },
+		{ 9000 - 4096, EALREADY, EALREADY },
+	};
+	const enum srtp_suite suite = SRTP_AES_CM_128_HMAC_SHA1_80;
+	struct srtp *tx = NULL, *rx = NULL, *rx64 = NULL;
+	struct mbuf *mb;
+	uint16_t seq;
+	int err;
+
+	mb = mbuf_alloc(1024);
+	if (!mb)
+		return ENOMEM;
+
+	err  = srtp_alloc(&tx, suite, key, sizeof(key), 0);
+	err |= srtp_alloc(&rx, suite, key, sizeof(key),
+			  SRTP_REPLAY_WINDOW_4K);
+	err |= srtp_alloc(&rx64, suite, key, sizeof(key), 0);
+	TEST_ERR(err);
+
+	for (size_t i = 0; i < RE_ARRAY_SIZE(stepv); i++) {
+
+		err = srtp_expect(tx, rx, mb, SSRC, stepv[i].seq,
+				  stepv[i].err);
+		TEST_ERR(err);
+
+		err = srtp_expect(tx, rx64, mb, SSRC, stepv[i].seq,
+				  stepv[i].err64);
+		TEST_ERR(err);
+	}
+
+	/* bursts of 1000 packets in reverse order, across ring wraps */
+	for (uint16_t blk = 10000; blk < 20000; blk += 1000) {
+
+		for (seq = blk + 999; seq >= blk; seq--) {
+			err = srtp_expect(tx, rx, mb, SSRC, seq, 0);
+			TEST_ERR(err);
+		}
+	}
+
+	for (seq = 16000; seq < 20000; seq += 7) {
+		err = srtp_expect(tx, rx, mb, SSRC, seq, EALREADY);
+		TEST_ERR(err);
+	}
+
+	/* the ring slides over words that held packets 16000.. */
+	err = srtp_expect(tx, rx, mb, SSRC, 25000, 0);
+	TEST_ERR(err);
+	err = srtp_expect(tx, rx, mb, SSRC, 16000 + 8192, 0);
+	TEST_ERR(err);
+
+	/* jump further than the ring, all history is dropped */
+	err = srtp_expect(tx, rx, mb, SSRC, 40000, 0);
+	TEST_ERR(err);
+	err = srtp_expect(tx, rx, mb, SSRC, 40000 - 4095, 0);
+	TEST_ERR(err);
+	err = srtp_expect(tx, rx, mb, SSRC, 25000, EALREADY);
+	TEST_ERR(err);
+
+ out:
+	mem_deref(tx);
+	mem_deref(rx);
+	mem_deref(rx64);
+	mem_deref(mb);
+
+	return err;
+}
+
+
+static int test_srtp_streams(void)
+{
+	static const uint8_t key[16+14] = {
+		0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22,
+		0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22,
+		0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44,
+		0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44,
+	};
+	const enum srtp_suite suite = SRTP_AES_CM_128_HMAC_SHA1_32;
+	struct srtp *tx = NULL, *rx = NULL;
+	struct mbuf *mb;
+	uint32_t ssrcv[8];
+	int err;
+
+	mb = mbuf_alloc(1024);
+	if (!mb)
+		return ENOMEM;
+
+	err  = srtp_alloc(&tx, suite, key, sizeof(key), 0);
+	err |= srtp_alloc(&rx, suite, key, sizeof(key), 0);
+	TEST_ERR(err);
+
+	for (size_t i = 0; i < RE_ARRAY_SIZE(ssrcv); i++)
+		ssrcv[i] = rand_u32();
+
+	/* interleaved streams, each with its own replay state */
+	for (uint16_t seq = 0; seq < 16; seq++) {
+
+		for (size_t i = 0; i < RE_ARRAY_SIZE(ssrcv); i++) {
+			err = srtp_expect(tx, rx, mb, ssrcv[i], seq, 0);
+			TEST_ERR(err);
+		}
+
+		err = srtp_expect(tx, rx, mb, ssrcv[seq % 8], seq, EALREADY);
+		TEST_ERR(err);
+	}
+
+	/* the number of streams is limited */
+	err = srtp_expect(tx, rx, mb, ~ssrcv[0], 0, ENOSR);
+	TEST_ERR(err);
+
+ out:
+	mem_deref(tx);
+	mem_deref(rx);
+	mem_deref(mb);
+
+	return err;
+}
+
+
+static int rtp_packet(struct mbuf *mb, uint32_t ssrc, uint16_t seq,
+		      size_t len)
+{
+	struct rtp_header hdr;
+	int err;
+
+	memset(&hdr, 0, sizeof(hdr));
+
+	hdr.ver  = RTP_VERSION;
+	hdr.seq  = seq;
+	hdr.ssrc = ssrc;
+
+	mb->pos = mb->end = 0;
+	err = rtp_hdr_encode(mb, &hdr);
+	if (err)
+		return err;
+
+	for (size_t i = 0; i < len && !err; i++)
+		err = mbuf_write_u8(mb, (uint8_t)(seq + i));
+
+	mb->pos = 0;
+
+	return err;
+}
+
+
+/* batch results must be identical to packet by packet processing */
+static int test_srtp_batch(enum srtp_suite suite)
+{
+	static const uint8_t key[32+14] = {
+		0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22,
+		0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22,
+		0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22,
+		0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22,
+		0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44,
+		0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44,
+	};
+	enum { N = 70 };
+	const size_t key_len = get_keylen(suite) + get_saltlen(suite);
+	struct srtp *tx = NULL, *tx1 = NULL, *rx = NULL;
+	struct mbuf *mbv[N] = {NULL}, *ref = NULL;
+	int errv[N];
+	int err;
+
+	err  = srtp_alloc(&tx, suite, key, key_len, 0);
+	err |= srtp_alloc(&tx1, suite, key, key_len, 0);
+	err |= srtp_alloc(&rx, suite, key, key_len, 0);
+	TEST_ERR(err);
+
+	ref = mbuf_alloc(1500);
+	if (!ref) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	/* three streams, one of them wraps its sequence number */
+	for (size_t i = 0; i < N; i++) {
+
+		const uint32_t ssrc = SSRC + i % 3;
+		const uint16_t seq = (uint16_t)(65500 + i / 3 * 2);
+		const size_t len = i * 17 % 1200;
+
+		mbv[i] = mbuf_alloc(len + 64);
+		if (!mbv[i]) {
+			err = ENOMEM;
+			goto out;
+		}
+
+		err = rtp_packet(mbv[i], ssrc, seq, len);
+		TEST_ERR(err);
+	}
+
+	err = srtp_encrypt_batch(tx, mbv, errv, N);
+	TEST_ERR(err);
+
+	for (size_t i = 0; i < N; i++) {
+
+		const uint16_t seq = (uint16_t)(65500 + i / 3 * 2);
+
+		TEST_EQUALS(0, errv[i]);
+		TEST_EQUALS(0, mbv[i]->pos);
+
+		err = rtp_packet(ref, SSRC + i % 3, seq, i * 17 % 1200);
+		TEST_ERR(err);
+
+		err = srtp_encrypt(tx1, ref);
+		TEST_ERR(err);
+
+		TEST_MEMCMP(ref->buf, ref->end, mbv[i]->buf, mbv[i]->end);
+	}
+
+	/* a replayed and a corrupted packet only fail themselves */
+	mbuf_reset(ref);
+	err = mbuf_write_mem(ref, mbv[N-2]->buf, mbv[N-2]->end);
+	TEST_ERR(err);
+	mbv[7]->buf[mbv[7]->end - 1] ^= 0x01;
+
+	err = srtp_decrypt_batch(rx, mbv, errv, N);
+	TEST_EQUALS(EAUTH, err);
+
+	for (size_t i = 0; i < N; i++) {
+
+		const size_t len = i * 17 % 1200;
+
+		if (i == 7) {
+			TEST_EQUALS(EAUTH, errv[i]);
+			continue;
+		}
+
+		TEST_EQUALS(0, errv[i]);
+		TEST_EQUALS(0, mbv[i]->pos);
+		TEST_EQUALS(RTP_HEADER_SIZE + len, mbv[i]->end);
+
+		for (size_t j = 0; j < len; j++) {
+			TEST_EQUALS((uint8_t)(65500 + i / 3 * 2 + j),
+				    mbv[i]->buf[RTP_HEADER_SIZE + j]);
+		}
+	}
+
+	ref->pos = 0;
+	err = srtp_decrypt_batch(rx, &ref, errv, 1);
+	TEST_EQUALS(EALREADY, err);
+	TEST_EQUALS(EALREADY, errv[0]);
+	err = 0;
+
+	TEST_EQUALS(EINVAL, srtp_encrypt_batch(NULL, mbv, errv, N));
+	TEST_EQUALS(0, srtp_encrypt_batch(tx, NULL, NULL, 0));
+
+ out:
+	for (size_t i = 0; i < N; i++)
+		mem_deref(mbv[i]);
+	mem_deref(ref);
+	mem_deref(tx);
+	mem_deref(tx1);
+	mem_deref(rx);
+
+	return err;
+}
+
+
+static int srtp_perf(enum srtp_suite suite, size_t len)
+{
+	enum { N = 32, ROUNDS = 400 };
+	static const uint8_t key[32+14];
+	const size_t key_len = get_keylen(suite) + get_saltlen(suite);
+	struct srtp *tx = NULL, *rx = NULL;
+	struct mbuf *mbv[N] = {NULL};
+	int errv[N];
+	uint64_t t[3];
+	uint16_t seq = 0;
+	int err;
+
+	for (size_t i = 0; i < N; i++) {
+		mbv[i] = mbuf_alloc(len + 64);
+		if (!mbv[i]) {
+			err = ENOMEM;
+			goto out;
+		}
+	}
+
+	for (int batch = 0; batch <= 1; batch++) {
+
+		uint64_t dt[2] = {0, 0};
+
+		err  = srtp_alloc(&tx, suite, key, key_len, 0);
+		err |= srtp_alloc(&rx, suite, key, key_len, 0);
+		TEST_ERR(err);
+
+		for (int r = 0; r < ROUNDS; r++) {
+
+			for (size_t i = 0; i < N; i++) {
+				err = rtp_packet(mbv[i], SSRC, seq++, len);
+				TEST_ERR(err);
+			}
+
+			t[0] = tmr_jiffies_usec();
+
+			if (batch) {
+				err = srtp_encrypt_batch(tx, mbv, errv, N);
+			}
+			else {
+				for (size_t i = 0; i < N && !err; i++)
+					err = srtp_encrypt(tx, mbv[i]);
+			}
+			TEST_ERR(err);
+
+			t[1] = tmr_jiffies_usec();
+
+			if (batch) {
+				err = srtp_decrypt_batch(rx, mbv, errv, N);
+			}
+			else {
+				for (size_t i = 0; i < N && !err; i++)
+					err = srtp_decrypt(rx, mbv[i]);
+			}
+			TEST_ERR(err);
+
+			t[2] = tmr_jiffies_usec();
+
+			dt[0] += t[1] - t[0];
+			dt[1] += t[2] - t[1];
+		}
+
+		dt[0] = max(dt[0], (uint64_t)1);
+		dt[1] = max(dt[1], (uint64_t)1);
+
+		re_printf("%-28s %4zu bytes %-6s encrypt %7llu pkt/s"
+			  " %5.2f Gbit/s, decrypt %7llu pkt/s %5.2f Gbit/s\n",
+			  srtp_suite_name(suite), len,
+			  batch ? "batch" : "single",
+			  1000000ULL * N * ROUNDS / dt[0],
+			  8e-3 * N * ROUNDS * len / (double)dt[0],
+			  1000000ULL * N * ROUNDS / dt[1],
+			  8e-3 * N * ROUNDS * len / (double)dt[1]);
+
+		tx = mem_deref(tx);
+		rx = mem_deref(rx);
+	}
+
+ out:
+	for (size_t i = 0; i < N; i++)
+		mem_deref(mbv[i]);
+	mem_deref(tx);
+	mem_deref(rx);
+
+	return err;
+}
+
+
+static int test_srtp_perf(const enum srtp_suite *suitev, size_t suitec)
+{
+	int err = 0;
+
+	for (size_t i = 0; i < suitec && !err; i++) {
+		err  = srtp_perf(suitev[i], 160);
+		err |= srtp_perf(suitev[i], 1200);
+	}
+
+	return err;
+}
+
+
 static int test_seq_loop(const uint16_t *seqv, size_t seqn)
 {
 	static const uint8_t key[16+14] = {
@@ -1119,6 +1545,18 @@ int test_srtp(void)
 	err = test_srtp_replay(SRTP_AES_CM_128_HMAC_SHA1_32);
 	TEST_ERR(err);
 
+	err = test_srtp_replay_window();
+	TEST_ERR(err);
+
+	err = test_srtp_batch(SRTP_AES_CM_128_HMAC_SHA1_80);
+	TEST_ERR(err);
+
+	err = test_srtp_batch(SRTP_AES_256_CM_HMAC_SHA1_32);
+	TEST_ERR(err);
+
+	err = test_srtp_streams();
+	TEST_ERR(err);
+
 	err = test_srtp_reordering_and_wrap();
 	TEST_ERR(err);
 
@@ -1128,6 +1566,17 @@ int test_srtp(void)
 	err = test_srtp_random(SRTP_AES_CM_128_HMAC_SHA1_32);
 	TEST_ERR(err);
 
+	if (test_mode == TEST_PERF) {
+		static const enum srtp_suite suitev[] = {
+			SRTP_AES_CM_128_HMAC_SHA1_80,
+			SRTP_AES_CM_128_HMAC_SHA1_32,
+			SRTP_AES_256_CM_HMAC_SHA1_80,
+		};
+
+		err = test_srtp_perf(suitev, RE_ARRAY_SIZE(suitev));
+		TEST_ERR(err);
+	}
+
 out:
 	return err;
 }
@@ -1199,6 +1648,19 @@ int test_srtp_gcm(void)
 	err = test_srtp_random(SRTP_AES_128_GCM);
 	TEST_ERR(err);
 
+	err = test_srtp_batch(SRTP_AES_128_GCM);
+	TEST_ERR(err);
+
+	if (test_mode == TEST_PERF) {
+		static const enum srtp_suite suitev[] = {
+			SRTP_AES_128_GCM,
+			SRTP_AES_256_GCM,
+		};
+
+		err = test_srtp_perf(suitev, RE_ARRAY_SIZE(suitev));
+		TEST_ERR(err);
+	}
+
 out:
 	return err;
 }
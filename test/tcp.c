@@ -38,6 +38,8 @@ struct tcp_test {
 	struct tcp_sock *ts;
 	struct tcp_conn *tc;
 	struct tcp_conn *tc2;
+	struct mbuf_pool *rxpool;
+	struct mbuf_pool *rxpool_small;
 	int err;
 };
 
@@ -53,6 +55,8 @@ static void destructor(void *arg)
 	mem_deref(tt->tc2);
 	mem_deref(tt->tc);
 	mem_deref(tt->ts);
+	mem_deref(tt->rxpool);
+	mem_deref(tt->rxpool_small);
 }
 
 
@@ -88,6 +92,46 @@ static int send_data(struct tcp_conn *tc, const char *data)
 }
 
 
+/* send the data in two segments with one vectored write */
+static int send_datav(struct tcp_conn *tc, const char *data)
+{
+	const size_t half = strlen(data) / 2;
+	struct mbuf *mb1, *mb2;
+	struct mbuf_chain mc;
+	int err;
+
+	mbuf_chain_init(&mc);
+
+	mb1 = mbuf_alloc(half);
+	mb2 = mbuf_alloc(strlen(data) - half);
+	if (!mb1 || !mb2) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err  = mbuf_write_mem(mb1, (const uint8_t *)data, half);
+	err |= mbuf_write_str(mb2, data + half);
+	if (err)
+		goto out;
+
+	mb1->pos = 0;
+	mb2->pos = 0;
+
+	err  = mbuf_chain_append(&mc, mb2);
+	err |= mbuf_chain_prepend(&mc, mb1);
+	if (err)
+		goto out;
+
+	err = tcp_sendv(tc, &mc);
+
+ out:
+	mbuf_chain_reset(&mc);
+	mem_deref(mb1);
+	mem_deref(mb2);
+	return err;
+}
+
+
 static bool mbuf_compare(const struct mbuf *mb, const char *str)
 {
 	if (mbuf_get_left(mb) != strlen(str)) {
@@ -119,7 +163,7 @@ static void tcp_server_recv_handler(struct mbuf *mb, void *arg)
 		return;
 	}
 
-	err = send_data(tt->tc2, pong);
+	err = send_datav(tt->tc2, pong);
 	if (err)
 		abort_test(tt, err);
 }
@@ -147,6 +191,8 @@ static void tcp_server_conn_handler(const struct sa *peer, void *arg)
 		abort_test(tt, err);
 		return;
 	}
+
+	tcp_conn_rxpool_set(tt->tc2, tt->rxpool);
 }
 
 
@@ -174,6 +220,12 @@ static void tcp_client_recv_handler(struct mbuf *mb, void *arg)
 		return;
 	}
 
+	/* too small pool buffers, heap buffers are still trimmed */
+	if (tt->rxpool_small && mb->size != mb->end) {
+		abort_test(tt, EPROTO);
+		return;
+	}
+
 	abort_test(tt, 0);
 }
 
@@ -201,6 +253,11 @@ int test_tcp(void)
 	if (err)
 		goto out;
 
+	/* server receive buffers from a pool */
+	err = mbuf_pool_alloc(&tt->rxpool, 2, 8192);
+	if (err)
+		goto out;
+
 	err = tcp_listen(&tt->ts, &srv, tcp_server_conn_handler, tt);
 	if (err)
 		goto out;
@@ -215,6 +272,12 @@ int test_tcp(void)
 	if (err)
 		goto out;
 
+	err = mbuf_pool_alloc(&tt->rxpool_small, 2, 64);
+	if (err)
+		goto out;
+
+	tcp_conn_rxpool_set(tt->tc, tt->rxpool_small);
+
 	err = re_main_timeout(500);
 	if (err)
 		goto out;
@@ -222,6 +285,14 @@ int test_tcp(void)
 	if (tt->err)
 		err = tt->err;
 
+	if (!err) {
+		struct mbuf_pool_stat stat;
+
+		err = mbuf_pool_get_stat(tt->rxpool, &stat);
+		if (!err && (!stat.borrows || stat.misses))
+			err = EPROTO;
+	}
+
  out:
 	mem_deref(tt);
 
@@ -293,3 +364,270 @@ int test_tcp_tos(void)
 	return 0;
 }
 #endif
+
+
+enum {
+	SENDQ_CHUNK = 65536,
+	SENDQ_SMALL = 500,
+	SENDQ_MSGSZ = 100,
+	SENDQ_LIMIT = 64 * 1024 * 1024,
+	SENDQ_ZCMIN = 16384,
+};
+
+struct sendq_test {
+	struct tcp_sock *ts;
+	struct tcp_conn *tc;
+	struct tcp_conn *tc2;
+	struct tmr tmr;
+	size_t n_sent;
+	size_t n_recv;
+	size_t entries;
+	size_t n_zc;
+	bool zc;
+	int err;
+};
+
+
+static void sendq_destructor(void *arg)
+{
+	struct sendq_test *st = arg;
+
+	tmr_cancel(&st->tmr);
+	mem_deref(st->tc2);
+	mem_deref(st->tc);
+	mem_deref(st->ts);
+}
+
+
+static void sendq_abort(struct sendq_test *st, int err)
+{
+	st->err = err;
+	re_cancel();
+}
+
+
+/* the stream bytes follow a pattern, so the order can be verified */
+static int sendq_send(struct sendq_test *st, size_t len)
+{
+	struct mbuf *mb;
+	int err;
+
+	/* a new buffer for each send, zero-copy sends keep it */
+	mb = mbuf_alloc(len);
+	if (!mb)
+		return ENOMEM;
+
+	for (size_t i = 0; i < len; i++)
+		mb->buf[i] = (uint8_t)((st->n_sent + i) % 251);
+
+	mb->end = len;
+
+	if (st->zc && len >= SENDQ_ZCMIN) {
+		struct tcp_txq_stat stat;
+		size_t pending;
+
+		err = tcp_conn_txq_stat(st->tc, &stat);
+		if (err)
+			goto out;
+
+		pending = stat.zc_pending;
+
+		err = tcp_send_zc(st->tc, mb);
+		if (err)
+			goto out;
+
+		/* a pending zero-copy send holds the buffer */
+		err = tcp_conn_txq_stat(st->tc, &stat);
+		if (err)
+			goto out;
+
+		if (stat.zc_pending > pending) {
+			if (mem_nrefs(mb) != 2)
+				err = EPROTO;
+			++st->n_zc;
+		}
+	}
+	else {
+		err = tcp_send(st->tc, mb);
+	}
+
+	if (!err)
+		st->n_sent += len;
+
+ out:
+	mem_deref(mb);
+
+	return err;
+}
+
+
+static void sendq_zc_wait(void *arg)
+{
+	struct sendq_test *st = arg;
+	struct tcp_txq_stat stat;
+	int err;
+
+	err = tcp_conn_txq_stat(st->tc, &stat);
+	if (err) {
+		sendq_abort(st, err);
+		return;
+	}
+
+	if (stat.zc_pending) {
+		tmr_start(&st->tmr, 5, sendq_zc_wait, st);
+		return;
+	}
+
+	re_cancel();
+}
+
+
+static void sendq_client_estab(void *arg)
+{
+	struct sendq_test *st = arg;
+	struct tcp_txq_stat stat;
+	int err;
+
+	/* fill the socket buffers, the peer is not reading yet */
+	while (!tcp_conn_txqsz(st->tc)) {
+
+		if (st->n_sent > SENDQ_LIMIT) {
+			err = ENOSPC;
+			goto out;
+		}
+
+		err = sendq_send(st, SENDQ_CHUNK);
+		if (err)
+			goto out;
+	}
+
+	for (unsigned i = 0; i < SENDQ_SMALL; i++) {
+
+		err = sendq_send(st, SENDQ_MSGSZ);
+		if (err)
+			goto out;
+	}
+
+	err = tcp_conn_txq_stat(st->tc, &stat);
+	if (err)
+		goto out;
+
+	st->entries = stat.entries;
+
+	if (stat.bytes != tcp_conn_txqsz(st->tc) ||
+	    stat.bytes_peak < stat.bytes)
+		err = EPROTO;
+
+ out:
+	if (err)
+		sendq_abort(st, err);
+}
+
+
+static void sendq_server_recv(struct mbuf *mb, void *arg)
+{
+	struct sendq_test *st = arg;
+	const uint8_t *p = mbuf_buf(mb);
+	const size_t n = mbuf_get_left(mb);
+
+	for (size_t i = 0; i < n; i++) {
+		if (p[i] != (uint8_t)((st->n_recv + i) % 251)) {
+			sendq_abort(st, EPROTO);
+			return;
+		}
+	}
+
+	st->n_recv += n;
+
+	if (st->n_recv == st->n_sent)
+		sendq_zc_wait(st);
+}
+
+
+static void sendq_close(int err, void *arg)
+{
+	struct sendq_test *st = arg;
+
+	sendq_abort(st, err ? err : ECONNRESET);
+}
+
+
+static void sendq_conn(const struct sa *peer, void *arg)
+{
+	struct sendq_test *st = arg;
+	int err;
+	(void)peer;
+
+	err = tcp_accept(&st->tc2, st->ts, NULL, sendq_server_recv,
+			 sendq_close, st);
+	if (err)
+		sendq_abort(st, err);
+}
+
+
+static int tcp_sendq(bool zc)
+{
+	struct sendq_test *st;
+	struct tcp_txq_stat stat;
+	struct sa srv;
+	int err;
+
+	st = mem_zalloc(sizeof(*st), sendq_destructor);
+	if (!st)
+		return ENOMEM;
+
+	tmr_init(&st->tmr);
+	st->zc = zc;
+
+	err = sa_set_str(&srv, "127.0.0.1", 0);
+	TEST_ERR(err);
+
+	err = tcp_listen(&st->ts, &srv, sendq_conn, st);
+	TEST_ERR(err);
+
+	err = tcp_local_get(st->ts, &srv);
+	TEST_ERR(err);
+
+	err = tcp_connect(&st->tc, &srv, sendq_client_estab, NULL,
+			  sendq_close, st);
+	TEST_ERR(err);
+
+	/* room for the whole test */
+	tcp_conn_txqsz_set(st->tc, SENDQ_LIMIT);
+
+	err = re_main_timeout(5000);
+	TEST_ERR(err);
+	err = st->err;
+	TEST_ERR(err);
+
+	TEST_EQUALS(st->n_sent, st->n_recv);
+	TEST_ASSERT(st->entries >= SENDQ_SMALL);
+
+	err = tcp_conn_txq_stat(st->tc, &stat);
+	TEST_ERR(err);
+
+	TEST_EQUALS(0, stat.entries);
+	TEST_EQUALS(0, stat.bytes);
+	TEST_EQUALS(0, stat.zc_pending);
+	TEST_ASSERT(stat.bytes_peak >= SENDQ_SMALL * SENDQ_MSGSZ);
+
+ out:
+	mem_deref(st);
+
+	return err;
+}
+
+
+int test_tcp_sendq(void)
+{
+	int err;
+
+	err = tcp_sendq(false);
+	TEST_ERR(err);
+
+	err = tcp_sendq(true);
+	TEST_ERR(err);
+
+ out:
+	return err;
+}
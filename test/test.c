@@ -56,6 +56,7 @@ static const struct test tests[] = {
 	TEST(test_aubuf),
 	TEST(test_aulength),
 	TEST(test_aulevel),
+	TEST(test_aumix),
 	TEST(test_auposition),
 	TEST(test_auresamp),
 	TEST(test_async),
@@ -113,6 +114,7 @@ static const struct test tests[] = {
 	TEST(test_hmac_sha256),
 	TEST(test_http),
 	TEST(test_http_loop),
+	TEST(test_http_msg_arena),
 	TEST(test_http_large_body),
 	TEST(test_http_conn),
 	TEST(test_http_conn_large_body),
@@ -145,6 +147,9 @@ static const struct test tests[] = {
 	TEST(test_mem_pool),
 	TEST(test_mem_reallocarray),
 	TEST(test_mem_secure),
+	TEST(test_mem_arena),
+	TEST(test_mem_cache),
+	TEST(test_mem_stat),
 	TEST(test_net_if),
 	TEST(test_mqueue),
 	TEST(test_odict),
@@ -152,6 +157,7 @@ static const struct test tests[] = {
 	TEST(test_odict_pl),
 	TEST(test_pcp),
 	TEST(test_remain),
+	TEST(test_remain_udp_flood),
 	TEST(test_re_assert_se),
 	TEST(test_rtmp_play),
 	TEST(test_rtmp_publish),
@@ -159,6 +165,7 @@ static const struct test tests[] = {
 	TEST(test_rtmps_publish),
 #endif
 	TEST(test_rtp),
+	TEST(test_rtp_mux),
 	TEST(test_rtpext),
 	TEST(test_rtcp_encode),
 	TEST(test_rtcp_encode_afb),
@@ -181,14 +188,18 @@ static const struct test tests[] = {
 	TEST(test_sdp_extmap),
 	TEST(test_sdp_disabled_rejected),
 	TEST(test_sha1),
+	TEST(test_shard),
 	TEST(test_sip_addr),
 	TEST(test_sip_auth),
 	TEST(test_sip_drequestf),
 	TEST(test_sip_apply),
 	TEST(test_sip_hdr),
+	TEST(test_sip_msg_arena),
+	TEST(test_sip_msg_lazy),
 	TEST(test_sip_param),
 	TEST(test_sip_parse),
 	TEST(test_sip_via),
+	TEST(test_sip_transp_framer),
 #ifdef USE_TLS
 	TEST(test_sip_transp_add_client_cert),
 #endif
@@ -220,6 +231,7 @@ static const struct test tests[] = {
 	TEST(test_sys_getenv),
 	TEST(test_tcp),
 	TEST(test_tcp_tos),
+	TEST(test_tcp_sendq),
 	TEST(test_telev),
 	TEST(test_text2pcap),
 	TEST(test_fmt_trim),
@@ -233,6 +245,8 @@ static const struct test tests[] = {
 	TEST(test_tls_session_reuse_tls_v12),
 	TEST(test_tls_sni),
 #endif
+	TEST(test_tmr_order),
+	TEST(test_tmr_scale),
 	TEST(test_trice_cand),
 	TEST(test_trice_candpair),
 	TEST(test_trice_checklist),
@@ -242,6 +256,10 @@ static const struct test tests[] = {
 	TEST(test_turn_tcp),
 	TEST(test_udp),
 	TEST(test_udp_tos),
+	TEST(test_udp_batch),
+	TEST(test_udp_gso),
+	TEST(test_udp_rxpool),
+	TEST(test_udp_sendv),
 	TEST(test_unixsock),
 	TEST(test_uri),
 	TEST(test_uri_encode),
@@ -253,6 +271,7 @@ static const struct test tests[] = {
 	TEST(test_vidconv),
 	TEST(test_vidconv_scaling),
 	TEST(test_vidconv_pixel_formats),
+	TEST(test_vidmix),
 	TEST(test_websock),
 	TEST(test_trace),
 	TEST(test_thread),
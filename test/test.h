@@ -161,6 +161,7 @@ int test_au(void);
 int test_aubuf(void);
 int test_aulevel(void);
 int test_aulength(void);
+int test_aumix(void);
 int test_auposition(void);
 int test_auresamp(void);
 int test_async(void);
@@ -216,6 +217,7 @@ int test_hmac_sha1(void);
 int test_hmac_sha256(void);
 int test_http(void);
 int test_http_loop(void);
+int test_http_msg_arena(void);
 int test_http_large_body(void);
 int test_http_conn(void);
 int test_http_conn_large_body(void);
@@ -250,6 +252,9 @@ int test_mem(void);
 int test_mem_pool(void);
 int test_mem_reallocarray(void);
 int test_mem_secure(void);
+int test_mem_arena(void);
+int test_mem_cache(void);
+int test_mem_stat(void);
 int test_mqueue(void);
 int test_net_if(void);
 int test_net_dst_source_addr_get(void);
@@ -262,6 +267,7 @@ int test_trice_candpair(void);
 int test_trice_checklist(void);
 int test_trice_loop(void);
 int test_remain(void);
+int test_remain_udp_flood(void);
 int test_re_assert_se(void);
 int test_rtmp_play(void);
 int test_rtmp_publish(void);
@@ -270,6 +276,7 @@ int test_rtmps_publish(void);
 #endif
 int test_rtp(void);
 int test_rtp_listen(void);
+int test_rtp_mux(void);
 int test_rtpext(void);
 int test_rtcp_encode(void);
 int test_rtcp_encode_afb(void);
@@ -292,15 +299,19 @@ int test_sdp_oa(void);
 int test_sdp_extmap(void);
 int test_sdp_disabled_rejected(void);
 int test_sha1(void);
+int test_shard(void);
 int test_sip_addr(void);
 int test_sip_auth(void);
 int test_sip_drequestf(void);
 int test_sip_apply(void);
 int test_sip_hdr(void);
 int test_sip_msg(void);
+int test_sip_msg_arena(void);
+int test_sip_msg_lazy(void);
 int test_sip_param(void);
 int test_sip_parse(void);
 int test_sip_via(void);
+int test_sip_transp_framer(void);
 #ifdef USE_TLS
 int test_sip_transp_add_client_cert(void);
 #endif
@@ -337,18 +348,25 @@ int test_sys_fs_fopen(void);
 int test_sys_getenv(void);
 int test_tcp(void);
 int test_tcp_tos(void);
+int test_tcp_sendq(void);
 int test_telev(void);
 int test_text2pcap(void);
 int test_thread(void);
 int test_thread_cnd_timedwait(void);
 int test_tmr_jiffies(void);
 int test_tmr_jiffies_usec(void);
+int test_tmr_order(void);
+int test_tmr_scale(void);
 int test_try_into(void);
 int test_turn(void);
 int test_turn_tcp(void);
 int test_turn_thread(void);
 int test_udp(void);
 int test_udp_tos(void);
+int test_udp_batch(void);
+int test_udp_gso(void);
+int test_udp_rxpool(void);
+int test_udp_sendv(void);
 int test_unixsock(void);
 int test_uri(void);
 int test_uri_encode(void);
@@ -360,6 +378,7 @@ int test_vid(void);
 int test_vidconv(void);
 int test_vidconv_scaling(void);
 int test_vidconv_pixel_formats(void);
+int test_vidmix(void);
 int test_websock(void);
 int test_trace(void);
 #ifdef USE_TLS
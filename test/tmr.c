@@ -48,3 +48,184 @@ int test_tmr_jiffies_usec(void)
 out:
 	return err;
 }
+
+
+struct tmr_order_test;
+
+struct tmr_order {
+	struct tmr tmr;
+	struct tmr_order_test *t;
+	uint64_t jfs;
+	unsigned seq;
+};
+
+struct tmr_order_test {
+	struct tmr_order *v;
+	unsigned n;
+	unsigned fired;
+	uint64_t last_jfs;
+	unsigned last_seq;
+	int err;
+};
+
+
+static void order_handler(void *arg)
+{
+	struct tmr_order *to = arg;
+	struct tmr_order_test *t = to->t;
+	int err = 0;
+
+	/* expiry must be non-decreasing, FIFO for equal expiry */
+	if (t->fired) {
+		TEST_ASSERT(to->jfs >= t->last_jfs);
+		if (to->jfs == t->last_jfs)
+			TEST_ASSERT(to->seq > t->last_seq);
+	}
+
+	t->last_jfs = to->jfs;
+	t->last_seq = to->seq;
+
+ out:
+	if (err)
+		t->err = err;
+
+	if (err || ++t->fired == t->n)
+		re_cancel();
+}
+
+
+int test_tmr_order(void)
+{
+	struct tmr_order_test t;
+	struct tmr tmr_long, tmr_huge;
+	const unsigned n = 200;
+	int err = 0;
+
+	memset(&t, 0, sizeof(t));
+	tmr_init(&tmr_long);
+	tmr_init(&tmr_huge);
+
+	t.v = mem_zalloc(n * sizeof(*t.v), NULL);
+	if (!t.v)
+		return ENOMEM;
+
+	t.n = n;
+
+	/* far timers in the outer levels and the overflow list */
+	tmr_start(&tmr_long, 600000, order_handler, NULL);
+	tmr_start(&tmr_huge, 1ULL << 40, order_handler, NULL);
+	TEST_EQUALS(2, tmrl_count(re_tmrl_get()));
+	TEST_ASSERT(tmr_next_timeout(re_tmrl_get()) > 599000);
+
+	for (unsigned i = 0; i < n; i++) {
+		struct tmr_order *to = &t.v[i];
+
+		tmr_init(&to->tmr);
+		to->t   = &t;
+		to->seq = i;
+
+		if (i % 10 == 9) {
+			/* already expired, continued from the past */
+			tmr_continue(&to->tmr, i % 7, order_handler, to);
+		}
+		else {
+			tmr_start(&to->tmr, (i * 7) % 23, order_handler, to);
+		}
+
+		to->jfs = to->tmr.jfs;
+	}
+
+	TEST_EQUALS(n + 2, tmrl_count(re_tmrl_get()));
+	TEST_EQUALS(1, tmr_next_timeout(re_tmrl_get()));
+
+	err = re_main_timeout(500);
+	TEST_ERR(err);
+	err = t.err;
+	TEST_ERR(err);
+
+	TEST_EQUALS(n, t.fired);
+	TEST_EQUALS(2, tmrl_count(re_tmrl_get()));
+	TEST_ASSERT(tmr_isrunning(&tmr_long));
+	TEST_ASSERT(tmr_isrunning(&tmr_huge));
+
+ out:
+	tmr_cancel(&tmr_long);
+	tmr_cancel(&tmr_huge);
+
+	for (unsigned i = 0; t.v && i < n; i++)
+		tmr_cancel(&t.v[i].tmr);
+
+	mem_deref(t.v);
+
+	return err;
+}
+
+
+static void dummy_handler(void *arg)
+{
+	(void)arg;
+}
+
+
+static int tmr_scale(struct tmr *tmrv, uint32_t n)
+{
+	struct tmrl *tmrl = re_tmrl_get();
+	uint64_t t0, t1, t2;
+	uint32_t i;
+	int err = 0;
+
+	t0 = tmr_jiffies_usec();
+
+	for (i = 0; i < n; i++) {
+		tmr_init(&tmrv[i]);
+		tmr_start(&tmrv[i], 1000 + (i * 7919) % 3600000,
+			  dummy_handler, NULL);
+	}
+
+	t1 = tmr_jiffies_usec();
+
+	TEST_EQUALS(n, tmrl_count(tmrl));
+	TEST_ASSERT(tmr_next_timeout(tmrl) <= 1000);
+
+	for (i = 0; i < n; i++)
+		tmr_cancel(&tmrv[i]);
+
+	t2 = tmr_jiffies_usec();
+
+	TEST_EQUALS(0, tmrl_count(tmrl));
+
+	if (test_mode == TEST_PERF) {
+		re_printf("tmr: %8u timers: start %6.1f nsec, "
+			  "cancel %6.1f nsec\n", n,
+			  1000.0 * (double)(t1 - t0) / n,
+			  1000.0 * (double)(t2 - t1) / n);
+	}
+
+ out:
+	for (i = 0; i < n; i++)
+		tmr_cancel(&tmrv[i]);
+
+	return err;
+}
+
+
+int test_tmr_scale(void)
+{
+	const uint32_t nmax = test_mode == TEST_PERF ? 1000000 : 10000;
+	struct tmr *tmrv;
+	int err = 0;
+
+	tmrv = mem_zalloc(nmax * sizeof(*tmrv), NULL);
+	if (!tmrv)
+		return ENOMEM;
+
+	for (uint32_t n = 1000; n <= nmax; n *= 10) {
+		err = tmr_scale(tmrv, n);
+		if (err)
+			break;
+	}
+
+	mem_deref(tmrv);
+
+	return err;
+}
@@ -290,3 +290,644 @@ int test_udp_tos(void)
 	return 0;
 }
 #endif
+
+
+struct sendv_test {
+	struct mbuf *mb;
+	unsigned n_recv;
+};
+
+
+static void sendv_recv(const struct sa *src, struct mbuf *mb, void *arg)
+{
+	struct sendv_test *st = arg;
+	(void)src;
+
+	(void)mbuf_write_mem(st->mb, mbuf_buf(mb), mbuf_get_left(mb));
+
+	if (++st->n_recv == 2)
+		re_cancel();
+}
+
+
+static bool sendv_helper_send(int *err, struct sa *dst, struct mbuf *mb,
+			      void *arg)
+{
+	(void)err;
+	(void)dst;
+	(void)mb;
+	(void)arg;
+
+	return false;
+}
+
+
+int test_udp_sendv(void)
+{
+	struct sendv_test st = {NULL, 0};
+	struct udp_sock *usc = NULL, *uss = NULL;
+	struct udp_helper *uh = NULL;
+	struct mbuf *hdr = NULL, *pld = NULL;
+	struct mbuf_chain mc;
+	struct sa srv;
+	int err;
+
+	mbuf_chain_init(&mc);
+
+	st.mb = mbuf_alloc(64);
+	hdr   = mbuf_alloc(16);
+	pld   = mbuf_alloc(16);
+	if (!st.mb || !hdr || !pld) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = sa_set_str(&srv, "127.0.0.1", 0);
+	TEST_ERR(err);
+
+	err  = udp_listen(&uss, &srv, sendv_recv, &st);
+	err |= udp_listen(&usc, &srv, NULL, NULL);
+	TEST_ERR(err);
+
+	err = udp_local_get(uss, &srv);
+	TEST_ERR(err);
+
+	err  = mbuf_write_str(hdr, "[hdr]");
+	err |= mbuf_write_str(pld, "payload");
+	TEST_ERR(err);
+
+	hdr->pos = 0;
+	pld->pos = 0;
+
+	err  = mbuf_chain_append(&mc, pld);
+	err |= mbuf_chain_prepend(&mc, hdr);
+	TEST_ERR(err);
+
+	/* vectored write */
+	err = udp_sendv(usc, &srv, &mc);
+	TEST_ERR(err);
+
+	/* flattened for the helper */
+	err = udp_register_helper(&uh, usc, 0, sendv_helper_send, NULL, NULL);
+	TEST_ERR(err);
+
+	err = udp_sendv(usc, &srv, &mc);
+	TEST_ERR(err);
+
+	err = re_main_timeout(500);
+	TEST_ERR(err);
+
+	TEST_EQUALS(2, st.n_recv);
+	TEST_MEMCMP("[hdr]payload[hdr]payload", 24, st.mb->buf, st.mb->end);
+
+ out:
+	mbuf_chain_reset(&mc);
+	mem_deref(uh);
+	mem_deref(usc);
+	mem_deref(uss);
+	mem_deref(hdr);
+	mem_deref(pld);
+	mem_deref(st.mb);
+
+	return err;
+}
+
+
+enum {
+	BATCH_SIZE  = 16,
+	BATCH_PLEN  = 172,   /* RTP header + 20ms G.711 */
+	BATCH_PERF  = 100000,
+};
+
+struct batch_test {
+	struct udp_sock *us;
+	size_t n_recv;
+	size_t n_expect;
+	uint32_t seq;
+	bool shrink;
+	int err;
+};
+
+
+static void batch_recv(const struct sa *src, struct mbuf *mb, void *arg)
+{
+	struct batch_test *bt = arg;
+	(void)src;
+
+	if (mbuf_get_left(mb) != BATCH_PLEN) {
+		bt->err = EPROTO;
+		re_cancel();
+		return;
+	}
+
+	if (ntohl(*(uint32_t *)(void *)mbuf_buf(mb)) != bt->seq++)
+		bt->err = EPROTO;
+
+	/* shrink the batch in the middle of a batch */
+	if (bt->shrink && bt->n_recv == 1)
+		bt->err = udp_rxbatch_set(bt->us, 1);
+
+	if (++bt->n_recv >= bt->n_expect || bt->err)
+		re_cancel();
+}
+
+
+static int batch_send(struct udp_sock *us, const struct sa *dst,
+		      struct mbuf **mbv, struct sa *dstv, bool batch,
+		      uint32_t seq)
+{
+	int err = 0;
+
+	for (size_t i = 0; i < BATCH_SIZE; i++) {
+		*(uint32_t *)(void *)mbv[i]->buf = htonl(seq + (uint32_t)i);
+		dstv[i] = *dst;
+	}
+
+	if (batch)
+		return udp_send_batch(us, dstv, mbv, BATCH_SIZE);
+
+	for (size_t i = 0; i < BATCH_SIZE && !err; i++)
+		err = udp_send(us, dst, mbv[i]);
+
+	return err;
+}
+
+
+static int udp_batch(bool batch, bool shrink, size_t n, uint64_t *usec)
+{
+	struct batch_test bt = {0};
+	struct udp_sock *usc = NULL, *uss = NULL;
+	struct mbuf *mbv[BATCH_SIZE] = {NULL};
+	struct sa dstv[BATCH_SIZE];
+	struct sa srv;
+	uint64_t t0;
+	int err;
+
+	err = sa_set_str(&srv, "127.0.0.1", 0);
+	TEST_ERR(err);
+
+	err  = udp_listen(&uss, &srv, batch_recv, &bt);
+	err |= udp_listen(&usc, &srv, NULL, NULL);
+	TEST_ERR(err);
+
+	err = udp_local_get(uss, &srv);
+	TEST_ERR(err);
+
+	bt.us	  = uss;
+	bt.shrink = shrink;
+
+	if (batch) {
+		err = udp_rxbatch_set(uss, BATCH_SIZE);
+		if (err == ENOSYS)
+			err = 0;
+		TEST_ERR(err);
+	}
+
+	for (size_t i = 0; i < BATCH_SIZE; i++) {
+		mbv[i] = mbuf_alloc(BATCH_PLEN);
+		if (!mbv[i]) {
+			err = ENOMEM;
+			goto out;
+		}
+
+		err = mbuf_fill(mbv[i], 0xa5, BATCH_PLEN);
+		TEST_ERR(err);
+
+		mbv[i]->pos = 0;
+	}
+
+	t0 = tmr_jiffies_usec();
+
+	while (bt.n_expect < n) {
+
+		err = batch_send(usc, &srv, mbv, dstv, batch,
+				 (uint32_t)bt.n_expect);
+		TEST_ERR(err);
+
+		bt.n_expect += BATCH_SIZE;
+
+		err = re_main_timeout(1000);
+		TEST_ERR(err);
+		err = bt.err;
+		TEST_ERR(err);
+
+		TEST_EQUALS(bt.n_expect, bt.n_recv);
+	}
+
+	if (usec)
+		*usec = tmr_jiffies_usec() - t0;
+
+ out:
+	for (size_t i = 0; i < BATCH_SIZE; i++)
+		mem_deref(mbv[i]);
+
+	mem_deref(usc);
+	mem_deref(uss);
+
+	return err;
+}
+
+
+int test_udp_batch(void)
+{
+	uint64_t usec_single = 0, usec_batch = 0;
+	int err;
+
+	if (test_mode != TEST_PERF) {
+
+		err = udp_batch(false, false, BATCH_SIZE * 2, NULL);
+		TEST_ERR(err);
+
+		err = udp_batch(true, false, BATCH_SIZE * 2, NULL);
+		TEST_ERR(err);
+
+		err = udp_batch(true, true, BATCH_SIZE * 2, NULL);
+		TEST_ERR(err);
+
+		return 0;
+	}
+
+	err = udp_batch(false, false, BATCH_PERF, &usec_single);
+	TEST_ERR(err);
+
+	err = udp_batch(true, false, BATCH_PERF, &usec_batch);
+	TEST_ERR(err);
+
+	re_printf("udp: loopback %u bytes, bursts of %u:"
+		  " single %llu pps, batch %llu pps\n",
+		  BATCH_PLEN, BATCH_SIZE,
+		  (uint64_t)BATCH_PERF * 1000000 / max(usec_single, 1),
+		  (uint64_t)BATCH_PERF * 1000000 / max(usec_batch, 1));
+
+ out:
+	return err;
+}
+
+
+enum {
+	GSO_SEGS  = 10,
+	GSO_SEGSZ = 100,
+	GSO_TAIL  = 50,
+	GSO_HEADROOM = 12,
+};
+
+struct gso_test {
+	unsigned n_recv;
+	unsigned n_helper;
+	int err;
+};
+
+
+static void gso_recv(const struct sa *src, struct mbuf *mb, void *arg)
+{
+	struct gso_test *gt = arg;
+	const size_t len = gt->n_recv < GSO_SEGS ? GSO_SEGSZ : GSO_TAIL;
+	const uint8_t *p = mbuf_buf(mb);
+	(void)src;
+
+	if (mbuf_get_left(mb) != len)
+		gt->err = EPROTO;
+
+	/* not the 64K GRO receive buffer */
+	if (mb->size > 2048)
+		gt->err = EOVERFLOW;
+
+	for (size_t i = 0; i < mbuf_get_left(mb) && !gt->err; i++) {
+		if (p[i] != gt->n_recv)
+			gt->err = EPROTO;
+	}
+
+	if (++gt->n_recv > GSO_SEGS || gt->err)
+		re_cancel();
+}
+
+
+static bool gso_helper_send(int *err, struct sa *dst, struct mbuf *mb,
+			    void *arg)
+{
+	struct gso_test *gt = arg;
+	(void)err;
+	(void)dst;
+
+	/* each datagram keeps the headroom of the buffer */
+	if (mb->pos != GSO_HEADROOM)
+		gt->err = EPROTO;
+
+	++gt->n_helper;
+
+	return false;
+}
+
+
+static int udp_gso(bool gro, bool helper)
+{
+	struct gso_test gt = {0, 0, 0};
+	struct udp_sock *usc = NULL, *uss = NULL;
+	struct udp_helper *uh = NULL;
+	struct mbuf *mb = NULL;
+	struct sa srv;
+	int err;
+
+	err = sa_set_str(&srv, "127.0.0.1", 0);
+	TEST_ERR(err);
+
+	err  = udp_listen(&uss, &srv, gso_recv, &gt);
+	err |= udp_listen(&usc, &srv, NULL, NULL);
+	TEST_ERR(err);
+
+	err = udp_local_get(uss, &srv);
+	TEST_ERR(err);
+
+	if (gro) {
+		err = udp_gro_set(uss, true);
+		if (err == ENOSYS)
+			err = 0;
+		TEST_ERR(err);
+	}
+
+	if (helper) {
+		err = udp_register_helper(&uh, usc, 0, gso_helper_send,
+					  NULL, &gt);
+		TEST_ERR(err);
+	}
+
+	mb = mbuf_alloc(GSO_HEADROOM + GSO_SEGS * GSO_SEGSZ + GSO_TAIL);
+	if (!mb) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = mbuf_fill(mb, 0xff, GSO_HEADROOM);
+	TEST_ERR(err);
+
+	for (unsigned i = 0; i <= GSO_SEGS; i++) {
+		err = mbuf_fill(mb, i, i < GSO_SEGS ? GSO_SEGSZ : GSO_TAIL);
+		TEST_ERR(err);
+	}
+
+	mb->pos = GSO_HEADROOM;
+
+	err = udp_send_gso(usc, &srv, mb, GSO_SEGSZ);
+	TEST_ERR(err);
+
+	TEST_EQUALS(mb->end, mb->pos);
+
+	err = re_main_timeout(500);
+	TEST_ERR(err);
+	err = gt.err;
+	TEST_ERR(err);
+
+	TEST_EQUALS(GSO_SEGS + 1, gt.n_recv);
+	TEST_EQUALS(helper ? GSO_SEGS + 1 : 0, gt.n_helper);
+
+ out:
+	mem_deref(uh);
+	mem_deref(usc);
+	mem_deref(uss);
+	mem_deref(mb);
+
+	return err;
+}
+
+
+int test_udp_gso(void)
+{
+	int err;
+
+	err = udp_gso(false, false);
+	TEST_ERR(err);
+
+	err = udp_gso(true, false);
+	TEST_ERR(err);
+
+	err = udp_gso(false, true);
+	TEST_ERR(err);
+
+	err = udp_gso(true, true);
+	TEST_ERR(err);
+
+ out:
+	return err;
+}
+
+
+enum {
+	RXPOOL_BUFSZ = 2048,
+	RXPOOL_SIZE  = 32,
+	RXPOOL_PERF  = 100000,
+};
+
+
+static int udp_rxpool(bool pool, size_t n, uint64_t *allocs)
+{
+	struct batch_test bt = {0};
+	struct udp_sock *usc = NULL, *uss = NULL;
+	struct mbuf_pool *mp = NULL;
+	struct mbuf *mbv[BATCH_SIZE] = {NULL};
+	struct sa dstv[BATCH_SIZE];
+	struct mbuf_pool_stat pst;
+	struct memstat mst;
+	struct sa srv;
+	uint64_t allocs0;
+	int err;
+
+	err = sa_set_str(&srv, "127.0.0.1", 0);
+	TEST_ERR(err);
+
+	err  = udp_listen(&uss, &srv, batch_recv, &bt);
+	err |= udp_listen(&usc, &srv, NULL, NULL);
+	TEST_ERR(err);
+
+	err = udp_local_get(uss, &srv);
+	TEST_ERR(err);
+
+	udp_rxsz_set(uss, RXPOOL_BUFSZ);
+
+	if (pool) {
+		err = mbuf_pool_alloc(&mp, RXPOOL_SIZE, RXPOOL_BUFSZ);
+		TEST_ERR(err);
+
+		err = udp_rxpool_set(uss, mp);
+		TEST_ERR(err);
+	}
+
+	for (size_t i = 0; i < BATCH_SIZE; i++) {
+		mbv[i] = mbuf_alloc(BATCH_PLEN);
+		if (!mbv[i]) {
+			err = ENOMEM;
+			goto out;
+		}
+
+		err = mbuf_fill(mbv[i], 0x5a, BATCH_PLEN);
+		TEST_ERR(err);
+
+		mbv[i]->pos = 0;
+	}
+
+	err = mem_get_stat(&mst);
+	TEST_ERR(err);
+	allocs0 = mst.allocs;
+
+	while (bt.n_expect < n) {
+
+		err = batch_send(usc, &srv, mbv, dstv, false,
+				 (uint32_t)bt.n_expect);
+		TEST_ERR(err);
+
+		bt.n_expect += BATCH_SIZE;
+
+		err = re_main_timeout(1000);
+		TEST_ERR(err);
+		err = bt.err;
+		TEST_ERR(err);
+
+		TEST_EQUALS(bt.n_expect, bt.n_recv);
+	}
+
+	err = mem_get_stat(&mst);
+	TEST_ERR(err);
+
+	if (allocs)
+		*allocs = mst.allocs - allocs0;
+
+	if (pool) {
+		err = mbuf_pool_get_stat(mp, &pst);
+		TEST_ERR(err);
+
+		TEST_EQUALS(0, pst.inuse);
+		TEST_EQUALS(n, pst.borrows);
+		TEST_ASSERT(pst.inuse_peak >= 1);
+		TEST_ASSERT(pst.inuse_peak <= RXPOOL_SIZE);
+	}
+
+ out:
+	for (size_t i = 0; i < BATCH_SIZE; i++)
+		mem_deref(mbv[i]);
+
+	mem_deref(usc);
+	mem_deref(uss);
+	mem_deref(mp);
+
+	return err;
+}
+
+
+struct keep_test {
+	struct mbuf *mbv[2];
+	unsigned n;
+};
+
+
+static void keep_recv(const struct sa *src, struct mbuf *mb, void *arg)
+{
+	struct keep_test *kt = arg;
+	(void)src;
+
+	if (kt->n < RE_ARRAY_SIZE(kt->mbv))
+		kt->mbv[kt->n++] = mem_ref(mb);
+
+	if (kt->n == RE_ARRAY_SIZE(kt->mbv))
+		re_cancel();
+}
+
+
+/* buffers that are kept exhaust the pool, heap buffers are trimmed */
+static int udp_rxpool_exhaust(void)
+{
+	struct keep_test kt = {{NULL}, 0};
+	struct udp_sock *usc = NULL, *uss = NULL;
+	struct mbuf_pool *mp = NULL;
+	struct mbuf_pool_stat pst;
+	struct mbuf *mb = NULL;
+	struct sa srv;
+	int err;
+
+	err = sa_set_str(&srv, "127.0.0.1", 0);
+	TEST_ERR(err);
+
+	err  = udp_listen(&uss, &srv, keep_recv, &kt);
+	err |= udp_listen(&usc, &srv, NULL, NULL);
+	TEST_ERR(err);
+
+	err = udp_local_get(uss, &srv);
+	TEST_ERR(err);
+
+	udp_rxsz_set(uss, RXPOOL_BUFSZ);
+
+	err = mbuf_pool_alloc(&mp, 1, RXPOOL_BUFSZ);
+	TEST_ERR(err);
+
+	err = udp_rxpool_set(uss, mp);
+	TEST_ERR(err);
+
+	mb = mbuf_alloc(BATCH_PLEN);
+	if (!mb) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = mbuf_fill(mb, 0x5a, BATCH_PLEN);
+	TEST_ERR(err);
+
+	for (unsigned i = 0; i < RE_ARRAY_SIZE(kt.mbv); i++) {
+		mb->pos = 0;
+		err = udp_send(usc, &srv, mb);
+		TEST_ERR(err);
+	}
+
+	err = re_main_timeout(1000);
+	TEST_ERR(err);
+
+	TEST_EQUALS(BATCH_PLEN, mbuf_get_left(kt.mbv[0]));
+	TEST_EQUALS(RXPOOL_BUFSZ, kt.mbv[0]->size);
+
+	TEST_EQUALS(BATCH_PLEN, mbuf_get_left(kt.mbv[1]));
+	TEST_EQUALS(kt.mbv[1]->end, kt.mbv[1]->size);
+
+	err = mbuf_pool_get_stat(mp, &pst);
+	TEST_ERR(err);
+	TEST_EQUALS(2, pst.borrows);
+	TEST_EQUALS(1, pst.misses);
+
+ out:
+	for (unsigned i = 0; i < RE_ARRAY_SIZE(kt.mbv); i++)
+		mem_deref(kt.mbv[i]);
+
+	mem_deref(mb);
+	mem_deref(usc);
+	mem_deref(uss);
+	mem_deref(mp);
+
+	return err;
+}
+
+
+int test_udp_rxpool(void)
+{
+	uint64_t allocs_heap = 0, allocs_pool = 0;
+	int err;
+
+	if (test_mode != TEST_PERF) {
+
+		err = udp_rxpool(true, BATCH_SIZE * 4, NULL);
+		TEST_ERR(err);
+
+		err = udp_rxpool_exhaust();
+		TEST_ERR(err);
+
+		return 0;
+	}
+
+	err = udp_rxpool(false, RXPOOL_PERF, &allocs_heap);
+	TEST_ERR(err);
+
+	err = udp_rxpool(true, RXPOOL_PERF, &allocs_pool);
+	TEST_ERR(err);
+
+	re_printf("udp: %u datagrams received:"
+		  " heap %llu allocations, pool %llu allocations\n",
+		  RXPOOL_PERF, allocs_heap, allocs_pool);
+
+ out:
+	return err;
+}
@@ -0,0 +1,433 @@
+/**
+ * @file test/vidmix.c  Video mixer testcode
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include <rem.h>
+#include "test.h"
+
+
+#define DEBUG_MODULE "test_vidmix"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+enum {
+	FPS = 50,
+	SENDERS = 3,
+	VIEWERS = 4,
+	MIX_SIZE = 60,
+	GRID = 4,
+};
+
+
+struct mix_src {
+	struct vidmix_source *src;
+	const struct vidframe *frame;
+	uint8_t yv[SENDERS];
+	uint8_t gridv[GRID];
+	RE_ATOMIC uint32_t n;
+};
+
+
+static const uint8_t rgbv[GRID][3] = {
+	{255, 0, 0}, {0, 255, 0}, {0, 0, 255}, {255, 255, 0}
+};
+
+
+static void mix_frame_handler(uint64_t ts, const struct vidframe *frame,
+			      void *arg)
+{
+	struct mix_src *ms = arg;
+	const unsigned w = frame->size.w / SENDERS;
+	(void)ts;
+
+	/* three senders are shown in three columns */
+	for (unsigned i = 0; i < SENDERS; i++) {
+		ms->yv[i] = frame->data[0][frame->size.h/2 *
+					   frame->linesize[0] +
+					   w * i + w/2];
+	}
+
+	/* four senders are shown in a 2x2 grid */
+	for (unsigned i = 0; i < GRID; i++) {
+		unsigned x = frame->size.w / 4 * (1 + 2 * (i % 2));
+		unsigned y = frame->size.h / 4 * (1 + 2 * (i / 2));
+
+		ms->gridv[i] = frame->data[0][y * frame->linesize[0] + x];
+	}
+
+	ms->frame = frame;
+	re_atomic_seq_add(&ms->n, 1);
+}
+
+
+static int wait_frames(struct mix_src *ms, uint32_t n)
+{
+	for (int i = 0; i < 250; i++) {
+
+		if (re_atomic_acq(&ms->n) >= n)
+			return 0;
+
+		sys_msleep(2);
+	}
+
+	return ETIMEDOUT;
+}
+
+
+static bool y_equal(uint8_t y, const uint8_t *rgb)
+{
+	int d = y - rgb2y(rgb[0], rgb[1], rgb[2]);
+
+	return d >= -2 && d <= 2;
+}
+
+
+static int mix_stats(struct vidmix *mix, uint64_t *composed,
+		     uint64_t *delivered, uint64_t *redraws, uint64_t *drawn)
+{
+	struct pl pl_comp, pl_deliv, pl_redraws, pl_drawn;
+	char *debug = NULL;
+	int err;
+
+	err = re_sdprintf(&debug, "%H", vidmix_debug, mix);
+	if (err)
+		return err;
+
+	err = re_regex(debug, str_len(debug),
+		       "composed=[0-9]+ delivered=[0-9]+", &pl_comp, &pl_deliv);
+	if (err)
+		goto out;
+
+	err = re_regex(debug, str_len(debug),
+		       "redraws=[0-9]+ tiles drawn=[0-9]+",
+		       &pl_redraws, &pl_drawn);
+	if (err)
+		goto out;
+
+	*composed  = pl_u64(&pl_comp);
+	*delivered = pl_u64(&pl_deliv);
+	*redraws   = pl_u64(&pl_redraws);
+	*drawn     = pl_u64(&pl_drawn);
+
+ out:
+	mem_deref(debug);
+
+	return err;
+}
+
+
+static int test_vidmix_share(void)
+{
+	const struct vidsz sz = {MIX_SIZE, MIX_SIZE};
+	const struct vidsz insz = {32, 32};
+	struct mix_src sendv[SENDERS];
+	struct mix_src viewv[VIEWERS];
+	struct vidframe *frame = NULL;
+	struct vidmix *mix = NULL;
+	uint64_t composed, delivered, redraws, drawn;
+	uint32_t n;
+	int err;
+
+	memset(sendv, 0, sizeof(sendv));
+	memset(viewv, 0, sizeof(viewv));
+
+	err = vidmix_alloc(&mix);
+	TEST_ERR(err);
+
+	err = vidframe_alloc(&frame, VID_FMT_YUV420P, &insz);
+	TEST_ERR(err);
+
+	for (unsigned i = 0; i < SENDERS; i++) {
+		struct mix_src *ms = &sendv[i];
+
+		err = vidmix_source_alloc(&ms->src, mix, &sz, FPS, false,
+					  mix_frame_handler, ms);
+		TEST_ERR(err);
+
+		vidmix_source_enable(ms->src, true);
+
+		vidframe_fill(frame, rgbv[i][0], rgbv[i][1], rgbv[i][2]);
+		vidmix_source_put(ms->src, frame);
+	}
+
+	/* receive-only participants all see the same mosaic */
+	for (unsigned i = 0; i < VIEWERS; i++) {
+		struct mix_src *ms = &viewv[i];
+
+		err = vidmix_source_alloc(&ms->src, mix, &sz, FPS, false,
+					  mix_frame_handler, ms);
+		TEST_ERR(err);
+	}
+
+	vidmix_source_set_focus(viewv[VIEWERS-1].src, sendv[0].src, false);
+
+	for (unsigned i = 0; i < SENDERS; i++) {
+		err = vidmix_source_start(sendv[i].src);
+		TEST_ERR(err);
+	}
+
+	for (unsigned i = 0; i < VIEWERS; i++) {
+		err = vidmix_source_start(viewv[i].src);
+		TEST_ERR(err);
+	}
+
+	err = vidmix_source_start(viewv[0].src);
+	TEST_EQUALS(EALREADY, err);
+	err = 0;
+
+	for (unsigned i = 0; i < VIEWERS && !err; i++)
+		err = wait_frames(&viewv[i], 5);
+
+	for (unsigned i = 0; i < VIEWERS; i++)
+		vidmix_source_stop(viewv[i].src);
+
+	for (unsigned i = 0; i < SENDERS; i++)
+		vidmix_source_stop(sendv[i].src);
+
+	/* composites are allocated by the scheduler */
+	TEST_ERR(err);
+
+	TEST_ASSERT(!vidmix_source_isrunning(viewv[0].src));
+
+	/* viewers with the same layout share one composite */
+	TEST_ASSERT(viewv[0].frame != NULL);
+	TEST_ASSERT(viewv[0].frame == viewv[1].frame);
+	TEST_ASSERT(viewv[0].frame == viewv[2].frame);
+	TEST_ASSERT(viewv[0].frame != viewv[VIEWERS-1].frame);
+
+	for (unsigned i = 0; i < SENDERS; i++) {
+		TEST_ASSERT(sendv[i].frame != viewv[0].frame);
+		TEST_ASSERT(sendv[i].frame != viewv[VIEWERS-1].frame);
+	}
+
+	for (unsigned i = 0; i < SENDERS; i++)
+		TEST_ASSERT(y_equal(viewv[0].yv[i], rgbv[i]));
+
+	/* 3 senders and 2 viewer layouts for 7 outputs per tick */
+	err = mix_stats(mix, &composed, &delivered, &redraws, &drawn);
+	TEST_ERR(err);
+
+	TEST_ASSERT(delivered >= 5 * (SENDERS + VIEWERS));
+	TEST_ASSERT(composed * (SENDERS + VIEWERS) <
+		    delivered * (SENDERS + 2) + 4 * (SENDERS + VIEWERS));
+
+	/* no frames after stop */
+	n = re_atomic_acq(&viewv[0].n);
+	sys_msleep(3 * 1000 / FPS);
+	TEST_EQUALS(n, re_atomic_acq(&viewv[0].n));
+
+ out:
+	for (unsigned i = 0; i < VIEWERS; i++)
+		mem_deref(viewv[i].src);
+
+	for (unsigned i = 0; i < SENDERS; i++)
+		mem_deref(sendv[i].src);
+
+	mem_deref(frame);
+	mem_deref(mix);
+
+	return err;
+}
+
+
+static int test_vidmix_dirty(void)
+{
+	static const uint8_t white[3] = {255, 255, 255};
+	const struct vidsz sz = {MIX_SIZE, MIX_SIZE};
+	const struct vidsz insz = {32, 32};
+	struct mix_src sendv[GRID];
+	struct mix_src view;
+	struct vidframe *frame = NULL;
+	struct vidmix *mix = NULL;
+	uint64_t composed, delivered, redraws, drawn;
+	uint32_t n;
+	int err;
+
+	memset(sendv, 0, sizeof(sendv));
+	memset(&view, 0, sizeof(view));
+
+	err = vidmix_alloc(&mix);
+	TEST_ERR(err);
+
+	err = vidframe_alloc(&frame, VID_FMT_YUV420P, &insz);
+	TEST_ERR(err);
+
+	for (unsigned i = 0; i < GRID; i++) {
+		struct mix_src *ms = &sendv[i];
+
+		err = vidmix_source_alloc(&ms->src, mix, &sz, FPS, false,
+					  mix_frame_handler, ms);
+		TEST_ERR(err);
+
+		vidmix_source_enable(ms->src, true);
+
+		vidframe_fill(frame, rgbv[i][0], rgbv[i][1], rgbv[i][2]);
+		vidmix_source_put(ms->src, frame);
+	}
+
+	err = vidmix_source_alloc(&view.src, mix, &sz, FPS, false,
+				  mix_frame_handler, &view);
+	TEST_ERR(err);
+
+	err = vidmix_source_start(view.src);
+	TEST_ERR(err);
+
+	err = wait_frames(&view, 3);
+	TEST_ERR(err);
+
+	/* the first frame draws all tiles, then nothing changes */
+	err = mix_stats(mix, &composed, &delivered, &redraws, &drawn);
+	TEST_ERR(err);
+	TEST_EQUALS(1, redraws);
+	TEST_EQUALS(GRID, drawn);
+
+	/* a new frame of one participant draws only its tile */
+	vidframe_fill(frame, white[0], white[1], white[2]);
+	vidmix_source_put(sendv[2].src, frame);
+
+	n = re_atomic_acq(&view.n);
+	err = wait_frames(&view, n + 2);
+	TEST_ERR(err);
+
+	err = mix_stats(mix, &composed, &delivered, &redraws, &drawn);
+	TEST_ERR(err);
+	TEST_EQUALS(1, redraws);
+	TEST_EQUALS(GRID + 1, drawn);
+
+	/* a focus change is a new layout */
+	vidmix_source_set_focus(view.src, sendv[0].src, false);
+
+	n = re_atomic_acq(&view.n);
+	err = wait_frames(&view, n + 2);
+	TEST_ERR(err);
+
+	err = mix_stats(mix, &composed, &delivered, &redraws, &drawn);
+	TEST_ERR(err);
+	TEST_EQUALS(2, redraws);
+	TEST_EQUALS(2 * GRID + 1, drawn);
+
+	/* back to the grid, which is still up to date */
+	vidmix_source_set_focus(view.src, NULL, false);
+
+	n = re_atomic_acq(&view.n);
+	err = wait_frames(&view, n + 2);
+	TEST_ERR(err);
+
+	vidmix_source_stop(view.src);
+
+	err = mix_stats(mix, &composed, &delivered, &redraws, &drawn);
+	TEST_ERR(err);
+	TEST_EQUALS(2, redraws);
+	TEST_EQUALS(2 * GRID + 1, drawn);
+
+	TEST_ASSERT(y_equal(view.gridv[0], rgbv[0]));
+	TEST_ASSERT(y_equal(view.gridv[1], rgbv[1]));
+	TEST_ASSERT(y_equal(view.gridv[2], white));
+	TEST_ASSERT(y_equal(view.gridv[3], rgbv[3]));
+
+ out:
+	mem_deref(view.src);
+
+	for (unsigned i = 0; i < GRID; i++)
+		mem_deref(sendv[i].src);
+
+	mem_deref(frame);
+	mem_deref(mix);
+
+	return err;
+}
+
+
+/* Both frame handlers of a tick wait for each other */
+struct meet {
+	struct vidmix_source *srcv[2];
+	RE_ATOMIC uint32_t in;
+	RE_ATOMIC uint32_t missed;
+	RE_ATOMIC uint32_t n;
+};
+
+
+static void meet_frame_handler(uint64_t ts, const struct vidframe *frame,
+			       void *arg)
+{
+	struct meet *m = arg;
+	uint32_t round = re_atomic_seq_add(&m->in, 1) / 2;
+	(void)ts;
+	(void)frame;
+
+	for (int i = 0; re_atomic_acq(&m->in) < 2 * (round + 1); i++) {
+
+		if (i == 100) {
+			re_atomic_seq_add(&m->missed, 1);
+			break;
+		}
+
+		sys_msleep(1);
+	}
+
+	re_atomic_seq_add(&m->n, 1);
+}
+
+
+static int test_vidmix_parallel(void)
+{
+	const struct vidsz sz = {MIX_SIZE, MIX_SIZE};
+	struct vidmix *mix = NULL;
+	struct meet m;
+	int err;
+
+	memset(&m, 0, sizeof(m));
+
+	err = vidmix_alloc(&mix);
+	TEST_ERR(err);
+
+	for (unsigned i = 0; i < 2; i++) {
+		err = vidmix_source_alloc(&m.srcv[i], mix, &sz, FPS, false,
+					  meet_frame_handler, &m);
+		TEST_ERR(err);
+	}
+
+	for (unsigned i = 0; i < 2; i++) {
+		err = vidmix_source_start(m.srcv[i]);
+		TEST_ERR(err);
+	}
+
+	for (int i = 0; i < 250 && re_atomic_acq(&m.n) < 10; i++)
+		sys_msleep(2);
+
+	for (unsigned i = 0; i < 2; i++)
+		vidmix_source_stop(m.srcv[i]);
+
+	TEST_ASSERT(re_atomic_acq(&m.n) >= 10);
+	TEST_EQUALS(0, re_atomic_acq(&m.missed));
+
+ out:
+	for (unsigned i = 0; i < 2; i++)
+		mem_deref(m.srcv[i]);
+
+	mem_deref(mix);
+
+	return err;
+}
+
+
+int test_vidmix(void)
+{
+	int err;
+
+	err = test_vidmix_share();
+	TEST_ERR(err);
+
+	err = test_vidmix_dirty();
+	TEST_ERR(err);
+
+	err = test_vidmix_parallel();
+	TEST_ERR(err);
+
+ out:
+	return err;
+}